@@ -5,7 +5,9 @@
 #include "Socket.hpp"
 #include "TLSSocket.hpp"
 
+#include <chrono>
 #include <functional>
+#include <unordered_map>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
@@ -26,10 +28,78 @@ class Acceptor : public Pollable {
         void pollHandler();
 };
 
+/**
+ * TLS Acceptor
+ *
+ * Accepted sockets are registered with the NetService while their
+ * handshake is in progress, so a slow or silent client never blocks the
+ * polling thread. connectHandler is called once the handshake completes;
+ * handshakes that fail or take longer than HANDSHAKE_TIMEOUT are dropped.
+ * A timer polled by the same NetService (a timerfd, Linux only) wakes the
+ * acceptor when the oldest handshake runs out of time, so a silent client
+ * is dropped even if no other client connects. On other platforms stale
+ * handshakes are only dropped when the next connection is accepted.
+ *
+ * @param servicer:    NetService that polls the sockets being handshaken
+ * @param handshakes:  sockets whose handshake is in progress (keyed by fd)
+ * @param sweepTimer:  timer that fires when the oldest handshake times out
+ * @param sweepArmed:  signals that the timer is armed
+ */
 class TLSAcceptor : public Acceptor {
+    private:
+        class Handshake : public Pollable {
+            public:
+                TLSAcceptor* acceptor;
+                std::unique_ptr<TLSSocket> socket;
+                std::chrono::steady_clock::time_point started;
+
+                Handshake(TLSAcceptor* acceptor, TLSSocket* socket);
+
+                // Pollable
+                struct pollfd pollInfo();
+                void pollHandler();
+        };
+
+        class SweepTimer : public Pollable {
+            public:
+                TLSAcceptor* acceptor;
+                int fd;
+
+                SweepTimer(TLSAcceptor* acceptor);
+                ~SweepTimer();
+                SweepTimer(const SweepTimer&) = delete;
+                SweepTimer& operator=(const SweepTimer&) = delete;
+
+                // Pollable
+                struct pollfd pollInfo();
+                void pollHandler();
+        };
+
+        NetService* servicer;
+        std::unordered_map<int, std::shared_ptr<Handshake>> handshakes;
+        std::shared_ptr<SweepTimer> sweepTimer;
+        bool sweepArmed;
+
+    public:
+        static constexpr std::chrono::seconds HANDSHAKE_TIMEOUT = std::chrono::seconds(10);
+
+        TLSAcceptor(in_addr_t addr, int port, int backlog, std::function<void(Socket *)> connectHandler, NetService* servicer);
+
+    /**
+     * Private Helper Functions
+     *
+     * @func continueHandshake:    advances the handshake on fd and hands the socket to connectHandler when it completes
+     * @func dropStaleHandshakes:  drops handshakes older than HANDSHAKE_TIMEOUT
+     * @func armSweep:             arms the sweep timer for the time the oldest handshake times out (if it is not armed)
+     */
+
+    private:
+        void continueHandshake(int fd);
+        void dropStaleHandshakes();
+        void armSweep();
+
     public:
         void pollHandler() override;
-        TLSAcceptor(in_addr_t addr, int port, int backlog, std::function<void(Socket *)> connectHandler) : Acceptor(addr, port, backlog, connectHandler) {}
 };
 
 #endif
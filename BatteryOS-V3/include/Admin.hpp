@@ -54,6 +54,7 @@ class Admin {
      * @func createPhysicalBattery:  creates a physical battery
      * @func createAggregateBattery: creates an aggregate battery
      * @func createPartitionBattery: creates a partition battery
+     * @func reloadDrivers:          loads new and changed driver libraries on the BOS instance
      */
 
     public:
@@ -92,6 +93,8 @@ class Admin {
                                   const RefreshMode& refreshMode = RefreshMode::LAZY);
                                     
         bool createSecureBattery(const std::string &sourceName, uint64_t num_clients);
+
+        bool reloadDrivers();
 };
 
 #endif
@@ -3,15 +3,49 @@
 
 #include "VirtualBattery.hpp"
 
+#include <set>
+#include <atomic>
+#include <unordered_map>
+
 /**
  * Aggregate Battery Class
  *
  * Aggregates physical or virtual batteries together 
  * to form a single virtual battery.
  *
+ * The aggregate subscribes to its parents and keeps running totals of
+ * their statuses. A parent pushes its status whenever it changes, so the
+ * aggregate updates its totals for that one parent (and pushes its own
+ * new status to its children) instead of rescanning every parent on each
+ * refresh. Lazy parents only push when they are read or refreshed, so
+ * before the aggregate is read or handles its events it reads (without
+ * holding its lock) every parent whose last push is older than its max
+ * staleness, and a lazy parent with a stale status refreshes and pushes
+ * it. recomputeStatus() (the full rescan) is kept as a consistency check.
+ *
+ * A set_current request is split across the parents in two phases. In
+ * the prepare phase every parent holds its share in parallel: a hold
+ * counts against the parent's projected capacity but is not scheduled.
+ * If any parent rejects its share, the request is aborted and the parents
+ * that accepted drop their holds, so nothing was scheduled on any of them.
+ * Otherwise the request is committed and every parent schedules its held
+ * share.
+ *
  * @param parents:              list of parents that compose the virtual battery
  * @param eff_charge_c_rate:    the effective charge c rate of the battery
  * @param eff_discharge_c_rate: the effective discharge c rate of the battery
+ * @param parentIndex:          index of each parent in parents
+ * @param parentStatuses:       last status pushed by each parent
+ * @param parentTimes:          time of the last status pushed by each parent (read without the lock)
+ * @param chargeCRates:         finite charge c rate of each parent (the smallest is eff_charge_c_rate, 0 if there is none)
+ * @param dischargeCRates:      finite discharge c rate of each parent (the smallest is eff_discharge_c_rate, 0 if there is none)
+ * @param total_current_mA:        sum of the parents' current
+ * @param total_capacity_mAh:      sum of the parents' capacity
+ * @param total_max_capacity_mAh:  sum of the parents' max capacity
+ * @param total_charge_energy:     sum of (max capacity - capacity) * voltage over the parents
+ * @param total_discharge_energy:  sum of capacity * voltage over the parents
+ * @param temperatures:            max temperature of each parent that reports one (the largest is the aggregate's)
+ * @param protectionCounts:        number of parents raising each protection flag (the aggregate raises every flag a parent raises)
  *
  */
 
@@ -20,6 +54,18 @@ class AggregateBattery : public VirtualBattery {
         double eff_charge_c_rate;
         double eff_discharge_c_rate; 
         std::vector<std::shared_ptr<Battery>> parents;
+        std::unordered_map<const Battery*, size_t> parentIndex;
+        std::vector<BatteryStatus> parentStatuses;
+        std::vector<std::atomic<uint64_t>> parentTimes;
+        std::multiset<double> chargeCRates;
+        std::multiset<double> dischargeCRates;
+        double total_current_mA;
+        double total_capacity_mAh;
+        double total_max_capacity_mAh;
+        double total_charge_energy;
+        double total_discharge_energy;
+        std::multiset<uint16_t> temperatures;
+        uint32_t protectionCounts[16];
 
     /**
      * Constructors
@@ -37,34 +83,55 @@ class AggregateBattery : public VirtualBattery {
     /**
      * Private Helper Functions
      *
-     * @func set_c_rate:     sets the effective charge/discharge c rate of the battery
-     * @func calc_c_rate:    calculates the c rate of the battery 
-     * @func calcStatusVals: calculates the battery status values of the battery 
+     * @func calc_c_rates:     calculates the charge/discharge c rate of a parent status
+     * @func calc_c_rate:      calculates the c rate of the battery 
+     * @func calcStatusVals:   calculates the battery status values from the status of every parent (full rescan)
+     * @func addToTotals:      adds a parent status to the running totals (lock must be held)
+     * @func removeFromTotals: removes a parent status from the running totals (lock must be held)
+     * @func statusFromTotals: calculates the battery status values from the running totals (lock must be held)
      */
                                                                           
     private:
-        void set_c_rate();
-        BatteryStatus calcStatusVals();
+        void addToTotals(const BatteryStatus &pStatus);
+        void removeFromTotals(const BatteryStatus &pStatus);
+        BatteryStatus statusFromTotals();
+        BatteryStatus calcStatusVals(const std::vector<BatteryStatus> &pStatuses);
         double calc_c_rate(const double &current_mA, const double &capacity_mAh);
+        std::pair<double, double> calc_c_rates(const BatteryStatus &pStatus);
     
     /**
-     * Overridden Protected Function
+     * Overridden Protected Functions
      *
-     * @func refresh: refreshes battery status
+     * @func refresh:             refreshes battery status from the running totals
+     * @func parentStatusChanged: replaces a parent's status in the running totals
+     * @func refreshParents:      reads every parent whose last push is older than maxStaleness, so a lazy parent
+                                  with a stale status refreshes and pushes it
      */
     
     protected:
         BatteryStatus refresh() override;
+        void parentStatusChanged(Battery *parent, const BatteryStatus &parentStatus) override;
+        void refreshParents() override;
 
     /**
      * Overridden Public Function
      *
-     * @func schedule_set_current: schedules a set_current event for the battery 
+     * @func prepare_set_current:  holds the share of a set_current event on every parent battery, or on none of them
+                                   if one of the parents rejects it
+     * @func commit_set_current:   commits a held set_current event on every parent battery
+     * @func abort_set_current:    drops a held set_current event on every parent battery
+     * @func cancel_set_current:   cancels a set_current event on every parent battery
+     * @func recomputeStatus:      rescans every parent, rebuilds the running totals and returns
+                                   the status calculated from the rescan (consistency check)
      */
 
     public:
+        BatteryStatus recomputeStatus();
         std::string getBatteryString() const override;
-        bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) override;
+        bool prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) override;
+        bool commit_set_current(uint64_t sequenceNumber) override;
+        bool abort_set_current(uint64_t sequenceNumber) override;
+        bool cancel_set_current(uint64_t sequenceNumber) override;
 };
 
 #endif 
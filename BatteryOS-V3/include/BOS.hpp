@@ -9,6 +9,9 @@
 #include <dlfcn.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <signal.h>
+#include <algorithm>
+#include <unordered_set>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -22,16 +25,13 @@
 #include "NetService.hpp"
 #include "Aggregator.hpp"
 #include "TLSSocket.hpp"
+#include "DispatchPool.hpp"
+#include "DriverRegistry.hpp"
+#include "Journal.hpp"
+#include "TelemetryLog.hpp"
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-#error "Windows not supported!"
-#elif __APPLE__
-#define DYLIB_EXT ".dylib"
-#else
-#define DYLIB_EXT ".so"
-#endif
-
-#define DYLIB_PATH(path) path DYLIB_EXT
+#define DRIVER_DIRECTORY "../tests/"
+#define JOURNAL_REPLAY_MARGIN_MS 50
 
 enum BOSMode {
     Network,
@@ -60,6 +60,11 @@ typedef TLSSocket BOSSocket;
  * @param battery_names:    map of file desriptors to battery names
  * @param batteryListener:  file descriptor of socket listening for battery connections
  * @param directoryManager: directory manager that manages batteries
+ * @param drivers:          driver libraries that dynamic batteries are created from (loaded from DRIVER_DIRECTORY)
+ * @param dispatcher:       worker threads that run battery commands (commands run on the polling thread if null)
+ * @param journal:          journal of the batteries and reservations (nothing is journaled if null)
+ * @param recovered:        the journal has been replayed into the directory
+ * @param telemetryLog:     log the statuses of every battery are appended to (nothing is logged if null)
  */
 
 class BOS {
@@ -68,7 +73,6 @@ class BOS {
         pollfd* fds;
         bool hasQuit;
         bool quitPoll;
-        void* library;
         NetService netServicer;
         int adminFifoFD;
         //int adminSocketFD;
@@ -77,7 +81,12 @@ class BOS {
         std::shared_ptr<Pollable> adminListener;
         std::shared_ptr<TLSAcceptor> batteryListener;
         std::string directoryPath;
+        std::unique_ptr<DriverRegistry> drivers;
         std::unique_ptr<BatteryDirectoryManager> directoryManager;
+        std::unique_ptr<DispatchPool> dispatcher;
+        std::unique_ptr<Journal> journal;
+        bool recovered;
+        std::shared_ptr<TelemetryLog> telemetryLog;
 
         // TODO: move these somewhere sensible....
         std::vector<std::shared_ptr<FifoAcceptor>> fifos;
@@ -109,19 +118,32 @@ class BOS {
      * @func pollFDs:                 polls the file descriptors in this->fds 
      * @func createFifos:             creates an input/output fifo for a battery
      * @func createDirectory:         creates a directory using given file path
-     * @func handleAdminCommand:      handles a command from the admin fifo or admin socket 
-     * @func handleBatteryCommand:    handles a battery command from a battery fifo or battery socket
+     * @func handleAdminCommand:      reads a command from the admin fifo or admin socket, runs it, journals it and responds
+     * @func runAdminCommand:         runs an admin command that creates batteries
+     * @func applyJournalRecord:      replays a journaled command (false if it cannot be replayed) and adds the battery
+     *                               of a restored reservation to restored (whose events recover() arms once replayed)
+     * @func handleBatteryCommand:    reads a battery command from a battery fifo or battery socket and dispatches it
+     * @func runBatteryCommand:       runs a battery command and writes the response
      * @func checkFileDescriptors:    check file descriptors for POLLIN
      * @func acceptBatteryConnection: accepts a connection for battery communication over network 
+     * @func handleBatteryConnect:    reads the BatteryConnect message that names the battery of a new network connection
+     * @func setBatteryHandler:       routes the messages of a connection to handleBatteryCommand
+     * @func closeConnection:         stops serving a battery connection whose peer closed it
      */
 
     private:
         void pollFDs();
         void checkFileDescriptors();
-        void acceptBatteryConnection(const std::string& batteryName, std::shared_ptr<BatteryConnection> connection);
+        void acceptBatteryConnection(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection);
         void acceptAdminConnection(Stream* stream);
-        void handleBatteryCommand(const std::string& batteryName, BatteryConnection& connection);
+        void handleBatteryConnect(std::shared_ptr<BatteryConnection> connection);
+        void setBatteryHandler(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection);
+        void closeConnection(const std::shared_ptr<BatteryConnection>& connection);
+        void handleBatteryCommand(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection);
+        void runBatteryCommand(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection);
         void handleAdminCommand(BatteryConnection& connection);
+        bosproto::AdminResponse runAdminCommand(const bosproto::Admin_Command& command);
+        bool applyJournalRecord(const bosproto::Journal_Record& record, std::unordered_set<std::shared_ptr<Battery>>& restored);
         void createDirectory(const std::string &directoryPath, mode_t permission);
         void createBatteryFifos(const std::string& batteryName);
 
@@ -132,28 +154,45 @@ class BOS {
      * @func shutdown:     shutdowns BOS instance (deletes fifos and closes socket)
      * @func startFifos:   creates directory and admin fifos so user can send commands
      * @func startSockets: creates admin and battery sockets so user can send commands
+     * @func setDispatchThreads: runs battery commands on numThreads worker threads (0 runs them on the polling thread)
+     * @func setJournal:   journals batteries and reservations to path (call before start*, which recover from it; without
+     *                    syncWrites an acknowledged command can be lost on power loss, see Journal.hpp)
+     * @func recover:      replays the journal into the directory once (returns the number of commands recovered); the
+     *                    reservations were admitted before they were journaled, so they are restored without being
+     *                    admitted again and each battery arms its events once they are all replayed
+     * @func setTelemetryLog: appends the statuses of the batteries created from now on to the telemetry log at path
+     * @func getBattery:   returns a battery in the directory (nullptr if there is none)
      */
 
     public:
         void shutdown();
         void startFifos(mode_t adminPermission);
         void startSockets(int adminPort, int batteryPort);
+        void setDispatchThreads(unsigned int numThreads);
+        void setJournal(const std::string &path, size_t snapshotEvery = JOURNAL_SNAPSHOT_EVERY, bool syncWrites = false);
+        size_t recover();
+        void setTelemetryLog(const std::string &path, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(TELEMETRY_FLUSH_INTERVAL_MS));
+        std::shared_ptr<Battery> getBattery(const std::string &batteryName) const;
         void startAggregator(int client_port, int agg_port); 
 
     /**
      * Private Helper Functions
      *
      * @func getStatus:          get status of battery and sends it back to user
-     * @func setStatus:          sets the status of the battery 
+     * @func getStatusBatch:     gets the status of a list of batteries (or every battery) and sends them back in one response
+     * @func getStatusHistory:   gets the recent statuses of a battery between two times and sends them back
+     * @func setStatus:          sets the status of the battery (and journals it)
      * @func removeBattery:      removes a battery from the directory
-     * @func scheduleSetCurrent: schedules a set_current event for a battery
+     * @func scheduleSetCurrent: schedules a set_current event for a battery (and journals it)
      */
 
     private:
-        void getStatus(const std::string& batteryName, BatteryConnection& connection);
+        void getStatus(battery_id_t batteryID, BatteryConnection& connection);
+        void getStatusBatch(const bosproto::BatteryCommand& command, BatteryConnection& connection);
+        void getStatusHistory(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection);
         void removeBattery(int fd);
-        void setStatus(const bosproto::BatteryCommand& command, const std::string& batteryName, BatteryConnection& connection);
-        void scheduleSetCurrent(const bosproto::BatteryCommand& command, const std::string& batteryName, BatteryConnection& connection);
+        void setStatus(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection);
+        void scheduleSetCurrent(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection);
 
     /**
      * Private Helper Functions
@@ -161,14 +200,17 @@ class BOS {
      * @func createPhysicalBattery:  creates a physical battery and adds to directory
      * @func createAggregateBattery: creates a aggregate battery and adds to directory 
      * @func createPartitionBattery: creates a partition battery and adds to directory 
+     * @func createDynamicBattery:   creates a battery from a loaded driver and adds to directory
+     * @func reloadDrivers:          loads new and changed driver libraries (running batteries keep their build)
      */
 
     private:
-        void createPhysicalBattery(const bosproto::Admin_Command& command, BatteryConnection& connection);
-        void createAggregateBattery(const bosproto::Admin_Command& command, BatteryConnection& connection);
-        void createPartitionBattery(const bosproto::Admin_Command& command, BatteryConnection& connection);
-        void createDynamicBattery(const bosproto::Admin_Command& command, BatteryConnection& connection);
-        void createSecureBattery(const bosproto::Admin_Command& command, BatteryConnection& connection);
+        bosproto::AdminResponse createPhysicalBattery(const bosproto::Admin_Command& command);
+        bosproto::AdminResponse createAggregateBattery(const bosproto::Admin_Command& command);
+        bosproto::AdminResponse createPartitionBattery(const bosproto::Admin_Command& command);
+        bosproto::AdminResponse createDynamicBattery(const bosproto::Admin_Command& command);
+        bosproto::AdminResponse createSecureBattery(const bosproto::Admin_Command& command);
+        void reloadDrivers(BatteryConnection& connection);
 };
 
 
@@ -0,0 +1,89 @@
+#ifndef BATTERY_CLOCK_HPP
+#define BATTERY_CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+
+#include "BatteryStatus.hpp"
+
+using monotonic_t = std::chrono::steady_clock::time_point;
+
+/**
+ * Battery Clock
+ *
+ * Source of time for batteries, schedulers and drivers. Every clock has
+ * two faces:
+ *  - now():          wall clock time, used for status timestamps and for
+ *                    reservation start/end times (what clients send)
+ *  - monotonicNow(): time that never jumps, used to measure intervals
+ *                    (refresh periods, scheduler waits), so stepping the
+ *                    wall clock (e.g. NTP) does not stall or burst them
+ *
+ * Batteries take the process-wide clock (getClock()) when they are created.
+ *
+ * @func now:          current wall clock time
+ * @func monotonicNow: current monotonic time
+ * @func toMonotonic:  monotonic time at which the wall clock will read time
+ * @func toWallClock:  wall clock time at the monotonic time
+ */
+class BatteryClock {
+    public:
+        virtual ~BatteryClock() = default;
+        virtual timestamp_t now() const = 0;
+        virtual monotonic_t monotonicNow() const = 0;
+
+        monotonic_t toMonotonic(timestamp_t time) const;
+        timestamp_t toWallClock(monotonic_t time) const;
+};
+
+/**
+ * System Clock
+ *
+ * system_clock for the wall clock and steady_clock for monotonic time
+ * (the default process-wide clock).
+ */
+class SystemClock : public BatteryClock {
+    public:
+        timestamp_t now() const override;
+        monotonic_t monotonicNow() const override;
+};
+
+/**
+ * Manual Clock
+ *
+ * Clock that only moves when it is told to, for tests and simulation
+ * (see SimulationScheduler). Both faces move together: monotonic time
+ * is the time since start.
+ *
+ * @param start:   wall clock time the clock started at
+ * @param time_ms: current wall clock time in milliseconds since the epoch
+ *
+ * @func set:     moves the clock to time (never backwards)
+ * @func advance: moves the clock forward by duration
+ */
+class ManualClock : public BatteryClock {
+    private:
+        const timestamp_t start;
+        std::atomic<int64_t> time_ms;
+
+    public:
+        ManualClock(timestamp_t start);
+
+        timestamp_t now() const override;
+        monotonic_t monotonicNow() const override;
+        void set(timestamp_t time);
+        void advance(std::chrono::milliseconds duration);
+};
+
+/**
+ * Process-wide clock used by getTimeNow() and by newly created batteries and schedulers
+ *
+ * @func getClock: returns the clock (a SystemClock by default)
+ * @func setClock: replaces the clock
+ */
+std::shared_ptr<BatteryClock> getClock(void);
+void setClock(std::shared_ptr<BatteryClock> clock);
+
+#endif
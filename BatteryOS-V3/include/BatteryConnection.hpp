@@ -1,6 +1,8 @@
 #ifndef BATTERY_CONNECTION_HPP
 #define BATTERY_CONNECTION_HPP
 
+#include <mutex>
+#include <vector>
 #include "Socket.hpp"
 #include <google/protobuf/message_lite.h>
 
@@ -8,6 +10,16 @@
  * Wrapper around a socket/fd/etc. which handles handles all
  * protocol details, e.g. protobuf message serialization/deserialization,
  * encoding message lengths, etc.
+ *
+ * read() and write() hold ioLock so that a response written by a
+ * BOS worker thread never interleaves with the poll thread reading
+ * the next command from the same stream.
+ *
+ * Messages are framed by a 4-byte big-endian length. The frame is
+ * serialized into writeBuffer and sent with a single write, and the
+ * body is read into readBuffer and parsed in place. Both buffers only
+ * grow, so once they fit the largest message seen a connection does
+ * not allocate per message.
  */
 class BatteryConnection : public Pollable {
     public:
@@ -15,6 +27,9 @@ class BatteryConnection : public Pollable {
 
         // TODO: make non-pointer?
         std::unique_ptr<Stream> stream;
+        std::mutex ioLock;
+        std::vector<char> readBuffer;
+        std::vector<char> writeBuffer;
         BatteryConnection(std::unique_ptr<Stream> stream) : stream(std::move(stream)) {}
 
         // TODO: ctors, etc.
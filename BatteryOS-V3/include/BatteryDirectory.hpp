@@ -1,22 +1,27 @@
 #ifndef BATTERY_DIRECTORY_HPP
 #define BATTERY_DIRECTORY_HPP
-#include <map>
-#include <list>
+#include <vector>
 #include <memory>
+#include <utility>
+#include "BatteryGraph.hpp"
 #include "BatteryInterface.hpp"
 
 /**
 * Battery Directory
-* @param batteryMap:  map holding battery name and corrsponding pointer to the battery
-* @param childGraph:  graph of child batteries pointing to parent batteries (used for battery removal) 
-* @param parentGraph: graph of parent batteries pointing to child batteries (represents battery topology)
+* Batteries and graph nodes are indexed by battery ID (see BatteryID.hpp),
+* so looking a battery up by ID is an array access and by name is one hash lookup.
+* Names are only translated to IDs at the public functions.
+*
+* @param lock:      protects the members below (BOS workers look batteries up while admin commands modify the directory)
+* @param batteries: pointer to each battery in the directory indexed by its ID (nullptr if the ID is not in the directory)
+* @param graph:     battery topology, with an edge from each source battery to the batteries built on top of it
 */
 class BatteryDirectory {
     private:
         bool destroyed;
-        std::map<std::string, std::list<std::string>> childGraph;
-        std::map<std::string, std::list<std::string>> parentGraph;
-        std::map<std::string, std::shared_ptr<Battery>> batteryMap;
+        mutable lock_t lock;
+        BatteryGraph graph;
+        std::vector<std::shared_ptr<Battery>> batteries;
    
     /**
      * Constructors/Destructor
@@ -31,24 +36,46 @@ class BatteryDirectory {
         BatteryDirectory& operator=(BatteryDirectory&&) = delete;
         BatteryDirectory& operator=(const BatteryDirectory&) = delete;
     
+    /**
+     * Private Functions
+     * @func findLocked:          returns the ID of a battery in the directory (INVALID_BATTERY_ID if it is not; lock must be held)
+     */
+    private:
+        battery_id_t findLocked(const std::string &batteryName) const;
+
     /**
      * Public Functions
-     * @func addEdge:          adds an edge between batteries in the battery graphs
+     * @func addEdge:          adds an edge between batteries in the battery graph
      * @func addBattery:       adds a battery to the directory
-     * @func getBattery:       returns a battery from the directory
+     * @func addBatteries:     adds a group of batteries and the edges between them (and to batteries already in the directory)
+     *                         in one step; nothing is added if any battery or edge is invalid
+     * @func getBattery:       returns a battery from the directory by name or by ID
      * @func nameExists:       checks to see if battery name is in directory 
      * @func canBeSource:      checks if a battery can be a source for an aggregate or partition
-     * @func removeBattery:    removes a battery from the directory
-     * @func destroyDirectory: calls quit() on all the batteries in the topology (stops their eventThread)
+     * @func removeBattery:    removes a battery and every battery built on top of it from the directory
+     * @func getChildren:      returns the batteries built directly on top of a battery
+     * @func getParents:       returns the source batteries of a battery
+     * @func getTopologicalOrder: returns every battery in the directory ordered so that sources come before the batteries built on them
+     * @func getStatusSnapshot: returns the status of a list of batteries (every battery if the list is empty);
+                               names that are not in the directory are added to missing
+     * @func destroyDirectory: calls quit() on all the batteries in the topology (removes them from the event scheduler)
      */
     public:
         void destroyDirectory();
         bool nameExists(const std::string &name);
         bool canBeSource(const std::string &batteryName);
         bool addBattery(std::shared_ptr<Battery> battery);
+        bool addBatteries(const std::vector<std::shared_ptr<Battery>> &newBatteries,
+                          const std::vector<std::pair<std::string, std::string>> &edges);
         bool removeBattery(const std::string &batteryName);
         bool addEdge(const std::string &parentName, const std::string &childName);
         std::shared_ptr<Battery> getBattery(const std::string &batteryName) const;
+        std::shared_ptr<Battery> getBattery(battery_id_t id) const;
+        std::vector<std::shared_ptr<Battery>> getChildren(const std::string &batteryName) const;
+        std::vector<std::shared_ptr<Battery>> getParents(const std::string &batteryName) const;
+        std::vector<std::shared_ptr<Battery>> getTopologicalOrder() const;
+        std::vector<std::pair<std::string, BatteryStatus>> getStatusSnapshot(const std::vector<std::string> &batteryNames,
+                                                                             std::vector<std::string> &missing) const;
 };
 
 
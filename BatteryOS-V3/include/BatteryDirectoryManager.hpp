@@ -48,8 +48,9 @@ class BatteryDirectoryManager {
     /**
      * Public Helper Functions
      *
-     * @func getBattery:             gets a battery from the directory
+     * @func getBattery:             gets a battery from the directory by name or by ID
      * @func removeBattery:          removes a battery from the directory
+     * @func getStatusSnapshot:      gets the status of a list of batteries (or the whole directory) in one pass
      * @func createPhysicalBattery:  creates a physical battery and inserts it into the directory
      * @func createAggregateBattery: creates an aggregate battery and inserts it into the directory
      * @func createParititonBattery: creates a partition battery and inserts it into the directory
@@ -62,6 +63,9 @@ class BatteryDirectoryManager {
         void destroyDirectory();
         bool removeBattery(const std::string &name);
         std::shared_ptr<Battery> getBattery(const std::string &name) const;
+        std::shared_ptr<Battery> getBattery(battery_id_t id) const;
+        std::vector<std::pair<std::string, BatteryStatus>> getStatusSnapshot(const std::vector<std::string> &names,
+                                                                             std::vector<std::string> &missing) const;
 
         std::shared_ptr<Battery> createPhysicalBattery(const std::string &name,
                                                        const std::chrono::milliseconds &maxStaleness = std::chrono::milliseconds(1000), 
@@ -91,7 +95,9 @@ class BatteryDirectoryManager {
                                                       void* setCurrentFunc, 
                                                       const std::string& batteryName, 
                                                       const std::chrono::milliseconds& maxStaleness = std::chrono::milliseconds(1000),
-                                                      const RefreshMode& refreshMode = RefreshMode::LAZY);
+                                                      const RefreshMode& refreshMode = RefreshMode::LAZY,
+                                                      void* telemetryFunc = nullptr,
+                                                      std::shared_ptr<void> library = nullptr);
 
         std::shared_ptr<Battery> createSecureBattery(const std::string &name,
                                                      uint32_t num_clients,
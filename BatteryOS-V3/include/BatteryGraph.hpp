@@ -0,0 +1,104 @@
+#ifndef BATTERY_GRAPH_HPP
+#define BATTERY_GRAPH_HPP
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "BatteryID.hpp"
+
+/**
+ * Battery Graph
+ *
+ * Topology of the batteries in a directory, with battery IDs as nodes
+ * and an edge from every source battery (parent) to each battery built
+ * on top of it (child). The children and the parents of every node are
+ * kept in compressed sparse row form: one flat array of IDs per
+ * direction and an offset array indexed by ID, so the children or
+ * parents of a battery are a contiguous span. New edges are queued and
+ * merged into the arrays (O(V + E)) the next time a span is read, so a
+ * batch of additions costs one rebuild. Removing nodes edits the spans
+ * of their neighbours in place, which leaves unused slots behind until
+ * the next rebuild but never rebuilds on its own.
+ *
+ * NOTE: not thread safe, the owner (BatteryDirectory) locks around it
+ *
+ * @param nodes:         whether each ID is a node of the graph
+ * @param pending:       (parent, child) edges added since the last rebuild
+ * @param numChildren:   number of children of each node (including pending edges)
+ * @param numParents:    number of parents of each node (including pending edges)
+ * @param childOffsets:  children of node id start at childIDs[childOffsets[id]]
+ * @param childIDs:      children of every node, grouped by node
+ * @param parentOffsets: parents of node id start at parentIDs[parentOffsets[id]]
+ * @param parentIDs:     parents of every node, grouped by node
+ */
+class BatteryGraph {
+    public:
+        /**
+         * contiguous range of IDs inside the graph, valid until the graph is edited
+         */
+        struct Span {
+            const battery_id_t *first;
+            const battery_id_t *last;
+
+            const battery_id_t* begin() const { return first; }
+            const battery_id_t* end() const { return last; }
+            size_t size() const { return last - first; }
+            bool empty() const { return first == last; }
+        };
+
+    private:
+        std::vector<bool> nodes;
+        mutable std::vector<std::pair<battery_id_t, battery_id_t>> pending;
+        std::vector<uint32_t> numChildren;
+        std::vector<uint32_t> numParents;
+        mutable std::vector<uint32_t> childOffsets;
+        mutable std::vector<battery_id_t> childIDs;
+        mutable std::vector<uint32_t> parentOffsets;
+        mutable std::vector<battery_id_t> parentIDs;
+
+    public:
+        BatteryGraph();
+
+    /**
+     * Private Functions
+     * @func dirty:   checks if the span arrays are missing nodes or pending edges
+     * @func rebuild: merges the pending edges into the span arrays
+     * @func erase:   removes an ID from a span (keeping the order of the rest)
+     */
+    private:
+        bool dirty() const;
+        void rebuild() const;
+        static void erase(std::vector<battery_id_t> &ids, uint32_t offset, uint32_t &length, battery_id_t id);
+
+    /**
+     * Public Functions
+     * @func addNode:          adds a node to the graph
+     * @func hasNode:          checks if a node is in the graph
+     * @func addEdge:          adds an edge from parent to child (both must be nodes)
+     * @func addEdges:         adds a list of (parent, child) edges
+     * @func children:         children of a node
+     * @func parents:          parents of a node
+     * @func childCount:       number of children of a node
+     * @func parentCount:      number of parents of a node
+     * @func subtree:          a node and every node reachable through its children, each once
+     * @func removeNodes:      removes a list of nodes and every edge touching them
+     * @func topologicalOrder: every node ordered so that parents come before their children
+     * @func clear:            removes every node and edge
+     */
+    public:
+        void addNode(battery_id_t id);
+        bool hasNode(battery_id_t id) const;
+        void addEdge(battery_id_t parent, battery_id_t child);
+        void addEdges(const std::vector<std::pair<battery_id_t, battery_id_t>> &newEdges);
+        Span children(battery_id_t id) const;
+        Span parents(battery_id_t id) const;
+        size_t childCount(battery_id_t id) const;
+        size_t parentCount(battery_id_t id) const;
+        std::vector<battery_id_t> subtree(battery_id_t id) const;
+        void removeNodes(const std::vector<battery_id_t> &ids);
+        std::vector<battery_id_t> topologicalOrder() const;
+        void clear();
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef BATTERY_ID_HPP
+#define BATTERY_ID_HPP
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * Battery IDs
+ *
+ * Battery names are interned into dense integer IDs (0, 1, 2, ...) when
+ * a battery is created. Events, reservations, the battery directory and
+ * BOS connections key on the ID so the hot paths index arrays instead of
+ * copying, hashing and comparing names. A name keeps its ID for the life
+ * of the process, so a battery that is removed and created again under
+ * the same name gets the same ID back.
+ *
+ * @func internBatteryName: returns the ID of a name, assigning the next ID if the name is new
+ * @func findBatteryID:     returns the ID of a name (INVALID_BATTERY_ID if it was never interned)
+ * @func getBatteryNameOf:  returns the name of an ID
+ */
+
+using battery_id_t = uint32_t;
+
+const battery_id_t INVALID_BATTERY_ID = UINT32_MAX;
+
+battery_id_t internBatteryName(const std::string &name);
+battery_id_t findBatteryID(const std::string &name);
+std::string getBatteryNameOf(battery_id_t id);
+
+#endif
@@ -6,7 +6,15 @@
 #include "refresh.hpp"
 #include "event_t.hpp"
 #include "BatteryStatus.hpp"
+#include "BatteryClock.hpp"
+#include "BatteryTelemetry.hpp"
+#include "EventScheduler.hpp"
+#include "StatusSeqLock.hpp"
+#include "StatusHistory.hpp"
+#include "TelemetryLog.hpp"
+#include "ReservationMap.hpp"
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <thread>
@@ -16,10 +24,9 @@
 #include <memory>
 #include <utility>
 #include <chrono>
-#include <condition_variable>
 
 /* global sequence number for events */
-extern uint64_t SEQUENCE_NUMBER;
+extern std::atomic<uint64_t> SEQUENCE_NUMBER;
 uint64_t getSequenceNumber(void);
 
 /* get current system clock time */
@@ -30,32 +37,49 @@ using lockguard_t = std::lock_guard<lock_t>;
 
 /**
 * Abstract Battery Class
-* @param lock:                  battery lock used between main and background threads
+* @param lock:                  battery lock used between callers and the event scheduler
+* @param notifyLock:            serializes the notifications of subscribers (taken before lock, never while holding it)
 * @param status:                status of the battery
-* @param eventSet:              set used to order and hold events to be processed
-* @param eventMap:              map used to hold all set_current_* events indexed by sequence number (used for merging events)
+* @param publishedStatus:       copy of status that getStatus() reads without taking the lock
+* @param history:               recent statuses of the battery (every published status)
+* @param telemetryLog:          log the statuses added to history are appended to (nullptr if there is none)
+* @param subscribers:           child batteries that are pushed this battery's status whenever it changes (e.g. aggregates)
+* @param notifyPending:         signals that a status was published since the subscribers were last notified
+* @param reservations:          set_current reservations of the battery and the net current they produce
+* @param refreshTime:           monotonic time of the next REFRESH event (if refreshPending)
+* @param refreshPending:        signals that a REFRESH event is scheduled
+* @param scheduler:             event scheduler that calls dispatchEvents() when the next event is due
+* @param clock:                 clock of the battery; wall clock time for status times and reservations,
+                                monotonic time for the refresh cadence
 * @param current_mA:            current of the battery
-* @param quitThread:            signals to background thread that it should quit
+* @param quitThread:            signals that the battery should no longer handle events
 * @param refreshMode:           refresh mode of the battery (either ACTIVE or LAZY)
-* @param eventThread:           background thread for handling events in the eventSet
 * @param batteryName:           name of the battery (unique for each Battery instance)
+* @param batteryID:             interned ID of batteryName (see BatteryID.hpp)
 * @param maxStaleness:          time between two refreshes RefreshMode::ACTIVE;
                                 max staleness tolerance for RefreshMODE::LAZY
-* @param condition_variable:    condition variable used for event scheduling
 */
 class Battery : public Node {
     protected:
         lock_t lock;
+        lock_t notifyLock;
         bool quitThread;
         double current_mA;
-        EventSet eventSet;
-        EventMap eventMap;
+        monotonic_t refreshTime;
+        bool refreshPending;
+        ReservationMap reservations;
         BatteryStatus status{};
-        RefreshMode refreshMode;
-        std::thread eventThread;
+        StatusSeqLock publishedStatus;
+        StatusHistory history;
+        std::shared_ptr<TelemetryLog> telemetryLog;
+        std::vector<Battery*> subscribers;
+        std::atomic<bool> notifyPending;
+        std::atomic<RefreshMode> refreshMode;
         const std::string batteryName;
-        std::chrono::milliseconds maxStaleness;
-        std::condition_variable condition_variable;                
+        const battery_id_t batteryID;
+        std::atomic<std::chrono::milliseconds> maxStaleness;
+        std::shared_ptr<EventScheduler> scheduler;
+        std::shared_ptr<BatteryClock> clock;
     
     /**
      * Constructors
@@ -84,50 +108,111 @@ class Battery : public Node {
     
     /**
      * BAL API Functions (used by virtual batteries)
-     * @func getStatus():            returns the current status of the logical battery
+     * @func getStatus():            returns the last published status of the logical battery without waiting on a refresh
+                                     (a stale LAZY status is refreshed unless another caller is already refreshing it)
+     * @func getFreshStatus():       returns the current status of the logical battery, waiting for a refresh if it is stale (LAZY)
      * @func schedule_set_current(): specifies a set_current request with a startTime and endTime for request 
+                                     (prepare_set_current() followed by commit_set_current())
+     * @func prepare_set_current():  checks a set_current request and holds it (it counts against the projected capacity
+                                     but is not scheduled) until it is committed or aborted
+     * @func commit_set_current():   schedules the held parts of a set_current request by its sequence number
+     * @func abort_set_current():    drops the held parts of a set_current request, leaving what was already committed
+     * @func cancel_set_current():   cancels what is left of a set_current request by its sequence number
+     * @func restore_set_current():  adds a set_current request that was admitted before a restart (see BOS::recover) without
+                                     checking it or arming the event scheduler (call armEvents() once every request is restored)
+     * @func getStatusHistory():     returns the statuses of the battery between startTime and endTime, averaged
+                                     over buckets of downsample if it is not zero (see StatusHistory.hpp)
      */
     public:
         virtual BatteryStatus getStatus();
+        BatteryStatus getFreshStatus();
         bool schedule_set_current(double current_mA, uint64_t startTime, uint64_t endTime);
         bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime);
-        virtual bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber);
+        bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber);
+        virtual bool prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber);
+        virtual bool commit_set_current(uint64_t sequenceNumber);
+        virtual bool abort_set_current(uint64_t sequenceNumber);
+        virtual bool cancel_set_current(uint64_t sequenceNumber);
+        virtual bool restore_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime);
+        std::vector<BatteryStatus> getStatusHistory(timepoint_t startTime, timepoint_t endTime,
+                                                    std::chrono::milliseconds downsample = std::chrono::milliseconds(0));
     
     /**
      * Extra Protected Helper Functions
      * @func checkAndRefresh(): calls refresh() if last time battery was refreshed was after maxStaleness (for RefreshMode::LAZY)
-     * @func runEventThread():  runs eventThread that handles events in eventSet 
-     * @func checkMergeAndInsertEvents(): inserts set_current_* events into eventSet and merges together events if possible
+     * @func isStale():         checks if a status time is more than maxStaleness away from now
+                                (either way, so a status stamped before the wall clock stepped back is stale)
+     * @func armScheduler():    arms the event scheduler with the time of the next REFRESH or current change (lock must be held)
+     * @func scheduleRefresh(): schedules the next REFRESH event (lock must be held)
+     * @func holdReservation():  holds a set_current request in reservations until it is committed (on commit it overrides
+                                  overlapping requests from the same requester)
+     * @func admitReservation():  holds a set_current request like holdReservation() if the projected capacity of the battery
+                                  stays within [0, max capacity] with it (see ReservationMap::admits), returns false otherwise
+                                  or if the reservation map rejects it (e.g. endTime <= startTime)
+     * @func checksAdmission():   returns if admitReservation() checks requests against the projected capacity (false for
+                                  batteries whose state of charge follows a ChargeModel, which stops them at full or empty)
+     * @func publishStatus():   publishes status to getStatus() readers, records it in the history (and the telemetry log if it is new)
+                                and marks it for the subscribers (lock must be held; call notifySubscribers() once it is released)
+     * @func notifySubscribers(): pushes the last published status to every subscriber (lock must not be held)
+     * @func parentStatusChanged(): called by a parent this battery subscribed to with the parent's new status
+                                    (the parent's lock is not held, but its notifications are serialized)
+     * @func refreshParents():      reads the parents this battery subscribed to, so lazy parents refresh a stale status
+                                    and push it before this battery uses it (lock must not be held; does nothing by default)
      */
     protected:
-        virtual void runEventThread();
+        void armScheduler();
+        void publishStatus();
+        void notifySubscribers();
+        bool isStale(const BatteryStatus &status) const;
         BatteryStatus checkAndRefresh();
-        void checkMergeAndInsertEvents(std::string batteryName, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber);
+        void scheduleRefresh(monotonic_t time);
+        bool holdReservation(battery_id_t requester, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber);
+        bool admitReservation(battery_id_t requester, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber);
+        virtual bool checksAdmission() const;
+        virtual void parentStatusChanged(Battery *parent, const BatteryStatus &parentStatus);
+        virtual void refreshParents();
     
     /**
      * Extra Public Helper Functions
-     * @func quit():                     signals to eventThread to quit
+     * @func quit():                     stops handling events and removes the battery from the event scheduler
+     * @func armEvents():                arms the event scheduler with the next event of the battery (after restore_set_current())
+     * @func dispatchEvents():           handles the REFRESH event and current changes that are due (called by the event scheduler)
      * @func getCurrent():               returns current of battery at moment function is called
+     * @func getScheduledCurrent():      returns the net current scheduled for the battery at a point in time
+     * @func getProjectedCapacity():     returns the capacity the battery is projected to have at a point in time given its
+                                       last status and the current scheduled since
      * @func getMaxStaleness():          returns maxStaleness
      * @func getMaxChargingCurrent():    returns max charging current of battery
      * @func getMaxDischargingCurrent(): returns max discharging current of battery
      * @func getBatteryName():           returns batteryName
+     * @func getBatteryID():             returns batteryID
      * @func getBatteryString():         returns if battery is a physical or virtual battery
+     * @func getTelemetry():             copies the last extended telemetry of the battery (false if it has none)
      * @func cancelEvent():              cancels set current event
      * @func setMaxStaleness():          setter for maxStaleness
      * @func getDelay():                 calculates delay from setting battery from old_current_mA to new_current_mA 
+     * @func addSubscriber():            pushes status to child now and on every status change until removeSubscriber()
+     * @func removeSubscriber():         stops pushing status to child
      */
     public:
         void quit();
+        void armEvents();
+        void dispatchEvents();
         double getCurrent() const;
+        double getScheduledCurrent(timepoint_t time);
+        double getProjectedCapacity(timepoint_t time);
         std::string getBatteryName() const;
+        battery_id_t getBatteryID() const;
         double getMaxChargingCurrent() const;
         double getMaxDischargingCurrent() const;
         virtual std::string getBatteryString() const;       
+        virtual bool getTelemetry(BatteryTelemetry &telemetry);
         std::chrono::milliseconds getMaxStaleness() const;
         void setRefreshMode(const RefreshMode &refreshMode);
         // bool cancelEvent(timepoint_t startTime, timepoint_t endTime);
         void setMaxStaleness(const std::chrono::milliseconds &maxStaleness);
+        void addSubscriber(Battery *child);
+        void removeSubscriber(Battery *child);
         // virtual std::chrono::milliseconds getDelay(double old_current_mA, double new_current_mA) = 0;
 
     public:
@@ -135,7 +220,9 @@ class Battery : public Node {
         void setBatteryStatus(const BatteryStatus &status) {
             this->lock.lock();
             this->status = status;
+            this->publishStatus();
             this->lock.unlock();
+            this->notifySubscribers();
             return;
         }
 };
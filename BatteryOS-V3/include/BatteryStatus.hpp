@@ -12,7 +12,7 @@
 
 using timestamp_t = std::chrono::time_point<std::chrono::system_clock, std::chrono::milliseconds>;
 
-/* get current system clock time */
+/* get current time of the process-wide clock (see BatteryClock.hpp) */
 timestamp_t getTimeNow(void);
 
 #ifdef __cplusplus
@@ -30,6 +30,8 @@ typedef struct BatteryStatus BatteryStatus;
         max_capacity_mAh:             max capacity of the battery 
         max_charging_current_mA:      max charging current of the battery
         max_discharging_current_mA:   max discharging current of the battery
+        max_temperature_dK:           highest temperature reported by the battery in 0.1 K (0 if unknown)
+        protection_flags:             ProtectionFlag bits raised by the battery (see BatteryTelemetry.hpp)
         time:                         time the status was captured
 */
 
@@ -40,6 +42,8 @@ struct BatteryStatus {
     double max_capacity_mAh;
     double max_charging_current_mA;
     double max_discharging_current_mA;
+    uint16_t max_temperature_dK;
+    uint16_t protection_flags;
     uint64_t time;
 
     BatteryStatus()
@@ -49,6 +53,8 @@ struct BatteryStatus {
           max_capacity_mAh(0),
           max_charging_current_mA(0),
           max_discharging_current_mA(0),
+          max_temperature_dK(0),
+          protection_flags(0),
           time(0) {}
     BatteryStatus(const bosproto::BatteryStatus &proto_status)
         : voltage_mV(proto_status.voltage_mv()),
@@ -57,6 +63,8 @@ struct BatteryStatus {
           max_capacity_mAh(proto_status.max_capacity_mah()),
           max_charging_current_mA(proto_status.max_charging_current_ma()),
           max_discharging_current_mA(proto_status.max_discharging_current_ma()),
+          max_temperature_dK(proto_status.max_temperature_dk()),
+          protection_flags(proto_status.protection_flags()),
           time(proto_status.timestamp()) {}
     void toProto(bosproto::BatteryStatus &proto_status) const;
 }; 
@@ -0,0 +1,73 @@
+#ifndef BATTERY_TELEMETRY_HPP
+#define BATTERY_TELEMETRY_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Protection flags of a battery management system
+ * (bit layout of the JBD "current errors" field, see doc/JBD_REGISTER_MAP.md)
+ */
+enum ProtectionFlag : uint16_t {
+    PROTECTION_CELL_OVERVOLTAGE       = 1 << 0,
+    PROTECTION_CELL_UNDERVOLTAGE      = 1 << 1,
+    PROTECTION_PACK_OVERVOLTAGE       = 1 << 2,
+    PROTECTION_PACK_UNDERVOLTAGE      = 1 << 3,
+    PROTECTION_CHARGE_OVERTEMP        = 1 << 4,
+    PROTECTION_CHARGE_UNDERTEMP       = 1 << 5,
+    PROTECTION_DISCHARGE_OVERTEMP     = 1 << 6,
+    PROTECTION_DISCHARGE_UNDERTEMP    = 1 << 7,
+    PROTECTION_CHARGE_OVERCURRENT     = 1 << 8,
+    PROTECTION_DISCHARGE_OVERCURRENT  = 1 << 9,
+    PROTECTION_SHORT_CIRCUIT          = 1 << 10,
+    PROTECTION_FRONTEND_ERROR         = 1 << 11,
+    PROTECTION_FET_LOCKED             = 1 << 12,
+};
+
+/* every protection flag raised by a temperature */
+constexpr uint16_t PROTECTION_TEMPERATURE = PROTECTION_CHARGE_OVERTEMP | PROTECTION_CHARGE_UNDERTEMP |
+                                            PROTECTION_DISCHARGE_OVERTEMP | PROTECTION_DISCHARGE_UNDERTEMP;
+
+/**
+ * Battery Telemetry
+ *
+ * Extended telemetry of a battery management system that does not fit
+ * in a BatteryStatus (which only carries the highest temperature and the
+ * protection flags). encode() packs the record into a fixed little-endian
+ * layout of 24 bytes plus 2 bytes per cell and temperature sensor, which
+ * is what Get_Status sends for batteries that have telemetry.
+ *
+ * @param time:             time the record was last updated (ms since epoch)
+ * @param cellVoltagesTime: time the cell voltages were captured (they are read less often)
+ * @param cycles:           charge/discharge cycles
+ * @param stateOfCharge:    state of charge reported by the BMS (percent)
+ * @param fetStatus:        bit 0: charge FET conducting, bit 1: discharge FET conducting
+ * @param protectionFlags:  ProtectionFlag bits that are raised
+ * @param balanceFlags:     cells being balanced (bit i is cell i + 1)
+ * @param cellVoltages:     voltage of each cell (mV)
+ * @param temperatures:     temperature of each sensor (0.1 K)
+ *
+ * @func encode:         packs the record
+ * @func decode:         unpacks an encoded record (false if the bytes are not a record)
+ * @func maxTemperature: highest sensor temperature (0.1 K), 0 without sensors
+ */
+struct BatteryTelemetry {
+    uint64_t time = 0;
+    uint64_t cellVoltagesTime = 0;
+    uint16_t cycles = 0;
+    uint8_t stateOfCharge = 0;
+    uint8_t fetStatus = 0;
+    uint16_t protectionFlags = 0;
+    uint32_t balanceFlags = 0;
+    std::vector<uint16_t> cellVoltages;
+    std::vector<uint16_t> temperatures;
+
+    std::string encode() const;
+    static bool decode(const std::string &bytes, BatteryTelemetry &telemetry);
+    uint16_t maxTemperature() const;
+};
+
+bool operator==(const BatteryTelemetry &lhs, const BatteryTelemetry &rhs);
+
+#endif
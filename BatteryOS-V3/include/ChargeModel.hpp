@@ -0,0 +1,46 @@
+#ifndef CHARGE_MODEL_HPP
+#define CHARGE_MODEL_HPP
+
+#include <chrono>
+#include <stdint.h>
+
+#include "BatteryStatus.hpp"
+
+/**
+ * Charge Model
+ *
+ * State of charge model of the pseudo and partition batteries. While
+ * current flows the capacity changes by -current_mA / 20 once every
+ * interval, starting at the moment the current is switched on, and
+ * current stops once the battery is full (charging) or empty
+ * (discharging). The steps are applied to the status in closed form
+ * whenever the battery is refreshed or its current changes, so no
+ * thread has to wake up every interval and the same status comes out
+ * whether the battery runs on the system clock or a ManualClock. A step
+ * that is due at the same millisecond as a current change still uses
+ * the old current.
+ *
+ * @param interval: time between two steps
+ * @param nextStep: time of the next step (only meaningful while current flows)
+ */
+class ChargeModel {
+    private:
+        std::chrono::milliseconds interval;
+        timestamp_t nextStep;
+
+    public:
+        ChargeModel(std::chrono::milliseconds interval);
+
+    /**
+     * Public Functions
+     *
+     * @func advance:    applies every step due at or before now to status
+     * @func setCurrent: advances to now and then switches status to current_mA
+     *                   (a battery that was idle takes its first step at now)
+     */
+    public:
+        void advance(BatteryStatus &status, timestamp_t now);
+        void setCurrent(BatteryStatus &status, double current_mA, timestamp_t now);
+};
+
+#endif
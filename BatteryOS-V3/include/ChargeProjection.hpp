@@ -0,0 +1,147 @@
+#ifndef CHARGE_PROJECTION_HPP
+#define CHARGE_PROJECTION_HPP
+
+#include <memory>
+#include <random>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "event_t.hpp"
+
+/**
+ * Charge Projection
+ *
+ * Projected charge drawn from a battery by its scheduled current, kept as
+ * a piecewise linear curve. The curve changes slope only where the net
+ * current changes, so it is stored as a balanced (treap) search tree of
+ * those breakpoints keyed by time. Every node holds the charge drawn at
+ * its time (in mAh, relative to an arbitrary origin) and bounds on the
+ * smallest and largest charge of its subtree.
+ *
+ * Adding a current over [startTime, endTime) adds a linear function of
+ * time to the charge of the breakpoints inside the window (a ramp) and a
+ * constant to the breakpoints after it. Both are tags (a charge and a
+ * current) applied lazily to whole subtrees, so an add is O(log n). A tag
+ * moves the extremes of a subtree by no more than it moves its first or
+ * last breakpoint, which keeps the bounds of the subtree sound without
+ * visiting it; they are tightened whenever a path through the subtree is
+ * updated. The lowest and highest projected state of charge after a point
+ * in time are found exactly by walking down only the subtrees whose
+ * bounds could still change them.
+ *
+ * admits() checks a set of changes against the state of charge of the
+ * battery without changing the curve. Most checks are decided from the
+ * extremes of the curve: a change that moves the curve less than the room
+ * it has is admitted, and a change that takes the curve out of range after
+ * its window is rejected. The rest are decided by the extremes of the
+ * curve with the changes laid over it, which between two of their start
+ * or end times only add a linear function of time.
+ *
+ * The part of the curve before the last consumed time is dropped: the
+ * curve starts at baseTime with baseCharge and baseCurrent_mA. Current
+ * added before baseTime only counts from baseTime on.
+ *
+ * @param baseTime:       time the curve starts at (latest time passed to consume())
+ * @param baseCharge:     charge drawn at baseTime
+ * @param baseCurrent_mA: net current from baseTime to the first breakpoint
+ * @param origin:         time the positions of the breakpoints are measured from (reset when the tree is empty)
+ * @param count:          number of breakpoints
+ * @param generator:      priorities of the nodes
+ * @param root:           root of the breakpoint tree
+ */
+class ChargeProjection {
+    public:
+        struct Change {
+            double current_mA;
+            timepoint_t startTime;
+            timepoint_t endTime;
+        };
+
+    private:
+        struct Node {
+            int64_t key;
+            double position;
+            double delta_mA;
+            double sumDelta_mA;
+            double charge;
+            double minCharge;
+            double maxCharge;
+            double firstPosition;
+            double lastPosition;
+            double pendingCharge;
+            double pendingCurrent_mA;
+            uint32_t priority;
+            std::unique_ptr<Node> left;
+            std::unique_ptr<Node> right;
+
+            Node(int64_t key, double position, double charge, uint32_t priority)
+                : key(key), position(position), delta_mA(0), sumDelta_mA(0), charge(charge), minCharge(charge), maxCharge(charge),
+                  firstPosition(position), lastPosition(position), pendingCharge(0), pendingCurrent_mA(0), priority(priority) {}
+        };
+
+        int64_t baseTime;
+        double baseCharge;
+        double baseCurrent_mA;
+        int64_t origin;
+        size_t count;
+        std::mt19937 generator;
+        std::unique_ptr<Node> root;
+
+    public:
+        ChargeProjection();
+
+    /**
+     * Private Helper Functions
+     *
+     * @func shift:      adds charge + current_mA * position worth of charge to every node of a subtree (lazily below its root)
+     * @func push:       passes the pending tag of a node on to its children
+     * @func update:     recomputes the subtree fields of a node from its children
+     * @func merge:      joins two trees (every key of left before every key of right)
+     * @func split:      splits a tree into the keys <= key and the keys > key
+     * @func widen:      widens range to the charge (plus a linear function of position) of the nodes of a subtree with
+     *                   lo <= key < hi, skipping the subtrees whose bounds are already inside range
+     * @func addDelta:   adds to the current change of an existing breakpoint
+     * @func erase:      removes a breakpoint
+     * @func positionOf: position of a time on the curve (mAh drawn by 1 mA since origin)
+     * @func insertAt:   adds a breakpoint on the curve at time (if there is none)
+     * @func pruneAt:    removes a breakpoint that no longer changes the current
+     */
+
+    private:
+        static void shift(std::unique_ptr<Node> &node, double charge, double current_mA);
+        static void push(std::unique_ptr<Node> &node);
+        static void update(std::unique_ptr<Node> &node);
+        static std::unique_ptr<Node> merge(std::unique_ptr<Node> left, std::unique_ptr<Node> right);
+        static void split(std::unique_ptr<Node> node, int64_t key, std::unique_ptr<Node> &left, std::unique_ptr<Node> &right);
+        static void widen(const Node* node, int64_t lo, int64_t hi, double pendingCharge, double pendingCurrent_mA,
+                          double charge, double current_mA, std::pair<double, double> &range);
+        static bool addDelta(std::unique_ptr<Node> &node, int64_t key, double delta_mA);
+        static bool erase(std::unique_ptr<Node> &node, int64_t key);
+        double positionOf(int64_t time) const;
+        void insertAt(int64_t time);
+        void pruneAt(int64_t time);
+
+    /**
+     * Public Functions
+     *
+     * @func add:      adds current_mA over [startTime, endTime) to the curve (a negative current removes it again)
+     * @func consume:  drops the curve before time
+     * @func chargeAt: charge drawn at a point in time
+     * @func extremes: smallest and largest charge drawn at or after a point in time
+     * @func size:     number of breakpoints
+     * @func admits:   checks if the changes keep the capacity of the battery, starting at capacity_mAh at time from,
+     *                 within [0, maxCapacity_mAh] from then on (or, if the curve already leaves that range, do not
+     *                 take it further out)
+     */
+
+    public:
+        void add(double current_mA, timepoint_t startTime, timepoint_t endTime);
+        void consume(timepoint_t time);
+        double chargeAt(timepoint_t time) const;
+        std::pair<double, double> extremes(timepoint_t time) const;
+        size_t size() const;
+        bool admits(const std::vector<Change> &changes, timepoint_t from, double capacity_mAh, double maxCapacity_mAh);
+};
+
+#endif
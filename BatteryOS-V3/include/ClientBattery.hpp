@@ -6,6 +6,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#include <map>
+#include <vector>
+
 #include "util.hpp"
 #include "BatteryStatus.hpp"
 #include "protobuf/battery.pb.h"
@@ -51,12 +54,20 @@ class ClientBattery {
      * Public Helper Functions
      *
      * @func getStatus:            gets the status of the battery
+     * @func getStatusBatch:       gets the status of a list of batteries (every battery in the directory
+                                   if the list is empty) with a single request
+     * @func getStatusHistory:     gets the statuses of the battery (or of batteryName) between two times, averaged
+                                   over buckets of downsample unless it is zero
      * @func setBatteryStatus:     sets the status of the battery
      * @func schedule_set_current: schedules a set_current event of the battery 
      */
     
     public:
         BatteryStatus getStatus();
+        std::map<std::string, BatteryStatus> getStatusBatch(const std::vector<std::string>& batteryNames = {});
+        std::vector<BatteryStatus> getStatusHistory(timestamp_t startTime, timestamp_t endTime,
+                                                    std::chrono::milliseconds downsample = std::chrono::milliseconds(0),
+                                                    const std::string& batteryName = "");
         bool setBatteryStatus(const BatteryStatus& status);
         bool schedule_set_current(double current_mA, uint64_t startTime, uint64_t endTime);
         bool schedule_set_current(double current_mA, timestamp_t startTime, timestamp_t endTime);
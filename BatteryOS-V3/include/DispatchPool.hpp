@@ -0,0 +1,84 @@
+#ifndef DISPATCH_POOL_HPP
+#define DISPATCH_POOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "BatteryID.hpp"
+
+/**
+ * Dispatch Pool
+ *
+ * Fixed pool of worker threads that runs tasks submitted under a key
+ * (the battery ID for BOS commands). Tasks with the same key run one
+ * at a time in the order they were submitted, while tasks with different
+ * keys run in parallel. Keys with pending tasks are served round robin
+ * so one busy battery cannot starve the others.
+ *
+ * runAll() runs a batch of tasks on the pool and waits for them. The
+ * calling thread runs every task of the batch that no worker has picked
+ * up yet, so a batch finishes even when every worker is busy (e.g. with
+ * the batches of a nested aggregate) and the pool stays bounded.
+ *
+ * @param lock:      protects every member below
+ * @param quit:      signals the worker threads to exit
+ * @param strands:   pending tasks of each key that has work
+ * @param readyKeys: keys that have pending tasks and no running task
+ * @param condition: signals workers that a key became ready
+ * @param workers:   worker threads
+ */
+class DispatchPool {
+    private:
+        struct Strand {
+            std::deque<std::function<void()>> tasks;
+        };
+
+        struct Batch {
+            std::vector<std::pair<battery_id_t, std::function<void()>>> tasks;
+            std::unique_ptr<std::atomic<bool>[]> claimed;
+            std::mutex lock;
+            std::condition_variable finished;
+            size_t remaining;
+        };
+
+        std::mutex lock;
+        bool quit;
+        std::unordered_map<battery_id_t, Strand> strands;
+        std::deque<battery_id_t> readyKeys;
+        std::condition_variable condition;
+        std::vector<std::thread> workers;
+
+    public:
+        ~DispatchPool();
+        DispatchPool(unsigned int numThreads);
+        DispatchPool(const DispatchPool&) = delete;
+        DispatchPool& operator=(const DispatchPool&) = delete;
+
+    private:
+        void runWorker();
+        static void runTask(battery_id_t key, const std::function<void()> &task);
+        static void runClaimed(Batch &batch, size_t index);
+
+    /**
+     * Public Functions
+     *
+     * @func submit:  queues a task behind the other tasks of its key
+     * @func runAll:  runs every task (each under its key) and returns once all of them are done
+     * @func size:    number of worker threads
+     */
+
+    public:
+        void submit(battery_id_t key, std::function<void()> task);
+        void runAll(std::vector<std::pair<battery_id_t, std::function<void()>>> tasks);
+        size_t size() const;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef DRIVER_ABI_HPP
+#define DRIVER_ABI_HPP
+
+#include <stdint.h>
+#include "BatteryStatus.hpp"
+
+/**
+ * Driver ABI
+ *
+ * Every driver library loaded by BOS exports a driver table through
+ *
+ *     extern "C" const DriverTable* BOSDriverTable();
+ *
+ * The table lists the drivers in the library and, for each of them, the
+ * names of the C functions that create, destroy, refresh and set the
+ * current of a battery (see DynamicBattery.hpp for their signatures).
+ * A library is only loaded if its table has the ABI version and the
+ * BatteryStatus size BOS was built with, so a driver built against an
+ * older BatteryStatus is rejected instead of corrupting the status it
+ * returns.
+ *
+ * BOS_DRIVER_ABI_VERSION has to be incremented whenever DriverTable,
+ * DriverEntry or the signature of the driver functions change.
+ */
+
+#define BOS_DRIVER_ABI_VERSION 1
+#define BOS_DRIVER_TABLE_SYMBOL "BOSDriverTable"
+
+/**
+ * Capabilities of a driver
+ *
+ * DRIVER_CHARGE:    set_current() can charge the battery (negative current)
+ * DRIVER_DISCHARGE: set_current() can discharge the battery (positive current)
+ * DRIVER_TELEMETRY: the driver exports a telemetry function
+ */
+enum DriverCapability : uint32_t {
+    DRIVER_CHARGE    = 1 << 0,
+    DRIVER_DISCHARGE = 1 << 1,
+    DRIVER_TELEMETRY = 1 << 2,
+};
+
+/**
+ * Driver Entry
+ *
+ * @param name:         name of the driver (unique within BOS)
+ * @param capabilities: DriverCapability flags
+ * @param constructor:  name of the constructor function
+ * @param destructor:   name of the destructor function
+ * @param refresh:      name of the refresh function
+ * @param setCurrent:   name of the set_current function
+ * @param telemetry:    name of the telemetry function (nullptr without DRIVER_TELEMETRY)
+ */
+struct DriverEntry {
+    const char* name;
+    uint32_t    capabilities;
+    const char* constructor;
+    const char* destructor;
+    const char* refresh;
+    const char* setCurrent;
+    const char* telemetry;
+};
+
+/**
+ * Driver Table
+ *
+ * @param abiVersion: BOS_DRIVER_ABI_VERSION the library was built with
+ * @param statusSize: sizeof(BatteryStatus) the library was built with
+ * @param numDrivers: number of entries in drivers
+ * @param drivers:    drivers in the library
+ */
+struct DriverTable {
+    uint32_t           abiVersion;
+    uint32_t           statusSize;
+    uint32_t           numDrivers;
+    const DriverEntry* drivers;
+};
+
+typedef const DriverTable* (*driver_table_t)();
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef DRIVER_REGISTRY_HPP
+#define DRIVER_REGISTRY_HPP
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "DriverABI.hpp"
+#include "DynamicBattery.hpp"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#error "Windows not supported!"
+#elif __APPLE__
+#define DYLIB_EXT ".dylib"
+#else
+#define DYLIB_EXT ".so"
+#endif
+
+/**
+ * Driver Library
+ *
+ * One build of a driver library, loaded from a private copy of the
+ * library file so that a new build can be written over the file (and
+ * loaded next to this one) while batteries still run on this one. The
+ * library is closed when the last driver and battery using it go away.
+ *
+ * @param handle:     handle returned by dlopen
+ * @param path:       path of the library file in the driver directory
+ * @param generation: number of builds of the file loaded before this one
+ */
+class DriverLibrary {
+    public:
+        void*       handle;
+        std::string path;
+        uint64_t    generation;
+
+    public:
+        ~DriverLibrary();
+        DriverLibrary(void* handle, const std::string &path, uint64_t generation);
+        DriverLibrary(const DriverLibrary&) = delete;
+        DriverLibrary& operator=(const DriverLibrary&) = delete;
+};
+
+/**
+ * Loaded Driver
+ *
+ * Functions of a driver resolved from its library when the library was
+ * loaded. A battery created from the driver keeps the library loaded.
+ *
+ * @param name:           name of the driver
+ * @param capabilities:   DriverCapability flags
+ * @param *Name:          names of the functions (from the driver table)
+ * @param constructor:    constructor function
+ * @param destructor:     destructor function
+ * @param refreshFunc:    refresh function
+ * @param setCurrentFunc: set_current function
+ * @param telemetryFunc:  telemetry function (nullptr if the driver has none)
+ * @param library:        library build the functions live in
+ */
+struct LoadedDriver {
+    std::string   name;
+    uint32_t      capabilities;
+    std::string   constructorName;
+    std::string   destructorName;
+    std::string   refreshName;
+    std::string   setCurrentName;
+    std::string   telemetryName;
+    construct_t   constructor;
+    destruct_t    destructor;
+    refresh_t     refreshFunc;
+    set_current_t setCurrentFunc;
+    telemetry_t   telemetryFunc;
+    std::shared_ptr<DriverLibrary> library;
+};
+
+/**
+ * Driver Registry
+ *
+ * Loads every driver library in a directory once, checks its driver table
+ * (see DriverABI.hpp) and keeps the resolved functions of its drivers, so
+ * creating a dynamic battery is a lookup by the name of its constructor
+ * function instead of a dlsym per function.
+ *
+ * scan() loads the libraries added to the directory since the last scan
+ * and reloads the ones whose file changed. The drivers of a reloaded
+ * library replace the ones of the previous build for new batteries, while
+ * the batteries created from the previous build keep running on it. A
+ * build that does not pass the checks leaves the previous one in place.
+ *
+ * @param directory: directory holding the driver libraries
+ * @param lock:      protects the maps below (scan() can run while batteries are created)
+ * @param drivers:   drivers by the name of their constructor function
+ * @param libraries: loaded libraries by path, with the file they were loaded from
+ */
+class DriverRegistry {
+    private:
+        struct LibraryFile {
+            dev_t    device;
+            ino_t    inode;
+            off_t    size;
+            timespec modified;
+            uint64_t generation;
+            std::shared_ptr<DriverLibrary> library; // nullptr if the file is not a valid driver library
+        };
+
+        std::string directory;
+        mutable std::mutex lock;
+        std::unordered_map<std::string, std::shared_ptr<const LoadedDriver>> drivers;
+        std::map<std::string, LibraryFile> libraries;
+
+    public:
+        DriverRegistry(const std::string &directory);
+
+    /**
+     * Public Functions
+     *
+     * @func scan:       loads new and changed libraries and drops the drivers of removed ones (returns the number of libraries loaded)
+     * @func find:       returns the driver whose constructor function is called constructor (nullptr if there is none)
+     * @func resolve:    returns the driver whose functions are called by these names (nullptr, with the reason in error, if there is none)
+     * @func getDrivers: returns the names of the drivers that are loaded
+     * @func validate:   checks a driver table (false, with the reason in error, if it cannot be loaded)
+     */
+
+    public:
+        size_t scan();
+        std::shared_ptr<const LoadedDriver> find(const std::string &constructor) const;
+        std::shared_ptr<const LoadedDriver> resolve(const std::string &constructor,
+                                                    const std::string &destructor,
+                                                    const std::string &refreshFunc,
+                                                    const std::string &setCurrentFunc,
+                                                    const std::string &telemetryFunc,
+                                                    std::string &error) const;
+        std::vector<std::string> getDrivers() const;
+        static bool validate(const DriverTable* table, std::string &error);
+
+    private:
+        std::shared_ptr<DriverLibrary> load(const std::string &path, uint64_t generation,
+                                            std::vector<std::shared_ptr<const LoadedDriver>> &loaded) const;
+        void removeDrivers(const std::shared_ptr<DriverLibrary> &library);
+};
+
+#endif
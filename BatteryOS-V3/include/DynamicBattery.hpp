@@ -10,6 +10,9 @@
  * destruct_t:    function that takes a void* as input and returns nothing
  * construct_t:   function that takes a void* as input and returns a void*
  * set_current_t: function that takes a void* as input and returns a bool
+ * telemetry_t:   function that takes a void* and a buffer as input, encodes
+ *                the telemetry of the battery into the buffer if it fits, and
+ *                returns the size of the encoded telemetry (0 if it has none)
  *
  * The constructor function should return a pointer to the battery.
  * This pointer is then passed through to each function as a void*
@@ -24,6 +27,7 @@ typedef void (*destruct_t)(void*);
 typedef void* (*construct_t)(void*);
 typedef BatteryStatus (*refresh_t)(void*);
 typedef bool (*set_current_t)(void*, double); 
+typedef size_t (*telemetry_t)(void*, uint8_t*, size_t);
 
 /**
  * Dynamic Battery Class
@@ -37,6 +41,9 @@ typedef bool (*set_current_t)(void*, double);
  * @param constructor:    constructor of physical battery
  * @param refreshFunc:    refresh() function of physical battery
  * @param setCurrentFunc: set_current() function of physical battery  
+ * @param telemetryFunc:  telemetry function of physical battery (optional)
+ * @param telemetry:      telemetry fetched by the last refresh()
+ * @param library:        keeps the library the functions live in loaded (optional)
  *
 **/
 class DynamicBattery: public PhysicalBattery {
@@ -46,6 +53,9 @@ class DynamicBattery: public PhysicalBattery {
         destruct_t    destructor;
         construct_t   constructor;
         set_current_t setCurrentFunc;
+        telemetry_t   telemetryFunc;
+        BatteryTelemetry telemetry;
+        std::shared_ptr<void> library;
 
     public:
         virtual ~DynamicBattery();
@@ -56,7 +66,12 @@ class DynamicBattery: public PhysicalBattery {
                        void* setCurrentFunc,
                        const std::string& batteryName,
                        const std::chrono::milliseconds& maxStaleness = std::chrono::milliseconds(1000),
-                       const RefreshMode& refreshMode = RefreshMode::LAZY);
+                       const RefreshMode& refreshMode = RefreshMode::LAZY,
+                       void* telemetryFunc = nullptr,
+                       std::shared_ptr<void> library = nullptr);
+
+    public:
+        bool getTelemetry(BatteryTelemetry &telemetry) override;
 
     protected:
         BatteryStatus refresh() override;
@@ -0,0 +1,245 @@
+#ifndef EVENT_SCHEDULER_HPP
+#define EVENT_SCHEDULER_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <stdint.h>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "event_t.hpp"
+#include "BatteryClock.hpp"
+
+class Battery;
+
+/**
+ * Event Scheduler
+ *
+ * Process-wide service that wakes batteries up when their next event
+ * is due. A battery arms the scheduler with the time of its next REFRESH
+ * or current change and the scheduler calls dispatchEvents() on the
+ * battery once that time has passed. Batteries re-arm the scheduler
+ * from within dispatchEvents() so the scheduler only ever tracks one
+ * pending wakeup per battery.
+ *
+ * @func schedule: arms (or moves forward) the wakeup of a battery
+ * @func cancel:   removes a battery from the scheduler; blocks until no
+ *                 dispatch for that battery is in flight
+ */
+class EventScheduler {
+    public:
+        virtual ~EventScheduler() = default;
+        virtual void schedule(Battery* battery, timepoint_t time) = 0;
+        virtual void cancel(Battery* battery) = 0;
+};
+
+/**
+ * Threaded Event Scheduler
+ *
+ * Runs one background thread per battery that sleeps on its own
+ * condition variable until the battery's next wakeup (the original
+ * per-battery eventThread design). Kept for comparison benchmarks and
+ * for setups with only a handful of batteries.
+ *
+ * @param clock:   clock the deadlines are measured on
+ * @param lock:    protects the worker map and each worker's state
+ * @param workers: per-battery thread state indexed by battery
+ */
+class ThreadedEventScheduler : public EventScheduler {
+    private:
+        struct Worker {
+            bool quit;
+            bool armed;
+            monotonic_t deadline;
+            std::thread thread;
+            std::condition_variable condition_variable;
+        };
+
+        std::shared_ptr<BatteryClock> clock;
+        std::mutex lock;
+        std::map<Battery*, std::unique_ptr<Worker>> workers;
+
+    public:
+        ThreadedEventScheduler(std::shared_ptr<BatteryClock> clock = getClock());
+        ~ThreadedEventScheduler();
+
+    private:
+        void runWorker(Battery* battery, Worker* worker);
+
+    public:
+        void schedule(Battery* battery, timepoint_t time) override;
+        void cancel(Battery* battery) override;
+};
+
+/**
+ * Timer Wheel Scheduler
+ *
+ * Hierarchical timer wheel (WHEEL_LEVELS levels of WHEEL_SLOTS slots,
+ * one tick per millisecond) advanced by a single timer thread. Expired
+ * batteries are handed to a fixed pool of worker threads, so the number
+ * of threads does not grow with the number of batteries. Arming and
+ * cancelling a wakeup is O(1); stale wakeups are skipped lazily using
+ * a per-battery generation number.
+ *
+ * @param clock:       clock the ticks are measured on (monotonic time)
+ * @param lock:        protects every member below
+ * @param quit:        signals timer and worker threads to exit
+ * @param currentTick: last tick the wheel has been advanced to
+ * @param startTime:   monotonic time corresponding to tick 0
+ * @param numArmed:    number of armed wakeups (timer thread sleeps when 0)
+ * @param wheel:       WHEEL_LEVELS * WHEEL_SLOTS slots of pending timers
+ * @param entries:     registration/arming state of each battery
+ * @param readyQueue:  expired batteries waiting for a worker
+ * @param inFlight:    number of workers currently dispatching each battery
+ * @param timerThread: thread advancing the wheel
+ * @param workers:     pool of threads running dispatchEvents()
+ */
+class TimerWheelScheduler : public EventScheduler {
+    public:
+        static constexpr int WHEEL_BITS   = 6;
+        static constexpr int WHEEL_LEVELS = 5;
+        static constexpr uint64_t WHEEL_SLOTS = 1 << WHEEL_BITS;
+        static constexpr uint64_t WHEEL_MASK  = WHEEL_SLOTS - 1;
+        static constexpr uint64_t WHEEL_RANGE = (uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS);
+
+    private:
+        struct Timer {
+            Battery* battery;
+            uint64_t generation;
+            uint64_t expires;
+        };
+
+        struct Entry {
+            bool armed;
+            uint64_t epoch;
+            uint64_t generation;
+            uint64_t expires;
+        };
+
+        struct Ready {
+            Battery* battery;
+            uint64_t epoch;
+        };
+
+        std::shared_ptr<BatteryClock> clock;
+        std::mutex lock;
+        bool quit;
+        uint64_t currentTick;
+        uint64_t numArmed;
+        uint64_t counter;
+        monotonic_t startTime;
+        std::vector<std::vector<Timer>> wheel;
+        std::unordered_map<Battery*, Entry> entries;
+        std::deque<Ready> readyQueue;
+        std::unordered_map<Battery*, int> inFlight;
+        std::condition_variable timerCondition;
+        std::condition_variable readyCondition;
+        std::condition_variable idleCondition;
+        std::thread timerThread;
+        std::vector<std::thread> workers;
+
+    public:
+        ~TimerWheelScheduler();
+        TimerWheelScheduler(unsigned int numWorkers = 4, std::shared_ptr<BatteryClock> clock = getClock());
+        TimerWheelScheduler(const TimerWheelScheduler&) = delete;
+        TimerWheelScheduler& operator=(const TimerWheelScheduler&) = delete;
+
+    /**
+     * Private Helper Functions
+     *
+     * @func insertTimer: places a timer in the slot matching its expiry
+     * @func expireTimer: moves a timer to the ready queue if it is still current
+     * @func advance:     advances the wheel by one tick, cascading upper levels
+     * @func runTimer:    body of the timer thread
+     * @func runWorker:   body of a worker thread
+     */
+
+    private:
+        void insertTimer(const Timer& timer);
+        void expireTimer(const Timer& timer);
+        void advance();
+        void runTimer();
+        void runWorker();
+        uint64_t toTick(monotonic_t time) const;
+
+    public:
+        void schedule(Battery* battery, timepoint_t time) override;
+        void cancel(Battery* battery) override;
+};
+
+/**
+ * Simulation Scheduler
+ *
+ * Discrete-event scheduler for running batteries on a ManualClock. No
+ * thread waits on a wakeup: runUntil() repeatedly takes the earliest
+ * wakeup, moves the clock to it and calls dispatchEvents() on the
+ * battery, all on the calling thread, so a day of schedules runs as
+ * fast as the batteries can dispatch. Batteries must be created after
+ * the clock and the scheduler are installed with setClock() and
+ * setEventScheduler().
+ *
+ * @param clock:   clock moved from one wakeup to the next
+ * @param lock:    protects every member below
+ * @param counter: source of wakeup generations
+ * @param entries: armed wakeup of each battery
+ * @param queue:   wakeups ordered by time (stale ones are skipped by generation)
+ */
+class SimulationScheduler : public EventScheduler {
+    private:
+        struct Entry {
+            bool armed;
+            uint64_t generation;
+            timepoint_t time;
+        };
+
+        struct Wakeup {
+            timepoint_t time;
+            uint64_t generation;
+            Battery* battery;
+
+            friend bool operator>(const Wakeup &lhs, const Wakeup &rhs) {
+                if (lhs.time != rhs.time)
+                    return lhs.time > rhs.time;
+                return lhs.generation > rhs.generation;
+            }
+        };
+
+        std::shared_ptr<ManualClock> clock;
+        std::mutex lock;
+        uint64_t counter;
+        std::unordered_map<Battery*, Entry> entries;
+        std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> queue;
+
+    public:
+        SimulationScheduler(std::shared_ptr<ManualClock> clock);
+
+    /**
+     * Public Functions
+     *
+     * @func runUntil: dispatches every wakeup due at or before end in time order and
+     *                 leaves the clock at end; returns the number of dispatches
+     * @func pending:  number of armed wakeups
+     */
+
+    public:
+        void schedule(Battery* battery, timepoint_t time) override;
+        void cancel(Battery* battery) override;
+        uint64_t runUntil(timepoint_t end);
+        size_t pending();
+};
+
+/**
+ * Process-wide scheduler used by newly created batteries
+ *
+ * @func getEventScheduler: returns the scheduler (a TimerWheelScheduler by default)
+ * @func setEventScheduler: replaces the scheduler for batteries created afterwards
+ */
+std::shared_ptr<EventScheduler> getEventScheduler(void);
+void setEventScheduler(std::shared_ptr<EventScheduler> scheduler);
+
+#endif
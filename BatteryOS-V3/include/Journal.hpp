@@ -0,0 +1,134 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "util.hpp"
+#include "protobuf/battery.pb.h"
+#include "protobuf/battery_manager.pb.h"
+
+#define JOURNAL_SNAPSHOT_EVERY 10000
+
+/**
+ * Journal
+ *
+ * Append-only log of the state BOS cannot get back from the batteries
+ * after a restart: the admin commands that created batteries and the
+ * Set_Status and Schedule_Set_Current commands of every battery. Each
+ * record is written with a single write() as
+ *
+ *     [uint32 length][uint32 CRC-32 of the record][Journal_Record]
+ *
+ * so a crash can only leave a torn record at the end, which is dropped
+ * (and cut off the file) when the journal is loaded.
+ *
+ * Every snapshotEvery records the records that still matter (all admin
+ * commands, the last status of each battery and the reservations that
+ * have not ended) are written to <path>.snapshot next to the journal and
+ * the journal is emptied. The snapshot is renamed into place before the
+ * journal is truncated, and records carry a log sequence number (LSN), so
+ * records that a crash left in the journal after the snapshot are skipped.
+ *
+ * Records are replayed in the order they were journaled, so partitions
+ * are created after their source and reservations of the same requester
+ * override each other the way they did before. Each reservation is
+ * replayed after the status its battery had when it was journaled, so an
+ * aggregate or partition splits it with the same status (a reservation is
+ * not admitted again, see BOS::recover). A new status of a battery replaces
+ * the previous one in place if no reservation of the battery came in
+ * between; otherwise both are kept.
+ *
+ * A command is journaled after it is applied and before its response is
+ * written, so a command whose response was not sent may be lost in a
+ * crash, but not one that was acknowledged. Without syncWrites the record
+ * is only in the page cache when the response is written: it survives BOS
+ * crashing, but an acknowledged command can be lost if the machine loses
+ * power (or the kernel crashes) before the page cache is written back.
+ *
+ * @param path:          path of the journal file
+ * @param snapshotPath:  path of the snapshot file
+ * @param fd:            journal file opened for appending (-1 if it could not be opened)
+ * @param syncWrites:    fdatasync every record (survives power loss, not just a crash of BOS)
+ * @param snapshotEvery: number of records in the journal that triggers a snapshot (0 never takes one)
+ * @param numRecords:    number of records in the journal file
+ * @param nextSnapshot:  number of records in the journal that triggers the next snapshot (snapshotEvery later after a failed one)
+ * @param lsn:           LSN of the last record
+ * @param lock:          serializes appends (battery commands are journaled by the dispatch threads)
+ * @param records:       records that still matter by LSN
+ * @param statuses:      last status of each battery in records
+ */
+class Journal {
+    private:
+        /**
+         * @param lsn:      key in records of the status
+         * @param reserved: signals that a reservation of the battery was journaled after the status
+         */
+        struct StatusSlot {
+            uint64_t lsn;
+            bool reserved;
+        };
+
+
+        std::string path;
+        std::string snapshotPath;
+        int fd;
+        bool syncWrites;
+        size_t snapshotEvery;
+        size_t numRecords;
+        size_t nextSnapshot;
+        uint64_t lsn;
+        std::mutex lock;
+        std::map<uint64_t, bosproto::Journal_Record> records;
+        std::unordered_map<std::string, StatusSlot> statuses;
+
+    public:
+        ~Journal();
+        Journal(const std::string &path, size_t snapshotEvery = JOURNAL_SNAPSHOT_EVERY, bool syncWrites = false);
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+    /**
+     * Private Helper Functions
+     *
+     * @func load:          reads the snapshot and the journal into records (cuts a torn record off the journal)
+     * @func loadSnapshot:  reads the snapshot into records (false if there is none or it is corrupt)
+     * @func track:         moves a record into records (a status replaces the last one of its battery if no reservation came after it)
+     * @func append:        writes a record to the journal, moves it into records and takes a snapshot if it is due (lock must be held)
+     * @func takeSnapshot:  drops ended reservations (and the statuses only they needed), writes records to the
+     *                      snapshot and empties the journal (lock must be held)
+     */
+
+    private:
+        void load();
+        bool loadSnapshot();
+        void track(bosproto::Journal_Record &&record);
+        bool append(bosproto::Journal_Record &record);
+        bool takeSnapshot();
+
+    /**
+     * Public Functions
+     *
+     * @func isOpen:                returns if records can be appended to the journal
+     * @func replay:                calls apply on every record in journal order (returns the number apply returned true for)
+     * @func appendAdminCommand:    journals an admin command that created batteries
+     * @func appendBatteryCommand:  journals a Set_Status or Schedule_Set_Current command of a battery
+     * @func snapshot:              takes a snapshot now
+     * @func getNumRecords:         returns the number of records in the journal file (since the last snapshot)
+     * @func getNumLiveRecords:     returns the number of records a replay goes through
+     */
+
+    public:
+        bool isOpen() const;
+        size_t replay(const std::function<bool(const bosproto::Journal_Record&)> &apply);
+        bool appendAdminCommand(const bosproto::Admin_Command &command);
+        bool appendBatteryCommand(const std::string &batteryName, const bosproto::BatteryCommand &command);
+        bool snapshot();
+        size_t getNumRecords();
+        size_t getNumLiveRecords();
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <poll.h>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 class Pollable {
     public:
@@ -15,14 +16,52 @@ class Pollable {
  * The NetService class services its file descriptors,
  * and calls their polling event handler when they
  * have input data.
+ *
+ * On Linux the file descriptors are registered with epoll once
+ * (when the pollable is added) instead of being rebuilt on every
+ * call to poll(). A pollable is removed the first time its fd is
+ * ready after its weak_ptr expired. Several pollables may share
+ * one fd (e.g. a FifoAcceptor and the FifoPipe it handed its fd to);
+ * the event goes to the one whose pollInfo() currently reports that
+ * fd. poll() blocks until an fd is ready or wakeup() is called.
+ *
+ * @param wakeupFDs:     pipe used by wakeup() to interrupt poll()
+ * @param pollFD:        epoll instance (Linux only)
+ * @param registrations: pollables registered for each fd
  */
 class NetService {
     private:
-        std::vector<std::weak_ptr<Pollable>> pollables;
-        
+        int wakeupFDs[2];
+#ifdef __linux__
+        int pollFD;
+#endif
+        size_t sweepSize;
+        std::unordered_map<int, std::vector<std::weak_ptr<Pollable>>> registrations;
+
+    public:
+        NetService();
+        ~NetService();
+        NetService(const NetService&) = delete;
+        NetService& operator=(const NetService&) = delete;
+
+    /**
+     * Private Helper Functions
+     *
+     * @func dispatch:   calls the handler of the pollable that owns a ready fd
+     * @func unregister: stops polling an fd
+     * @func sweep:      drops expired pollables that never became ready again
+     */
+
+    private:
+        void dispatch(int fd);
+        void unregister(int fd);
+        void sweep();
+
     public:
         void add(std::weak_ptr<Pollable> pollable);
         void poll();
+        void wakeup();
 };
 
 #endif
+
@@ -1,6 +1,7 @@
 #ifndef PARTITION_BATTERY_HPP
 #define PARTITION_BATTERY_HPP
 
+#include "ChargeModel.hpp"
 #include "VirtualBattery.hpp"
 #include "PartitionManager.hpp"
 
@@ -10,16 +11,17 @@
  * The partition battery class creates partitioned batteries  
  * of various charge/capacity values from a source battery.
  *
+ * @param charge:               state of charge model of the partition (one step per CHARGE_INTERVAL)
  * @param source:               source battery for partitioned batteries
- * @param thread:               background thread for charging/discharging batteries
- * @param runningThread:        indicates if background thread is running
  * @param requested_current_mA: requested current fir charging/discharging
  */
 
 class PartitionBattery : public VirtualBattery {
+    public:
+        static constexpr std::chrono::milliseconds CHARGE_INTERVAL = std::chrono::seconds(5);
+
     private:
-        bool runningThread;
-        std::thread thread;
+        ChargeModel charge;
         double requested_current_mA;
         std::weak_ptr<PartitionManager> source;
 
@@ -38,11 +40,11 @@ class PartitionBattery : public VirtualBattery {
     /**
      * Private Helper Functions
      *
-     * @func runChargingThread: function that runs in background thread to charge/discharge battery
+     * @func limitCurrent: limits a current to the max charging/discharging current of the partition
      */    
 
     private:
-        void runChargingThread();
+        double limitCurrent(double current_mA) const;
 
     /**
      * Protected Helper Functions
@@ -60,14 +62,20 @@ class PartitionBattery : public VirtualBattery {
      *
      * @func getSourceName:        gets the name of the source battery
      * @func setSourceBattery:     sets the source battery
-     * @func schedule_set_current: schedules a set_current event
+     * @func prepare_set_current:  prepares a set_current event on the partition manager and holds it
+     * @func commit_set_current:   commits a set_current event on the partition manager and schedules it
+     * @func abort_set_current:    aborts a set_current event on the partition manager and drops the hold
+     * @func cancel_set_current:   cancels a set_current event
      */
 
     public:
         std::string getSourceName() const;
         std::string getBatteryString() const override;        
         void setSourceBattery(std::shared_ptr<PartitionManager> source);
-        bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) override;
+        bool prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) override;
+        bool commit_set_current(uint64_t sequenceNumber) override;
+        bool abort_set_current(uint64_t sequenceNumber) override;
+        bool cancel_set_current(uint64_t sequenceNumber) override;
 
 };
 
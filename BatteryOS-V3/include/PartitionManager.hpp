@@ -3,6 +3,7 @@
 
 #include "scale.hpp"
 #include "VirtualBattery.hpp"
+#include "PartitionPolicy.hpp"
 
 /**
  * Partition Manager Class
@@ -15,6 +16,7 @@
  * @param children:          list of child partitioned batteries
  * @param policyType:        policy of partition (proportional, tranched, or reserved)
  * @param child_proportions: list of proportion types for children
+ * @param policy:            splits the status of the source between the children on every refresh
  */
 
 class PartitionManager : public VirtualBattery {
@@ -23,6 +25,7 @@ class PartitionManager : public VirtualBattery {
         std::shared_ptr<Battery> source;
         std::vector<Scale> child_proportions;
         std::vector<std::weak_ptr<VirtualBattery>> children;
+        PartitionPolicy policy;
     
     /**
      * Constructor
@@ -41,19 +44,6 @@ class PartitionManager : public VirtualBattery {
                          std::shared_ptr<Battery> sourceBattery,
                          std::vector<std::weak_ptr<VirtualBattery>> childBatteries);
     
-    /**
-     * Private Helper Functions
-     *
-     * @func refreshTranched:     refreshes child batteries corresponding to tranched policy
-     * @func refreshReserved:     refreshes child batteries corresponding to reserved policy 
-     * @func refreshProportional: refreshes child batteries corresponding to proportional policy 
-     */
-
-    private:
-        void refreshTranched(const BatteryStatus &pStatus);
-        void refreshReserved(const BatteryStatus &pStatus);
-        void refreshProportional(const BatteryStatus &pStatus);
-
     /**
      * Protected Helper Functions
      *
@@ -69,13 +59,19 @@ class PartitionManager : public VirtualBattery {
      * Public Helper Functions
      *
      * @func initBatteryStatus:    sets the status of one of the child batteries 
-     * @func schedule_set_current: schedules a set_current event 
+     * @func prepare_set_current:  prepares a set_current event on the source battery and holds it
+     * @func commit_set_current:   commits a set_current event on the source battery and schedules it
+     * @func abort_set_current:    aborts a set_current event on the source battery and drops the hold
+     * @func cancel_set_current:   cancels a set_current event on the source battery
      */
 
     public:
         std::string getBatteryString() const override;
         BatteryStatus initBatteryStatus(const std::string &childName);
-        bool schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) override;
+        bool prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) override;
+        bool commit_set_current(uint64_t sequenceNumber) override;
+        bool abort_set_current(uint64_t sequenceNumber) override;
+        bool cancel_set_current(uint64_t sequenceNumber) override;
  
 };
 
@@ -0,0 +1,122 @@
+#ifndef PARTITION_POLICY_HPP
+#define PARTITION_POLICY_HPP
+
+#include <vector>
+#include <stddef.h>
+
+#include "scale.hpp"
+#include "BatteryStatus.hpp"
+
+/**
+ * Partition Shares
+ *
+ * Capacity and limits of every child of a partition, one array per
+ * field (child i is index i of each array).
+ */
+struct PartitionShares {
+    std::vector<double> capacity_mAh;
+    std::vector<double> max_capacity_mAh;
+    std::vector<double> max_charging_current_mA;
+    std::vector<double> max_discharging_current_mA;
+
+    void resize(size_t numChildren);
+};
+
+/**
+ * Partition Policy
+ *
+ * Splits the status of a source battery between the children of a
+ * partition. The state of the children is kept as arrays (PartitionShares)
+ * instead of per child, so a refresh is a few passes over contiguous
+ * doubles without branches or calls. The compiler vectorizes them at -O3,
+ * except for the sums and the running sums of the waterfill below, which
+ * stay scalar.
+ *
+ * PROPORTIONAL: the limits and max capacity of a child are its proportion
+ *     of the source's. The capacity of the source is split in proportion to
+ *     the capacity the children have left (by their proportion if none has).
+ *
+ * TRANCHED and RESERVED: a child keeps the limits and max capacity it was
+ *     given when the partition was created (its proportion of the source at
+ *     the time) and its own capacity. What the source has on top of the
+ *     children goes to the first child (TRANCHED) or the last child
+ *     (RESERVED), and what it is short of is taken from the last children
+ *     first. A surplus of capacity fills the children up to their max
+ *     capacity from the first child (TRANCHED) or the last child (RESERVED)
+ *     on.
+ *
+ * Handing out a surplus or taking a shortfall in order is a waterfill: a
+ * child gets min(max(amount - room before it, 0), its room), where the room
+ * before it is a running sum over the children ahead of it in the order.
+ *
+ * @param policyType:         policy of the partition
+ * @param numChildren:        number of children
+ * @param chargeProportion:   proportion of the max charging/discharging currents of each child
+ * @param capacityProportion: proportion of the capacity of each child
+ * @param reserved:           reservation of each child (tranched and reserved policies)
+ * @param reservedTotal:      sum of the reservations of all children
+ * @param shares:             shares computed by the last refresh (the capacities are the input of the next one)
+ * @param room:               scratch array of the room of each child
+ * @param before:             scratch array of the room ahead of each child
+ */
+class PartitionPolicy {
+    private:
+        PolicyType policyType;
+        size_t numChildren;
+        std::vector<double> chargeProportion;
+        std::vector<double> capacityProportion;
+        PartitionShares reserved;
+        BatteryStatus reservedTotal;
+        PartitionShares shares;
+        std::vector<double> room;
+        std::vector<double> before;
+
+    /**
+     * Constructor
+     *
+     * - Constructor requires the partition policy type and the proportion of each child
+     */
+
+    public:
+        PartitionPolicy(const PolicyType &policyType, const std::vector<Scale> &proportions);
+
+    /**
+     * Private Helper Functions
+     *
+     * @func sum:                 returns the sum of an array of the children
+     * @func waterfill:           adds amount to the values of the children (takes it away if negative), no more than
+     *                            the room of a child each, from the first child on (from the last child backwards if fromBack)
+     * @func distribute:          adds the difference between the source and the sum of a field to the field of one
+     *                            child, or takes a shortfall from the last children first
+     * @func refreshProportional: computes the shares of the proportional policy
+     * @func refreshReservations: computes the shares of the tranched and reserved policies
+     */
+
+    private:
+        double sum(const std::vector<double> &values) const;
+        void waterfill(double amount, const std::vector<double> &room, std::vector<double> &values, bool fromBack);
+        void distribute(double difference, std::vector<double> &values, size_t beneficiary);
+        void refreshProportional(const BatteryStatus &source);
+        void refreshReservations(const BatteryStatus &source);
+
+    /**
+     * Public Functions
+     *
+     * @func size:          returns the number of children
+     * @func reserve:       gives every child its proportion of the source (the reservations of the tranched and reserved policies)
+     * @func setCapacity:   sets the capacity a child has left before the next refresh
+     * @func setCapacities: sets the capacity every child has left before the next refresh (one value per child)
+     * @func refresh:       computes the shares of every child from the status of the source
+     * @func getShares:     returns the shares computed by the last refresh
+     */
+
+    public:
+        size_t size() const;
+        void reserve(const BatteryStatus &source);
+        void setCapacity(size_t index, double capacity_mAh);
+        void setCapacities(const std::vector<double> &capacities);
+        const PartitionShares& refresh(const BatteryStatus &source);
+        const PartitionShares& getShares() const;
+};
+
+#endif
@@ -46,6 +46,7 @@ typedef struct dynamicBatteryParameters {
     std::string constructor;
     std::string refreshFunc;
     std::string setCurrentFunc;
+    std::string telemetryFunc;
 } paramsDynamic;
 
 typedef struct secureParameters {
@@ -1,12 +1,26 @@
 #ifndef PSEUDO_BATTERY_HPP
 #define PSEUDO_BATTERY_HPP
 
+#include "ChargeModel.hpp"
 #include "PhysicalBattery.hpp"
 
+/**
+ * Pseudo Battery Class
+ *
+ * Physical battery without a device behind it. Its state of charge
+ * follows the ChargeModel (one step per CHARGE_INTERVAL), so fleets of
+ * pseudo batteries can also be run on a simulated clock (see
+ * SimulationScheduler). Requests are not checked against the projected
+ * capacity: the model stops the current once the battery is full or empty.
+ *
+ * @param charge: state of charge model applied to status
+ */
 class PseudoBattery: public PhysicalBattery {
+    public:
+        static constexpr std::chrono::milliseconds CHARGE_INTERVAL = std::chrono::seconds(1);
+
     private:
-        bool runningThread;
-        std::thread thread;
+        ChargeModel charge;
 
     public:
         virtual ~PseudoBattery();
@@ -14,12 +28,10 @@ class PseudoBattery: public PhysicalBattery {
                       const std::chrono::milliseconds &maxStaleness = std::chrono::milliseconds(1000),
                       const RefreshMode& refreshMode = RefreshMode::LAZY);
 
-    private:
-        void runChargingThread();
-
     protected:
         BatteryStatus refresh() override;
         bool set_current(double current_mA) override;
+        bool checksAdmission() const override;
 
     public:
         double getCapacity() const;
@@ -0,0 +1,207 @@
+#ifndef RESERVATION_MAP_HPP
+#define RESERVATION_MAP_HPP
+
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "event_t.hpp"
+#include "ChargeProjection.hpp"
+
+/**
+ * Profile Tree
+ *
+ * Balanced (treap) search tree of current changes keyed by time. Every
+ * node stores the change in net current at its time and the sum of its
+ * subtree, so the net current at any time is a prefix sum that can be
+ * answered in O(log n).
+ *
+ * @func add:      adds value to the change at time key (removes the key if it becomes zero)
+ * @func addAll:   adds every (key, value) of changes like add, rebuilding the tree once in O(n log n)
+ *                 instead of searching it once per change (for large batches)
+ * @func prefix:   sum of all changes at or before key
+ * @func consume:  removes every change at or before key and returns their sum
+ * @func firstKey: earliest time with a pending change
+ */
+class ProfileTree {
+    private:
+        struct Node {
+            int64_t key;
+            double value;
+            double sum;
+            uint32_t priority;
+            std::unique_ptr<Node> left;
+            std::unique_ptr<Node> right;
+
+            Node(int64_t key, double value, uint32_t priority)
+                : key(key), value(value), sum(value), priority(priority) {}
+        };
+
+        size_t count;
+        std::mt19937 generator;
+        std::unique_ptr<Node> root;
+
+    public:
+        ProfileTree();
+
+    private:
+        static double sumOf(const std::unique_ptr<Node> &node);
+        static void update(std::unique_ptr<Node> &node);
+        static std::unique_ptr<Node> merge(std::unique_ptr<Node> left, std::unique_ptr<Node> right);
+        static void split(std::unique_ptr<Node> node, int64_t key, std::unique_ptr<Node> &left, std::unique_ptr<Node> &right);
+        static bool addExisting(std::unique_ptr<Node> &node, int64_t key, double value, bool &removed);
+        static void updateAll(std::unique_ptr<Node> &node);
+
+    public:
+        bool empty() const;
+        size_t size() const;
+        int64_t firstKey() const;
+        double prefix(int64_t key) const;
+        double consume(int64_t key);
+        void add(int64_t key, double value);
+        void addAll(std::vector<std::pair<int64_t, double>> &changes);
+        void clear();
+};
+
+/**
+ * Reservation Map
+ *
+ * Holds the set_current reservations of a battery and the net current
+ * profile they produce. Reservations from the same requester never
+ * overlap: a new reservation overrides the part of that requester's
+ * earlier reservations that it overlaps (trimming or splitting them),
+ * while reservations from different requesters add up. Insert, cancel
+ * and "current at time t" are O(log n) (amortized over the reservations
+ * a new one overrides).
+ *
+ * The charge the reservations will draw is projected alongside the
+ * profile, so a reservation can be checked against the state of charge
+ * of the battery before it is inserted (see admits()). The projection is
+ * only built the first time it is needed, so maps that are never checked
+ * (e.g. of aggregate and partition batteries, whose parents check their
+ * share) do not pay for keeping it.
+ *
+ * A reservation can also be held (the prepare step of a request that
+ * spans several batteries): a hold counts against the projection, so
+ * other requests cannot be admitted into the charge it needs, but it is
+ * not in the profile (the battery does not draw it) until it is
+ * committed. Releasing a hold leaves the active reservations untouched.
+ *
+ * @param profile:       net current changes that have not been applied yet
+ * @param projection:    charge drawn by the net current over time (if projected)
+ * @param projected:     signals that projection is built and kept up to date
+ * @param timelines:     non-overlapping reservations of each requester, indexed by start time
+ * @param reservations:  requester, current and start times of each reservation, indexed by sequence number
+ * @param holds:         held (prepared, not yet active) reservations, indexed by sequence number
+ * @param restored:      changes of restored reservations that are not in profile yet (see restore())
+ * @param restoring:     signals that changes go to restored instead of profile
+ * @param applied_mA:    net current of every change that has been consumed
+ * @param consumedUntil: latest time passed to consume()
+ */
+class ReservationMap {
+    private:
+        struct Segment {
+            timepoint_t endTime;
+            double current_mA;
+            uint64_t sequenceNumber;
+        };
+
+        struct Reservation {
+            battery_id_t requester;
+            double current_mA;
+            std::set<timepoint_t> startTimes;
+        };
+
+        struct Hold {
+            battery_id_t requester;
+            double current_mA;
+            timepoint_t startTime;
+            timepoint_t endTime;
+        };
+
+        using Timeline = std::map<timepoint_t, Segment>;
+
+        mutable ProfileTree profile;
+        ChargeProjection projection;
+        bool projected;
+        std::unordered_map<battery_id_t, Timeline> timelines;
+        std::unordered_map<uint64_t, Reservation> reservations;
+        std::unordered_map<uint64_t, std::vector<Hold>> holds;
+        mutable std::vector<std::pair<int64_t, double>> restored;
+        bool restoring;
+        double applied_mA;
+        timepoint_t consumedUntil;
+
+    public:
+        ReservationMap();
+
+    /**
+     * Private Helper Functions
+     *
+     * @func addSegment:    adds a segment to a timeline and its current to the profile
+     * @func removeSegment: removes a segment from a timeline and its current from the profile
+     * @func addChange:     adds a change in net current to the profile (or to restored while restoring)
+     * @func settle:        adds the restored changes to the profile at once (before it is read)
+     * @func prune:         drops segments of a timeline that ended before consumedUntil
+     * @func plan:          current changes an insert would make (the reservation, minus the parts it overrides or replaces)
+     * @func project:       builds the projection from the pending segments and the holds
+     * @func unproject:     removes a hold from the projection
+     */
+
+    private:
+        void addSegment(battery_id_t requester, Timeline &timeline, timepoint_t startTime, const Segment &segment);
+        Timeline::iterator removeSegment(Timeline &timeline, Timeline::iterator iter);
+        void addChange(timepoint_t time, double current_mA);
+        void settle() const;
+        void prune(Timeline &timeline);
+        void project();
+        void unproject(const Hold &hold);
+        std::vector<ChargeProjection::Change> plan(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime) const;
+
+    /**
+     * Public Functions
+     *
+     * @func insert:        adds a reservation (summed with an existing reservation of the same sequence number)
+     * @func restore:       adds a reservation like insert, but leaves the profile and the projection to be built
+     *                      once for a whole batch of restored reservations (by the next read and admits())
+     * @func hold:          holds a reservation (counted by admits() but not active) until it is committed or released
+     * @func commit:        inserts every hold of a sequence number (checks if the reservation is pending, so a
+     *                      reservation committed through another path of an aggregate is not an error)
+     * @func release:       drops every hold of a sequence number without touching its active reservation
+     * @func cancel:        removes every remaining part of a reservation
+     * @func contains:      checks if a reservation is still pending
+     * @func currentAt:     net scheduled current at a point in time
+     * @func consume:       applies every change at or before a time and returns the change in net current
+     * @func nextEventTime: time of the next change in net current
+     * @func hasEvents:     checks if there are pending changes in net current
+     * @func size:          number of pending reservations
+     * @func chargeBetween: charge (mAh) the net current draws between two points in time
+     * @func admits:        checks if inserting a reservation keeps the projected capacity of the battery, starting at
+     *                      capacity_mAh at time from, within [0, maxCapacity_mAh] from then on (or, if the schedule
+     *                      already leaves that range, does not take it further out)
+     */
+
+    public:
+        bool insert(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime);
+        bool restore(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime);
+        bool hold(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime);
+        bool commit(uint64_t sequenceNumber);
+        bool release(uint64_t sequenceNumber);
+        bool cancel(uint64_t sequenceNumber);
+        bool contains(uint64_t sequenceNumber) const;
+        double currentAt(timepoint_t time) const;
+        double consume(timepoint_t time);
+        timepoint_t nextEventTime() const;
+        bool hasEvents() const;
+        size_t size() const;
+        double chargeBetween(timepoint_t startTime, timepoint_t endTime);
+        bool admits(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime,
+                    timepoint_t from, double capacity_mAh, double maxCapacity_mAh);
+};
+
+#endif
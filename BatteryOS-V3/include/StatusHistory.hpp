@@ -0,0 +1,76 @@
+#ifndef STATUS_HISTORY_HPP
+#define STATUS_HISTORY_HPP
+
+#include <vector>
+#include <stdint.h>
+#include "BatteryStatus.hpp"
+
+#define STATUS_HISTORY_SIZE 1024
+
+/**
+ * Status Sample
+ *
+ * Compact copy of a BatteryStatus kept in a status history. The time is
+ * stored as the milliseconds since the previous sample and the fields
+ * are rounded to whole mV, mA and mAh (the charging and discharging
+ * limits are not kept).
+ */
+struct StatusSample {
+    uint32_t delta_ms;
+    int32_t  voltage_mV;
+    int32_t  current_mA;
+    int32_t  capacity_mAh;
+    int32_t  max_capacity_mAh;
+    uint16_t max_temperature_dK;
+    uint16_t protection_flags;
+};
+
+static_assert(sizeof(StatusSample) == 24, "a status sample should stay 24 bytes");
+
+/**
+ * Status History
+ *
+ * Fixed-size ring buffer of the last statuses of a battery. Only the time
+ * of the newest sample is absolute, older times are found by walking back
+ * over the deltas, which is how queries read it (they ask for the recent
+ * past). Sample times never go backwards: a status older than the newest
+ * sample is stored at the time of the newest sample. A gap of more than
+ * 2^32 ms (49 days) starts the history over. Not thread safe (the battery
+ * lock protects it).
+ *
+ * @param samples:  ring buffer (allocated when the first status is recorded)
+ * @param capacity: number of samples kept
+ * @param next:     index the next sample is written to
+ * @param count:    number of samples in the ring buffer
+ * @param lastTime: time of the newest sample
+ */
+class StatusHistory {
+    private:
+        std::vector<StatusSample> samples;
+        size_t capacity;
+        size_t next;
+        size_t count;
+        uint64_t lastTime;
+
+    public:
+        StatusHistory(size_t capacity = STATUS_HISTORY_SIZE);
+
+    /**
+     * Public Functions
+     *
+     * @func record: adds a status as the newest sample (returns false if it was dropped: never captured or equal to the newest sample)
+     * @func query:  returns the samples with a time in [startTime, endTime] oldest first, or their
+     *               averages over buckets of downsample_ms aligned to multiples of downsample_ms
+     *               (highest temperature and every protection flag of a bucket, stamped with its start)
+     * @func size:   number of samples in the history
+     * @func clear:  drops every sample
+     */
+
+    public:
+        bool record(const BatteryStatus &status);
+        std::vector<BatteryStatus> query(uint64_t startTime, uint64_t endTime, uint64_t downsample_ms = 0) const;
+        size_t size() const;
+        void clear();
+};
+
+#endif
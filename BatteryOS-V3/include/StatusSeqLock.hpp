@@ -0,0 +1,45 @@
+#ifndef STATUS_SEQ_LOCK_HPP
+#define STATUS_SEQ_LOCK_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include "BatteryStatus.hpp"
+
+/**
+ * Status SeqLock
+ *
+ * Publishes a BatteryStatus to readers that must not wait on the writer.
+ * The writer makes the sequence number odd, stores the fields and makes
+ * it even again; a reader retries if the sequence number was odd or
+ * changed while it copied the fields. The fields are stored as relaxed
+ * atomics so a torn copy is never undefined behavior, only retried.
+ * Stores must be serialized by the caller (the battery lock).
+ *
+ * @param sequence: even when no store is in progress
+ * @param fields:   bit patterns of the BatteryStatus fields
+ */
+class StatusSeqLock {
+    private:
+        static const int NUM_FIELDS = 8;
+
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> fields[NUM_FIELDS];
+
+    public:
+        StatusSeqLock();
+        StatusSeqLock(const StatusSeqLock&) = delete;
+        StatusSeqLock& operator=(const StatusSeqLock&) = delete;
+
+    /**
+     * Public Functions
+     *
+     * @func store: publishes a status (one writer at a time)
+     * @func load:  returns the last published status without blocking the writer
+     */
+
+    public:
+        void store(const BatteryStatus &status);
+        BatteryStatus load() const;
+};
+
+#endif
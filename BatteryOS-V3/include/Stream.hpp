@@ -5,6 +5,8 @@
 
 class Stream : public Pollable {
     public:
+        virtual ~Stream() = default;
+
         virtual size_t read(char* buffer, size_t len) = 0;
         virtual size_t write(char* buffer, size_t len) = 0;
 
@@ -16,13 +16,28 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+/**
+ * TLS socket
+ *
+ * The server and client contexts are created once per process by
+ * InitializeServer/InitializeClient. Clients keep the last session
+ * ticket they received from each server and offer it on their next
+ * connect, so reconnecting skips the certificate exchange. Servers
+ * accept with continueAccept(), which never blocks: the socket is
+ * non-blocking until the handshake completes and blocking afterwards.
+ *
+ * @param ssl:                OpenSSL connection state (freed with the socket, which also closes the fd)
+ * @param serverContext:      context used by accepted sockets
+ * @param clientContext:      context used by connected sockets
+ * @param sessionResumption:  whether clients offer cached sessions
+ */
 class TLSSocket: public Socket {
     public:
         SSL* ssl;
 
         // TODO: remove fd from args
-        TLSSocket(int fd);
-        TLSSocket(int fd, std::function<void()> readHandler);
+        TLSSocket(int fd, SSL_CTX* context);
+        TLSSocket(int fd, SSL_CTX* context, std::function<void()> readHandler);
         ~TLSSocket();
         TLSSocket(const TLSSocket& other) = delete;
         TLSSocket(TLSSocket&& other) noexcept;
@@ -31,6 +46,7 @@ class TLSSocket: public Socket {
 
         static void InitializeServer(const std::string& ca_path, const std::string& cert_path, const std::string& key_path);
         static void InitializeClient(const std::string& ca_path, const std::string& cert_path, const std::string& key_path);
+        static void SetSessionResumption(bool enable);
 
         // Stream
         size_t read(char* buffer, size_t len) override;
@@ -42,10 +58,19 @@ class TLSSocket: public Socket {
         // TODO: maybe move this somewhere else
         // TODO: remove fd from args
         static std::unique_ptr<TLSSocket> connect(int fd, in_addr_t addr, int port);
-        static TLSSocket* accept(int fd);
+        static TLSSocket* accept(int fd); // returns a non-blocking socket that still needs continueAccept()
+
+        /**
+         * Runs the server handshake as far as the data received so far
+         * allows. Returns 1 when the handshake completed, 0 when it needs
+         * more data from the client and -1 when it failed.
+         */
+        int continueAccept();
 
     private:
-        static SSL_CTX* context;
+        static SSL_CTX* serverContext;
+        static SSL_CTX* clientContext;
+        static bool sessionResumption;
 
 };
 
@@ -0,0 +1,286 @@
+#ifndef TELEMETRY_LOG_HPP
+#define TELEMETRY_LOG_HPP
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "util.hpp"
+#include "BatteryID.hpp"
+#include "BatteryStatus.hpp"
+
+#define TELEMETRY_LOG_MAGIC         "BOSTLOG1"
+#define TELEMETRY_INDEX_MAGIC       "BOSTIDX1"
+#define TELEMETRY_SEGMENT_MAGIC     0x47455354 // "TSEG"
+#define TELEMETRY_SEGMENT_SIZE      4096
+#define TELEMETRY_FLUSH_INTERVAL_MS 60000
+#define TELEMETRY_MAX_PENDING       (1 << 20)
+
+/**
+ * Columns of a telemetry log, one per BatteryStatus field
+ * (the time in ms since epoch, the other fields rounded to whole mV, mA, mAh, 0.1 K)
+ */
+enum TelemetryColumn {
+    TELEMETRY_TIME = 0,
+    TELEMETRY_VOLTAGE,
+    TELEMETRY_CURRENT,
+    TELEMETRY_CAPACITY,
+    TELEMETRY_MAX_CAPACITY,
+    TELEMETRY_MAX_CHARGING_CURRENT,
+    TELEMETRY_MAX_DISCHARGING_CURRENT,
+    TELEMETRY_TEMPERATURE,
+    TELEMETRY_PROTECTION_FLAGS,
+    TELEMETRY_NUM_COLUMNS
+};
+
+const uint32_t TELEMETRY_ALL_COLUMNS = (1 << TELEMETRY_NUM_COLUMNS) - 1;
+
+/* name of a column (as printed by the telemetry_log tool) */
+const char* getTelemetryColumnName(int column);
+
+/**
+ * Telemetry Segment Header
+ *
+ * A telemetry log is the 8 byte TELEMETRY_LOG_MAGIC followed by segments.
+ * Each segment holds up to TELEMETRY_SEGMENT_SIZE samples of one battery:
+ *
+ *     [header][battery name][column 0][column 1]...[column 8]
+ *
+ * Each column is its values as differences from the previous value of
+ * the column (the first one from 0), zigzag and varint encoded, so slowly
+ * changing fields take one byte per sample. The header is written in host
+ * byte order (little-endian on every platform BOS runs on).
+ *
+ * Every segment header is also appended to <log>.index next to the log
+ * (TELEMETRY_INDEX_MAGIC followed by [uint64 offset][header][battery name]
+ * for each segment), so opening a log reads the small index instead of a
+ * header every few thousand samples all over the log. The index is only a
+ * copy: segments it is missing (e.g. after a crash) are found from their
+ * headers in the log.
+ *
+ * @param magic:      TELEMETRY_SEGMENT_MAGIC
+ * @param crc:        CRC-32 of the header after this field and of the payload
+ * @param size:       bytes of the payload (the name and the columns)
+ * @param numSamples: number of samples in the segment
+ * @param nameLength: bytes of the battery name
+ * @param columnEnd:  end of each column from the start of column 0
+ * @param minValue:   smallest value of each column
+ * @param maxValue:   largest value of each column
+ */
+struct TelemetrySegmentHeader {
+    uint32_t magic;
+    uint32_t crc;
+    uint32_t size;
+    uint32_t numSamples;
+    uint32_t nameLength;
+    uint32_t columnEnd[TELEMETRY_NUM_COLUMNS];
+    int64_t  minValue[TELEMETRY_NUM_COLUMNS];
+    int64_t  maxValue[TELEMETRY_NUM_COLUMNS];
+};
+
+static_assert(sizeof(TelemetrySegmentHeader) == 200, "the segment header is part of the file format");
+
+/**
+ * Telemetry Columns
+ *
+ * Decoded samples of a battery, one vector per column (a column that was
+ * not asked for is left empty).
+ */
+struct TelemetryColumns {
+    size_t numSamples = 0;
+    std::vector<int64_t> values[TELEMETRY_NUM_COLUMNS];
+
+    BatteryStatus getStatus(size_t index) const;
+};
+
+/**
+ * Telemetry Log
+ *
+ * Appends the statuses batteries publish to a columnar telemetry log for
+ * offline analysis (see TelemetryLogReader and the telemetry_log tool).
+ * record() only copies the status into a pending buffer, so publishing a
+ * status never waits on the disk. A writer thread moves pending statuses
+ * into a buffer per battery and appends a segment when a buffer is full or
+ * its oldest status has waited flushInterval. If the writer falls behind
+ * by more than TELEMETRY_MAX_PENDING statuses new statuses are dropped.
+ *
+ * Opening an existing log appends to it. A segment torn by a crash at the
+ * end of the log is cut off first and the index is brought up to date.
+ *
+ * Batteries take the process-wide log (getTelemetryLog()) when they are
+ * created and record every status they add to their status history.
+ *
+ * @param path:           path of the log
+ * @param fd:             log opened for appending (-1 if it could not be opened)
+ * @param indexFd:        index opened for appending
+ * @param logLength:      bytes in the log (offset of the next segment)
+ * @param segmentSize:    samples per segment
+ * @param flushInterval:  longest time a status waits in a buffer before it is written
+ * @param lock:           protects pending and the counters
+ * @param flushSignal:    wakes the writer thread
+ * @param flushedSignal:  wakes flush() callers
+ * @param pending:        statuses recorded since the writer thread last ran
+ * @param buffers:        statuses of each battery waiting for a full segment (writer thread only)
+ * @param quit:           stops the writer thread
+ * @param flushRequests:  number of flush() calls
+ * @param flushesDone:    number of flush() calls the writer thread has served
+ * @param numSamples:     number of samples written
+ * @param numSegments:    number of segments written
+ * @param numDropped:     number of statuses dropped because the writer fell behind
+ * @param writer:         writer thread
+ */
+class TelemetryLog {
+    private:
+        struct PendingStatus {
+            battery_id_t batteryID;
+            BatteryStatus status;
+        };
+
+        struct Buffer {
+            std::string batteryName;
+            std::vector<BatteryStatus> statuses;
+            std::chrono::steady_clock::time_point firstTime;
+        };
+
+        std::string path;
+        int fd;
+        int indexFd;
+        size_t logLength;
+        size_t segmentSize;
+        std::chrono::milliseconds flushInterval;
+        std::mutex lock;
+        std::condition_variable flushSignal;
+        std::condition_variable flushedSignal;
+        std::vector<PendingStatus> pending;
+        std::unordered_map<battery_id_t, Buffer> buffers;
+        bool quit;
+        uint64_t flushRequests;
+        uint64_t flushesDone;
+        uint64_t numSamples;
+        uint64_t numSegments;
+        uint64_t numDropped;
+        std::thread writer;
+
+    public:
+        ~TelemetryLog();
+        TelemetryLog(const std::string &path, size_t segmentSize = TELEMETRY_SEGMENT_SIZE,
+                     std::chrono::milliseconds flushInterval = std::chrono::milliseconds(TELEMETRY_FLUSH_INTERVAL_MS));
+        TelemetryLog(const TelemetryLog&) = delete;
+        TelemetryLog& operator=(const TelemetryLog&) = delete;
+
+    /**
+     * Private Helper Functions
+     *
+     * @func open:         opens the log and its index, cuts a torn segment off the log and indexes the segments the index is missing
+     * @func run:          writer thread
+     * @func encode:       appends a segment of numStatuses statuses to buffer and its index entry to index
+     * @func writeBuffers: appends a segment for every buffer that is full, has waited flushInterval or (if all) is not empty
+     */
+
+    private:
+        bool open();
+        void run();
+        void encode(const std::string &batteryName, const BatteryStatus* statuses, size_t numStatuses, std::string &buffer, std::string &index);
+        void writeBuffers(bool all);
+
+    /**
+     * Public Functions
+     *
+     * @func isOpen:         returns if statuses can be appended to the log
+     * @func record:         queues a status of a battery to be written
+     * @func flush:          writes every queued status (partial segments too) and waits for the write
+     * @func getNumSamples:  returns the number of samples written
+     * @func getNumSegments: returns the number of segments written
+     * @func getNumDropped:  returns the number of statuses dropped
+     */
+
+    public:
+        bool isOpen() const;
+        void record(battery_id_t batteryID, const BatteryStatus &status);
+        void flush();
+        uint64_t getNumSamples();
+        uint64_t getNumSegments();
+        uint64_t getNumDropped();
+};
+
+/**
+ * Telemetry Log Reader
+ *
+ * Maps a telemetry log into memory and loads the headers of its segments
+ * by battery when it is opened (from the index). A scan only touches the
+ * segments of the battery whose time range overlaps the scan and decodes
+ * only the columns asked for. Segments appended after the log was opened
+ * are not seen, and a segment that fails its checksum is skipped.
+ *
+ * @param path:     path of the log
+ * @param fd:       log opened for reading (-1 if it could not be opened)
+ * @param data:     the log mapped into memory
+ * @param length:   bytes of the log that were mapped
+ * @param segments: offset and header of every segment of each battery, in the order they were written
+ */
+class TelemetryLogReader {
+    private:
+        struct Segment {
+            size_t offset;
+            TelemetrySegmentHeader header;
+        };
+
+        std::string path;
+        int fd;
+        const char* data;
+        size_t length;
+        std::unordered_map<std::string, std::vector<Segment>> segments;
+
+    public:
+        ~TelemetryLogReader();
+        TelemetryLogReader(const std::string &path);
+        TelemetryLogReader(const TelemetryLogReader&) = delete;
+        TelemetryLogReader& operator=(const TelemetryLogReader&) = delete;
+
+    /**
+     * Private Helper Functions
+     *
+     * @func decode: decodes the columns of a segment (false if it is not in the log or fails its checksum)
+     */
+
+    private:
+        bool decode(const Segment &segment, uint32_t columns, TelemetryColumns &samples) const;
+
+    /**
+     * Public Functions
+     *
+     * @func isOpen:          returns if the log was mapped
+     * @func getBatteryNames: returns the name of every battery in the log
+     * @func getSegments:     returns the headers of every segment of a battery (the min/max index of the log)
+     * @func scan:            calls visit with the samples of a battery with a time in [startTime, endTime], a
+     *                        segment at a time oldest first, decoding only the columns set in the columns mask
+     *                        (returns the number of samples visited)
+     * @func read:            returns the statuses of a battery with a time in [startTime, endTime]
+     */
+
+    public:
+        bool isOpen() const;
+        std::vector<std::string> getBatteryNames() const;
+        std::vector<TelemetrySegmentHeader> getSegments(const std::string &batteryName) const;
+        size_t scan(const std::string &batteryName, uint64_t startTime, uint64_t endTime,
+                    const std::function<void(const TelemetryColumns&)> &visit, uint32_t columns = TELEMETRY_ALL_COLUMNS) const;
+        std::vector<BatteryStatus> read(const std::string &batteryName, uint64_t startTime, uint64_t endTime) const;
+};
+
+/**
+ * Process-wide telemetry log used by newly created batteries
+ *
+ * @func getTelemetryLog: returns the log (nullptr by default, nothing is logged)
+ * @func setTelemetryLog: replaces the log
+ */
+std::shared_ptr<TelemetryLog> getTelemetryLog(void);
+void setTelemetryLog(std::shared_ptr<TelemetryLog> log);
+
+#endif
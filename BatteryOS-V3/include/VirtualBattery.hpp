@@ -14,6 +14,9 @@
  * @func set_current:              set the current of the battery
  * @func setMaxChargingCurrent:    sets the charging current of the battery
  * @func setMaxDischargingCurrent: sets the discharging current of the battery
+ * @func setShare:                 sets the capacity, max capacity, max currents, max temperature and protection flags
+ *                                 of the battery and publishes them
+ * @func restore_set_current:      schedules a restored set_current request (its share has to reach the parents)
  */
 
 class VirtualBattery: public Battery {
@@ -32,6 +35,9 @@ class VirtualBattery: public Battery {
         std::string getBatteryString() const override; 
         void setMaxChargingCurrent(double current_mA);
         void setMaxDischargingCurrent(double current_mA);
+        void setShare(double capacity_mAh, double max_capacity_mAh, double max_charging_current_mA, double max_discharging_current_mA,
+                      uint16_t max_temperature_dK, uint16_t protection_flags);
+        bool restore_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime) override;
 
     protected:
         BatteryStatus refresh() override;
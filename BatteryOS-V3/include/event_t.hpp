@@ -7,6 +7,7 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include "BatteryID.hpp"
 
 using timepoint_t = std::chrono::time_point<std::chrono::system_clock, std::chrono::milliseconds>;
 
@@ -31,7 +32,7 @@ enum class EventID : int {
 * @param eventID:        defines kind of event
 * @param eventTime:      specifies time when event happens
 * @param current_mA:     target current for a SET_CURRENT_* event, set to 0 for a REFRESH event
-* @param batteryName:    name of the battery that created event
+* @param batteryID:      ID of the battery that created event
 * @param sequenceNumber: sequence number of event; used for ordering multiple events happening at same time
 * @param sourceSequenceNumber: sequence number of event that source battery uses; used so that child can cancel event from source battery (0 if the battery does not have a source)
 */
@@ -40,15 +41,15 @@ struct event_t {
         EventID eventID;   
         double current_mA;
         timepoint_t eventTime;
-        std::string batteryName;
+        battery_id_t batteryID;
         uint64_t sequenceNumber;
 
     public:
-        event_t(std::string name, EventID event, int64_t current_mA, timepoint_t time, uint64_t sequenceNumber) {
+        event_t(battery_id_t batteryID, EventID event, int64_t current_mA, timepoint_t time, uint64_t sequenceNumber) {
             this->eventID              = event;
             this->eventTime            = time;
             this->current_mA           = current_mA;
-            this->batteryName          = name;
+            this->batteryID            = batteryID;
             this->sequenceNumber       = sequenceNumber;
         }
         
@@ -1,21 +1,145 @@
 #ifndef IEC61850_HPP
 #define IEC61850_HPP
 
+#include <map>
 #include <array>
 #include <tuple>
+#include <mutex>
+#include <memory>
+#include <vector>
 #include <sstream>
 #include <fcntl.h>
 #include <errno.h>
 #include <algorithm>
+#include <condition_variable>
 #include "BatteryInterface.hpp"
 #include "hal_thread.h"
 #include "iec61850_client.h"
 #include "PhysicalBattery.hpp"
 
+/**************************************************************************
+ * IEC61850 Report Cache
+ *
+ * Last report of the status dataset of a battery, written by the report
+ * handler on the connection thread. The handler is given the cache instead
+ * of the battery, and the connection keeps the cache of a report control
+ * block until it is closed or the report control block is reused, so a
+ * report handled while the battery is being destroyed never touches freed
+ * memory.
+ * ************************************************************************/
+struct IEC61850ReportCache {
+    std::mutex lock;
+    std::shared_ptr<BatteryClock> clock;
+    std::array<float, 4> values;
+    std::array<bool, 4> fields;
+    monotonic_t time;
+    uint64_t reports;
+
+    IEC61850ReportCache(std::shared_ptr<BatteryClock> clock);
+};
+
+/**************************************************************************
+ * IEC61850 Connection
+ *
+ * TLS connection to an IEC61850 server, shared by every IEC61850 battery
+ * whose logical device is on that server (one connection per hostname and
+ * port, closed when the last battery using it is destroyed). libiec61850
+ * matches responses to requests by invoke ID, so requests of different
+ * batteries are pipelined on the shared connection instead of waiting for
+ * one another, up to MAX_OUTSTANDING_REQUESTS at once. libiec61850 fails a
+ * request beyond its outstanding call limit instead of queuing it, so a
+ * battery holds a Request for as long as it has one outstanding.
+ * ************************************************************************/
+class IEC61850Connection {
+    public:
+        IedConnection con;
+        TLSConfiguration config;
+
+        /*****************************************************************
+         * Requests outstanding on a connection at once (the default
+         * outstanding call limit of an MMS client in libiec61850)
+         * ***************************************************************/
+        static const int MAX_OUTSTANDING_REQUESTS = 5;
+
+        /*****************************************************************
+         * Slot for a request (or a series of requests sent one after the
+         * other) on a connection, waiting for a free one if every slot
+         * is taken and freeing it when it goes out of scope
+         * ***************************************************************/
+        class Request {
+            public:
+                Request(IEC61850Connection &connection);
+                ~Request();
+
+            private:
+                IEC61850Connection &connection;
+        };
+
+    private:
+        static std::mutex poolLock;
+        static std::map<std::string, std::weak_ptr<IEC61850Connection>> pool;
+
+        std::mutex cacheLock;
+        std::map<std::string, std::shared_ptr<IEC61850ReportCache>> reportCaches;
+
+        std::mutex requestLock;
+        std::condition_variable requestFinished;
+        int outstandingRequests;
+
+    public:
+        ~IEC61850Connection();
+        IEC61850Connection(const IEC61850Connection&) = delete;
+        IEC61850Connection& operator=(const IEC61850Connection&) = delete;
+
+        /*****************************************************************
+         * Returns the connection to hostname:tcpPort, connecting first if
+         * there is no open connection to it (nullptr if connecting fails)
+         * ***************************************************************/
+        static std::shared_ptr<IEC61850Connection> acquire(const std::string &hostname, int tcpPort);
+
+        /**********************************
+         * Number of open pooled connections
+         * ********************************/
+        static size_t getConnectionCount();
+
+        /*****************************************************************
+         * Keeps the report cache of a report control block until the
+         * connection (and its thread, which may still be handling a
+         * report) is destroyed, or until the report control block gets a
+         * new report handler (which releases the cache of the old one)
+         * ***************************************************************/
+        void retain(const std::string &reportReference, std::shared_ptr<IEC61850ReportCache> cache);
+
+    private:
+        IEC61850Connection(IedConnection con, TLSConfiguration config);
+};
+
+/**************************************************************************
+ * IEC61850 Battery
+ *
+ * Reads the status of a battery from the ZBAT logical node of an IEC61850
+ * server in one of three ways (fastest first):
+ *  - reports:   a report control block on the server pushes the status
+ *               dataset whenever a value changes (and once every integrity
+ *               period), and refresh() copies the last report as long as
+ *               it is not older than maxStaleness
+ *  - dataset:   refresh() reads the status dataset in a single request
+ *  - attribute: refresh() reads Vol, Amp, AhrRtg and MaxBatA one by one
+ * refresh() falls back to a dataset read (or attribute reads) whenever the
+ * last report is too old.
+ *
+ * The status dataset holds ZBAT Vol.mag.f [MX], Amp.mag.f [MX],
+ * AhrRtg.setMag.f [SP] and MaxBatA.setMag.f [SP] in this order (as FCDAs,
+ * or as FCDs whose first leaf is the value).
+ *
+ * set_current() writes the ZBTC and ZINV attributes in a single MMS
+ * write request. Every request to the server waits for a request slot of
+ * the shared connection.
+ * ************************************************************************/
 class IEC61850 : public PhysicalBattery {
     public:
         /****************
-         * Destructor 
+         * Destructor
          * **************/
         ~IEC61850();
 
@@ -26,30 +150,47 @@ class IEC61850 : public PhysicalBattery {
         std::string getBatteryString() const override;
         bool set_current(double current_mA) override;
 
-        /*****************
+        /*****************************************************************
          * Constructors
-         * ***************/
-        IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, 
+         * - dataSetName (optional): status dataset relative to the logical
+         *   device, e.g. "LLN0.BatteryStatus"
+         * - reportName (optional): report control block sending the status
+         *   dataset relative to the logical device, e.g.
+         *   "LLN0.RP.BatteryStatusRCB01" (unbuffered) or "LLN0.BR.BatteryStatusRCB01"
+         * ***************************************************************/
+        IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name,
         std::string ZBAT_Name, std::string ZBTC_Name, std::string ZINV_Name);
-        IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, 
-        std::string ZBAT_Name, std::string ZBTC_Name, std::string ZINV_Name, std::string hostname, int tcpPort);
+        IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name,
+        std::string ZBAT_Name, std::string ZBTC_Name, std::string ZINV_Name, std::string hostname, int tcpPort,
+        std::string dataSetName = "", std::string reportName = "");
 
     private:
         /*****************************************************************
-         * Variables to estalish IED Connection and track any errors that 
-         * may occur when trying to read and write data to/from server
+         * Variables to estalish IED Connection (con is the IedConnection
+         * of the pooled connection). Every request keeps its own error,
+         * since batteries on the same connection send requests at once.
          * ***************************************************************/
+        std::shared_ptr<IEC61850Connection> connection;
         IedConnection con;
-        IedClientError error;
-        TLSConfiguration config;
+        bool connected;
 
         /*************************************************************
-         * Names of the IEC61850 Logical Device on the server as well 
+         * Names of the IEC61850 Logical Device on the server as well
          * as the names of the Logical Nodes for ZBAT, ZBTC, and ZINV
          * ***********************************************************/
         std::string LogicalDevice_Name;
         std::string ZBAT_Name, ZBTC_Name, ZINV_Name;
 
+        /*****************************************************************
+         * Status dataset and report control block (empty if not used).
+         * The last report is kept in reportCache (under its lock, which
+         * is never held across a request to the server because reports
+         * are handled on the connection thread).
+         * ***************************************************************/
+        std::string dataSetReference;
+        std::string reportReference;
+        std::shared_ptr<IEC61850ReportCache> reportCache;
+
         /*******************************************************
          * Helper Functions to start client/server connection
          * and check errors that may occur when reading/writing
@@ -57,6 +198,17 @@ class IEC61850 : public PhysicalBattery {
          * *****************************************************/
         bool check_MmsValue(MmsValue* value);
         bool create_iec61850_client(std::string hostname, int tcpPort);
+        bool enable_reporting();
+        void disable_reporting();
+        bool read_attributes(std::array<float, 4> &values);
+        bool read_dataset(std::array<float, 4> &values);
+        bool write_values(std::vector<std::pair<std::string, MmsValue*>> writes);
+        void set_status(const std::array<float, 4> &values);
+        static bool to_float(const MmsValue* value, float &result);
+        static void report_handler(void* parameter, ClientReport report);
+
+    public:
+        uint64_t getReportCount();
 };
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 #include <sstream>
+#include <stdint.h>
 #include <iostream>
 #include <unistd.h>
 #include <openssl/ssl.h>
@@ -100,6 +101,13 @@ namespace util {
 
     size_t SSL_read_exact(SSL* fd, char* buffer, size_t num_bytes);
     size_t SSL_write_exact(SSL* fd, char* buffer, size_t num_bytes);
+
+    // every message is sent with a single write, so Nagle's algorithm
+    // only delays responses behind the peer's delayed ACK
+    void set_nodelay(int fd);
+
+    // CRC-32 (the polynomial of zlib and Ethernet), continued from crc
+    uint32_t crc32(const char* data, size_t length, uint32_t crc = 0);
 }
 
 #endif
@@ -1,8 +1,12 @@
 #include "Acceptor.hpp"
 
 #include <cerrno>
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 #include "util.hpp"
 
 Acceptor::Acceptor(in_addr_t addr, int port, int backlog, std::function<void(Socket *)> connectHandler) 
@@ -48,11 +52,127 @@ struct pollfd Acceptor::pollInfo() {
 }
 
 void Acceptor::pollHandler() {
-    Socket* socket = new Socket(accept(this->fd, NULL, NULL));
+    int fd = accept(this->fd, NULL, NULL);
+    util::set_nodelay(fd);
+    Socket* socket = new Socket(fd);
     this->connectHandler(socket);
 }
 
+TLSAcceptor::Handshake::Handshake(TLSAcceptor* acceptor, TLSSocket* socket) 
+    : acceptor(acceptor), socket(socket), started(std::chrono::steady_clock::now()) {}
+
+struct pollfd TLSAcceptor::Handshake::pollInfo() {
+    return this->socket->pollInfo();
+}
+
+void TLSAcceptor::Handshake::pollHandler() {
+    this->acceptor->continueHandshake(this->socket->fd);
+}
+
+TLSAcceptor::SweepTimer::SweepTimer(TLSAcceptor* acceptor) : acceptor(acceptor), fd(-1) {
+#ifdef __linux__
+    this->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (this->fd == -1)
+        WARNING() << "could not create handshake timer: " << strerror(errno) << std::endl;
+#endif
+}
+
+TLSAcceptor::SweepTimer::~SweepTimer() {
+    if (this->fd != -1)
+        close(this->fd);
+}
+
+struct pollfd TLSAcceptor::SweepTimer::pollInfo() {
+    struct pollfd fd = {this->fd, POLLIN, 0};
+    return fd;
+}
+
+void TLSAcceptor::SweepTimer::pollHandler() {
+    uint64_t expirations;
+    if (::read(this->fd, &expirations, sizeof(expirations)) == -1)
+        return;
+
+    this->acceptor->sweepArmed = false;
+    this->acceptor->dropStaleHandshakes();
+}
+
+TLSAcceptor::TLSAcceptor(in_addr_t addr, int port, int backlog, std::function<void(Socket *)> connectHandler, NetService* servicer) 
+    : Acceptor(addr, port, backlog, connectHandler), servicer(servicer), sweepArmed(false) {
+    this->sweepTimer = std::make_shared<SweepTimer>(this);
+    if (this->sweepTimer->fd != -1)
+        this->servicer->add(this->sweepTimer);
+}
+
+void TLSAcceptor::continueHandshake(int fd) {
+    auto iter = this->handshakes.find(fd);
+    if (iter == this->handshakes.end())
+        return;
+
+    // keep the handshake alive after it is erased since this may run inside its pollHandler
+    std::shared_ptr<Handshake> handshake = iter->second;
+    int result = handshake->socket->continueAccept();
+    if (result == 0)
+        return;
+
+    this->handshakes.erase(iter);
+    if (result == -1)
+        return;
+
+    this->connectHandler(handshake->socket.release());
+}
+
+void TLSAcceptor::dropStaleHandshakes() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (auto iter = this->handshakes.begin(); iter != this->handshakes.end();) {
+        if (now - iter->second->started > HANDSHAKE_TIMEOUT) {
+            WARNING() << "dropping TLS handshake that did not complete in time" << std::endl;
+            iter = this->handshakes.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    this->armSweep();
+}
+
+void TLSAcceptor::armSweep() {
+    if (this->sweepArmed || this->sweepTimer->fd == -1 || this->handshakes.empty())
+        return;
+
+#ifdef __linux__
+    std::chrono::steady_clock::time_point oldest = std::chrono::steady_clock::time_point::max();
+    for (const auto &iter : this->handshakes)
+        oldest = std::min(oldest, iter.second->started);
+
+    // at least 1 ms, since a zero timer is disarmed instead
+    std::chrono::steady_clock::duration delay = oldest + HANDSHAKE_TIMEOUT - std::chrono::steady_clock::now();
+    int64_t delay_ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count(), 1000000) + 1000000;
+
+    struct itimerspec timer = {};
+    timer.it_value.tv_sec  = delay_ns / 1000000000;
+    timer.it_value.tv_nsec = delay_ns % 1000000000;
+    if (timerfd_settime(this->sweepTimer->fd, 0, &timer, NULL) == -1) {
+        WARNING() << "could not arm handshake timer: " << strerror(errno) << std::endl;
+        return;
+    }
+    this->sweepArmed = true;
+#endif
+}
+
 void TLSAcceptor::pollHandler() {
-    Socket* socket = TLSSocket::accept(accept(this->fd, NULL, NULL));
-    this->connectHandler(socket);
+    int fd = accept(this->fd, NULL, NULL);
+    if (fd == -1) {
+        WARNING() << "could not accept connection: " << strerror(errno) << std::endl;
+        return;
+    }
+    util::set_nodelay(fd);
+
+    this->dropStaleHandshakes();
+
+    std::shared_ptr<Handshake> handshake = std::make_shared<Handshake>(this, TLSSocket::accept(fd));
+    this->handshakes[fd] = handshake;
+    this->servicer->add(handshake);
+    this->armSweep();
+
+    // the client hello has usually arrived by now
+    this->continueHandshake(fd);
 }
@@ -487,3 +487,22 @@ bool Admin::createSecureBattery(const std::string& name, uint64_t num_clients)
         return false;
     return true;  
 }
+
+bool Admin::reloadDrivers()
+{
+    bosproto::Admin_Command command;
+    bosproto::AdminResponse response;
+
+    command.set_command_options(bosproto::Command_Options::Reload_Drivers);
+    this->clientSocket->write(command);
+
+    int success = this->clientSocket->read(response);
+
+    if (!success) {
+        WARNING() << "could not parse admin response" << std::endl;
+        return false;
+    }
+
+    LOG() << response.success_message() << std::endl;
+    return response.return_code() != -1;
+}
@@ -1,7 +1,25 @@
 #include "AggregateBattery.hpp"
 
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+#include "DispatchPool.hpp"
+
+/**
+ * Requests are fanned out to the parents on one pool shared by every
+ * aggregate (the thread calling runAll() helps, so nested aggregates do
+ * not need more threads than this).
+ */
+static DispatchPool& fanoutPool() {
+    static DispatchPool pool(std::max(2u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
 AggregateBattery::~AggregateBattery() {
     PRINT() << "AGGREGATE DESTRUCTOR" << std::endl;
+    for (std::shared_ptr<Battery> battery : this->parents)
+        battery->removeSubscriber(this);
     if (!quitThread)
         quit();
 }
@@ -16,13 +34,29 @@ AggregateBattery::AggregateBattery(const std::string &batteryName,
     this->type = BatteryType::Aggregate;
     this->parents = parentBatteries;      
 
-    this->eventThread = std::thread(&AggregateBattery::runEventThread, this);
-    
-    this->eventSet.insert(event_t(this->batteryName,
-                                  EventID::REFRESH,
-                                  0,
-                                  getTimeNow(),
-                                  getSequenceNumber()));
+    this->total_current_mA       = 0;
+    this->total_capacity_mAh     = 0;
+    this->total_max_capacity_mAh = 0;
+    this->total_charge_energy    = 0;
+    this->total_discharge_energy = 0;
+    std::fill(std::begin(this->protectionCounts), std::end(this->protectionCounts), 0);
+
+    // every parent starts out with an empty status, which
+    // addSubscriber() replaces with the parent's current status
+    this->parentStatuses.resize(this->parents.size());
+    this->parentTimes = std::vector<std::atomic<uint64_t>>(this->parents.size());
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        this->parentIndex[this->parents[i].get()] = i;
+        this->addToTotals(this->parentStatuses[i]);
+    }
+
+    for (std::shared_ptr<Battery> battery : this->parents) {
+        battery->getFreshStatus(); // refreshes lazy parents
+        battery->addSubscriber(this);
+    }
+
+    lockguard_t mutexLock(this->lock);
+    this->scheduleRefresh(this->clock->monotonicNow());
     // at some point need to ensure parent battery currents
     // are at zero when first constructing the aggregate battery
 }
@@ -33,45 +67,97 @@ double AggregateBattery::calc_c_rate(const double &current_mA, const double &cap
     return current_mA/capacity_mAh;
 }
 
-void AggregateBattery::set_c_rate() {
-    std::vector<double> eff_charge_c_rates;
-    std::vector<double> eff_discharge_c_rates;
+std::pair<double, double> AggregateBattery::calc_c_rates(const BatteryStatus &pStatus) {
+    double charge_c_rate    = this->calc_c_rate(pStatus.max_charging_current_mA, (pStatus.max_capacity_mAh - pStatus.capacity_mAh));
+    double discharge_c_rate = this->calc_c_rate(pStatus.max_discharging_current_mA, pStatus.capacity_mAh);
+    return {charge_c_rate, discharge_c_rate};
+}
 
-    for (std::shared_ptr<Battery> battery : this->parents) {
-        BatteryStatus pStatus = battery->getStatus();
+void AggregateBattery::addToTotals(const BatteryStatus &pStatus) {
+    // a NaN would never be found again by removeFromTotals()
+    std::pair<double, double> c_rates = this->calc_c_rates(pStatus);
+    if (std::isfinite(c_rates.first))
+        this->chargeCRates.insert(c_rates.first);
+    if (std::isfinite(c_rates.second))
+        this->dischargeCRates.insert(c_rates.second);
 
-        double charge_c_rate    = this->calc_c_rate(pStatus.max_charging_current_mA, (pStatus.max_capacity_mAh - pStatus.capacity_mAh));
-        double discharge_c_rate = this->calc_c_rate(pStatus.max_discharging_current_mA, pStatus.capacity_mAh);
+    this->total_current_mA       += pStatus.current_mA;
+    this->total_capacity_mAh     += pStatus.capacity_mAh;
+    this->total_max_capacity_mAh += pStatus.max_capacity_mAh;
+    this->total_charge_energy    += (pStatus.max_capacity_mAh - pStatus.capacity_mAh) * pStatus.voltage_mV;
+    this->total_discharge_energy += pStatus.capacity_mAh * pStatus.voltage_mV;
 
-        eff_charge_c_rates.push_back(charge_c_rate);
-        eff_discharge_c_rates.push_back(discharge_c_rate);
-    }
+    if (pStatus.max_temperature_dK != 0)
+        this->temperatures.insert(pStatus.max_temperature_dK);
+    for (int bit = 0; bit < 16; bit++)
+        this->protectionCounts[bit] += (pStatus.protection_flags >> bit) & 1;
+}
 
-    auto min = [] (const std::vector<double>& s) -> double {
-        double minValue = s[0];
-        for (double val : s) {
-            if (val < minValue)
-                minValue = val;
-        }
-        return minValue;
-    }; 
+void AggregateBattery::removeFromTotals(const BatteryStatus &pStatus) {
+    std::pair<double, double> c_rates = this->calc_c_rates(pStatus);
+    if (std::isfinite(c_rates.first))
+        this->chargeCRates.erase(this->chargeCRates.find(c_rates.first));
+    if (std::isfinite(c_rates.second))
+        this->dischargeCRates.erase(this->dischargeCRates.find(c_rates.second));
+
+    this->total_current_mA       -= pStatus.current_mA;
+    this->total_capacity_mAh     -= pStatus.capacity_mAh;
+    this->total_max_capacity_mAh -= pStatus.max_capacity_mAh;
+    this->total_charge_energy    -= (pStatus.max_capacity_mAh - pStatus.capacity_mAh) * pStatus.voltage_mV;
+    this->total_discharge_energy -= pStatus.capacity_mAh * pStatus.voltage_mV;
 
-    this->eff_charge_c_rate    = min(eff_charge_c_rates);
-    this->eff_discharge_c_rate = min(eff_discharge_c_rates);
+    if (pStatus.max_temperature_dK != 0)
+        this->temperatures.erase(this->temperatures.find(pStatus.max_temperature_dK));
+    for (int bit = 0; bit < 16; bit++)
+        this->protectionCounts[bit] -= (pStatus.protection_flags >> bit) & 1;
+}
+
+BatteryStatus AggregateBattery::statusFromTotals() {
+    BatteryStatus newStatus{};
+
+    this->eff_charge_c_rate    = this->chargeCRates.empty() ? 0 : *this->chargeCRates.begin();
+    this->eff_discharge_c_rate = this->dischargeCRates.empty() ? 0 : *this->dischargeCRates.begin();
+
+    newStatus.current_mA       = this->total_current_mA;
+    newStatus.capacity_mAh     = this->total_capacity_mAh;
+    newStatus.max_capacity_mAh = this->total_max_capacity_mAh;
+
+    newStatus.max_charging_current_mA    = (this->total_max_capacity_mAh - this->total_capacity_mAh) * this->eff_charge_c_rate;
+    newStatus.max_discharging_current_mA = this->total_capacity_mAh * this->eff_discharge_c_rate;
+
+    if (newStatus.max_charging_current_mA != 0)
+        newStatus.voltage_mV = (double)(this->total_charge_energy * this->eff_charge_c_rate / newStatus.max_charging_current_mA); // report charge voltage always 
+    else if (newStatus.max_discharging_current_mA != 0)
+        newStatus.voltage_mV = (double)(this->total_discharge_energy * this->eff_discharge_c_rate / newStatus.max_discharging_current_mA);
+
+    if (!this->temperatures.empty())
+        newStatus.max_temperature_dK = *this->temperatures.rbegin();
+    for (int bit = 0; bit < 16; bit++) {
+        if (this->protectionCounts[bit] > 0)
+            newStatus.protection_flags |= 1 << bit;
+    }
 
-    return;
+    newStatus.time = convertToMilliseconds(this->clock->now());
+
+    return newStatus;
 }
 
-BatteryStatus AggregateBattery::calcStatusVals() {
-    this->set_c_rate();
-   
+BatteryStatus AggregateBattery::calcStatusVals(const std::vector<BatteryStatus> &pStatuses) {
     BatteryStatus newStatus{};    
+    double eff_charge_c_rate             = 0;
+    double eff_discharge_c_rate          = 0;
     double max_effective_charge_power    = 0; 
     double max_effective_discharge_power = 0; 
 
-    for (std::shared_ptr<Battery> battery : this->parents) {
-        BatteryStatus pStatus = battery->getStatus();
+    for (size_t i = 0; i < pStatuses.size(); i++) {
+        std::pair<double, double> c_rates = this->calc_c_rates(pStatuses[i]);
+        if (i == 0 || c_rates.first < eff_charge_c_rate)
+            eff_charge_c_rate = c_rates.first;
+        if (i == 0 || c_rates.second < eff_discharge_c_rate)
+            eff_discharge_c_rate = c_rates.second;
+    }
 
+    for (const BatteryStatus &pStatus : pStatuses) {
         newStatus.current_mA += pStatus.current_mA;
         newStatus.capacity_mAh += pStatus.capacity_mAh;
         newStatus.max_capacity_mAh += pStatus.max_capacity_mAh;
@@ -79,42 +165,76 @@ BatteryStatus AggregateBattery::calcStatusVals() {
         double chargeCapacity    = pStatus.max_capacity_mAh - pStatus.capacity_mAh;
         double dischargeCapacity = pStatus.capacity_mAh; 
         
-        newStatus.max_charging_current_mA    += (double)(chargeCapacity * this->eff_charge_c_rate);
-        newStatus.max_discharging_current_mA += (double)(dischargeCapacity  * this->eff_discharge_c_rate);
+        newStatus.max_charging_current_mA    += (double)(chargeCapacity * eff_charge_c_rate);
+        newStatus.max_discharging_current_mA += (double)(dischargeCapacity  * eff_discharge_c_rate);
 
-        max_effective_charge_power    += (chargeCapacity * this->eff_charge_c_rate) * pStatus.voltage_mV;
-        max_effective_discharge_power += (dischargeCapacity * this->eff_discharge_c_rate) * pStatus.voltage_mV;
+        max_effective_charge_power    += (chargeCapacity * eff_charge_c_rate) * pStatus.voltage_mV;
+        max_effective_discharge_power += (dischargeCapacity * eff_discharge_c_rate) * pStatus.voltage_mV;
+
+        newStatus.max_temperature_dK = std::max(newStatus.max_temperature_dK, pStatus.max_temperature_dK);
+        newStatus.protection_flags  |= pStatus.protection_flags;
     }
     
     if (newStatus.max_charging_current_mA != 0)
         newStatus.voltage_mV = (double)(max_effective_charge_power / newStatus.max_charging_current_mA); // report charge voltage always 
-    else
+    else if (newStatus.max_discharging_current_mA != 0)
         newStatus.voltage_mV = (double)(max_effective_discharge_power / newStatus.max_discharging_current_mA); // report charge voltage always 
 
-    newStatus.time = convertToMilliseconds(getTimeNow());
+    newStatus.time = convertToMilliseconds(this->clock->now());
 
     return newStatus;
 }
 
-// should you move BatteryStatus instead of copy? 
-// maybe do later  if you want to increase performance
-// on a refresh show the discharge battery voltage
+// the running totals are kept up to date by parentStatusChanged(),
+// so a refresh no longer has to read every parent
 BatteryStatus AggregateBattery::refresh() {
-    PRINT() << "Aggregate Battery Refresh!!!" << std::endl;
-    return this->calcStatusVals();
+    return this->statusFromTotals();
+}
+
+// called without the lock: a parent that refreshes pushes its
+// status to parentStatusChanged(), which takes it
+void AggregateBattery::refreshParents() {
+    timepoint_t currentTime = this->clock->now();
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        timepoint_t pushed = convertToTimestamp(this->parentTimes[i].load(std::memory_order_relaxed));
+        if (std::chrono::abs(currentTime - pushed) > this->maxStaleness.load())
+            this->parents[i]->getStatus();
+    }
 }
 
-bool AggregateBattery::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) {
-    timepoint_t currentTime = getTimeNow(); 
+void AggregateBattery::parentStatusChanged(Battery *parent, const BatteryStatus &parentStatus) {
+    std::unique_lock<lock_t> mutexLock(this->lock);
+    auto iter = this->parentIndex.find(parent);
+    if (iter == this->parentIndex.end())
+        return;
+
+    BatteryStatus &pStatus = this->parentStatuses[iter->second];
+    this->removeFromTotals(pStatus);
+    pStatus = parentStatus;
+    this->addToTotals(pStatus);
+    this->parentTimes[iter->second].store(parentStatus.time, std::memory_order_relaxed);
+
+    this->status = this->statusFromTotals();
+    this->publishStatus();
+    mutexLock.unlock();
+
+    this->notifySubscribers();
+}
+
+bool AggregateBattery::prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) {
+    timepoint_t currentTime = this->clock->now(); 
 
     if (checkIfZero(this->status))
         std::this_thread::sleep_for(std::chrono::milliseconds(1000)); 
 
+    this->refreshParents();
     this->lock.lock();
     this->status = this->checkAndRefresh();
+    this->publishStatus();
     this->lock.unlock();
+    this->notifySubscribers();
     
-    if (name == this->batteryName) {
+    if (requester == this->batteryID) {
         if (startTime < currentTime) {
             WARNING() << "start time of event has already passed!" << std::endl;
             return false; 
@@ -129,27 +249,117 @@ bool AggregateBattery::schedule_set_current(double current_mA, timepoint_t start
 
     double c_rate = this->calc_c_rate(current_mA, this->status.capacity_mAh);
 
-    for (std::shared_ptr<Battery> battery : this->parents) {
-        double target_current_mA;
-    
-        BatteryStatus pStatus    = battery->getStatus();
-        double chargeCapacity    = pStatus.max_capacity_mAh - pStatus.capacity_mAh;
-        double dischargeCapacity = pStatus.capacity_mAh; 
+    std::vector<double> target_currents_mA;
+    {
+        lockguard_t mutexLock(this->lock);
+        for (const BatteryStatus &pStatus : this->parentStatuses) {
+            double chargeCapacity    = pStatus.max_capacity_mAh - pStatus.capacity_mAh;
+            double dischargeCapacity = pStatus.capacity_mAh; 
 
-        if (current_mA < 0) 
-            target_current_mA = (double)(-chargeCapacity * c_rate);
-        else
-            target_current_mA = (double)(dischargeCapacity * c_rate);
-        
-        if (!battery->schedule_set_current(target_current_mA, startTime, endTime, name, sequenceNumber)) {
-            WARNING() << "schedule_set_current command failed for one of the parent batteries ... command unsuccessful" << std::endl;
-            return false;
+            if (current_mA < 0) 
+                target_currents_mA.push_back((double)(-chargeCapacity * c_rate));
+            else
+                target_currents_mA.push_back((double)(dischargeCapacity * c_rate));
         }
-    } 
+    }
+
+    // prepare: hold the share of every parent at once, so the request
+    // takes as long as the slowest parent instead of their sum (nothing
+    // is scheduled on any parent until the request is committed)
+    std::unique_ptr<bool[]> prepared(new bool[this->parents.size()]);
+    std::vector<std::pair<battery_id_t, std::function<void()>>> tasks;
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        std::shared_ptr<Battery> battery = this->parents[i];
+        double target_current_mA = target_currents_mA[i];
+        bool *result = &prepared[i];
+        *result = false;
+        tasks.push_back({battery->getBatteryID(), [=]() {
+            *result = battery->prepare_set_current(target_current_mA, startTime, endTime, requester, sequenceNumber);
+        }});
+    }
+    fanoutPool().runAll(std::move(tasks));
+
+    size_t failed = 0;
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        if (!prepared[i])
+            failed++;
+    }
+    if (failed == 0)
+        return true;
 
+    // abort: drop the holds of the parents that accepted so a partial
+    // failure does not leave part of the request held
+    WARNING() << "schedule_set_current command failed for " << failed
+              << " of the parent batteries ... command unsuccessful" << std::endl;
+    this->abort_set_current(sequenceNumber);
+    return false;
+}
+
+/**
+ * In a diamond the first commit to reach a shared ancestor schedules the
+ * holds of every path, and the later ones find the reservation pending.
+ */
+bool AggregateBattery::commit_set_current(uint64_t sequenceNumber) {
+    std::unique_ptr<bool[]> committed(new bool[this->parents.size()]);
+    std::vector<std::pair<battery_id_t, std::function<void()>>> tasks;
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        std::shared_ptr<Battery> battery = this->parents[i];
+        bool *result = &committed[i];
+        *result = false;
+        tasks.push_back({battery->getBatteryID(), [=]() {
+            *result = battery->commit_set_current(sequenceNumber);
+        }});
+    }
+    fanoutPool().runAll(std::move(tasks));
+
+    for (size_t i = 0; i < this->parents.size(); i++) {
+        if (!committed[i])
+            return false;
+    }
+    return true;
+}
+
+bool AggregateBattery::abort_set_current(uint64_t sequenceNumber) {
+    std::vector<std::pair<battery_id_t, std::function<void()>>> tasks;
+    for (std::shared_ptr<Battery> battery : this->parents)
+        tasks.push_back({battery->getBatteryID(), [=]() { battery->abort_set_current(sequenceNumber); }});
+    fanoutPool().runAll(std::move(tasks));
     return true;
 }
 
+bool AggregateBattery::cancel_set_current(uint64_t sequenceNumber) {
+    bool canceled = false;
+    for (std::shared_ptr<Battery> battery : this->parents) {
+        if (battery->cancel_set_current(sequenceNumber))
+            canceled = true;
+    }
+    return canceled;
+}
+
+BatteryStatus AggregateBattery::recomputeStatus() {
+    std::vector<BatteryStatus> pStatuses;
+    for (std::shared_ptr<Battery> battery : this->parents)
+        pStatuses.push_back(battery->getFreshStatus());
+
+    // rebuilding from the statuses the parents pushed (rather than the
+    // rescan) keeps a push that raced with the rescan, and drops any
+    // rounding error the running totals picked up
+    lockguard_t mutexLock(this->lock);
+    this->chargeCRates.clear();
+    this->dischargeCRates.clear();
+    this->temperatures.clear();
+    std::fill(std::begin(this->protectionCounts), std::end(this->protectionCounts), 0);
+    this->total_current_mA       = 0;
+    this->total_capacity_mAh     = 0;
+    this->total_max_capacity_mAh = 0;
+    this->total_charge_energy    = 0;
+    this->total_discharge_energy = 0;
+    for (const BatteryStatus &pStatus : this->parentStatuses)
+        this->addToTotals(pStatus);
+
+    return this->calcStatusVals(pStatuses);
+}
+
 std::string AggregateBattery::getBatteryString() const {
     return "AggregateBattery";
 }
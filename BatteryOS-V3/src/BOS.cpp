@@ -8,20 +8,22 @@ BOS::~BOS() {
     delete[] this->fds;
     if (!this->hasQuit)
         this->shutdown();
-    dlclose(this->library);
 }
 
 BOS::BOS() {
+    this->mode             = BOSMode::Network;
     this->hasQuit          = true;
     this->quitPoll         = false;
+    this->recovered        = false;
     this->adminFifoFD      = -1;
     this->adminConnection      = nullptr;
     this->fds = new pollfd[1028];
+    this->drivers          = std::make_unique<DriverRegistry>(DRIVER_DIRECTORY);
     this->directoryManager = std::make_unique<BatteryDirectoryManager>();
 
-    this->library = dlopen(DYLIB_PATH("../tests/libbatterydrivers"), RTLD_LAZY);
-    if (!this->library)
-        ERROR() << "could not open dynamic library!" << std::endl;
+    // drivers can also be deployed later (Reload_Drivers)
+    if (this->drivers->scan() == 0)
+        WARNING() << "no driver library loaded from " << DRIVER_DIRECTORY << std::endl;
 } // use only for socket mode
 
 BOS::BOS(const std::string &directoryPath, mode_t permission) : BOS() {
@@ -43,40 +45,106 @@ void BOS::acceptAdminConnection(Stream* stream) {
     this->adminConnection = std::make_shared<BatteryConnection>(std::unique_ptr<Stream>(stream));
     this->adminConnection->messageReadyHandler = [this](BatteryConnection* connection) {
         std::cout << "ADMIN COMMAND!" << std::endl;
+        // keeps the connection alive if the command closes it
+        std::shared_ptr<BatteryConnection> current = this->adminConnection;
         this->handleAdminCommand(*connection);
     };
     netServicer.add(this->adminConnection);
 }
 
-void BOS::acceptBatteryConnection(const std::string& batteryName, std::shared_ptr<BatteryConnection> connection) {
-    connection->messageReadyHandler = [this, batteryName](BatteryConnection* connection) {
-        this->handleBatteryCommand(batteryName, *connection);
-    };
+void BOS::acceptBatteryConnection(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection) {
+    this->setBatteryHandler(batteryID, connection);
     netServicer.add(connection);
     this->connections.push_back(connection);
 }
 
-void BOS::handleBatteryCommand(const std::string& batteryName, BatteryConnection& connection) {
+void BOS::handleBatteryConnect(std::shared_ptr<BatteryConnection> connection) {
+    bosproto::BatteryConnect command;
+    int success = connection->read(command);
+    if (!success) {
+        WARNING() << "Unable to read batteryName from clientSocket!" << std::endl;
+        this->closeConnection(connection);
+        return;
+    }
+
+    std::cout << "Battery connect: " << command.batteryname() << std::endl;
+
+    bosproto::ConnectResponse response;
+    std::shared_ptr<Battery> battery = this->directoryManager->getBattery(command.batteryname());
+    if (battery == nullptr) {
+        WARNING() << "Get battery nullptr: " << command.batteryname() << std::endl;
+        response.set_status_code(bosproto::ConnectStatusCode::DoesNotExist);
+        connection->write(response);
+        return;
+    }
+
+    response.set_status_code(bosproto::ConnectStatusCode::Success);
+    connection->write(response);
+
+    // replaces the handler that is running, so nothing may run after this
+    this->setBatteryHandler(battery->getBatteryID(), connection);
+}
+
+void BOS::setBatteryHandler(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection) {
+    std::weak_ptr<BatteryConnection> weakConnection = connection;
+    connection->messageReadyHandler = [this, batteryID, weakConnection](BatteryConnection*) {
+        std::shared_ptr<BatteryConnection> current = weakConnection.lock();
+        if (current)
+            this->handleBatteryCommand(batteryID, current);
+    };
+}
+
+void BOS::closeConnection(const std::shared_ptr<BatteryConnection>& connection) {
+    // NetService drops the connection once it expires (commands already
+    // dispatched keep it alive until they have responded)
+    auto iter = std::find(this->connections.begin(), this->connections.end(), connection);
+    if (iter != this->connections.end()) {
+        std::swap(*iter, this->connections.back());
+        this->connections.pop_back();
+    }
+}
+
+void BOS::handleBatteryCommand(battery_id_t batteryID, std::shared_ptr<BatteryConnection> connection) {
     bosproto::BatteryCommand command;
-    int success = connection.read(command);
+    int success = connection->read(command);
 
     if (!success) {
-        WARNING() << "could not parse BatteryCommand" << std::endl;
+        LOG() << "closing connection to " << getBatteryNameOf(batteryID) << std::endl;
+        this->closeConnection(connection);
         return;
     } 
 
+    if (!this->dispatcher) {
+        this->runBatteryCommand(command, batteryID, *connection);
+        return;
+    }
+
+    // commands for the same battery run in the order they were read,
+    // commands for different batteries run in parallel
+    this->dispatcher->submit(batteryID, [this, command = std::move(command), batteryID, connection]() {
+        this->runBatteryCommand(command, batteryID, *connection);
+    });
+}
+
+void BOS::runBatteryCommand(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection) {
     switch(command.command()) {
         case bosproto::Command::Get_Status:
-            this->getStatus(batteryName, connection);
+            this->getStatus(batteryID, connection);
+            break;
+        case bosproto::Command::Get_Status_Batch:
+            this->getStatusBatch(command, connection);
+            break;
+        case bosproto::Command::Get_Status_History:
+            this->getStatusHistory(command, batteryID, connection);
             break;
         case bosproto::Command::Set_Status:
-            this->setStatus(command, batteryName, connection);
+            this->setStatus(command, batteryID, connection);
             break;
         case bosproto::Command::Schedule_Set_Current:
-            this->scheduleSetCurrent(command, batteryName, connection);
+            this->scheduleSetCurrent(command, batteryID, connection);
             break;
         case bosproto::Command::Set_Schedule: {
-            std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryName);
+            std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryID);
             SecureBattery* secBat = (SecureBattery*) bat.get();
             bosproto::SetSchedule params = command.set_schedule();
             secBat->set_schedule(params.my_schedule().c_str(), params.my_schedule().size());
@@ -93,22 +161,124 @@ void BOS::handleBatteryCommand(const std::string& batteryName, BatteryConnection
     return;
 }
 
-void BOS::getStatus(const std::string& batteryName, BatteryConnection& connection) {
-    std::cout << "GET STATUS: " << batteryName << std::endl;
+void BOS::getStatus(battery_id_t batteryID, BatteryConnection& connection) {
+    std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryID);
+    std::cout << "GET STATUS: " << bat->getBatteryName() << std::endl;
 
     bosproto::BatteryStatusResponse response;
     bosproto::BatteryStatus* s = response.mutable_status();
 
-    std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryName);
     BatteryStatus status = bat->getStatus();
     status.toProto(*response.mutable_status());
 
+    BatteryTelemetry telemetry;
+    if (bat->getTelemetry(telemetry))
+        s->set_telemetry(telemetry.encode());
+
     response.set_return_code(0);    
     std::cout << "STATUS: " << response.DebugString() << std::endl;
     connection.write(response);
 }
 
-void BOS::setStatus(const bosproto::BatteryCommand& command, const std::string& batteryName, BatteryConnection& connection) {
+void BOS::getStatusBatch(const bosproto::BatteryCommand& command, BatteryConnection& connection) {
+    bosproto::BatteryStatusBatchResponse response;
+
+    std::vector<std::string> names;
+    if (command.has_status_batch()) {
+        const bosproto::StatusBatch& params = command.status_batch();
+        names.assign(params.batterynames().begin(), params.batterynames().end());
+    }
+
+    std::vector<std::string> missing;
+    std::vector<std::pair<std::string, BatteryStatus>> snapshot = this->directoryManager->getStatusSnapshot(names, missing);
+
+    int size = snapshot.size();
+    response.mutable_batterynames()->Reserve(size);
+    response.mutable_voltage_mv()->Reserve(size);
+    response.mutable_current_ma()->Reserve(size);
+    response.mutable_capacity_mah()->Reserve(size);
+    response.mutable_max_capacity_mah()->Reserve(size);
+    response.mutable_max_charging_current_ma()->Reserve(size);
+    response.mutable_max_discharging_current_ma()->Reserve(size);
+    response.mutable_timestamp()->Reserve(size);
+
+    for (const auto& iter : snapshot) {
+        const BatteryStatus& status = iter.second;
+        response.add_batterynames(iter.first);
+        response.add_voltage_mv(status.voltage_mV);
+        response.add_current_ma(status.current_mA);
+        response.add_capacity_mah(status.capacity_mAh);
+        response.add_max_capacity_mah(status.max_capacity_mAh);
+        response.add_max_charging_current_ma(status.max_charging_current_mA);
+        response.add_max_discharging_current_ma(status.max_discharging_current_mA);
+        response.add_timestamp(status.time);
+    }
+
+    for (const std::string& name : missing)
+        response.add_missing(name);
+
+    if (missing.empty()) {
+        response.set_return_code(0);
+    } else {
+        response.set_return_code(-1);
+        response.set_fail_reason("some batteries do not exist in directory!");
+    }
+
+    if (!connection.write(response)) {
+        WARNING() << "unable to write batch status response" << std::endl;
+    }
+}
+
+void BOS::getStatusHistory(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection) {
+    bosproto::BatteryStatusHistoryResponse response;
+    if (!command.has_status_history()) {
+        response.set_return_code(-1);
+        response.set_fail_reason("start time and end time need to be set!");
+
+        connection.write(response);
+        return;
+    }
+
+    const bosproto::StatusHistory& params = command.status_history();
+    std::shared_ptr<Battery> battery = params.batteryname().empty() ? this->directoryManager->getBattery(batteryID)
+                                                                    : this->directoryManager->getBattery(params.batteryname());
+    if (battery == nullptr) {
+        response.set_return_code(-1);
+        response.set_fail_reason("battery does not exist in directory!");
+
+        connection.write(response);
+        return;
+    }
+
+    std::vector<BatteryStatus> history = battery->getStatusHistory(convertToTimestamp(params.starttime()), convertToTimestamp(params.endtime()),
+                                                                   std::chrono::milliseconds(params.downsample_ms()));
+
+    int size = history.size();
+    response.mutable_timestamp()->Reserve(size);
+    response.mutable_voltage_mv()->Reserve(size);
+    response.mutable_current_ma()->Reserve(size);
+    response.mutable_capacity_mah()->Reserve(size);
+    response.mutable_max_capacity_mah()->Reserve(size);
+    response.mutable_max_temperature_dk()->Reserve(size);
+    response.mutable_protection_flags()->Reserve(size);
+
+    for (const BatteryStatus& status : history) {
+        response.add_timestamp(status.time);
+        response.add_voltage_mv(status.voltage_mV);
+        response.add_current_ma(status.current_mA);
+        response.add_capacity_mah(status.capacity_mAh);
+        response.add_max_capacity_mah(status.max_capacity_mAh);
+        response.add_max_temperature_dk(status.max_temperature_dK);
+        response.add_protection_flags(status.protection_flags);
+    }
+    response.set_return_code(0);
+
+    if (!connection.write(response)) {
+        WARNING() << "unable to write status history response" << std::endl;
+    }
+}
+
+void BOS::setStatus(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection) {
     bosproto::SetStatusResponse response;
     if (!command.has_status()) {
         response.set_return_code(-1);
@@ -120,7 +290,7 @@ void BOS::setStatus(const bosproto::BatteryCommand& command, const std::string&
 
     BatteryStatus status(command.status());
 
-    std::shared_ptr<Battery> battery = this->directoryManager->getBattery(batteryName);
+    std::shared_ptr<Battery> battery = this->directoryManager->getBattery(batteryID);
 
     if (battery == nullptr) {
         response.set_return_code(-1);
@@ -129,12 +299,15 @@ void BOS::setStatus(const bosproto::BatteryCommand& command, const std::string&
         battery->setBatteryStatus(status);
         response.set_return_code(0);
         response.set_reason("successfully set status!");
+
+        if (this->journal && !this->journal->appendBatteryCommand(battery->getBatteryName(), command))
+            WARNING() << "could not journal status of " << battery->getBatteryName() << std::endl;
     }
 
     connection.write(response);
 }
 
-void BOS::scheduleSetCurrent(const bosproto::BatteryCommand& command, const std::string& batteryName, BatteryConnection& connection) {
+void BOS::scheduleSetCurrent(const bosproto::BatteryCommand& command, battery_id_t batteryID, BatteryConnection& connection) {
     bosproto::ScheduleSetCurrentResponse response;
     if (!command.has_schedule_set_current()) {
         response.set_return_code(-1);
@@ -150,8 +323,9 @@ void BOS::scheduleSetCurrent(const bosproto::BatteryCommand& command, const std:
     uint64_t startTime = params.starttime();
     uint64_t endTime   = params.endtime(); 
 
-    std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryName);
+    std::shared_ptr<Battery> bat = this->directoryManager->getBattery(batteryID);
     bool success = bat->schedule_set_current(current_mA, startTime, endTime);
+    std::string batteryName = bat->getBatteryName();
 
     if (!success) {
         response.set_return_code(-1);
@@ -159,6 +333,9 @@ void BOS::scheduleSetCurrent(const bosproto::BatteryCommand& command, const std:
     } else {
         response.set_return_code(0);
         response.set_success_message("successfully set current for " + batteryName);
+
+        if (this->journal && !this->journal->appendBatteryCommand(batteryName, command))
+            WARNING() << "could not journal reservation of " << batteryName << std::endl;
     }
 
     if (!connection.write(response)) {
@@ -211,38 +388,54 @@ void BOS::handleAdminCommand(BatteryConnection& connection) {
 
     int success = connection.read(command);
     if (!success) {
-        WARNING() << "could not parse Admin_Command" << std::endl;
+        WARNING() << "could not parse Admin_Command, closing admin connection" << std::endl;
+        if (this->adminConnection.get() == &connection)
+            this->adminConnection.reset();
         return;
     }
 
     switch(command.command_options()) {
-        case bosproto::Command_Options::Create_Physical:
-            this->createPhysicalBattery(command, connection); 
+        case bosproto::Command_Options::Reload_Drivers:
+            this->reloadDrivers(connection);
+            return;
+        case bosproto::Command_Options::Shutdown:
+            this->shutdown();
+            return;
+        default:
             break;
+    }
+
+    bosproto::AdminResponse response = this->runAdminCommand(command);
+
+    // the batteries are journaled before the admin hears about them
+    if (response.return_code() == 0 && this->journal && !this->journal->appendAdminCommand(command))
+        WARNING() << "could not journal admin command" << std::endl;
+
+    if (!connection.write(response)) {
+        WARNING() << "unable to write message to file descriptor" << std::endl;
+    }
+}
+
+bosproto::AdminResponse BOS::runAdminCommand(const bosproto::Admin_Command& command) {
+    switch(command.command_options()) {
+        case bosproto::Command_Options::Create_Physical:
+            return this->createPhysicalBattery(command);
         case bosproto::Command_Options::Create_Aggregate:
-            this->createAggregateBattery(command, connection);
-            break;
+            return this->createAggregateBattery(command);
         case bosproto::Command_Options::Create_Partition:
-            this->createPartitionBattery(command, connection);
-            break;
+            return this->createPartitionBattery(command);
         case bosproto::Command_Options::Create_Dynamic:
-            this->createDynamicBattery(command, connection);
-            break;
+            return this->createDynamicBattery(command);
         case bosproto::Command_Options::Create_Secure:
-            this->createSecureBattery(command, connection);
-            break;
-        case bosproto::Command_Options::Shutdown:
-            this->shutdown();
-            break;
-        default:
+            return this->createSecureBattery(command);
+        default: {
             WARNING() << "invalid Command_Options" << std::endl;
             bosproto::AdminResponse response;
             response.set_return_code(-1);
             response.set_failure_message("Invalid admin command!");
-            connection.write(response);
-            break;
+            return response;
+        }
     }
-    return;
 }
 
 void BOS::createBatteryFifos(const std::string& batteryName) {
@@ -251,25 +444,20 @@ void BOS::createBatteryFifos(const std::string& batteryName) {
 
     std::shared_ptr<FifoAcceptor> acceptor = std::make_shared<FifoAcceptor>(path, batteryName, [this](FifoPipe* pipe) {
         std::shared_ptr<BatteryConnection> connection = std::make_shared<BatteryConnection>(std::unique_ptr<Stream>(pipe));
-        this->acceptBatteryConnection(pipe->name, connection);
+        this->acceptBatteryConnection(internBatteryName(pipe->name), connection);
     }, true);
     this->fifos.push_back(acceptor);
     this->netServicer.add(this->fifos[this->fifos.size() - 1]);
 }
 
-void BOS::createPhysicalBattery(const bosproto::Admin_Command& command, BatteryConnection& connection) {
+bosproto::AdminResponse BOS::createPhysicalBattery(const bosproto::Admin_Command& command) {
     bosproto::AdminResponse response;
 
     std::cout << "GOT COMMAND: " << command.DebugString() << std::endl;
     if (!command.has_physical_battery()) {
         response.set_return_code(-1);
         response.set_failure_message("Physical_Battery parameters not set!");
-        
-        if (connection.write(response)) {
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        return;
+        return response;
     }
 
     paramsPhysical b = parsePhysicalBattery(command.physical_battery());
@@ -278,9 +466,7 @@ void BOS::createPhysicalBattery(const bosproto::Admin_Command& command, BatteryC
     if (!bat) {
         response.set_return_code(-1);
         response.set_failure_message("battery name: " +  b.name + " already exists");
-        connection.write(response);
-
-        return;
+        return response;
     }
 
     response.set_return_code(0);
@@ -290,35 +476,15 @@ void BOS::createPhysicalBattery(const bosproto::Admin_Command& command, BatteryC
         createBatteryFifos(b.name);
     }
 
-    if (!connection.write(response)) {
-        WARNING() << "unable to write message to file descriptor" << std::endl;
-    }
-
-    return;
+    return response;
 }
 
-void BOS::createAggregateBattery(const bosproto::Admin_Command& command, BatteryConnection& connection) {
-    //int output_fd;
-
-    //if (FIFO) {
-    //    std::string adminOutputFile = this->fileNames[this->adminBFifoFD].second;
-    //    output_fd = open(adminOutputFile.c_str(), O_WRONLY);
-    //} else
-    //    output_fd = fd;
-
+bosproto::AdminResponse BOS::createAggregateBattery(const bosproto::Admin_Command& command) {
     bosproto::AdminResponse response;
     if (!command.has_aggregate_battery()) {
         response.set_return_code(-1);
         response.set_failure_message("Aggregate_Battery parameters not set!");
-        
-        if (connection.write(response)) {
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        //if (FIFO)
-        //    close(output_fd);
-
-        return;
+        return response;
     }
 
     paramsAggregate b = parseAggregateBattery(command.aggregate_battery());
@@ -328,9 +494,7 @@ void BOS::createAggregateBattery(const bosproto::Admin_Command& command, Battery
     if (!bat) {
         response.set_return_code(-1);
         response.set_failure_message("error creating aggregate battery!");
-        connection.write(response);
-
-        return;
+        return response;
     }
 
     if (this->mode == BOSMode::Fifo) {
@@ -339,23 +503,15 @@ void BOS::createAggregateBattery(const bosproto::Admin_Command& command, Battery
 
     response.set_return_code(0);
     response.set_success_message("successfully created battery: " + b.name);
-
-    if (!connection.write(response)) {
-        WARNING() << "unable to write message to file descriptor" << std::endl;
-    }
+    return response;
 }
 
-void BOS::createPartitionBattery(const bosproto::Admin_Command& command, BatteryConnection& connection) {
+bosproto::AdminResponse BOS::createPartitionBattery(const bosproto::Admin_Command& command) {
     bosproto::AdminResponse response;
     if (!command.has_partition_battery()) {
         response.set_return_code(-1);
         response.set_failure_message("Partition_Battery parameters not set!");
-        
-        if (connection.write(response)) {
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        return;
+        return response;
     }
 
     paramsPartition b = parsePartitionBattery(command.partition_battery());
@@ -366,12 +522,7 @@ void BOS::createPartitionBattery(const bosproto::Admin_Command& command, Battery
     } else if (b.refreshModes.size() == 0 || b.stalenesses.size() == 0) {
         response.set_return_code(-1);
         response.set_failure_message("refresh modes and stalenesses both need to be included or excluded: cannot choose one");
-
-        if (!connection.write(response)) { 
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        return;
+        return response;
     } else {
         batteries = this->directoryManager->createPartitionBattery(b.source, b.policy, b.child_names, b.proportions, b.stalenesses, b.refreshModes); 
     }
@@ -379,8 +530,7 @@ void BOS::createPartitionBattery(const bosproto::Admin_Command& command, Battery
     if (batteries.size() == 0) {
         response.set_return_code(-1);
         response.set_failure_message("error creating partition batteries!");
-        connection.write(response);
-        return;
+        return response;
     }
 
     if (this->mode == BOSMode::Fifo) {
@@ -391,60 +541,43 @@ void BOS::createPartitionBattery(const bosproto::Admin_Command& command, Battery
 
     response.set_return_code(0);
     response.set_success_message("successfully created batteries!");
-
-    if (!connection.write(response)) {
-        WARNING() << "unable to write message to file descriptor" << std::endl;
-    }
+    return response;
 }
 
-void BOS::createDynamicBattery(const bosproto::Admin_Command& command, BatteryConnection& connection) {
+bosproto::AdminResponse BOS::createDynamicBattery(const bosproto::Admin_Command& command) {
     bosproto::AdminResponse response;
     if (!command.has_dynamic_battery()) {
-        WARNING() << "entering this branch :(" << std::endl;
         response.set_return_code(-1);
         response.set_failure_message("Dynamic_Battery parameters not set!");
-        
-        if (connection.write(response)) {
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        return;
+        return response;
     }
 
     paramsDynamic b = parseDynamicBattery(command.dynamic_battery());
 
     void* initArgs = (void*)b.initArgs;
-    void* destructor     = dlsym(this->library, b.destructor.c_str());
-    void* constructor    = dlsym(this->library, b.constructor.c_str());
-    void* refreshFunc    = dlsym(this->library, b.refreshFunc.c_str());
-    void* setCurrentFunc = dlsym(this->library, b.setCurrentFunc.c_str());
-
+    std::string error;
+    std::shared_ptr<const LoadedDriver> driver = this->drivers->resolve(b.constructor, b.destructor, b.refreshFunc,
+                                                                        b.setCurrentFunc, b.telemetryFunc, error);
 
-    if (constructor == NULL || destructor == NULL ||
-        refreshFunc == NULL || setCurrentFunc == NULL) {
+    if (driver == nullptr) {
+        delete[] b.initArgs;
         response.set_return_code(-1);
-        response.set_failure_message("function names not found in dynamic library file");
-
-        if (!connection.write(response)) {
-            WARNING() << "unable to write message to file descriptor" << std::endl;
-        }
-
-        return;
+        response.set_failure_message("function names not found in driver libraries: " + error);
+        return response;
     }
 
-    std::shared_ptr<Battery> bat = this->directoryManager->createDynamicBattery(initArgs, destructor, constructor,
-                                                                                refreshFunc, setCurrentFunc, b.name,
-                                                                                b.staleness, b.refresh);
-     
-    LOG() << "made it here!" << std::endl;
+    // the battery keeps the build of the driver it was created from, even if the driver is reloaded
+    std::shared_ptr<Battery> bat = this->directoryManager->createDynamicBattery(initArgs, (void*) driver->destructor, (void*) driver->constructor,
+                                                                                (void*) driver->refreshFunc, (void*) driver->setCurrentFunc,
+                                                                                b.name, b.staleness, b.refresh, (void*) driver->telemetryFunc,
+                                                                                driver->library);
 
     delete[] b.initArgs;
 
     if (!bat) {
         response.set_return_code(-1);
         response.set_failure_message("battery name: " +  b.name + " already exists");
-        connection.write(response);
-        return;
+        return response;
     }
 
     if (this->mode == BOSMode::Fifo) {
@@ -453,25 +586,17 @@ void BOS::createDynamicBattery(const bosproto::Admin_Command& command, BatteryCo
 
     response.set_return_code(0);
     response.set_success_message("successfully created battery: " + b.name);
-
-    if (!connection.write(response)) {
-        WARNING() << "unable to write message to file descriptor" << std::endl;
-    }
+    return response;
 }
 
-void BOS::createSecureBattery(const bosproto::Admin_Command& command, BatteryConnection& connection) {
+bosproto::AdminResponse BOS::createSecureBattery(const bosproto::Admin_Command& command) {
     bosproto::AdminResponse response;
 
     std::cout << "GOT COMMAND: " << command.DebugString() << std::endl;
     if (!command.has_secure_battery()) {
         response.set_return_code(-1);
         response.set_failure_message("Secure_Battery parameters not set!");
-        
-        if (connection.write(response)) {
-            WARNING() << "unable to write failure message to file descriptor" << std::endl;
-        }
-
-        return;
+        return response;
     }
 
     paramsSecure b = parseSecureBattery(command.secure_battery());
@@ -480,9 +605,7 @@ void BOS::createSecureBattery(const bosproto::Admin_Command& command, BatteryCon
     if (!bat) {
         response.set_return_code(-1);
         response.set_failure_message("battery name: " +  b.name + " already exists");
-        connection.write(response);
-
-        return;
+        return response;
     }
 
     response.set_return_code(0);
@@ -492,11 +615,66 @@ void BOS::createSecureBattery(const bosproto::Admin_Command& command, BatteryCon
         createBatteryFifos(b.name);
     }
 
+    return response;
+}
+
+void BOS::reloadDrivers(BatteryConnection& connection) {
+    bosproto::AdminResponse response;
+
+    size_t numLoaded = this->drivers->scan();
+    std::vector<std::string> names = this->drivers->getDrivers();
+
+    std::string message = "loaded " + std::to_string(numLoaded) + " driver libraries, drivers:";
+    for (const std::string& name : names)
+        message += " " + name;
+
+    response.set_return_code(0);
+    response.set_success_message(message);
+
     if (!connection.write(response)) {
         WARNING() << "unable to write message to file descriptor" << std::endl;
     }
+}
+
+bool BOS::applyJournalRecord(const bosproto::Journal_Record& record, std::unordered_set<std::shared_ptr<Battery>>& restored) {
+    if (record.has_admin_command()) {
+        bosproto::AdminResponse response = this->runAdminCommand(record.admin_command());
+        if (response.return_code() != 0)
+            WARNING() << "could not recover admin command " << record.lsn() << ": " << response.failure_message() << std::endl;
+        return response.return_code() == 0;
+    }
 
-    return;
+    std::shared_ptr<Battery> battery = this->directoryManager->getBattery(record.batteryname());
+    if (battery == nullptr) {
+        WARNING() << "could not recover command " << record.lsn() << ": " << record.batteryname() << " does not exist" << std::endl;
+        return false;
+    }
+
+    const bosproto::BatteryCommand& command = record.battery_command();
+    switch(command.command()) {
+        case bosproto::Command::Set_Status:
+            battery->setBatteryStatus(BatteryStatus(command.status()));
+            return true;
+        case bosproto::Command::Schedule_Set_Current: {
+            const bosproto::ScheduleSetCurrent& params = command.schedule_set_current();
+            uint64_t now = convertToMilliseconds(getClock()->now());
+
+            // what is left of a reservation that started while BOS was down starts once it is recovered
+            uint64_t startTime = std::max<uint64_t>(params.starttime(), now + JOURNAL_REPLAY_MARGIN_MS);
+            if (params.endtime() <= startTime)
+                return false;
+
+            // it was admitted before it was journaled, so it is not checked again
+            timepoint_t start;
+            timepoint_t end;
+            start += std::chrono::milliseconds(startTime);
+            end   += std::chrono::milliseconds(params.endtime());
+            restored.insert(battery);
+            return battery->restore_set_current(params.current_ma(), start, end);
+        }
+        default:
+            return false;
+    }
 }
 
 void BOS::createDirectory(const std::string &directoryPath, mode_t permission) {
@@ -522,6 +700,7 @@ void BOS::startFifos(mode_t adminPermission) {
     std::cout << "CREATED!" << std::endl;
     netServicer.add(this->adminListener);
 
+    this->recover();
     this->pollFDs();
 }
 
@@ -531,37 +710,81 @@ void BOS::startSockets(int adminPort, int batteryPort) {
     this->hasQuit = false;
     this->mode = BOSMode::Network;
 
+    // a client that closes its connection must not kill BOS while a response is written to it
+    signal(SIGPIPE, SIG_IGN);
+
     this->adminListener = std::make_shared<TLSAcceptor>(INADDR_ANY, adminPort, 1, [this](Socket* socket) {
         this->acceptAdminConnection(socket);
-    });
+    }, &this->netServicer);
     netServicer.add(this->adminListener);
 
+    // the BatteryConnect message is read when it arrives instead of
+    // blocking the polling thread right after the handshake
     this->batteryListener = std::make_shared<TLSAcceptor>(INADDR_ANY, batteryPort, 1024, [this](Socket* socket) {
-        bosproto::BatteryConnect command;
         std::shared_ptr<BatteryConnection> connection = std::make_shared<BatteryConnection>(std::unique_ptr<Stream>(socket));
- 
-        int bytes_read = connection->read(command);
-        std::cout << "Battery connect: " << command.batteryname() << std::endl;
-
-        bosproto::ConnectResponse response;
-        if (bytes_read == -1) {
-            WARNING() << "Unable to read batteryName from clientSocket!" << std::endl;
-            response.set_status_code(bosproto::ConnectStatusCode::GenericError);
-        } else if (this->directoryManager->getBattery(command.batteryname()) == nullptr) {
-            WARNING() << "Get battery nullptr: " << command.batteryname() << std::endl;
-            response.set_status_code(bosproto::ConnectStatusCode::DoesNotExist);
-        } else {
-            this->acceptBatteryConnection(command.batteryname(), connection);
-            response.set_status_code(bosproto::ConnectStatusCode::Success);
-        }
-
-        connection->write(response);
-    });
+        std::weak_ptr<BatteryConnection> weakConnection = connection;
+        connection->messageReadyHandler = [this, weakConnection](BatteryConnection*) {
+            std::shared_ptr<BatteryConnection> current = weakConnection.lock();
+            if (current)
+                this->handleBatteryConnect(current);
+        };
+        netServicer.add(connection);
+        this->connections.push_back(connection);
+    }, &this->netServicer);
     netServicer.add(this->batteryListener);
 
+    this->recover();
     this->pollFDs();
 }
 
+void BOS::setDispatchThreads(unsigned int numThreads) {
+    if (numThreads == 0)
+        this->dispatcher.reset();
+    else
+        this->dispatcher = std::make_unique<DispatchPool>(numThreads);
+}
+
+void BOS::setJournal(const std::string &path, size_t snapshotEvery, bool syncWrites) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    this->journal = std::make_unique<Journal>(path, snapshotEvery, syncWrites);
+    if (!this->journal->isOpen())
+        ERROR() << "could not open journal " << path << std::endl;
+    this->recovered = false;
+
+    double time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    LOG() << "loaded " << this->journal->getNumLiveRecords() << " journaled commands from " << path << " in " << time_ms << "ms" << std::endl;
+}
+
+size_t BOS::recover() {
+    if (!this->journal || this->recovered)
+        return 0;
+    this->recovered = true;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t numRecords   = this->journal->getNumLiveRecords();
+    std::unordered_set<std::shared_ptr<Battery>> restored;
+    size_t numRecovered = this->journal->replay([this, &restored](const bosproto::Journal_Record& record) {
+        return this->applyJournalRecord(record, restored);
+    });
+    for (const std::shared_ptr<Battery>& battery : restored)
+        battery->armEvents();
+    double time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    LOG() << "recovered " << numRecovered << " of " << numRecords << " journaled commands in " << time_ms << "ms" << std::endl;
+    return numRecovered;
+}
+
+void BOS::setTelemetryLog(const std::string &path, std::chrono::milliseconds flushInterval) {
+    this->telemetryLog = std::make_shared<TelemetryLog>(path, TELEMETRY_SEGMENT_SIZE, flushInterval);
+    if (!this->telemetryLog->isOpen())
+        ERROR() << "could not open telemetry log " << path << std::endl;
+    ::setTelemetryLog(this->telemetryLog);
+}
+
+std::shared_ptr<Battery> BOS::getBattery(const std::string &batteryName) const {
+    return this->directoryManager->getBattery(batteryName);
+}
+
 void BOS::startAggregator(int client_port, int agg_port) {
 
     char* verify_key = "abcdefghijklmnop";
@@ -574,6 +797,13 @@ void BOS::shutdown() {
 
     this->hasQuit  = true;
     this->quitPoll = true;
+    this->netServicer.wakeup();
+
+    // let running commands finish before the directory is destroyed
+    this->dispatcher.reset();
+
+    if (this->telemetryLog)
+        this->telemetryLog->flush();
 
     for (const auto &f: fileNames) {
         LOG() << "Closing " << f.second.first << std::endl;
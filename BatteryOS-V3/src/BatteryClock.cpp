@@ -0,0 +1,87 @@
+#include "BatteryClock.hpp"
+
+#include <mutex>
+#include <vector>
+
+static std::mutex clockLock;
+static std::shared_ptr<BatteryClock> processClock;
+static std::atomic<BatteryClock*> currentClock(nullptr);
+
+// getTimeNow() reads currentClock without taking clockLock, so clocks
+// that have been replaced are kept alive instead of being freed under it
+static std::vector<std::shared_ptr<BatteryClock>> replacedClocks;
+
+std::shared_ptr<BatteryClock> getClock(void) {
+    std::lock_guard<std::mutex> guard(clockLock);
+    if (processClock == nullptr) {
+        processClock = std::make_shared<SystemClock>();
+        currentClock.store(processClock.get(), std::memory_order_release);
+    }
+    return processClock;
+}
+
+void setClock(std::shared_ptr<BatteryClock> clock) {
+    std::lock_guard<std::mutex> guard(clockLock);
+    if (processClock != nullptr)
+        replacedClocks.push_back(processClock);
+    processClock = clock;
+    currentClock.store(processClock.get(), std::memory_order_release);
+}
+
+timestamp_t getTimeNow(void) {
+    BatteryClock* clock = currentClock.load(std::memory_order_acquire);
+    if (clock == nullptr)
+        return getClock()->now();
+    return clock->now();
+}
+
+/************
+BatteryClock
+*************/
+
+monotonic_t BatteryClock::toMonotonic(timestamp_t time) const {
+    return this->monotonicNow() + (time - this->now());
+}
+
+timestamp_t BatteryClock::toWallClock(monotonic_t time) const {
+    return this->now() + std::chrono::ceil<std::chrono::milliseconds>(time - this->monotonicNow());
+}
+
+/***********
+SystemClock
+************/
+
+timestamp_t SystemClock::now() const {
+    return std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now());
+}
+
+monotonic_t SystemClock::monotonicNow() const {
+    return std::chrono::steady_clock::now();
+}
+
+/***********
+ManualClock
+************/
+
+ManualClock::ManualClock(timestamp_t start) : start(start) {
+    this->time_ms = start.time_since_epoch().count();
+}
+
+timestamp_t ManualClock::now() const {
+    return timestamp_t(std::chrono::milliseconds(this->time_ms.load(std::memory_order_acquire)));
+}
+
+monotonic_t ManualClock::monotonicNow() const {
+    return monotonic_t(this->now() - this->start);
+}
+
+void ManualClock::set(timestamp_t time) {
+    int64_t target  = time.time_since_epoch().count();
+    int64_t current = this->time_ms.load(std::memory_order_acquire);
+    while (target > current && !this->time_ms.compare_exchange_weak(current, target, std::memory_order_acq_rel))
+        ;
+}
+
+void ManualClock::advance(std::chrono::milliseconds duration) {
+    this->time_ms.fetch_add(duration.count(), std::memory_order_acq_rel);
+}
@@ -1,37 +1,67 @@
 
 #include "BatteryConnection.hpp"
 
+#include <cstring>
 #include <arpa/inet.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "util.hpp"
 
+/* largest message accepted from a stream, anything bigger is treated as a corrupt length */
+static const uint32_t MAX_MESSAGE_LEN = 64 * 1024 * 1024;
+
+/* size of the big-endian length that prefixes every message */
+static const size_t HEADER_LEN = 4;
 
 // TODO: what should return value signify
 int BatteryConnection::write(const google::protobuf::MessageLite& message) {
-    // TODO: error handling
-    uint32_t message_len = htonl(message.ByteSizeLong());
-    this->stream->write_exact((char*)&message_len, 4);
+    std::lock_guard<std::mutex> guard(this->ioLock);
+
+    // ByteSizeLong() caches the size so the body can be serialized
+    // without computing it again
+    size_t num_bytes = message.ByteSizeLong();
+    if (num_bytes > MAX_MESSAGE_LEN) {
+        WARNING() << "message of " << num_bytes << " bytes is too large to send" << std::endl;
+        return 0;
+    }
+
+    if (this->writeBuffer.size() < HEADER_LEN + num_bytes)
+        this->writeBuffer.resize(HEADER_LEN + num_bytes);
+
+    uint32_t message_len = htonl(num_bytes);
+    memcpy(this->writeBuffer.data(), &message_len, HEADER_LEN);
+    message.SerializeWithCachedSizesToArray((uint8_t*)this->writeBuffer.data() + HEADER_LEN);
 
-    uint32_t num_bytes = message.ByteSizeLong();
-    char* buffer = new char[num_bytes];
-    message.SerializeToArray(buffer, num_bytes);
-    this->stream->write_exact(buffer, num_bytes);
-    delete[] buffer;
+    // length and body go out in a single write so they share one packet
+    if (this->stream->write_exact(this->writeBuffer.data(), HEADER_LEN + num_bytes) == (size_t)-1)
+        return 0;
 
     return 1;
 }
 
 int BatteryConnection::read(google::protobuf::MessageLite& message) {
-    char message_len_buf[4] = {0};
+    std::lock_guard<std::mutex> guard(this->ioLock);
+    char message_len_buf[HEADER_LEN] = {0};
+
+    if (this->stream->read_exact(message_len_buf, HEADER_LEN) == (size_t)-1)
+        return 0;
+
+    uint32_t message_len;
+    memcpy(&message_len, message_len_buf, HEADER_LEN);
+    message_len = ntohl(message_len);
+
+    if (message_len > MAX_MESSAGE_LEN) {
+        WARNING() << "message length " << message_len << " is too large" << std::endl;
+        return 0;
+    }
+
+    if (this->readBuffer.size() < message_len)
+        this->readBuffer.resize(message_len);
 
-    // get the expected message len and read untill it is full
-    while (this->stream->read_exact(message_len_buf, 4) == -1) {}
-    uint32_t message_len = ntohl(*(uint32_t*)message_len_buf);
+    if (this->stream->read_exact(this->readBuffer.data(), message_len) == (size_t)-1)
+        return 0;
 
-    char* buffer = new char[message_len];
-    uint32_t ret = this->stream->read_exact(buffer, message_len);
-    int r = message.ParseFromArray(buffer, message_len);
-    delete[] buffer;
-    return r;
+    google::protobuf::io::ArrayInputStream input(this->readBuffer.data(), message_len);
+    return message.ParseFromZeroCopyStream(&input);
 }
 
 struct pollfd BatteryConnection::pollInfo() {
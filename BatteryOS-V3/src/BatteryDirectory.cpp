@@ -1,5 +1,6 @@
 #include "BatteryDirectory.hpp"
 #include <iostream>
+#include <algorithm>
 
 /**********************
 Constructor/Destructor
@@ -14,22 +15,88 @@ BatteryDirectory::BatteryDirectory() {
     this->destroyed = false;
 }
 
+/*****************
+Private Functions
+******************/
+
+battery_id_t BatteryDirectory::findLocked(const std::string &batteryName) const {
+    battery_id_t id = findBatteryID(batteryName);
+    if (id >= batteries.size() || batteries[id] == nullptr)
+        return INVALID_BATTERY_ID;
+    return id;
+}
+
 /****************
 Public Functions
 *****************/
 
 bool BatteryDirectory::nameExists(const std::string &name) {
-    return batteryMap.count(name) == 1;
+    lockguard_t mutexLock(this->lock);
+    return this->findLocked(name) != INVALID_BATTERY_ID;
 }
 
 bool BatteryDirectory::addBattery(std::shared_ptr<Battery> battery) {
-    std::string name = battery->getBatteryName();
-    if (batteryMap.count(name) == 1) {
-        WARNING() << name << " already exists in directory! choose a unique battery name" << std::endl;
+    battery_id_t id = battery->getBatteryID();
+    lockguard_t mutexLock(this->lock);
+    if (id < batteries.size() && batteries[id] != nullptr) {
+        WARNING() << battery->getBatteryName() << " already exists in directory! choose a unique battery name" << std::endl;
         return false;
     } 
     
-    batteryMap.insert({name, battery}); 
+    if (id >= batteries.size())
+        batteries.resize(id + 1);
+    batteries[id] = battery; 
+    graph.addNode(id);
+    return true;
+}
+
+bool BatteryDirectory::addBatteries(const std::vector<std::shared_ptr<Battery>> &newBatteries,
+                                    const std::vector<std::pair<std::string, std::string>> &edges)
+{
+    lockguard_t mutexLock(this->lock);
+
+    std::vector<battery_id_t> newIDs;
+    for (const std::shared_ptr<Battery> &battery : newBatteries) {
+        battery_id_t id = battery->getBatteryID();
+        if ((id < batteries.size() && batteries[id] != nullptr) || std::find(newIDs.begin(), newIDs.end(), id) != newIDs.end()) {
+            WARNING() << battery->getBatteryName() << " already exists in directory! choose a unique battery name" << std::endl;
+            return false;
+        }
+        newIDs.push_back(id);
+    }
+
+    auto find = [&](const std::string &name) {
+        battery_id_t id = this->findLocked(name);
+        if (id == INVALID_BATTERY_ID) {
+            id = findBatteryID(name);
+            if (std::find(newIDs.begin(), newIDs.end(), id) == newIDs.end())
+                return INVALID_BATTERY_ID;
+        }
+        return id;
+    };
+
+    std::vector<std::pair<battery_id_t, battery_id_t>> edgeIDs;
+    for (const auto &edge : edges) {
+        battery_id_t parent = find(edge.first);
+        battery_id_t child  = find(edge.second);
+        if (parent == INVALID_BATTERY_ID) {
+            WARNING() << "parent name: " << edge.first << " does not exist in directory!" << std::endl;
+            return false;
+        } else if (child == INVALID_BATTERY_ID) {
+            WARNING() << "child name: " << edge.second << " does not exist in directory!" << std::endl;
+            return false;
+        }
+        edgeIDs.push_back({parent, child});
+    }
+
+    for (const std::shared_ptr<Battery> &battery : newBatteries) {
+        battery_id_t id = battery->getBatteryID();
+        if (id >= batteries.size())
+            batteries.resize(id + 1);
+        batteries[id] = battery;
+        graph.addNode(id);
+    }
+    graph.addEdges(edgeIDs);
     return true;
 }
 
@@ -37,35 +104,105 @@ bool BatteryDirectory::addBattery(std::shared_ptr<Battery> battery) {
 // check if battery can be source
 // before adding edges in directory
 bool BatteryDirectory::canBeSource(const std::string &batteryName) {
-    if (batteryMap.count(batteryName) != 1) {
+    lockguard_t mutexLock(this->lock);
+    battery_id_t id = this->findLocked(batteryName);
+    if (id == INVALID_BATTERY_ID) {
         WARNING() << batteryName << " does not exist in directory!" << std::endl;
         return false;
-    } else if (parentGraph.count(batteryName) == 1) {
+    } else if (graph.childCount(id) != 0) {
         return false;
     }
     return true; 
 }
 
 bool BatteryDirectory::addEdge(const std::string &parentName, const std::string &childName) {
-    if (batteryMap.count(parentName) != 1) {
+    lockguard_t mutexLock(this->lock);
+    battery_id_t parent = this->findLocked(parentName);
+    battery_id_t child  = this->findLocked(childName);
+    if (parent == INVALID_BATTERY_ID) {
         WARNING() << "parent name: " << parentName << " does not exist in directory!" << std::endl;
         return false;
-    } else if (batteryMap.count(childName) != 1) {
+    } else if (child == INVALID_BATTERY_ID) {
         WARNING() << "child name: " << childName << " does not exist in directory!" << std::endl;
         return false;
     } 
     
-    childGraph[childName].push_back(parentName);
-    parentGraph[parentName].push_back(childName);
+    graph.addEdge(parent, child);
     return true; 
 }
 
 std::shared_ptr<Battery> BatteryDirectory::getBattery(const std::string &batteryName) const {
-    if (batteryMap.count(batteryName) != 1) {
+    lockguard_t mutexLock(this->lock);
+    battery_id_t id = this->findLocked(batteryName);
+    if (id == INVALID_BATTERY_ID)
         return nullptr;
+    return batteries[id];
+}
+
+std::shared_ptr<Battery> BatteryDirectory::getBattery(battery_id_t id) const {
+    lockguard_t mutexLock(this->lock);
+    if (id >= batteries.size())
+        return nullptr;
+    return batteries[id];
+}
+
+std::vector<std::shared_ptr<Battery>> BatteryDirectory::getChildren(const std::string &batteryName) const {
+    std::vector<std::shared_ptr<Battery>> children;
+    lockguard_t mutexLock(this->lock);
+    battery_id_t id = this->findLocked(batteryName);
+    for (battery_id_t child : graph.children(id))
+        children.push_back(batteries[child]);
+    return children;
+}
+
+std::vector<std::shared_ptr<Battery>> BatteryDirectory::getParents(const std::string &batteryName) const {
+    std::vector<std::shared_ptr<Battery>> parents;
+    lockguard_t mutexLock(this->lock);
+    battery_id_t id = this->findLocked(batteryName);
+    for (battery_id_t parent : graph.parents(id))
+        parents.push_back(batteries[parent]);
+    return parents;
+}
+
+std::vector<std::shared_ptr<Battery>> BatteryDirectory::getTopologicalOrder() const {
+    std::vector<std::shared_ptr<Battery>> order;
+    lockguard_t mutexLock(this->lock);
+    for (battery_id_t id : graph.topologicalOrder())
+        order.push_back(batteries[id]);
+    return order;
+}
+
+std::vector<std::pair<std::string, BatteryStatus>> BatteryDirectory::getStatusSnapshot(const std::vector<std::string> &batteryNames,
+                                                                                        std::vector<std::string> &missing) const {
+    std::vector<std::shared_ptr<Battery>> snapshotBatteries;
+    std::vector<std::pair<std::string, BatteryStatus>> snapshot;
+
+    // statuses are read without holding the directory lock since
+    // refreshing a battery can block on its driver
+    {
+        lockguard_t mutexLock(this->lock);
+        if (batteryNames.empty()) {
+            snapshotBatteries.reserve(batteries.size());
+            for (const std::shared_ptr<Battery> &battery : batteries) {
+                if (battery != nullptr)
+                    snapshotBatteries.push_back(battery);
+            }
+        } else {
+            snapshotBatteries.reserve(batteryNames.size());
+            for (const std::string &name : batteryNames) {
+                battery_id_t id = this->findLocked(name);
+                if (id == INVALID_BATTERY_ID)
+                    missing.push_back(name);
+                else
+                    snapshotBatteries.push_back(batteries[id]);
+            }
+        }
     }
 
-    return batteryMap.at(batteryName);
+    snapshot.reserve(snapshotBatteries.size());
+    for (const std::shared_ptr<Battery> &battery : snapshotBatteries)
+        snapshot.push_back({battery->getBatteryName(), battery->getStatus()});
+    return snapshot;
 }
 
 // when removing a child of a partition, you should 
@@ -79,39 +216,33 @@ std::shared_ptr<Battery> BatteryDirectory::getBattery(const std::string &battery
 // it sends the removeBattery command with the name of the partition
 // manager that handles the children 
 bool BatteryDirectory::removeBattery(const std::string &batteryName) {
-    if (batteryMap.count(batteryName) == 0) {
+    lockguard_t mutexLock(this->lock);
+    battery_id_t id = this->findLocked(batteryName);
+    if (id == INVALID_BATTERY_ID) {
         WARNING() << batteryName << " does not exist in directory!" << std::endl;
         return false; 
-    } else if (parentGraph.count(batteryName) == 1) {
-        std::list<std::string> childNames = parentGraph[batteryName];
-        for (std::string &child : childNames) {
-            if (!this->removeBattery(child))
-                return false;
-        } 
-        parentGraph.erase(batteryName);
-    }
-    if (childGraph.count(batteryName) == 1) {
-        std::list<std::string> parentNames = childGraph[batteryName];
-        for (std::string &parent : parentNames) {
-            parentGraph[parent].remove(batteryName);
-            if (parentGraph[parent].empty())
-                parentGraph.erase(parent);
-        }
-        childGraph.erase(batteryName);
     }
 
-    LOG() << "removing " << batteryName <<  " from directory" << std::endl;
+    // the battery and everything built on top of it go in one pass over the graph
+    std::vector<battery_id_t> subtree = graph.subtree(id);
+    graph.removeNodes(subtree);
 
-    batteryMap.erase(batteryName);
+    for (battery_id_t removed : subtree) {
+        LOG() << "removing " << batteries[removed]->getBatteryName() <<  " from directory" << std::endl;
+        batteries[removed].reset();
+    }
     return true;
 }
 
 void BatteryDirectory::destroyDirectory() {
+    lockguard_t mutexLock(this->lock);
     if (!this->destroyed) {
-        for (const auto &batteryIter : batteryMap) {
-            batteryIter.second->quit();
+        for (const std::shared_ptr<Battery> &battery : batteries) {
+            if (battery != nullptr)
+                battery->quit();
         }
     }
-    this->batteryMap.clear();
+    this->batteries.clear();
+    this->graph.clear();
     this->destroyed = true; 
 }
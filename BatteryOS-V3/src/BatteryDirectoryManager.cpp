@@ -31,6 +31,15 @@ std::shared_ptr<Battery> BatteryDirectoryManager::getBattery(const std::string &
     return this->directory->getBattery(name);
 }
 
+std::shared_ptr<Battery> BatteryDirectoryManager::getBattery(battery_id_t id) const {
+    return this->directory->getBattery(id);
+}
+
+std::vector<std::pair<std::string, BatteryStatus>> BatteryDirectoryManager::getStatusSnapshot(const std::vector<std::string> &names,
+                                                                                               std::vector<std::string> &missing) const {
+    return this->directory->getStatusSnapshot(names, missing);
+}
+
 bool BatteryDirectoryManager::removeBattery(const std::string &name) {
     std::shared_ptr<Battery> battery = this->directory->getBattery(name);
 
@@ -63,12 +72,14 @@ std::shared_ptr<Battery> BatteryDirectoryManager::createDynamicBattery(void* ini
                                                                        void* setCurrentFunc, 
                                                                        const std::string& batteryName, 
                                                                        const std::chrono::milliseconds& maxStaleness,
-                                                                       const RefreshMode& refreshMode)
+                                                                       const RefreshMode& refreshMode,
+                                                                       void* telemetryFunc,
+                                                                       std::shared_ptr<void> library)
 {
     LOG() << "Made it here!" << std::endl;
     std::shared_ptr<Battery> battery = std::make_shared<DynamicBattery>(initArgs, destructor, constructor,
                                                                         refreshFunc, setCurrentFunc, batteryName,
-                                                                        maxStaleness, refreshMode);
+                                                                        maxStaleness, refreshMode, telemetryFunc, library);
     LOG() << "Made it here!" << std::endl;
 
     if (!this->directory->addBattery(battery))
@@ -106,13 +117,14 @@ std::shared_ptr<Battery> BatteryDirectoryManager::createAggregateBattery(const s
 
     std::shared_ptr<Battery> battery = std::make_shared<AggregateBattery>(name, parents, maxStaleness, refreshMode);
 
-    if (!this->directory->addBattery(battery))
-        return nullptr;
-
+    std::vector<std::pair<std::string, std::string>> edges;
     for (unsigned int i = 0; i < parentNames.size(); i++) {
-        this->directory->addEdge(parentNames[i], name);
+        edges.push_back({parentNames[i], name});
     }    
 
+    if (!this->directory->addBatteries({battery}, edges))
+        return nullptr;
+
     return battery;
 }
 
@@ -167,19 +179,18 @@ std::vector<std::shared_ptr<Battery>> BatteryDirectoryManager::createPartitionBa
         partitions[i]->setSourceBattery(manager);
     }
 
-    if (!this->directory->addBattery(manager)) { // should never hit this ERROR 
-        ERROR() << "could not add partition manager: " << pManager << " to directory";
-        return std::vector<std::shared_ptr<Battery>>();
-    }
-
-    this->directory->addEdge(sourceName, pManager);
+    // the partition manager and its partitions are added together so a
+    // bad partition name does not leave half of the subtree in the directory
+    std::vector<std::shared_ptr<Battery>> subtree = {manager};
+    std::vector<std::pair<std::string, std::string>> edges = {{sourceName, pManager}};
 
     for (unsigned int i = 0; i < names.size(); i++) {
-        if (!this->directory->addBattery(partitions[i]))
-            return std::vector<std::shared_ptr<Battery>>();
-
-        this->directory->addEdge(pManager, names[i]);
+        subtree.push_back(partitions[i]);
+        edges.push_back({pManager, names[i]});
     } 
+
+    if (!this->directory->addBatteries(subtree, edges))
+        return std::vector<std::shared_ptr<Battery>>();
     
     return batteries;
 }
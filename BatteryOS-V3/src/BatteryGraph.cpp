@@ -0,0 +1,196 @@
+#include "BatteryGraph.hpp"
+#include <algorithm>
+
+/***********
+Constructor
+************/
+
+BatteryGraph::BatteryGraph() {}
+
+/*****************
+Private Functions
+******************/
+
+bool BatteryGraph::dirty() const {
+    return !this->pending.empty() || this->childOffsets.size() != this->nodes.size() + 1;
+}
+
+// counting sort of the edges by parent (for the child spans) and by
+// child (for the parent spans); each span keeps its current IDs first
+// and then its pending ones in the order they were added
+void BatteryGraph::rebuild() const {
+    size_t size    = this->nodes.size();
+    size_t oldSize = this->childOffsets.empty() ? 0 : this->childOffsets.size() - 1;
+
+    std::vector<uint32_t> newChildOffsets(size + 1, 0);
+    std::vector<uint32_t> newParentOffsets(size + 1, 0);
+    for (size_t id = 0; id < size; id++) {
+        newChildOffsets[id + 1]  = newChildOffsets[id] + this->numChildren[id];
+        newParentOffsets[id + 1] = newParentOffsets[id] + this->numParents[id];
+    }
+
+    std::vector<uint32_t> childFill(newChildOffsets.begin(), newChildOffsets.end() - 1);
+    std::vector<uint32_t> parentFill(newParentOffsets.begin(), newParentOffsets.end() - 1);
+
+    // pending edges are not in the old spans yet
+    std::vector<uint32_t> pendingChildren(size, 0);
+    std::vector<uint32_t> pendingParents(size, 0);
+    for (const auto &edge : this->pending) {
+        pendingChildren[edge.first]++;
+        pendingParents[edge.second]++;
+    }
+
+    std::vector<battery_id_t> newChildIDs(newChildOffsets[size]);
+    std::vector<battery_id_t> newParentIDs(newParentOffsets[size]);
+    for (size_t id = 0; id < oldSize; id++) {
+        uint32_t offset = this->childOffsets[id];
+        for (uint32_t i = 0; i < this->numChildren[id] - pendingChildren[id]; i++)
+            newChildIDs[childFill[id]++] = this->childIDs[offset + i];
+
+        offset = this->parentOffsets[id];
+        for (uint32_t i = 0; i < this->numParents[id] - pendingParents[id]; i++)
+            newParentIDs[parentFill[id]++] = this->parentIDs[offset + i];
+    }
+    for (const auto &edge : this->pending) {
+        newChildIDs[childFill[edge.first]++]    = edge.second;
+        newParentIDs[parentFill[edge.second]++] = edge.first;
+    }
+    this->pending.clear();
+
+    this->childOffsets.swap(newChildOffsets);
+    this->childIDs.swap(newChildIDs);
+    this->parentOffsets.swap(newParentOffsets);
+    this->parentIDs.swap(newParentIDs);
+}
+
+void BatteryGraph::erase(std::vector<battery_id_t> &ids, uint32_t offset, uint32_t &length, battery_id_t id) {
+    auto first = ids.begin() + offset;
+    auto last  = std::remove(first, first + length, id);
+    length = last - first;
+}
+
+/****************
+Public Functions
+*****************/
+
+void BatteryGraph::addNode(battery_id_t id) {
+    if (id >= this->nodes.size()) {
+        this->nodes.resize(id + 1, false);
+        this->numChildren.resize(id + 1, 0);
+        this->numParents.resize(id + 1, 0);
+    }
+    this->nodes[id] = true;
+}
+
+bool BatteryGraph::hasNode(battery_id_t id) const {
+    return id < this->nodes.size() && this->nodes[id];
+}
+
+void BatteryGraph::addEdge(battery_id_t parent, battery_id_t child) {
+    this->pending.push_back({parent, child});
+    this->numChildren[parent]++;
+    this->numParents[child]++;
+}
+
+void BatteryGraph::addEdges(const std::vector<std::pair<battery_id_t, battery_id_t>> &newEdges) {
+    this->pending.reserve(this->pending.size() + newEdges.size());
+    for (const auto &edge : newEdges)
+        this->addEdge(edge.first, edge.second);
+}
+
+BatteryGraph::Span BatteryGraph::children(battery_id_t id) const {
+    if (id >= this->nodes.size())
+        return {nullptr, nullptr};
+    if (this->dirty())
+        this->rebuild();
+    const battery_id_t *first = this->childIDs.data() + this->childOffsets[id];
+    return {first, first + this->numChildren[id]};
+}
+
+BatteryGraph::Span BatteryGraph::parents(battery_id_t id) const {
+    if (id >= this->nodes.size())
+        return {nullptr, nullptr};
+    if (this->dirty())
+        this->rebuild();
+    const battery_id_t *first = this->parentIDs.data() + this->parentOffsets[id];
+    return {first, first + this->numParents[id]};
+}
+
+size_t BatteryGraph::childCount(battery_id_t id) const {
+    return id < this->nodes.size() ? this->numChildren[id] : 0;
+}
+
+size_t BatteryGraph::parentCount(battery_id_t id) const {
+    return id < this->nodes.size() ? this->numParents[id] : 0;
+}
+
+std::vector<battery_id_t> BatteryGraph::subtree(battery_id_t id) const {
+    std::vector<battery_id_t> ids;
+    if (!this->hasNode(id))
+        return ids;
+
+    // a battery can be reached through more than one parent (e.g. an
+    // aggregate of two partitions of the same source)
+    std::vector<bool> visited(this->nodes.size(), false);
+    visited[id] = true;
+    ids.push_back(id);
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        for (battery_id_t child : this->children(ids[i])) {
+            if (!visited[child]) {
+                visited[child] = true;
+                ids.push_back(child);
+            }
+        }
+    }
+    return ids;
+}
+
+void BatteryGraph::removeNodes(const std::vector<battery_id_t> &ids) {
+    if (this->dirty())
+        this->rebuild();
+
+    for (battery_id_t id : ids) {
+        if (!this->hasNode(id))
+            continue;
+        this->nodes[id] = false;
+
+        for (battery_id_t child : this->children(id))
+            erase(this->parentIDs, this->parentOffsets[child], this->numParents[child], id);
+        for (battery_id_t parent : this->parents(id))
+            erase(this->childIDs, this->childOffsets[parent], this->numChildren[parent], id);
+
+        this->numChildren[id] = 0;
+        this->numParents[id]  = 0;
+    }
+}
+
+// Kahn's algorithm starting from the batteries without a source
+std::vector<battery_id_t> BatteryGraph::topologicalOrder() const {
+    std::vector<battery_id_t> order;
+    std::vector<uint32_t> remaining(this->numParents);
+
+    for (battery_id_t id = 0; id < this->nodes.size(); id++) {
+        if (this->nodes[id] && remaining[id] == 0)
+            order.push_back(id);
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        for (battery_id_t child : this->children(order[i])) {
+            if (--remaining[child] == 0)
+                order.push_back(child);
+        }
+    }
+    return order;
+}
+
+void BatteryGraph::clear() {
+    this->nodes.clear();
+    this->pending.clear();
+    this->numChildren.clear();
+    this->numParents.clear();
+    this->childOffsets.clear();
+    this->childIDs.clear();
+    this->parentOffsets.clear();
+    this->parentIDs.clear();
+}
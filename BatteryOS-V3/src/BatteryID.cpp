@@ -0,0 +1,44 @@
+#include "BatteryID.hpp"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+static std::shared_mutex idLock;
+static std::deque<std::string> idNames;
+static std::unordered_map<std::string, battery_id_t> nameIDs;
+
+battery_id_t internBatteryName(const std::string &name) {
+    {
+        std::shared_lock<std::shared_mutex> readLock(idLock);
+        auto iter = nameIDs.find(name);
+        if (iter != nameIDs.end())
+            return iter->second;
+    }
+
+    std::unique_lock<std::shared_mutex> writeLock(idLock);
+    auto iter = nameIDs.find(name);
+    if (iter != nameIDs.end())
+        return iter->second;
+
+    battery_id_t id = idNames.size();
+    idNames.push_back(name);
+    nameIDs.insert({name, id});
+    return id;
+}
+
+battery_id_t findBatteryID(const std::string &name) {
+    std::shared_lock<std::shared_mutex> readLock(idLock);
+    auto iter = nameIDs.find(name);
+    if (iter == nameIDs.end())
+        return INVALID_BATTERY_ID;
+    return iter->second;
+}
+
+std::string getBatteryNameOf(battery_id_t id) {
+    std::shared_lock<std::shared_mutex> readLock(idLock);
+    if (id >= idNames.size())
+        return "";
+    return idNames[id];
+}
@@ -1,6 +1,7 @@
 #include "BatteryInterface.hpp"
+#include <algorithm>
 
-uint64_t SEQUENCE_NUMBER = 1;
+std::atomic<uint64_t> SEQUENCE_NUMBER(1);
 uint64_t getSequenceNumber(void) {
     return SEQUENCE_NUMBER++;
 }
@@ -15,12 +16,18 @@ Battery::~Battery() {
 
 Battery::Battery(const std::string &batteryName,
                  const std::chrono::milliseconds &maxStaleness, 
-                 const RefreshMode &refreshMode) : batteryName(batteryName) 
+                 const RefreshMode &refreshMode) : batteryName(batteryName),
+                                                   batteryID(internBatteryName(batteryName))
 {
     this->current_mA            = 0;
     this->quitThread            = false;
+    this->notifyPending         = false;
+    this->refreshPending        = false;
     this->refreshMode           = refreshMode;
     this->maxStaleness          = maxStaleness;
+    this->scheduler             = getEventScheduler();
+    this->clock                 = getClock();
+    this->telemetryLog          = getTelemetryLog();
 //    this->status.time           = convertToMilliseconds(getTimeNow()); 
 }
 
@@ -30,19 +37,57 @@ BAL API Functions
 ******************/
 
 BatteryStatus Battery::getStatus() {
-    lockguard_t mutexLock(this->lock);
+    if (this->refreshMode == RefreshMode::LAZY)
+        this->refreshParents();
+
+    BatteryStatus snapshot = this->publishedStatus.load();
+    if (this->refreshMode != RefreshMode::LAZY || !this->isStale(snapshot))
+        return snapshot;
+
+    // only one caller refreshes a stale status, the others
+    // return the last published status instead of waiting
+    // on the driver
+    std::unique_lock<lock_t> mutexLock(this->lock, std::try_to_lock);
+    if (!mutexLock.owns_lock())
+        return snapshot;
+
+    this->status = this->checkAndRefresh();
+    this->publishStatus();
+    snapshot = this->status;
+    mutexLock.unlock();
+
+    this->notifySubscribers();
+    return snapshot;
+}
+
+BatteryStatus Battery::getFreshStatus() {
+    if (this->refreshMode == RefreshMode::LAZY)
+        this->refreshParents();
+
+    std::unique_lock<lock_t> mutexLock(this->lock);
     if (this->refreshMode == RefreshMode::LAZY)
         this->status = this->checkAndRefresh();
-    return this->status;
+    this->publishStatus();
+    BatteryStatus status = this->status;
+    mutexLock.unlock();
+
+    this->notifySubscribers();
+    return status;
+}
+
+bool Battery::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) {
+    if (!prepare_set_current(current_mA, startTime, endTime, requester, sequenceNumber))
+        return false;
+    return commit_set_current(sequenceNumber);
 }
 
-bool Battery::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) {
-    timepoint_t currentTime = getTimeNow(); 
+bool Battery::prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) {
+    timepoint_t currentTime = this->clock->now(); 
 
     if (checkIfZero(this->status))
         std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
-    if (name == this->batteryName) {
+    if (requester == this->batteryID) {
         if (startTime < currentTime) {
             WARNING() << "start time of event has already passed!" << std::endl;
             return false; 
@@ -55,14 +100,51 @@ bool Battery::schedule_set_current(double current_mA, timepoint_t startTime, tim
         }
     }
 
-    checkMergeAndInsertEvents(name, current_mA, startTime, endTime, sequenceNumber);
-    this->condition_variable.notify_one();
+    if (!admitReservation(requester, current_mA, startTime, endTime, sequenceNumber)) {
+        WARNING() << "requested current would take the projected capacity of the battery past empty or full!" << std::endl;
+        return false;
+    }
     return true;
     // use delay to decrease startTime and endTime to work with battery
 }
 
+std::vector<BatteryStatus> Battery::getStatusHistory(timepoint_t startTime, timepoint_t endTime, std::chrono::milliseconds downsample) {
+    lockguard_t mutexLock(this->lock);
+    return this->history.query(convertToMilliseconds(startTime), convertToMilliseconds(endTime), downsample.count());
+}
+
+bool Battery::commit_set_current(uint64_t sequenceNumber) {
+    lockguard_t mutexLock(this->lock);
+    bool committed = this->reservations.commit(sequenceNumber);
+    this->armScheduler();
+    return committed;
+}
+
+bool Battery::abort_set_current(uint64_t sequenceNumber) {
+    lockguard_t mutexLock(this->lock);
+    return this->reservations.release(sequenceNumber);
+}
+
+bool Battery::cancel_set_current(uint64_t sequenceNumber) {
+    lockguard_t mutexLock(this->lock);
+    if (!this->reservations.cancel(sequenceNumber))
+        return false;
+    this->armScheduler();
+    return true;
+}
+
+/**
+ * The request was admitted before it was journaled, so it goes straight
+ * into the reservation map instead of being checked and armed again one
+ * request at a time.
+ */
+bool Battery::restore_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    lockguard_t mutexLock(this->lock);
+    return this->reservations.restore(this->batteryID, getSequenceNumber(), current_mA, startTime, endTime);
+}
+
 bool Battery::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime) {
-    return schedule_set_current(current_mA, startTime, endTime, this->batteryName, getSequenceNumber());
+    return schedule_set_current(current_mA, startTime, endTime, this->batteryID, getSequenceNumber());
 }
 
 bool Battery::schedule_set_current(double current_mA, uint64_t startTime, uint64_t endTime) {
@@ -80,159 +162,105 @@ bool Battery::schedule_set_current(double current_mA, uint64_t startTime, uint64
 Protected Helper Functions
 ***************************/
 
-void Battery::runEventThread() {
-    std::unique_lock<lock_t> uniqueLock(this->lock);
-    while (!(this->quitThread)) {
-        if (this->eventSet.size() == 0)
-            this->condition_variable.wait(uniqueLock, [this]{ return this->eventSet.size() > 0 || this->quitThread; }); 
-        if (this->quitThread)
-            return;
-        
-        while ( !(getTimeNow() >= this->eventSet.begin()->eventTime || this->quitThread)) {
-            if (this->condition_variable.wait_until(uniqueLock, this->eventSet.begin()->eventTime) == std::cv_status::timeout)
-                break;
-        }
-
-        if (this->quitThread)
-            return;
-
-        EventVector eventVector;
-        EventSet::iterator iter;
-        timepoint_t currentTime = getTimeNow();
-
-        for (iter = eventSet.begin(); iter != eventSet.end(); iter++) {
-            if (iter->eventTime > currentTime)
-                break;
-            else if (iter->eventID == EventID::SET_CURRENT_BEGIN)
-                eventVector.push_back(*iter);
-            else if (iter->eventID == EventID::SET_CURRENT_END)
-                eventVector.push_back(*iter);
-            else if (iter->eventID == EventID::CANCEL_SET_CURRENT_EVENT)
-                break;
-            else {
-                if (this->refreshMode == RefreshMode::ACTIVE) {
-                    event_t refreshEvent = event_t(iter->batteryName,
-                                                   iter->eventID,
-                                                   iter->current_mA,
-                                                   iter->eventTime + this->maxStaleness,
-                                                   getSequenceNumber());
-                    eventSet.insert(refreshEvent);
-                } 
-                this->status = refresh();
-                eventVector.push_back(*iter);
-            }
-        }
+void Battery::armScheduler() {
+    if (this->quitThread)
+        return;
 
-        if (iter->eventID == EventID::CANCEL_SET_CURRENT_EVENT) {
-            EventPair eventPair = eventMap.at(iter->sequenceNumber);
-            eventSet.erase(eventPair.first);
-            eventSet.erase(eventPair.second);
-            eventSet.erase(*iter);
-            eventMap.erase(iter->sequenceNumber);
-        }
-        
-        if (!(eventSet.empty())) {
-            double old_current_mA = this->current_mA;
-            for (event_t &event : eventVector) {
-                if (event.eventID == EventID::SET_CURRENT_BEGIN) 
-                    this->current_mA += event.current_mA;
-                else if (event.eventID == EventID::SET_CURRENT_END) {
-                    this->current_mA -= event.current_mA;
-                    eventMap.erase(event.sequenceNumber);
-                }
-                eventSet.erase(event);
-            }
-            if (this->current_mA != old_current_mA)
-                set_current(this->current_mA); 
-        }
+    if (this->reservations.hasEvents()) {
+        timepoint_t nextEventTime = this->reservations.nextEventTime();
+        if (this->refreshPending && this->clock->toWallClock(this->refreshTime) < nextEventTime)
+            nextEventTime = this->clock->toWallClock(this->refreshTime);
+        this->scheduler->schedule(this, nextEventTime);
+    } else if (this->refreshPending) {
+        this->scheduler->schedule(this, this->clock->toWallClock(this->refreshTime));
     }
 }
 
 BatteryStatus Battery::checkAndRefresh() {
-    if (this->refreshMode == RefreshMode::LAZY) {
-        timepoint_t currentTime = getTimeNow();
-        if (currentTime - convertToTimestamp(this->status.time) > this->maxStaleness)
-            return this->refresh();
-    }
+    if (this->refreshMode == RefreshMode::LAZY && this->isStale(this->status))
+        return this->refresh();
     return this->status;    
 }
 
-void Battery::checkMergeAndInsertEvents(std::string batteryName, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber) {
-    double target_current_mA = current_mA;
- 
-    lockguard_t mutexLock(this->lock);
+bool Battery::isStale(const BatteryStatus &status) const {
+    timepoint_t currentTime = this->clock->now();
+    return std::chrono::abs(currentTime - convertToTimestamp(status.time)) > this->maxStaleness.load();
+}
 
-    if (eventMap.count(sequenceNumber) == 1) {
-        EventPair pair = eventMap.at(sequenceNumber);
-        eventSet.erase(pair.first);
-        eventSet.erase(pair.second);
-        eventMap.erase(sequenceNumber);
-        target_current_mA += pair.first.current_mA;
-    } else {
-        for (const auto &iter : eventMap) {
-            EventPair currPair = iter.second;
-            event_t startEvent = currPair.first;
-            event_t endEvent   = currPair.second;
-
-            if (batteryName != startEvent.batteryName) {
-                continue;
-            } else if (startTime <= startEvent.eventTime && endTime >= endEvent.eventTime) {
-                event_t cancelEvent = event_t(batteryName,
-                                              EventID::CANCEL_SET_CURRENT_EVENT,
-                                              0,
-                                              startTime,
-                                              startEvent.sequenceNumber);
-                eventSet.insert(cancelEvent);
-            } else if (startTime >= startEvent.eventTime && endTime < endEvent.eventTime) {
-                target_current_mA -= startEvent.current_mA;
-            } else if (startTime >= startEvent.eventTime && endTime >= endEvent.eventTime) {
-                eventSet.erase(endEvent);
-                event_t newEvent = event_t(batteryName,
-                                           EventID::SET_CURRENT_END, 
-                                           endEvent.current_mA,
-                                           startTime,
-                                           endEvent.sequenceNumber);
-                eventSet.insert(newEvent);
-
-                EventPair oldPair = eventMap.at(endEvent.sequenceNumber);
-                oldPair.second = newEvent;
-                eventMap.at(endEvent.sequenceNumber) = oldPair;
-            } else if (startTime <= startEvent.eventTime && endTime <= endEvent.eventTime) {
-                eventSet.erase(startEvent);
-                event_t newEvent = event_t(batteryName,
-                                           EventID::SET_CURRENT_BEGIN,
-                                           startEvent.current_mA,
-                                           endTime,
-                                           startEvent.sequenceNumber);
-                eventSet.insert(newEvent);
-
-                EventPair oldPair = eventMap.at(startEvent.sequenceNumber);
-                oldPair.first = newEvent;
-                eventMap.at(startEvent.sequenceNumber) = oldPair;
-            }
-        }
-    }
+void Battery::publishStatus() {
+    this->publishedStatus.store(this->status);
+    if (this->history.record(this->status) && this->telemetryLog)
+        this->telemetryLog->record(this->batteryID, this->status);
+    if (!this->subscribers.empty())
+        this->notifyPending = true;
+}
 
-    event_t beginEvent = event_t(batteryName,
-                                 EventID::SET_CURRENT_BEGIN,
-                                 target_current_mA,
-                                 startTime,
-                                 sequenceNumber);
-    event_t endEvent   = event_t(batteryName,
-                                 EventID::SET_CURRENT_END,
-                                 target_current_mA,
-                                 endTime,
-                                 sequenceNumber);
+/**
+ * Notifications are delivered one at a time (notifyLock), and each one
+ * copies the status when it is delivered, so a child never sees an older
+ * status of this battery after a newer one.
+ */
+void Battery::notifySubscribers() {
+    if (!this->notifyPending)
+        return;
 
-    eventSet.insert(beginEvent);
-    eventSet.insert(endEvent);
+    lockguard_t notifyGuard(this->notifyLock);
+    std::vector<Battery*> subscribers;
+    BatteryStatus status;
+    {
+        lockguard_t mutexLock(this->lock);
+        if (!this->notifyPending)
+            return;
+        this->notifyPending = false;
+        subscribers = this->subscribers;
+        status      = this->status;
+    }
+
+    for (Battery *child : subscribers)
+        child->parentStatusChanged(this, status);
+}
 
-    EventPair eventPair = std::make_pair(beginEvent, endEvent);
-    eventMap.insert({sequenceNumber, eventPair});
+void Battery::parentStatusChanged(Battery*, const BatteryStatus&) {
+    return;
+}
 
+void Battery::refreshParents() {
     return;
 }
 
+void Battery::scheduleRefresh(monotonic_t time) {
+    this->refreshTime    = time;
+    this->refreshPending = true;
+    this->armScheduler();
+}
+
+bool Battery::holdReservation(battery_id_t requester, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber) {
+    lockguard_t mutexLock(this->lock);
+    return this->reservations.hold(requester, sequenceNumber, current_mA, startTime, endTime);
+}
+
+/**
+ * A battery without a status yet (no max capacity) admits every request.
+ */
+bool Battery::admitReservation(battery_id_t requester, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber) {
+    lockguard_t mutexLock(this->lock);
+    if (this->checksAdmission() && this->status.max_capacity_mAh > 0 &&
+        !this->reservations.admits(requester, sequenceNumber, current_mA, startTime, endTime, convertToTimestamp(this->status.time),
+                                   this->status.capacity_mAh, this->status.max_capacity_mAh))
+        return false;
+
+    return this->reservations.hold(requester, sequenceNumber, current_mA, startTime, endTime);
+}
+
+/**
+ * The projection is in mAh drawn at the scheduled current, which a
+ * ChargeModel does not follow (it moves the capacity by current_mA / 20
+ * every interval), so simulated batteries override this.
+ */
+bool Battery::checksAdmission() const {
+    return true;
+}
+
 
 /***********************
 Public Helper Functions
@@ -243,20 +271,67 @@ void Battery::quit() {
     this->quitThread = true; 
     this->lock.unlock(); 
 
-    this->condition_variable.notify_one();
-    if (eventThread.joinable()) {
-        eventThread.join();
+    this->scheduler->cancel(this);
+}
+
+void Battery::armEvents() {
+    lockguard_t mutexLock(this->lock);
+    this->armScheduler();
+}
+
+void Battery::dispatchEvents() {
+    this->refreshParents();
+
+    std::unique_lock<lock_t> mutexLock(this->lock);
+    if (this->quitThread)
+        return;
+
+    timepoint_t currentTime = this->clock->now();
+
+    if (this->refreshPending && this->refreshTime <= this->clock->monotonicNow()) {
+        if (this->refreshMode == RefreshMode::ACTIVE)
+            this->refreshTime += this->maxStaleness.load();
+        else
+            this->refreshPending = false;
+        this->status = refresh();
     }
+
+    double old_current_mA = this->current_mA;
+    this->current_mA += this->reservations.consume(currentTime);
+    if (this->current_mA != old_current_mA)
+        set_current(this->current_mA); 
+
+    // set_current() may have changed the status in place
+    this->publishStatus();
+
+    this->armScheduler();
+    mutexLock.unlock();
+
+    this->notifySubscribers();
 }
 
 double Battery::getCurrent() const {
     return this->status.current_mA;
 }
 
+double Battery::getScheduledCurrent(timepoint_t time) {
+    lockguard_t mutexLock(this->lock);
+    return this->reservations.currentAt(time);
+}
+
+double Battery::getProjectedCapacity(timepoint_t time) {
+    lockguard_t mutexLock(this->lock);
+    return this->status.capacity_mAh - this->reservations.chargeBetween(convertToTimestamp(this->status.time), time);
+}
+
 std::string Battery::getBatteryName() const {
     return this->batteryName;
 }
 
+battery_id_t Battery::getBatteryID() const {
+    return this->batteryID;
+}
+
 double Battery::getMaxChargingCurrent() const {
     return this->status.max_charging_current_mA;
 }
@@ -270,6 +345,10 @@ std::string Battery::getBatteryString() const {
     return "BatteryInterface";
 }
 
+bool Battery::getTelemetry(BatteryTelemetry&) {
+    return false;
+}
+
 std::chrono::milliseconds Battery::getMaxStaleness() const {
     return this->maxStaleness;
 }
@@ -278,19 +357,16 @@ void Battery::setRefreshMode(const RefreshMode &refreshMode) {
     if (this->refreshMode == refreshMode)
         return;
 
-    lockguard_t mutexLock(this->lock);
+    std::unique_lock<lock_t> mutexLock(this->lock);
     this->refreshMode = refreshMode;
     if (this->refreshMode == RefreshMode::ACTIVE) {
         this->status = refresh();
-        timepoint_t currentTime = getTimeNow();
-        event_t refreshEvent    = event_t(this->batteryName,
-                                          EventID::REFRESH,
-                                          0,
-                                          currentTime + getMaxStaleness(),
-                                          getSequenceNumber());
-        eventSet.insert(refreshEvent); 
-        this->condition_variable.notify_one();
+        this->publishStatus();
+        this->scheduleRefresh(this->clock->monotonicNow() + getMaxStaleness());
     }
+    mutexLock.unlock();
+
+    this->notifySubscribers();
     return;
 }
 
@@ -302,3 +378,21 @@ void Battery::setMaxStaleness(const std::chrono::milliseconds &maxStaleness) {
     lockguard_t mutexLock(this->lock);
     this->maxStaleness = maxStaleness;
 }
+
+void Battery::addSubscriber(Battery *child) {
+    lockguard_t notifyGuard(this->notifyLock);
+    BatteryStatus status;
+    {
+        lockguard_t mutexLock(this->lock);
+        this->subscribers.push_back(child);
+        status = this->status;
+    }
+    child->parentStatusChanged(this, status);
+}
+
+// waits for a notification in progress, so child is not notified once this returns
+void Battery::removeSubscriber(Battery *child) {
+    lockguard_t notifyGuard(this->notifyLock);
+    lockguard_t mutexLock(this->lock);
+    this->subscribers.erase(std::remove(this->subscribers.begin(), this->subscribers.end(), child), this->subscribers.end());
+}
@@ -1,9 +1,5 @@
 #include "BatteryStatus.hpp"
 
-timestamp_t getTimeNow(void) {
-    return std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()); 
-}
-
 char* formatTime(uint64_t time) {
     std::time_t t = std::chrono::system_clock::to_time_t(convertToTimestamp(time));
     return std::ctime(&t);
@@ -38,6 +34,8 @@ void BatteryStatus::toProto(bosproto::BatteryStatus& proto_status) const {
     proto_status.set_max_capacity_mah(this->max_capacity_mAh);
     proto_status.set_max_charging_current_ma(this->max_charging_current_mA);
     proto_status.set_max_discharging_current_ma(this->max_discharging_current_mA);
+    proto_status.set_max_temperature_dk(this->max_temperature_dK);
+    proto_status.set_protection_flags(this->protection_flags);
     proto_status.set_timestamp(this->time);
 }
 
@@ -47,7 +45,9 @@ bool operator==(const BatteryStatus &lhs, const BatteryStatus &rhs) {
            (lhs.capacity_mAh == rhs.capacity_mAh) &&
            (lhs.max_capacity_mAh == rhs.max_capacity_mAh) &&
            (lhs.max_charging_current_mA == rhs.max_charging_current_mA) &&
-           (lhs.max_discharging_current_mA == rhs.max_discharging_current_mA);
+           (lhs.max_discharging_current_mA == rhs.max_discharging_current_mA) &&
+           (lhs.max_temperature_dK == rhs.max_temperature_dK) &&
+           (lhs.protection_flags == rhs.protection_flags);
 }
 
 std::ostream& operator<<(std::ostream &out, const BatteryStatus &status){
@@ -58,6 +58,10 @@ std::ostream& operator<<(std::ostream &out, const BatteryStatus &status){
     out << "    .max_capacity_mAh =           " << status.max_capacity_mAh           << "mAh, \n";
     out << "    .max_charging_current_mA =    " << status.max_charging_current_mA    << "mA,  \n";
     out << "    .max_discharging_current_mA = " << status.max_discharging_current_mA << "mA,  \n";
+    if (status.max_temperature_dK != 0)
+        out << "    .max_temperature =            " << status.max_temperature_dK / 10.0 - 273.15 << "C,   \n";
+    if (status.protection_flags != 0)
+        out << "    .protection_flags =           0x" << std::hex << status.protection_flags << std::dec << ",  \n";
     out << "    .Latest Refresh =             " << formatTime(status.time)           << "     \n";
     out << "};\n";
     return out;
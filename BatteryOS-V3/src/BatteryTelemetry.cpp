@@ -0,0 +1,106 @@
+#include "BatteryTelemetry.hpp"
+
+#include <limits>
+#include <algorithm>
+
+/* bytes of an encoded record before the cell voltages and temperatures */
+static const size_t HEADER_SIZE = 24;
+
+static void put(std::string &bytes, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        bytes.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+static uint64_t get(const std::string &bytes, size_t &offset, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++)
+        value |= (uint64_t) (uint8_t) bytes[offset + i] << (8 * i);
+    offset += size;
+    return value;
+}
+
+/****************
+Public Functions
+*****************/
+
+/*
+ * Layout (little-endian):
+ *   time (8), age of the cell voltages in ms (4), cycles (2), protection flags (2),
+ *   balance flags (4), state of charge (1), FET status (1), cells (1), sensors (1),
+ *   cell voltages (2 each), temperatures (2 each)
+ */
+std::string BatteryTelemetry::encode() const {
+    size_t numCells   = std::min<size_t>(this->cellVoltages.size(), 255);
+    size_t numSensors = std::min<size_t>(this->temperatures.size(), 255);
+    uint64_t age = (this->cellVoltagesTime != 0 && this->time > this->cellVoltagesTime) ? this->time - this->cellVoltagesTime : 0;
+
+    std::string bytes;
+    bytes.reserve(HEADER_SIZE + 2 * (numCells + numSensors));
+
+    put(bytes, this->time, 8);
+    put(bytes, std::min<uint64_t>(age, std::numeric_limits<uint32_t>::max()), 4);
+    put(bytes, this->cycles, 2);
+    put(bytes, this->protectionFlags, 2);
+    put(bytes, this->balanceFlags, 4);
+    put(bytes, this->stateOfCharge, 1);
+    put(bytes, this->fetStatus, 1);
+    put(bytes, numCells, 1);
+    put(bytes, numSensors, 1);
+
+    for (size_t i = 0; i < numCells; i++)
+        put(bytes, this->cellVoltages[i], 2);
+    for (size_t i = 0; i < numSensors; i++)
+        put(bytes, this->temperatures[i], 2);
+
+    return bytes;
+}
+
+bool BatteryTelemetry::decode(const std::string &bytes, BatteryTelemetry &telemetry) {
+    if (bytes.size() < HEADER_SIZE)
+        return false;
+
+    size_t numCells   = (uint8_t) bytes[22];
+    size_t numSensors = (uint8_t) bytes[23];
+    if (bytes.size() != HEADER_SIZE + 2 * (numCells + numSensors))
+        return false;
+
+    size_t offset = 0;
+    telemetry.time            = get(bytes, offset, 8);
+    uint64_t age              = get(bytes, offset, 4);
+    telemetry.cycles          = get(bytes, offset, 2);
+    telemetry.protectionFlags = get(bytes, offset, 2);
+    telemetry.balanceFlags    = get(bytes, offset, 4);
+    telemetry.stateOfCharge   = get(bytes, offset, 1);
+    telemetry.fetStatus       = get(bytes, offset, 1);
+    offset += 2;
+
+    telemetry.cellVoltagesTime = numCells > 0 ? telemetry.time - age : 0;
+
+    telemetry.cellVoltages.resize(numCells);
+    for (size_t i = 0; i < numCells; i++)
+        telemetry.cellVoltages[i] = get(bytes, offset, 2);
+
+    telemetry.temperatures.resize(numSensors);
+    for (size_t i = 0; i < numSensors; i++)
+        telemetry.temperatures[i] = get(bytes, offset, 2);
+
+    return true;
+}
+
+uint16_t BatteryTelemetry::maxTemperature() const {
+    if (this->temperatures.empty())
+        return 0;
+    return *std::max_element(this->temperatures.begin(), this->temperatures.end());
+}
+
+bool operator==(const BatteryTelemetry &lhs, const BatteryTelemetry &rhs) {
+    return (lhs.time == rhs.time) &&
+           (lhs.cellVoltagesTime == rhs.cellVoltagesTime) &&
+           (lhs.cycles == rhs.cycles) &&
+           (lhs.stateOfCharge == rhs.stateOfCharge) &&
+           (lhs.fetStatus == rhs.fetStatus) &&
+           (lhs.protectionFlags == rhs.protectionFlags) &&
+           (lhs.balanceFlags == rhs.balanceFlags) &&
+           (lhs.cellVoltages == rhs.cellVoltages) &&
+           (lhs.temperatures == rhs.temperatures);
+}
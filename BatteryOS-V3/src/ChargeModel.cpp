@@ -0,0 +1,44 @@
+#include "ChargeModel.hpp"
+
+/***********
+Constructor
+************/
+
+ChargeModel::ChargeModel(std::chrono::milliseconds interval) {
+    this->interval = interval;
+}
+
+/****************
+Public Functions
+*****************/
+
+void ChargeModel::advance(BatteryStatus &status, timestamp_t now) {
+    if (status.current_mA == 0 || now < this->nextStep)
+        return;
+
+    uint64_t steps = (now - this->nextStep) / this->interval + 1;
+    double change  = -status.current_mA / 20; // dividing by 20 used for 3 minute intervals
+
+    // number of steps after which the battery is full (or empty)
+    double room = (change > 0) ? status.max_capacity_mAh - status.capacity_mAh : status.capacity_mAh;
+    uint64_t limit = (room <= 0) ? 1 : (uint64_t) std::ceil(room / std::fabs(change));
+
+    if (steps >= limit) {
+        status.capacity_mAh = (change > 0) ? status.max_capacity_mAh : 0;
+        status.current_mA   = 0;
+        return;
+    }
+
+    status.capacity_mAh += change * steps;
+    this->nextStep += steps * this->interval;
+}
+
+void ChargeModel::setCurrent(BatteryStatus &status, double current_mA, timestamp_t now) {
+    this->advance(status, now);
+
+    if (status.current_mA == 0)
+        this->nextStep = now;
+    status.current_mA = current_mA;
+
+    this->advance(status, now);
+}
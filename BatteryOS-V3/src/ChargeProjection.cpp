@@ -0,0 +1,395 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "ChargeProjection.hpp"
+
+/* mAh drawn by 1 mA flowing for 1 ms */
+static const double MAH_PER_MA_MS = 1.0 / 3600000;
+
+/* current changes smaller than this are treated as zero */
+static const double EPSILON_mA = 1e-9;
+
+/* capacity margin for rounding errors of the projection */
+static const double EPSILON_mAh = 1e-6;
+
+ChargeProjection::ChargeProjection() : baseTime(INT64_MIN), baseCharge(0), baseCurrent_mA(0), origin(0), count(0),
+                                       generator(std::random_device{}()) {}
+
+/**************************
+Private Helper Functions
+***************************/
+
+/**
+ * The charge of a node moves by a linear function of its position, so the
+ * extremes of its subtree move by no more than that function moves between
+ * the first and last position of the subtree.
+ */
+void ChargeProjection::shift(std::unique_ptr<Node> &node, double charge, double current_mA) {
+    if (!node)
+        return;
+
+    double first = current_mA * node->firstPosition;
+    double last  = current_mA * node->lastPosition;
+    node->charge            += charge + current_mA * node->position;
+    node->minCharge         += charge + std::min(first, last);
+    node->maxCharge         += charge + std::max(first, last);
+    node->pendingCharge     += charge;
+    node->pendingCurrent_mA += current_mA;
+}
+
+void ChargeProjection::push(std::unique_ptr<Node> &node) {
+    if (!node || (node->pendingCharge == 0 && node->pendingCurrent_mA == 0))
+        return;
+    shift(node->left, node->pendingCharge, node->pendingCurrent_mA);
+    shift(node->right, node->pendingCharge, node->pendingCurrent_mA);
+    node->pendingCharge     = 0;
+    node->pendingCurrent_mA = 0;
+}
+
+/* the node must have been pushed */
+void ChargeProjection::update(std::unique_ptr<Node> &node) {
+    if (!node)
+        return;
+
+    node->sumDelta_mA   = node->delta_mA;
+    node->minCharge     = node->charge;
+    node->maxCharge     = node->charge;
+    node->firstPosition = node->left ? node->left->firstPosition : node->position;
+    node->lastPosition  = node->right ? node->right->lastPosition : node->position;
+    for (const std::unique_ptr<Node> *child : {&node->left, &node->right}) {
+        if (*child) {
+            node->sumDelta_mA += (*child)->sumDelta_mA;
+            node->minCharge    = std::min(node->minCharge, (*child)->minCharge);
+            node->maxCharge    = std::max(node->maxCharge, (*child)->maxCharge);
+        }
+    }
+}
+
+std::unique_ptr<ChargeProjection::Node> ChargeProjection::merge(std::unique_ptr<Node> left, std::unique_ptr<Node> right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    if (left->priority > right->priority) {
+        push(left);
+        left->right = merge(std::move(left->right), std::move(right));
+        update(left);
+        return left;
+    }
+    push(right);
+    right->left = merge(std::move(left), std::move(right->left));
+    update(right);
+    return right;
+}
+
+/* left receives every key <= key, right every key > key */
+void ChargeProjection::split(std::unique_ptr<Node> node, int64_t key, std::unique_ptr<Node> &left, std::unique_ptr<Node> &right) {
+    if (!node) {
+        left.reset();
+        right.reset();
+        return;
+    }
+
+    push(node);
+    if (node->key <= key) {
+        split(std::move(node->right), key, node->right, right);
+        update(node);
+        left = std::move(node);
+    } else {
+        split(std::move(node->left), key, left, node->left);
+        update(node);
+        right = std::move(node);
+    }
+}
+
+void ChargeProjection::widen(const Node* node, int64_t lo, int64_t hi, double pendingCharge, double pendingCurrent_mA,
+                             double charge, double current_mA, std::pair<double, double> &range) {
+    if (!node)
+        return;
+
+    double offset = pendingCharge + charge;
+    double slope  = pendingCurrent_mA + current_mA;
+    double first  = slope * node->firstPosition;
+    double last   = slope * node->lastPosition;
+    if (node->minCharge + offset + std::min(first, last) >= range.first &&
+        node->maxCharge + offset + std::max(first, last) <= range.second)
+        return;
+
+    if (node->key >= lo && node->key < hi) {
+        double value = node->charge + offset + slope * node->position;
+        range.first  = std::min(range.first, value);
+        range.second = std::max(range.second, value);
+    }
+
+    pendingCharge     += node->pendingCharge;
+    pendingCurrent_mA += node->pendingCurrent_mA;
+    if (node->key > lo)
+        widen(node->left.get(), lo, hi, pendingCharge, pendingCurrent_mA, charge, current_mA, range);
+    if (node->key < hi - 1)
+        widen(node->right.get(), lo, hi, pendingCharge, pendingCurrent_mA, charge, current_mA, range);
+}
+
+bool ChargeProjection::addDelta(std::unique_ptr<Node> &node, int64_t key, double delta_mA) {
+    if (!node)
+        return false;
+
+    push(node);
+    bool found = true;
+    if (key < node->key)
+        found = addDelta(node->left, key, delta_mA);
+    else if (key > node->key)
+        found = addDelta(node->right, key, delta_mA);
+    else
+        node->delta_mA += delta_mA;
+
+    if (found)
+        update(node);
+    return found;
+}
+
+bool ChargeProjection::erase(std::unique_ptr<Node> &node, int64_t key) {
+    if (!node)
+        return false;
+
+    push(node);
+    bool found;
+    if (key < node->key) {
+        found = erase(node->left, key);
+    } else if (key > node->key) {
+        found = erase(node->right, key);
+    } else {
+        node = merge(std::move(node->left), std::move(node->right));
+        return true;
+    }
+
+    if (found)
+        update(node);
+    return found;
+}
+
+double ChargeProjection::positionOf(int64_t time) const {
+    return (double) (time - this->origin) * MAH_PER_MA_MS;
+}
+
+/**
+ * The curve is linear between two breakpoints, so a breakpoint added on
+ * the curve (with no current change yet) does not change it.
+ */
+void ChargeProjection::insertAt(int64_t time) {
+    if (time <= this->baseTime)
+        return;
+    if (!this->root)
+        this->origin = time;
+
+    for (const Node* node = this->root.get(); node; node = (time < node->key) ? node->left.get() : node->right.get()) {
+        if (node->key == time)
+            return;
+    }
+
+    double charge = this->chargeAt(timepoint_t(std::chrono::milliseconds(time)));
+    std::unique_ptr<Node> left, right;
+    split(std::move(this->root), time, left, right);
+    std::unique_ptr<Node> node = std::make_unique<Node>(time, this->positionOf(time), charge, this->generator());
+    this->root = merge(merge(std::move(left), std::move(node)), std::move(right));
+    this->count++;
+}
+
+void ChargeProjection::pruneAt(int64_t time) {
+    for (const Node* node = this->root.get(); node; node = (time < node->key) ? node->left.get() : node->right.get()) {
+        if (node->key == time) {
+            if (std::fabs(node->delta_mA) < EPSILON_mA && erase(this->root, time))
+                this->count--;
+            return;
+        }
+    }
+}
+
+/***************
+Public Functions
+****************/
+
+void ChargeProjection::add(double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    int64_t start = std::max<int64_t>(startTime.time_since_epoch().count(), this->baseTime);
+    int64_t end   = endTime.time_since_epoch().count();
+    if (end <= start || std::fabs(current_mA) < EPSILON_mA)
+        return;
+
+    this->insertAt(start);
+    this->insertAt(end);
+
+    // the charge grows inside the window and is raised by the whole window after it
+    std::unique_ptr<Node> before, window, after;
+    split(std::move(this->root), start, before, after);
+    split(std::move(after), end, window, after);
+    shift(window, -current_mA * this->positionOf(start), current_mA);
+    shift(after, current_mA * (end - start) * MAH_PER_MA_MS, 0);
+    this->root = merge(merge(std::move(before), std::move(window)), std::move(after));
+
+    if (start == this->baseTime)
+        this->baseCurrent_mA += current_mA;
+    else
+        addDelta(this->root, start, current_mA);
+    addDelta(this->root, end, -current_mA);
+
+    this->pruneAt(start);
+    this->pruneAt(end);
+}
+
+void ChargeProjection::consume(timepoint_t time) {
+    int64_t key = time.time_since_epoch().count();
+    if (key <= this->baseTime)
+        return;
+
+    // the curve carries on from the charge and current at time
+    double charge  = this->chargeAt(time);
+    double current = this->baseCurrent_mA;
+    std::unique_ptr<Node> left, right;
+    split(std::move(this->root), key, left, right);
+    this->root = std::move(right);
+    if (left)
+        current += left->sumDelta_mA;
+
+    this->baseTime       = key;
+    this->baseCharge     = charge;
+    this->baseCurrent_mA = current;
+
+    // walk the detached subtree once to keep the node count exact
+    std::vector<std::unique_ptr<Node>> stack;
+    if (left)
+        stack.push_back(std::move(left));
+    while (!stack.empty()) {
+        std::unique_ptr<Node> node = std::move(stack.back());
+        stack.pop_back();
+        this->count--;
+        if (node->left)
+            stack.push_back(std::move(node->left));
+        if (node->right)
+            stack.push_back(std::move(node->right));
+    }
+}
+
+double ChargeProjection::chargeAt(timepoint_t time) const {
+    int64_t key = time.time_since_epoch().count();
+
+    // charges below a node are missing the pending tags of its ancestors
+    double pendingCharge     = 0;
+    double pendingCurrent_mA = 0;
+    double current    = this->baseCurrent_mA;
+    const Node* last  = nullptr;
+    double lastCharge = 0;
+    const Node* node  = this->root.get();
+    while (node) {
+        if (node->key <= key) {
+            current   += node->delta_mA + (node->left ? node->left->sumDelta_mA : 0);
+            last       = node;
+            lastCharge = node->charge + pendingCharge + pendingCurrent_mA * node->position;
+        }
+        pendingCharge     += node->pendingCharge;
+        pendingCurrent_mA += node->pendingCurrent_mA;
+        node = (node->key <= key) ? node->right.get() : node->left.get();
+    }
+
+    if (!last)
+        return this->baseCharge + current * ((double) key - (double) this->baseTime) * MAH_PER_MA_MS;
+    return lastCharge + current * (key - last->key) * MAH_PER_MA_MS;
+}
+
+/**
+ * The curve only bends at breakpoints, so its extremes after time are at
+ * time or at a breakpoint. Every reservation ends, so the curve is flat
+ * after the last breakpoint.
+ */
+std::pair<double, double> ChargeProjection::extremes(timepoint_t time) const {
+    int64_t key = time.time_since_epoch().count();
+    double charge = this->chargeAt(time);
+    std::pair<double, double> range = {charge, charge};
+    widen(this->root.get(), key + 1, INT64_MAX, 0, 0, 0, 0, range);
+    return range;
+}
+
+size_t ChargeProjection::size() const {
+    return this->count;
+}
+
+bool ChargeProjection::admits(const std::vector<Change> &changes, timepoint_t from, double capacity_mAh, double maxCapacity_mAh) {
+    std::pair<double, double> before = this->extremes(from);
+    double fromCharge = this->chargeAt(from);
+    double lowBefore  = capacity_mAh - (before.second - fromCharge);
+    double highBefore = capacity_mAh - (before.first - fromCharge);
+
+    auto violates = [&](double low, double high) {
+        return (low < -EPSILON_mAh && low < lowBefore - EPSILON_mAh) ||
+               (high > maxCapacity_mAh + EPSILON_mAh && high > highBefore + EPSILON_mAh);
+    };
+
+    // each change moves the curve after from by at most the charge it draws (or adds) after from
+    double drawn = 0, added = 0;
+    timepoint_t lastEnd = from;
+    for (const Change &change : changes) {
+        double charge = change.current_mA * std::max<int64_t>(0, (change.endTime - std::max(change.startTime, from)).count()) * MAH_PER_MA_MS;
+        if (charge > 0)
+            drawn += charge;
+        else
+            added -= charge;
+        lastEnd = std::max(lastEnd, change.endTime);
+    }
+    if (!violates(lowBefore - drawn, highBefore + added))
+        return true;
+
+    // once every change has ended the curve is moved by all of them
+    std::pair<double, double> tail = this->extremes(lastEnd);
+    if (violates(capacity_mAh - (tail.second + drawn - added - fromCharge), capacity_mAh - (tail.first + drawn - added - fromCharge)))
+        return false;
+
+    // the changes add a linear function of time to the curve between two
+    // of their start or end times (they only count from baseTime on, like add())
+    int64_t fromKey = from.time_since_epoch().count();
+    if (!this->root)
+        this->origin = fromKey;
+
+    std::vector<Change> effective;
+    std::vector<int64_t> bends = {fromKey};
+    for (const Change &change : changes) {
+        int64_t start = std::max<int64_t>(change.startTime.time_since_epoch().count(), this->baseTime);
+        int64_t end   = change.endTime.time_since_epoch().count();
+        if (end <= start || std::fabs(change.current_mA) < EPSILON_mA)
+            continue;
+        effective.push_back({change.current_mA, timepoint_t(std::chrono::milliseconds(start)), change.endTime});
+        bends.push_back(start);
+        bends.push_back(end);
+    }
+    std::sort(bends.begin(), bends.end());
+    bends.erase(std::unique(bends.begin(), bends.end()), bends.end());
+    bends.erase(bends.begin(), std::lower_bound(bends.begin(), bends.end(), fromKey));
+
+    std::pair<double, double> after;
+    double afterFromCharge = 0;
+    for (size_t i = 0; i < bends.size(); i++) {
+        double charge = 0, current_mA = 0;
+        for (const Change &change : effective) {
+            int64_t start = change.startTime.time_since_epoch().count();
+            int64_t end   = change.endTime.time_since_epoch().count();
+            if (end <= bends[i]) {
+                charge += change.current_mA * (end - start) * MAH_PER_MA_MS;
+            } else if (start <= bends[i]) {
+                charge     -= change.current_mA * this->positionOf(start);
+                current_mA += change.current_mA;
+            }
+        }
+
+        double value = this->chargeAt(timepoint_t(std::chrono::milliseconds(bends[i]))) + charge + current_mA * this->positionOf(bends[i]);
+        if (i == 0) {
+            after = {value, value};
+            afterFromCharge = value;
+        }
+        after.first  = std::min(after.first, value);
+        after.second = std::max(after.second, value);
+
+        int64_t lo = (i == 0) ? bends[i] + 1 : bends[i];
+        int64_t hi = (i + 1 < bends.size()) ? bends[i + 1] : INT64_MAX;
+        widen(this->root.get(), lo, hi, 0, 0, charge, current_mA, after);
+    }
+
+    return !violates(capacity_mAh - (after.second - afterFromCharge), capacity_mAh - (after.first - afterFromCharge));
+}
@@ -63,7 +63,6 @@ BatteryStatus ClientBattery::getStatus() {
 
     bosproto::BatteryStatusResponse response;
     int success = this->connection->read(response);
-    std::cout << response.DebugString() << std::endl;
 
     if (!success) {
         WARNING() << "could not parse response" << std::endl;
@@ -76,6 +75,86 @@ BatteryStatus ClientBattery::getStatus() {
     return BatteryStatus(response.status());
 } 
 
+std::map<std::string, BatteryStatus> ClientBattery::getStatusBatch(const std::vector<std::string>& batteryNames) {
+    bosproto::BatteryCommand command;
+    command.set_command(bosproto::Command::Get_Status_Batch);
+
+    bosproto::StatusBatch* batch = command.mutable_status_batch();
+    for (const std::string& name : batteryNames)
+        batch->add_batterynames(name);
+
+    this->connection->write(command);
+
+    bosproto::BatteryStatusBatchResponse response;
+    int success = this->connection->read(response);
+
+    if (!success) {
+        WARNING() << "could not parse response" << std::endl;
+        throw std::runtime_error("could not parse response");
+    }
+
+    for (const std::string& name : response.missing())
+        WARNING() << name << " does not exist in directory" << std::endl;
+
+    std::map<std::string, BatteryStatus> statuses;
+    for (int i = 0; i < response.batterynames_size(); i++) {
+        BatteryStatus status;
+        status.voltage_mV                 = response.voltage_mv(i);
+        status.current_mA                 = response.current_ma(i);
+        status.capacity_mAh               = response.capacity_mah(i);
+        status.max_capacity_mAh           = response.max_capacity_mah(i);
+        status.max_charging_current_mA    = response.max_charging_current_ma(i);
+        status.max_discharging_current_mA = response.max_discharging_current_ma(i);
+        status.time                       = response.timestamp(i);
+        statuses.insert({response.batterynames(i), status});
+    }
+
+    return statuses;
+}
+
+std::vector<BatteryStatus> ClientBattery::getStatusHistory(timestamp_t startTime, timestamp_t endTime,
+                                                           std::chrono::milliseconds downsample, const std::string& batteryName) {
+    bosproto::BatteryCommand command;
+    command.set_command(bosproto::Command::Get_Status_History);
+
+    bosproto::StatusHistory* params = command.mutable_status_history();
+    params->set_batteryname(batteryName);
+    params->set_starttime(convertToMilliseconds(startTime));
+    params->set_endtime(convertToMilliseconds(endTime));
+    params->set_downsample_ms(downsample.count());
+
+    this->connection->write(command);
+
+    bosproto::BatteryStatusHistoryResponse response;
+    int success = this->connection->read(response);
+
+    if (!success) {
+        WARNING() << "could not parse response" << std::endl;
+        throw std::runtime_error("could not parse response");
+    }
+
+    std::vector<BatteryStatus> history;
+    if (response.return_code() != 0) {
+        WARNING() << response.fail_reason() << std::endl;
+        return history;
+    }
+
+    history.reserve(response.timestamp_size());
+    for (int i = 0; i < response.timestamp_size(); i++) {
+        BatteryStatus status;
+        status.voltage_mV         = response.voltage_mv(i);
+        status.current_mA         = response.current_ma(i);
+        status.capacity_mAh       = response.capacity_mah(i);
+        status.max_capacity_mAh   = response.max_capacity_mah(i);
+        status.max_temperature_dK = response.max_temperature_dk(i);
+        status.protection_flags   = response.protection_flags(i);
+        status.time               = response.timestamp(i);
+        history.push_back(status);
+    }
+
+    return history;
+}
+
 bool ClientBattery::setBatteryStatus(const BatteryStatus& status) {
     std::cout << "set battery status" << std::endl;
     bosproto::BatteryCommand command;
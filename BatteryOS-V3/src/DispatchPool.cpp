@@ -0,0 +1,115 @@
+#include "DispatchPool.hpp"
+#include "util.hpp"
+
+DispatchPool::~DispatchPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->quit = true;
+    }
+    this->condition.notify_all();
+
+    for (std::thread &worker : this->workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+DispatchPool::DispatchPool(unsigned int numThreads) {
+    this->quit = false;
+
+    if (numThreads == 0)
+        numThreads = 1;
+
+    for (unsigned int i = 0; i < numThreads; i++)
+        this->workers.push_back(std::thread(&DispatchPool::runWorker, this));
+}
+
+void DispatchPool::runWorker() {
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+    while (true) {
+        this->condition.wait(uniqueLock, [this]{ return !this->readyKeys.empty() || this->quit; });
+        if (this->quit)
+            return;
+
+        battery_id_t key = this->readyKeys.front();
+        this->readyKeys.pop_front();
+
+        Strand &strand = this->strands[key];
+        std::function<void()> task = std::move(strand.tasks.front());
+        strand.tasks.pop_front();
+
+        uniqueLock.unlock();
+        runTask(key, task);
+        uniqueLock.lock();
+
+        // the key stays off readyKeys while its task runs, which is what
+        // keeps the tasks of one key serialized
+        auto iter = this->strands.find(key);
+        if (iter->second.tasks.empty()) {
+            this->strands.erase(iter);
+        } else {
+            this->readyKeys.push_back(key);
+            this->condition.notify_one();
+        }
+    }
+}
+
+void DispatchPool::runTask(battery_id_t key, const std::function<void()> &task) {
+    try {
+        task();
+    } catch (const std::exception &e) {
+        WARNING() << "dispatched task for " << getBatteryNameOf(key) << " threw: " << e.what() << std::endl;
+    }
+}
+
+void DispatchPool::runClaimed(Batch &batch, size_t index) {
+    if (batch.claimed[index].exchange(true))
+        return;
+
+    runTask(batch.tasks[index].first, batch.tasks[index].second);
+
+    std::lock_guard<std::mutex> guard(batch.lock);
+    if (--batch.remaining == 0)
+        batch.finished.notify_all();
+}
+
+/**
+ * Whoever claims a task first runs it: a worker that reaches a task the
+ * caller already ran returns right away.
+ */
+void DispatchPool::runAll(std::vector<std::pair<battery_id_t, std::function<void()>>> tasks) {
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->tasks     = std::move(tasks);
+    batch->claimed   = std::unique_ptr<std::atomic<bool>[]>(new std::atomic<bool>[batch->tasks.size()]);
+    batch->remaining = batch->tasks.size();
+    for (size_t i = 0; i < batch->tasks.size(); i++)
+        batch->claimed[i] = false;
+
+    for (size_t i = 0; i < batch->tasks.size(); i++)
+        this->submit(batch->tasks[i].first, [batch, i]() { runClaimed(*batch, i); });
+
+    // the workers take the tasks from the front, so start from the back
+    for (size_t i = batch->tasks.size(); i > 0; i--)
+        runClaimed(*batch, i - 1);
+
+    std::unique_lock<std::mutex> uniqueLock(batch->lock);
+    batch->finished.wait(uniqueLock, [&batch]{ return batch->remaining == 0; });
+}
+
+void DispatchPool::submit(battery_id_t key, std::function<void()> task) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto iter = this->strands.find(key);
+    if (iter != this->strands.end()) {
+        iter->second.tasks.push_back(std::move(task));
+        return;
+    }
+
+    this->strands[key].tasks.push_back(std::move(task));
+    this->readyKeys.push_back(key);
+    this->condition.notify_one();
+}
+
+size_t DispatchPool::size() const {
+    return this->workers.size();
+}
@@ -0,0 +1,284 @@
+#include "DriverRegistry.hpp"
+
+#include <set>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+/**********************
+Constructor/Destructor
+***********************/
+
+DriverLibrary::~DriverLibrary() {
+    LOG() << "unloading " << this->path << " (build " << this->generation << ")" << std::endl;
+    dlclose(this->handle);
+}
+
+DriverLibrary::DriverLibrary(void* handle, const std::string &path, uint64_t generation) {
+    this->handle     = handle;
+    this->path       = path;
+    this->generation = generation;
+}
+
+DriverRegistry::DriverRegistry(const std::string &directory) {
+    this->directory = directory;
+    if (!this->directory.empty() && this->directory.back() != '/')
+        this->directory += '/';
+}
+
+/***************
+Public Functions
+****************/
+
+size_t DriverRegistry::scan() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+
+    DIR* dir = opendir(this->directory.c_str());
+    if (dir == NULL) {
+        WARNING() << "could not open driver directory " << this->directory << std::endl;
+        return 0;
+    }
+
+    size_t numLoaded = 0;
+    std::set<std::string> present;
+    std::string extension = DYLIB_EXT;
+
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= extension.size() || name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+            continue;
+
+        std::string path = this->directory + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == -1 || !S_ISREG(info.st_mode))
+            continue;
+        present.insert(path);
+
+        // a build (or copy) written to the file changes its inode, size or modification time
+        auto file = this->libraries.find(path);
+        if (file != this->libraries.end() &&
+            file->second.device == info.st_dev && file->second.inode == info.st_ino && file->second.size == info.st_size &&
+            file->second.modified.tv_sec == info.st_mtim.tv_sec && file->second.modified.tv_nsec == info.st_mtim.tv_nsec)
+            continue;
+
+        uint64_t generation = (file == this->libraries.end()) ? 0 : file->second.generation + 1;
+        std::vector<std::shared_ptr<const LoadedDriver>> loaded;
+        std::shared_ptr<DriverLibrary> library = this->load(path, generation, loaded);
+
+        LibraryFile record = {info.st_dev, info.st_ino, info.st_size, info.st_mtim, generation, library};
+        if (library == nullptr) {
+            // keep running the previous build (and do not retry this one until the file changes again)
+            if (file != this->libraries.end())
+                record.library = file->second.library;
+            this->libraries[path] = record;
+            continue;
+        }
+
+        if (file != this->libraries.end() && file->second.library != nullptr)
+            this->removeDrivers(file->second.library);
+
+        for (const std::shared_ptr<const LoadedDriver> &driver : loaded) {
+            auto previous = this->drivers.find(driver->constructorName);
+            if (previous != this->drivers.end())
+                WARNING() << driver->constructorName << " of " << path << " replaces the one of " << previous->second->library->path << std::endl;
+            this->drivers[driver->constructorName] = driver;
+        }
+
+        LOG() << "loaded " << loaded.size() << " drivers from " << path << " (build " << generation << ")" << std::endl;
+        this->libraries[path] = record;
+        numLoaded++;
+    }
+    closedir(dir);
+
+    // batteries of a removed library keep running, but no new ones are created from it
+    for (auto file = this->libraries.begin(); file != this->libraries.end();) {
+        if (present.count(file->first) != 0) {
+            file++;
+            continue;
+        }
+        if (file->second.library != nullptr)
+            this->removeDrivers(file->second.library);
+        file = this->libraries.erase(file);
+    }
+
+    return numLoaded;
+}
+
+std::shared_ptr<const LoadedDriver> DriverRegistry::find(const std::string &constructor) const {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    auto driver = this->drivers.find(constructor);
+    if (driver == this->drivers.end())
+        return nullptr;
+    return driver->second;
+}
+
+std::shared_ptr<const LoadedDriver> DriverRegistry::resolve(const std::string &constructor,
+                                                            const std::string &destructor,
+                                                            const std::string &refreshFunc,
+                                                            const std::string &setCurrentFunc,
+                                                            const std::string &telemetryFunc,
+                                                            std::string &error) const
+{
+    std::shared_ptr<const LoadedDriver> driver = this->find(constructor);
+    if (driver == nullptr) {
+        error = "no driver with constructor " + constructor;
+        return nullptr;
+    }
+
+    if (destructor != driver->destructorName || refreshFunc != driver->refreshName || setCurrentFunc != driver->setCurrentName) {
+        error = "functions do not belong to driver " + driver->name + " (" + driver->constructorName + ", " + driver->destructorName +
+                ", " + driver->refreshName + ", " + driver->setCurrentName + ")";
+        return nullptr;
+    }
+
+    if (!telemetryFunc.empty() && telemetryFunc != driver->telemetryName) {
+        error = "driver " + driver->name + " has no telemetry function " + telemetryFunc;
+        return nullptr;
+    }
+    return driver;
+}
+
+std::vector<std::string> DriverRegistry::getDrivers() const {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    std::vector<std::string> names;
+    for (const auto &driver : this->drivers)
+        names.push_back(driver.second->name);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool DriverRegistry::validate(const DriverTable* table, std::string &error) {
+    if (table == nullptr) {
+        error = "no driver table";
+        return false;
+    }
+    if (table->abiVersion != BOS_DRIVER_ABI_VERSION) {
+        error = "driver ABI version " + std::to_string(table->abiVersion) + " (BOS has version " + std::to_string(BOS_DRIVER_ABI_VERSION) + ")";
+        return false;
+    }
+    if (table->statusSize != sizeof(BatteryStatus)) {
+        error = "built with a BatteryStatus of " + std::to_string(table->statusSize) + " bytes (BOS has " +
+                std::to_string(sizeof(BatteryStatus)) + " bytes)";
+        return false;
+    }
+    if (table->numDrivers == 0 || table->drivers == nullptr) {
+        error = "no drivers in driver table";
+        return false;
+    }
+
+    const uint32_t capabilities = DRIVER_CHARGE | DRIVER_DISCHARGE | DRIVER_TELEMETRY;
+    std::set<std::string> names, constructors;
+
+    for (uint32_t i = 0; i < table->numDrivers; i++) {
+        const DriverEntry &entry = table->drivers[i];
+        const char* functions[] = {entry.name, entry.constructor, entry.destructor, entry.refresh, entry.setCurrent};
+
+        if (std::any_of(std::begin(functions), std::end(functions), [](const char* name) { return name == nullptr || *name == '\0'; })) {
+            error = "driver " + std::to_string(i) + " is missing a name or function";
+            return false;
+        }
+        if ((entry.capabilities & ~capabilities) != 0) {
+            error = "driver " + std::string(entry.name) + " has unknown capabilities";
+            return false;
+        }
+        if (((entry.capabilities & DRIVER_TELEMETRY) != 0) != (entry.telemetry != nullptr && *entry.telemetry != '\0')) {
+            error = "driver " + std::string(entry.name) + " has a telemetry function without the telemetry capability or the other way around";
+            return false;
+        }
+        if (!names.insert(entry.name).second || !constructors.insert(entry.constructor).second) {
+            error = "driver " + std::string(entry.name) + " appears twice";
+            return false;
+        }
+    }
+    return true;
+}
+
+/****************
+Private Functions
+*****************/
+
+/*
+ * Loads a private copy of the library (dlopen returns the library that is
+ * already loaded for a path it has seen, and a build written over a
+ * loaded library would change the code of running batteries), checks its
+ * driver table and resolves the functions of its drivers.
+ */
+std::shared_ptr<DriverLibrary> DriverRegistry::load(const std::string &path, uint64_t generation,
+                                                    std::vector<std::shared_ptr<const LoadedDriver>> &loaded) const
+{
+    std::string copy = path + ".XXXXXX";
+    int fd = mkstemp(&copy[0]);
+    if (fd == -1) {
+        WARNING() << "could not copy " << path << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    close(fd);
+
+    std::ifstream input(path, std::ios::binary);
+    std::ofstream output(copy, std::ios::binary | std::ios::trunc);
+    output << input.rdbuf();
+    output.close();
+
+    void* handle = (input && output) ? dlopen(copy.c_str(), RTLD_LAZY | RTLD_LOCAL) : NULL;
+    const char* dlerr = (handle == NULL) ? dlerror() : NULL;
+    unlink(copy.c_str());
+
+    if (handle == NULL) {
+        WARNING() << "could not load " << path << ": " << (dlerr ? dlerr : "copy failed") << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<DriverLibrary> library = std::make_shared<DriverLibrary>(handle, path, generation);
+    driver_table_t tableFunc = (driver_table_t) dlsym(handle, BOS_DRIVER_TABLE_SYMBOL);
+
+    std::string error;
+    if (!validate(tableFunc ? tableFunc() : nullptr, error)) {
+        WARNING() << "not loading " << path << ": " << error << std::endl;
+        return nullptr;
+    }
+
+    const DriverTable* table = tableFunc();
+    for (uint32_t i = 0; i < table->numDrivers; i++) {
+        const DriverEntry &entry = table->drivers[i];
+        std::shared_ptr<LoadedDriver> driver = std::make_shared<LoadedDriver>();
+
+        driver->name            = entry.name;
+        driver->capabilities    = entry.capabilities;
+        driver->constructorName = entry.constructor;
+        driver->destructorName  = entry.destructor;
+        driver->refreshName     = entry.refresh;
+        driver->setCurrentName  = entry.setCurrent;
+        driver->telemetryName   = entry.telemetry ? entry.telemetry : "";
+        driver->constructor     = (construct_t) dlsym(handle, entry.constructor);
+        driver->destructor      = (destruct_t) dlsym(handle, entry.destructor);
+        driver->refreshFunc     = (refresh_t) dlsym(handle, entry.refresh);
+        driver->setCurrentFunc  = (set_current_t) dlsym(handle, entry.setCurrent);
+        driver->telemetryFunc   = entry.telemetry ? (telemetry_t) dlsym(handle, entry.telemetry) : nullptr;
+        driver->library         = library;
+
+        if (driver->constructor == nullptr || driver->destructor == nullptr || driver->refreshFunc == nullptr ||
+            driver->setCurrentFunc == nullptr || (entry.telemetry != nullptr && driver->telemetryFunc == nullptr)) {
+            WARNING() << "not loading " << path << ": a function of driver " << entry.name << " is not exported" << std::endl;
+            loaded.clear();
+            return nullptr;
+        }
+        loaded.push_back(driver);
+    }
+    return library;
+}
+
+void DriverRegistry::removeDrivers(const std::shared_ptr<DriverLibrary> &library) {
+    for (auto driver = this->drivers.begin(); driver != this->drivers.end();) {
+        if (driver->second->library == library)
+            driver = this->drivers.erase(driver);
+        else
+            driver++;
+    }
+}
@@ -2,6 +2,8 @@
 
 DynamicBattery::~DynamicBattery() {
     PRINT() << "DYNAMIC DESTRUCTOR" << std::endl;
+    if (!this->quitThread)
+        quit();
     this->destructor(this->battery);
 }
 
@@ -12,7 +14,9 @@ DynamicBattery::DynamicBattery(void* initArgs,
                                void* setCurrentFunc,
                                const std::string& batteryName,
                                const std::chrono::milliseconds& maxStaleness,
-                               const RefreshMode& refreshMode) : PhysicalBattery(batteryName,
+                               const RefreshMode& refreshMode,
+                               void* telemetryFunc,
+                               std::shared_ptr<void> library) : PhysicalBattery(batteryName,
                                                                                  maxStaleness,
                                                                                  refreshMode)
 {
@@ -21,12 +25,39 @@ DynamicBattery::DynamicBattery(void* initArgs,
     this->destructor     = (destruct_t)destructor;
     this->constructor    = (construct_t)constructor; 
     this->setCurrentFunc = (set_current_t)setCurrentFunc;
+    this->telemetryFunc  = (telemetry_t)telemetryFunc;
+    this->library        = library;
 
     this->battery = this->constructor(initArgs);
 }
 
 BatteryStatus DynamicBattery::refresh() {
-    return this->refreshFunc(this->battery);
+    BatteryStatus status = this->refreshFunc(this->battery);
+    if (this->telemetryFunc == nullptr)
+        return status;
+
+    uint8_t buffer[512];
+    size_t size = this->telemetryFunc(this->battery, buffer, sizeof(buffer));
+    if (size > sizeof(buffer)) {
+        std::vector<uint8_t> bytes(size);
+        size = this->telemetryFunc(this->battery, bytes.data(), bytes.size());
+        if (size <= bytes.size())
+            BatteryTelemetry::decode(std::string((char*) bytes.data(), size), this->telemetry);
+    } else if (size > 0) {
+        BatteryTelemetry::decode(std::string((char*) buffer, size), this->telemetry);
+    }
+    return status;
+}
+
+bool DynamicBattery::getTelemetry(BatteryTelemetry &telemetry) {
+    if (this->telemetryFunc == nullptr)
+        return false;
+
+    lockguard_t mutexLock(this->lock);
+    if (this->telemetry.time == 0)
+        return false;
+    telemetry = this->telemetry;
+    return true;
 }
 
 bool DynamicBattery::set_current(double current_mA) {
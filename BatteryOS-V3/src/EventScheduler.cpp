@@ -0,0 +1,359 @@
+#include "EventScheduler.hpp"
+#include "BatteryInterface.hpp"
+
+static std::mutex schedulerLock;
+static std::shared_ptr<EventScheduler> defaultScheduler;
+
+std::shared_ptr<EventScheduler> getEventScheduler(void) {
+    std::lock_guard<std::mutex> guard(schedulerLock);
+    if (defaultScheduler == nullptr)
+        defaultScheduler = std::make_shared<TimerWheelScheduler>();
+    return defaultScheduler;
+}
+
+void setEventScheduler(std::shared_ptr<EventScheduler> scheduler) {
+    std::lock_guard<std::mutex> guard(schedulerLock);
+    defaultScheduler = scheduler;
+}
+
+/************************
+ThreadedEventScheduler
+*************************/
+
+ThreadedEventScheduler::ThreadedEventScheduler(std::shared_ptr<BatteryClock> clock) {
+    this->clock = clock;
+}
+
+ThreadedEventScheduler::~ThreadedEventScheduler() {
+    std::vector<Battery*> batteries;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (const auto &iter : this->workers)
+            batteries.push_back(iter.first);
+    }
+    for (Battery* battery : batteries)
+        this->cancel(battery);
+}
+
+void ThreadedEventScheduler::runWorker(Battery* battery, Worker* worker) {
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+    while (!worker->quit) {
+        if (!worker->armed) {
+            worker->condition_variable.wait(uniqueLock, [worker]{ return worker->armed || worker->quit; });
+            continue;
+        }
+
+        if (worker->condition_variable.wait_for(uniqueLock, worker->deadline - this->clock->monotonicNow()) != std::cv_status::timeout)
+            continue;
+        if (worker->quit || !worker->armed || this->clock->monotonicNow() < worker->deadline)
+            continue;
+
+        worker->armed = false;
+        uniqueLock.unlock();
+        battery->dispatchEvents();
+        uniqueLock.lock();
+    }
+}
+
+void ThreadedEventScheduler::schedule(Battery* battery, timepoint_t time) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto iter = this->workers.find(battery);
+    if (iter == this->workers.end()) {
+        std::unique_ptr<Worker> worker = std::make_unique<Worker>();
+        worker->quit   = false;
+        worker->armed  = false;
+        worker->thread = std::thread(&ThreadedEventScheduler::runWorker, this, battery, worker.get());
+        iter = this->workers.insert({battery, std::move(worker)}).first;
+    }
+
+    Worker* worker = iter->second.get();
+    monotonic_t deadline = this->clock->toMonotonic(time);
+    if (!worker->armed || deadline < worker->deadline) {
+        worker->armed    = true;
+        worker->deadline = deadline;
+        worker->condition_variable.notify_one();
+    }
+}
+
+void ThreadedEventScheduler::cancel(Battery* battery) {
+    std::unique_ptr<Worker> worker;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        auto iter = this->workers.find(battery);
+        if (iter == this->workers.end())
+            return;
+        worker = std::move(iter->second);
+        this->workers.erase(iter);
+        worker->quit = true;
+        worker->condition_variable.notify_one();
+    }
+
+    if (worker->thread.get_id() == std::this_thread::get_id())
+        worker->thread.detach();
+    else if (worker->thread.joinable())
+        worker->thread.join();
+}
+
+/*********************
+TimerWheelScheduler
+**********************/
+
+TimerWheelScheduler::~TimerWheelScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->quit = true;
+    }
+    this->timerCondition.notify_all();
+    this->readyCondition.notify_all();
+
+    if (this->timerThread.joinable())
+        this->timerThread.join();
+    for (std::thread &worker : this->workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+TimerWheelScheduler::TimerWheelScheduler(unsigned int numWorkers, std::shared_ptr<BatteryClock> clock) {
+    this->clock       = clock;
+    this->quit        = false;
+    this->numArmed    = 0;
+    this->counter     = 0;
+    this->currentTick = 0;
+    this->startTime   = clock->monotonicNow();
+    this->wheel.resize(WHEEL_LEVELS * WHEEL_SLOTS);
+
+    if (numWorkers == 0)
+        numWorkers = 1;
+
+    this->timerThread = std::thread(&TimerWheelScheduler::runTimer, this);
+    for (unsigned int i = 0; i < numWorkers; i++)
+        this->workers.push_back(std::thread(&TimerWheelScheduler::runWorker, this));
+}
+
+uint64_t TimerWheelScheduler::toTick(monotonic_t time) const {
+    if (time <= this->startTime)
+        return 0;
+    return std::chrono::ceil<std::chrono::milliseconds>(time - this->startTime).count();
+}
+
+void TimerWheelScheduler::insertTimer(const Timer& timer) {
+    if (timer.expires <= this->currentTick) {
+        this->expireTimer(timer);
+        return;
+    }
+
+    uint64_t delta   = timer.expires - this->currentTick;
+    uint64_t expires = timer.expires;
+
+    // timers past the range of the wheel wait in the top level and are
+    // re-inserted (with their real expiry) when that slot cascades
+    if (delta >= WHEEL_RANGE) {
+        delta   = WHEEL_RANGE - 1;
+        expires = this->currentTick + delta;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    uint64_t slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    this->wheel[level * WHEEL_SLOTS + slot].push_back(timer);
+}
+
+void TimerWheelScheduler::expireTimer(const Timer& timer) {
+    auto iter = this->entries.find(timer.battery);
+    if (iter == this->entries.end())
+        return;
+
+    Entry &entry = iter->second;
+    if (!entry.armed || entry.generation != timer.generation)
+        return;
+
+    entry.armed = false;
+    this->numArmed--;
+    this->readyQueue.push_back({timer.battery, entry.epoch});
+    this->readyCondition.notify_one();
+}
+
+void TimerWheelScheduler::advance() {
+    this->currentTick++;
+
+    // cascade a level every time the levels below it wrap around
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if ((this->currentTick & (((uint64_t)1 << (WHEEL_BITS * level)) - 1)) != 0)
+            break;
+
+        uint64_t slot = (this->currentTick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        std::vector<Timer> timers;
+        timers.swap(this->wheel[level * WHEEL_SLOTS + slot]);
+        for (const Timer &timer : timers)
+            this->insertTimer(timer);
+    }
+
+    std::vector<Timer> timers;
+    timers.swap(this->wheel[this->currentTick & WHEEL_MASK]);
+    for (const Timer &timer : timers)
+        this->expireTimer(timer);
+}
+
+void TimerWheelScheduler::runTimer() {
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+    while (!this->quit) {
+        uint64_t now = this->toTick(this->clock->monotonicNow());
+        while (this->currentTick < now)
+            this->advance();
+
+        // waits are relative (steady) so they are measured on the clock's monotonic time
+        if (this->numArmed == 0)
+            this->timerCondition.wait(uniqueLock, [this]{ return this->numArmed > 0 || this->quit; });
+        else
+            this->timerCondition.wait_for(uniqueLock, this->startTime + std::chrono::milliseconds(this->currentTick + 1) - this->clock->monotonicNow());
+    }
+}
+
+void TimerWheelScheduler::runWorker() {
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+    while (true) {
+        this->readyCondition.wait(uniqueLock, [this]{ return !this->readyQueue.empty() || this->quit; });
+        if (this->quit)
+            return;
+
+        Ready ready = this->readyQueue.front();
+        this->readyQueue.pop_front();
+
+        auto iter = this->entries.find(ready.battery);
+        if (iter == this->entries.end() || iter->second.epoch != ready.epoch)
+            continue;
+
+        this->inFlight[ready.battery]++;
+        uniqueLock.unlock();
+        ready.battery->dispatchEvents();
+        uniqueLock.lock();
+
+        if (--this->inFlight[ready.battery] == 0) {
+            this->inFlight.erase(ready.battery);
+            this->idleCondition.notify_all();
+        }
+    }
+}
+
+void TimerWheelScheduler::schedule(Battery* battery, timepoint_t time) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto iter = this->entries.find(battery);
+    if (iter == this->entries.end())
+        iter = this->entries.insert({battery, Entry{false, ++this->counter, 0, 0}}).first;
+
+    Entry &entry     = iter->second;
+    uint64_t expires = this->toTick(this->clock->toMonotonic(time));
+    if (entry.armed && entry.expires <= expires)
+        return;
+
+    // with nothing armed the timer thread stops advancing the wheel, so
+    // catch up here instead of walking every idle tick later
+    if (this->numArmed == 0) {
+        uint64_t now = this->toTick(this->clock->monotonicNow());
+        if (now > this->currentTick)
+            this->currentTick = now;
+    }
+
+    if (!entry.armed)
+        this->numArmed++;
+    entry.armed      = true;
+    entry.expires    = expires;
+    entry.generation = ++this->counter;
+
+    this->insertTimer(Timer{battery, entry.generation, expires});
+    this->timerCondition.notify_one();
+}
+
+void TimerWheelScheduler::cancel(Battery* battery) {
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+
+    auto iter = this->entries.find(battery);
+    if (iter != this->entries.end()) {
+        if (iter->second.armed)
+            this->numArmed--;
+        this->entries.erase(iter);
+    }
+
+    // a battery quitting from inside its own dispatch must not wait on itself
+    if (this->inFlight.count(battery) == 1 && this->inFlight[battery] > 0) {
+        for (const std::thread &worker : this->workers) {
+            if (worker.get_id() == std::this_thread::get_id())
+                return;
+        }
+    }
+
+    this->idleCondition.wait(uniqueLock, [this, battery]{ return this->inFlight.count(battery) == 0; });
+}
+
+/*********************
+SimulationScheduler
+**********************/
+
+SimulationScheduler::SimulationScheduler(std::shared_ptr<ManualClock> clock) {
+    this->clock   = clock;
+    this->counter = 0;
+}
+
+void SimulationScheduler::schedule(Battery* battery, timepoint_t time) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    Entry &entry = this->entries[battery];
+    if (entry.armed && entry.time <= time)
+        return;
+
+    entry.armed      = true;
+    entry.time       = time;
+    entry.generation = ++this->counter;
+    this->queue.push(Wakeup{time, entry.generation, battery});
+}
+
+void SimulationScheduler::cancel(Battery* battery) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->entries.erase(battery);
+}
+
+uint64_t SimulationScheduler::runUntil(timepoint_t end) {
+    uint64_t dispatched = 0;
+
+    while (true) {
+        Battery* battery;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            if (this->queue.empty() || this->queue.top().time > end)
+                break;
+
+            Wakeup wakeup = this->queue.top();
+            this->queue.pop();
+
+            auto iter = this->entries.find(wakeup.battery);
+            if (iter == this->entries.end() || !iter->second.armed || iter->second.generation != wakeup.generation)
+                continue;
+
+            iter->second.armed = false;
+            battery = wakeup.battery;
+            this->clock->set(wakeup.time);
+        }
+
+        // the battery re-arms the scheduler from inside dispatchEvents()
+        battery->dispatchEvents();
+        dispatched++;
+    }
+
+    this->clock->set(end);
+    return dispatched;
+}
+
+size_t SimulationScheduler::pending() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    size_t armed = 0;
+    for (const auto &iter : this->entries) {
+        if (iter.second.armed)
+            armed++;
+    }
+    return armed;
+}
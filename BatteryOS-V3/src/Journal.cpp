@@ -0,0 +1,310 @@
+#include "Journal.hpp"
+#include "BatteryClock.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+/*
+ * [length][CRC-32][message]
+ */
+static std::string frame(const google::protobuf::MessageLite &message) {
+    uint32_t length = message.ByteSizeLong();
+    std::string buffer(HEADER_SIZE + length, '\0');
+    message.SerializeToArray(&buffer[HEADER_SIZE], length);
+
+    uint32_t crc = util::crc32(&buffer[HEADER_SIZE], length);
+    memcpy(&buffer[0], &length, sizeof(length));
+    memcpy(&buffer[sizeof(length)], &crc, sizeof(crc));
+    return buffer;
+}
+
+/*
+ * parses the framed message at offset (false if it is torn or corrupt)
+ */
+static bool unframe(const std::string &data, size_t &offset, google::protobuf::MessageLite &message) {
+    if (data.size() - offset < HEADER_SIZE)
+        return false;
+
+    uint32_t length, crc;
+    memcpy(&length, &data[offset], sizeof(length));
+    memcpy(&crc, &data[offset + sizeof(length)], sizeof(crc));
+    if (length > data.size() - offset - HEADER_SIZE)
+        return false;
+
+    const char* payload = &data[offset + HEADER_SIZE];
+    if (util::crc32(payload, length) != crc || !message.ParseFromArray(payload, length))
+        return false;
+
+    offset += HEADER_SIZE + length;
+    return true;
+}
+
+static bool writeAll(int fd, const std::string &buffer) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t numBytes = write(fd, buffer.data() + written, buffer.size() - written);
+        if (numBytes == -1 && errno == EINTR)
+            continue;
+        if (numBytes <= 0)
+            return false;
+        written += numBytes;
+    }
+    return true;
+}
+
+static bool readAll(int fd, std::string &buffer) {
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+        return false;
+
+    buffer.resize(info.st_size);
+    size_t numRead = 0;
+    while (numRead < buffer.size()) {
+        ssize_t numBytes = pread(fd, &buffer[numRead], buffer.size() - numRead, numRead);
+        if (numBytes == -1 && errno == EINTR)
+            continue;
+        if (numBytes <= 0)
+            break;
+        numRead += numBytes;
+    }
+    buffer.resize(numRead);
+    return true;
+}
+
+static bool isReservation(const bosproto::Journal_Record &record) {
+    return record.has_battery_command() && record.battery_command().command() == bosproto::Command::Schedule_Set_Current;
+}
+
+static bool isStatus(const bosproto::Journal_Record &record) {
+    return record.has_battery_command() && record.battery_command().command() == bosproto::Command::Set_Status;
+}
+
+/**********************
+Constructor/Destructor
+***********************/
+
+Journal::~Journal() {
+    if (this->fd != -1)
+        close(this->fd);
+}
+
+Journal::Journal(const std::string &path, size_t snapshotEvery, bool syncWrites) {
+    this->path          = path;
+    this->snapshotPath  = path + ".snapshot";
+    this->syncWrites    = syncWrites;
+    this->snapshotEvery = snapshotEvery;
+    this->numRecords    = 0;
+    this->nextSnapshot  = snapshotEvery;
+    this->lsn           = 0;
+
+    this->fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->fd == -1) {
+        WARNING() << "could not open journal " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    this->load();
+}
+
+/*****************
+Private Functions
+******************/
+
+void Journal::load() {
+    this->loadSnapshot();
+    uint64_t snapshotLSN = this->lsn;
+
+    std::string data;
+    if (!readAll(this->fd, data)) {
+        WARNING() << "could not read journal " << this->path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    size_t offset = 0;
+    bosproto::Journal_Record record;
+    while (offset < data.size() && unframe(data, offset, record)) {
+        this->numRecords++;
+        // already in the snapshot (BOS stopped before the journal was emptied)
+        if (record.lsn() <= snapshotLSN)
+            continue;
+        this->lsn = record.lsn();
+        this->track(std::move(record));
+    }
+
+    if (offset < data.size()) {
+        WARNING() << "dropping " << data.size() - offset << " bytes of a torn record at the end of " << this->path << std::endl;
+        if (ftruncate(this->fd, offset) == -1)
+            WARNING() << "could not truncate journal " << this->path << ": " << strerror(errno) << std::endl;
+    }
+}
+
+bool Journal::loadSnapshot() {
+    int snapshotFD = open(this->snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (snapshotFD == -1)
+        return false;
+
+    std::string data;
+    bool success = readAll(snapshotFD, data);
+    close(snapshotFD);
+
+    size_t offset = 0;
+    bosproto::Journal_Snapshot snapshot;
+    if (!success || !unframe(data, offset, snapshot)) {
+        WARNING() << "snapshot " << this->snapshotPath << " is corrupt, recovering from the journal only" << std::endl;
+        return false;
+    }
+
+    for (bosproto::Journal_Record &record : *snapshot.mutable_records())
+        this->track(std::move(record));
+    this->lsn = snapshot.lsn();
+    return true;
+}
+
+void Journal::track(bosproto::Journal_Record &&record) {
+    auto status = this->statuses.find(record.batteryname());
+    if (isStatus(record)) {
+        // a status no reservation was admitted against is replaced in its
+        // place, which no reservation of the battery falls between
+        if (status != this->statuses.end() && !status->second.reserved) {
+            bosproto::Journal_Record &replaced = this->records[status->second.lsn];
+            replaced = std::move(record);
+            replaced.set_lsn(status->second.lsn);
+            return;
+        }
+        this->statuses[record.batteryname()] = {record.lsn(), false};
+    } else if (isReservation(record) && status != this->statuses.end()) {
+        status->second.reserved = true;
+    }
+    // records are tracked in LSN order, so each one goes at the end
+    this->records.emplace_hint(this->records.end(), record.lsn(), std::move(record));
+}
+
+bool Journal::append(bosproto::Journal_Record &record) {
+    if (this->fd == -1)
+        return false;
+
+    record.set_lsn(this->lsn + 1);
+    if (!writeAll(this->fd, frame(record)) || (this->syncWrites && fdatasync(this->fd) == -1)) {
+        WARNING() << "could not write to journal " << this->path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    this->lsn++;
+    this->numRecords++;
+    this->track(std::move(record));
+
+    // a failed snapshot is not retried on every append (a disk that is full stays full for a while)
+    if (this->snapshotEvery != 0 && this->numRecords >= this->nextSnapshot && !this->takeSnapshot())
+        this->nextSnapshot = this->numRecords + this->snapshotEvery;
+    return true;
+}
+
+bool Journal::takeSnapshot() {
+    uint64_t now = convertToMilliseconds(getClock()->now());
+
+    // reservations that have ended are not replayed, and tracking the rest
+    // again merges the statuses that were only kept for them
+    std::map<uint64_t, bosproto::Journal_Record> live;
+    live.swap(this->records);
+    this->statuses.clear();
+    for (auto &record : live) {
+        if (isReservation(record.second) && record.second.battery_command().schedule_set_current().endtime() <= now)
+            continue;
+        this->track(std::move(record.second));
+    }
+
+    bosproto::Journal_Snapshot snapshot;
+    snapshot.set_lsn(this->lsn);
+    for (const auto &record : this->records)
+        *snapshot.add_records() = record.second;
+
+    std::string temporary = this->snapshotPath + ".tmp";
+    int snapshotFD = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (snapshotFD == -1 || !writeAll(snapshotFD, frame(snapshot)) || fsync(snapshotFD) == -1) {
+        WARNING() << "could not write snapshot " << temporary << ": " << strerror(errno) << std::endl;
+        if (snapshotFD != -1)
+            close(snapshotFD);
+        unlink(temporary.c_str());
+        return false;
+    }
+    close(snapshotFD);
+
+    if (rename(temporary.c_str(), this->snapshotPath.c_str()) == -1) {
+        WARNING() << "could not rename snapshot " << temporary << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    // the rename has to reach the disk before the journal is emptied
+    size_t slash = this->snapshotPath.rfind('/');
+    std::string directory = (slash == std::string::npos) ? "." : this->snapshotPath.substr(0, slash + 1);
+    int directoryFD = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (directoryFD != -1) {
+        fsync(directoryFD);
+        close(directoryFD);
+    }
+
+    if (ftruncate(this->fd, 0) == -1) {
+        WARNING() << "could not truncate journal " << this->path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    this->numRecords   = 0;
+    this->nextSnapshot = this->snapshotEvery;
+    return true;
+}
+
+/****************
+Public Functions
+*****************/
+
+bool Journal::isOpen() const {
+    return this->fd != -1;
+}
+
+size_t Journal::replay(const std::function<bool(const bosproto::Journal_Record&)> &apply) {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    size_t numApplied = 0;
+    for (const auto &record : this->records) {
+        if (apply(record.second))
+            numApplied++;
+    }
+    return numApplied;
+}
+
+bool Journal::appendAdminCommand(const bosproto::Admin_Command &command) {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    bosproto::Journal_Record record;
+    *record.mutable_admin_command() = command;
+    return this->append(record);
+}
+
+bool Journal::appendBatteryCommand(const std::string &batteryName, const bosproto::BatteryCommand &command) {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    bosproto::Journal_Record record;
+    record.set_batteryname(batteryName);
+    *record.mutable_battery_command() = command;
+    return this->append(record);
+}
+
+bool Journal::snapshot() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    if (this->fd == -1)
+        return false;
+    return this->takeSnapshot();
+}
+
+size_t Journal::getNumRecords() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    return this->numRecords;
+}
+
+size_t Journal::getNumLiveRecords() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    return this->records.size();
+}
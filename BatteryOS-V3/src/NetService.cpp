@@ -1,34 +1,188 @@
-
 #include "NetService.hpp"
 
 #include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "util.hpp"
 
-void NetService::add(std::weak_ptr<Pollable> pollable) {
-    this->pollables.push_back(pollable);
+/* max number of ready fds handled per call to poll() */
+static const int MAX_EVENTS = 256;
+
+NetService::NetService() : sweepSize(64) {
+    if (pipe(this->wakeupFDs) == -1)
+        ERROR() << "could not create wakeup pipe: " << strerror(errno) << std::endl;
+
+    for (int fd : this->wakeupFDs)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+    this->pollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (this->pollFD == -1)
+        ERROR() << "could not create epoll instance: " << strerror(errno) << std::endl;
+
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = this->wakeupFDs[0];
+    if (epoll_ctl(this->pollFD, EPOLL_CTL_ADD, this->wakeupFDs[0], &event) == -1)
+        ERROR() << "could not register wakeup pipe: " << strerror(errno) << std::endl;
+#endif
 }
 
-void NetService::poll() {
-    int num_pollables = this->pollables.size();
-    struct pollfd fds[num_pollables];
+NetService::~NetService() {
+#ifdef __linux__
+    close(this->pollFD);
+#endif
+    close(this->wakeupFDs[0]);
+    close(this->wakeupFDs[1]);
+}
+
+/*****************
+Private Functions
+******************/
+
+void NetService::dispatch(int fd) {
+    auto iter = this->registrations.find(fd);
+    if (iter == this->registrations.end()) {
+        this->unregister(fd);
+        return;
+    }
 
+    std::shared_ptr<Pollable> owner;
+    std::vector<std::weak_ptr<Pollable>> &pollables = iter->second;
 
-    for (int i = 0; i < num_pollables; i++) {
-        auto pollable = this->pollables[i].lock();
-        if (!pollable) {
+    for (auto pollable = pollables.begin(); pollable != pollables.end();) {
+        std::shared_ptr<Pollable> current = pollable->lock();
+        if (!current) {
+            pollable = pollables.erase(pollable);
             continue;
         }
-        fds[i] = pollable->pollInfo();
+        if (!owner && current->pollInfo().fd == fd)
+            owner = current;
+        pollable++;
+    }
+
+    if (pollables.empty()) {
+        this->registrations.erase(iter);
+        this->unregister(fd);
+        return;
+    }
+
+    // the handler may add pollables, so nothing above is used after this call
+    if (owner)
+        owner->pollHandler();
+}
+
+void NetService::unregister(int fd) {
+#ifdef __linux__
+    // fails harmlessly if the fd was already closed (which unregisters it)
+    epoll_ctl(this->pollFD, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+void NetService::sweep() {
+    for (auto iter = this->registrations.begin(); iter != this->registrations.end();) {
+        std::vector<std::weak_ptr<Pollable>> &pollables = iter->second;
+        pollables.erase(std::remove_if(pollables.begin(), pollables.end(), [](const std::weak_ptr<Pollable> &pollable) {
+            return pollable.expired();
+        }), pollables.end());
+
+        if (pollables.empty()) {
+            this->unregister(iter->first);
+            iter = this->registrations.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+}
+
+/****************
+Public Functions
+*****************/
+
+void NetService::add(std::weak_ptr<Pollable> pollable) {
+    std::shared_ptr<Pollable> current = pollable.lock();
+    if (!current)
+        return;
+
+    int fd = current->pollInfo().fd;
+    if (fd < 0) {
+        WARNING() << "pollable does not have a file descriptor to poll" << std::endl;
+        return;
     }
 
-    int num_events = ::poll(fds, num_pollables, 200);
+    // pollables that expired without their fd becoming ready may still
+    // be registered under a reused fd number
+    std::vector<std::weak_ptr<Pollable>> &pollables = this->registrations[fd];
+    pollables.erase(std::remove_if(pollables.begin(), pollables.end(), [](const std::weak_ptr<Pollable> &pollable) {
+        return pollable.expired();
+    }), pollables.end());
+    pollables.push_back(pollable);
 
-    for (int i = 0; i < num_pollables; i++) {
-        if (fds[i].revents) {
-            auto pollable = this->pollables[i].lock();
-            if (!pollable) {
-                continue;
-            }
-            pollable->pollHandler();
+#ifdef __linux__
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(this->pollFD, EPOLL_CTL_ADD, fd, &event) == -1 && errno != EEXIST)
+        WARNING() << "could not register fd " << fd << ": " << strerror(errno) << std::endl;
+#endif
+
+    if (this->registrations.size() >= this->sweepSize) {
+        this->sweep();
+        this->sweepSize = std::max<size_t>(64, 2 * this->registrations.size());
+    }
+}
+
+void NetService::poll() {
+    std::vector<int> ready;
+
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+    int num_events = epoll_wait(this->pollFD, events, MAX_EVENTS, -1);
+    if (num_events == -1) {
+        if (errno != EINTR)
+            WARNING() << "epoll_wait failed: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    for (int i = 0; i < num_events; i++)
+        ready.push_back(events[i].data.fd);
+#else
+    std::vector<struct pollfd> fds;
+    fds.push_back({this->wakeupFDs[0], POLLIN, 0});
+    for (const auto &iter : this->registrations)
+        fds.push_back({iter.first, POLLIN, 0});
+
+    int num_events = ::poll(fds.data(), fds.size(), -1);
+    if (num_events == -1) {
+        if (errno != EINTR)
+            WARNING() << "poll failed: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    for (const struct pollfd &fd : fds) {
+        if (fd.revents)
+            ready.push_back(fd.fd);
+    }
+#endif
+
+    for (int fd : ready) {
+        if (fd == this->wakeupFDs[0]) {
+            char buffer[64];
+            while (::read(fd, buffer, sizeof(buffer)) > 0) {}
+        } else {
+            this->dispatch(fd);
         }
     }
 }
+
+void NetService::wakeup() {
+    char byte = 0;
+    if (::write(this->wakeupFDs[1], &byte, 1) == -1 && errno != EAGAIN)
+        WARNING() << "could not wake up NetService: " << strerror(errno) << std::endl;
+}
@@ -6,63 +6,29 @@ PartitionBattery::~PartitionBattery() {
     PRINT() << "PARTITION BATTERY DESTRUCTOR" << std::endl;
     if (!this->quitThread)
         quit();
-    if (this->runningThread) {
-        this->status.current_mA = 0;
-        this->thread.join();
-    }
 }
 
 PartitionBattery::PartitionBattery(const std::string &batteryName,    
                                    const std::chrono::milliseconds &maxStaleness,
                                    const RefreshMode &refreshMode) : VirtualBattery(batteryName,
                                                                                     maxStaleness,
-                                                                                    refreshMode)
+                                                                                    refreshMode),
+                                                                   charge(CHARGE_INTERVAL)
 {
-    this->runningThread = false;
     this->requested_current_mA = 0;
     this->type = BatteryType::Partition;
-    this->eventThread = std::thread(&PartitionBattery::runEventThread, this);
 }
 
 /*****************
 Private Functions
 ******************/
 
-void PartitionBattery::runChargingThread() {
-    double capacity = this->status.capacity_mAh;
-
-    while (this->status.current_mA != 0) {
-        if (this->status.current_mA < 0) {
-            if (-this->status.current_mA > this->status.max_charging_current_mA)
-                this->status.current_mA = -this->status.max_charging_current_mA;
-            else if (this->status.current_mA != this->requested_current_mA)
-                this->status.current_mA = this->requested_current_mA; 
-        } else {
-            if (this->status.current_mA > this->status.max_discharging_current_mA)
-                this->status.current_mA = this->status.max_discharging_current_mA;
-            else if (this->status.current_mA != this->requested_current_mA)
-                this->status.current_mA = this->requested_current_mA;
-        }
-
-        capacity += (-this->status.current_mA / 20);
-
-        if (this->status.current_mA < 0) {
-            if (capacity >= this->status.max_capacity_mAh) {
-                capacity = this->status.max_capacity_mAh;
-                this->status.current_mA = 0;
-            }
-        } else if (this->status.current_mA > 0) {
-            if (capacity <= 0) {
-                capacity = 0;
-                this->status.current_mA = 0;
-            }   
-        }
-        
-        this->status.capacity_mAh = capacity;
-//        std::this_thread::sleep_for(std::chrono::minutes(3));
-        std::this_thread::sleep_for(std::chrono::seconds(5));
-    }
-    return;
+double PartitionBattery::limitCurrent(double current_mA) const {
+    if (-current_mA > this->status.max_charging_current_mA)
+        return -this->status.max_charging_current_mA;
+    else if (current_mA > this->status.max_discharging_current_mA)
+        return this->status.max_discharging_current_mA;
+    return current_mA;
 }
 
 /*******************
@@ -70,24 +36,22 @@ Protected Functions
 ********************/
 
 BatteryStatus PartitionBattery::refresh() {
-    this->status.time = convertToMilliseconds(getTimeNow());
+    timestamp_t now = this->clock->now();
+    this->charge.advance(this->status, now);
+
+    // the max currents change whenever the partition manager refreshes
+    if (this->status.current_mA != 0)
+        this->status.current_mA = this->limitCurrent(this->requested_current_mA);
+
+    this->status.time = convertToMilliseconds(now);
     return this->status;
 }
 
 bool PartitionBattery::set_current(double current_mA) {
-    this->status.current_mA = current_mA;
     this->requested_current_mA = current_mA;
-
-    if (current_mA == 0) {
-        if (this->runningThread) {
-            this->thread.join();
-            this->runningThread = false; 
-        }
-    } else if (!this->runningThread) {
-        this->runningThread = true;
-        this->thread = std::thread(&PartitionBattery::runChargingThread, this);
-    }
-
+    timestamp_t now = this->clock->now();
+    this->charge.setCurrent(this->status, this->limitCurrent(current_mA), now);
+    this->status.time = convertToMilliseconds(now);
     return true; 
 }
 
@@ -109,25 +73,25 @@ std::string PartitionBattery::getBatteryString() const {
 void PartitionBattery::setSourceBattery(std::shared_ptr<PartitionManager> source) {
     this->source = source;
 
+    std::unique_lock<lock_t> mutexLock(this->lock);
     this->status = source->initBatteryStatus(this->batteryName); // write this function
+    this->publishStatus();
     
-    if (this->refreshMode == RefreshMode::ACTIVE) {
-        this->eventSet.insert(event_t(this->batteryName,
-                                      EventID::REFRESH,
-                                      0,
-                                      getTimeNow() + this->getMaxStaleness(),
-                                      getSequenceNumber()));
-    }
+    if (this->refreshMode == RefreshMode::ACTIVE)
+        this->scheduleRefresh(this->clock->monotonicNow() + this->getMaxStaleness());
+    mutexLock.unlock();
+
+    this->notifySubscribers();
     return;
 }
 
-bool PartitionBattery::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) {
-    timepoint_t currentTime = getTimeNow();
+bool PartitionBattery::prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) {
+    timepoint_t currentTime = this->clock->now();
 
     if (checkIfZero(this->status))
         std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
-    if (name == this->batteryName) {
+    if (requester == this->batteryID) {
         if (startTime < currentTime) {
             WARNING() << "start time of event has already passed!" << std::endl;
             return false; 
@@ -142,13 +106,33 @@ bool PartitionBattery::schedule_set_current(double current_mA, timepoint_t start
 
     std::shared_ptr<PartitionManager> bat = this->source.lock(); // weak_ptr to shared_ptr
 
-    if (bat->schedule_set_current(current_mA, startTime, endTime, name, sequenceNumber)) {
-        checkMergeAndInsertEvents(name, current_mA, startTime, endTime, sequenceNumber);
-        this->condition_variable.notify_one();
-    } else {
+    if (!bat->prepare_set_current(current_mA, startTime, endTime, requester, sequenceNumber)) {
         WARNING() << "schedule_set_current command failed for one of the parent batteries ... command unsuccessful" << std::endl;
         return false;
     }
 
-    return true;
+    return holdReservation(requester, current_mA, startTime, endTime, sequenceNumber);
+}
+
+bool PartitionBattery::commit_set_current(uint64_t sequenceNumber) {
+    std::shared_ptr<PartitionManager> bat = this->source.lock(); // weak_ptr to shared_ptr
+
+    bool committed = bat != nullptr && bat->commit_set_current(sequenceNumber);
+    return Battery::commit_set_current(sequenceNumber) && committed;
+}
+
+bool PartitionBattery::abort_set_current(uint64_t sequenceNumber) {
+    std::shared_ptr<PartitionManager> bat = this->source.lock(); // weak_ptr to shared_ptr
+
+    if (bat != nullptr)
+        bat->abort_set_current(sequenceNumber);
+    return Battery::abort_set_current(sequenceNumber);
+}
+
+bool PartitionBattery::cancel_set_current(uint64_t sequenceNumber) {
+    std::shared_ptr<PartitionManager> bat = this->source.lock(); // weak_ptr to shared_ptr
+
+    if (bat != nullptr)
+        bat->cancel_set_current(sequenceNumber);
+    return Battery::cancel_set_current(sequenceNumber);
 }
@@ -1,8 +1,6 @@
 #include "PartitionManager.hpp"
 
 
-// add destructor
-// quit eventThread??
 PartitionManager::~PartitionManager() {
     PRINT() << "PARTITION MANAGER DESTRUCTOR" << std::endl;
     if (!this->quitThread)
@@ -13,7 +11,8 @@ PartitionManager::PartitionManager(const std::string &batteryName,
                                    std::vector<Scale> proportions,
                                    const PolicyType &partitionPolicyType,
                                    std::shared_ptr<Battery> sourceBattery,
-                                   std::vector<std::weak_ptr<VirtualBattery>> childBatteries) : VirtualBattery(batteryName)
+                                   std::vector<std::weak_ptr<VirtualBattery>> childBatteries) : VirtualBattery(batteryName),
+                                                                                                policy(partitionPolicyType, proportions)
 {
     this->refreshMode  = RefreshMode::ACTIVE; 
     this->maxStaleness = std::chrono::minutes(1);
@@ -25,36 +24,12 @@ PartitionManager::PartitionManager(const std::string &batteryName,
     this->child_proportions = proportions;
     
     this->type     = BatteryType::PartitionManager;
-    this->status   = this->source->getStatus(); // parent current should be at 0 
-
-    this->eventSet.insert(event_t(this->batteryName,
-                                  EventID::REFRESH,
-                                  0,
-                                  getTimeNow() + this->maxStaleness,
-                                  getSequenceNumber())); 
-    this->eventThread = std::thread(&PartitionManager::runEventThread, this);
-}
-
-/*****************
-Private Functions 
-******************/
-
-void PartitionManager::refreshTranched(const BatteryStatus &pStatus) {
-    return;
-}
+    this->status   = this->source->getFreshStatus(); // parent current should be at 0 
+    this->policy.reserve(this->status);
 
-void PartitionManager::refreshReserved(const BatteryStatus &pStatus) {
-    return;
-}
-
-void PartitionManager::refreshProportional(const BatteryStatus &pStatus) {
-    for (unsigned int index = 0; index < this->children.size(); index++) {
-        std::shared_ptr<VirtualBattery> bat = this->children[index].lock();  // weak_ptr to shared_ptr
-
-        bat->setMaxChargingCurrent(pStatus.max_charging_current_mA * child_proportions[index].charge_proportion);
-        bat->setMaxDischargingCurrent(pStatus.max_discharging_current_mA * child_proportions[index].charge_proportion);
-    }
-    return;
+    lockguard_t mutexLock(this->lock);
+    this->publishStatus();
+    this->scheduleRefresh(this->clock->monotonicNow() + this->getMaxStaleness());
 }
 
 /*******************
@@ -63,17 +38,31 @@ Protected Functions
 
 BatteryStatus PartitionManager::refresh() {
     PRINT() << "Partition Manager Refresh!!!!" << std::endl;
-    BatteryStatus pStatus = this->source->getStatus();
-    // check pStatus w status to ensure that status values are the same
-    // if status values change, iteract with child structs to edit the information
-    if (this->policyType == PolicyType::PROPORTIONAL)
-        this->refreshProportional(pStatus);
-    else if (this->policyType == PolicyType::RESERVED)
-        this->refreshReserved(pStatus);
-    else
-        this->refreshTranched(pStatus);
-
-    this->status.time = convertToMilliseconds(getTimeNow());
+    BatteryStatus pStatus = this->source->getFreshStatus();
+
+    // the policy starts from the capacity each partition has left (the last share of a removed partition)
+    std::vector<std::shared_ptr<VirtualBattery>> batteries;
+    std::vector<double> capacities = this->policy.getShares().capacity_mAh;
+    for (unsigned int index = 0; index < this->children.size(); index++) {
+        batteries.push_back(this->children[index].lock());  // weak_ptr to shared_ptr
+        if (batteries.back())
+            capacities[index] = batteries.back()->getStatus().capacity_mAh;
+    }
+    this->policy.setCapacities(capacities);
+    const PartitionShares &shares = this->policy.refresh(pStatus);
+
+    // every partition shares the temperature and protection state of the source
+    this->status.max_temperature_dK = pStatus.max_temperature_dK;
+    this->status.protection_flags   = pStatus.protection_flags;
+    for (unsigned int index = 0; index < batteries.size(); index++) {
+        if (!batteries[index])
+            continue;
+        batteries[index]->setShare(shares.capacity_mAh[index], shares.max_capacity_mAh[index],
+                                   shares.max_charging_current_mA[index], shares.max_discharging_current_mA[index],
+                                   pStatus.max_temperature_dK, pStatus.protection_flags);
+    }
+
+    this->status.time = convertToMilliseconds(this->clock->now());
 
     return this->status;
 }
@@ -83,7 +72,7 @@ bool PartitionManager::set_current(double current_mA) {
     return true;
 }
 
-bool PartitionManager::schedule_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, std::string name, uint64_t sequenceNumber) {
+bool PartitionManager::prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) {
 //    checkMergeAndInsertEvents(name, current_mA, startTime, endTime, sequenceNumber);
 //
 //    using TC = std::pair<std::pair<timepoint_t, timepoint_t>, double>;
@@ -127,15 +116,27 @@ bool PartitionManager::schedule_set_current(double current_mA, timepoint_t start
 //        std::cout << this->batteryName << ": " << std::ctime(&t) << ": " << it.second << std::endl;
 //    }
 
-    if (this->source->schedule_set_current(current_mA, startTime, endTime, name, sequenceNumber)) {
-        checkMergeAndInsertEvents(name, current_mA, startTime, endTime, sequenceNumber);
-        this->condition_variable.notify_one(); 
-    } else {
+    if (!this->source->prepare_set_current(current_mA, startTime, endTime, requester, sequenceNumber)) {
         WARNING() << "schedule_set_current command failed for one of the parent batteries ... command unsuccessful" << std::endl;
         return false;
     }
 
-    return true;
+    return holdReservation(requester, current_mA, startTime, endTime, sequenceNumber);
+}
+
+bool PartitionManager::commit_set_current(uint64_t sequenceNumber) {
+    bool committed = this->source->commit_set_current(sequenceNumber);
+    return Battery::commit_set_current(sequenceNumber) && committed;
+}
+
+bool PartitionManager::abort_set_current(uint64_t sequenceNumber) {
+    this->source->abort_set_current(sequenceNumber);
+    return Battery::abort_set_current(sequenceNumber);
+}
+
+bool PartitionManager::cancel_set_current(uint64_t sequenceNumber) {
+    this->source->cancel_set_current(sequenceNumber);
+    return Battery::cancel_set_current(sequenceNumber);
 }
 
 BatteryStatus PartitionManager::initBatteryStatus(const std::string &childName) {
@@ -163,7 +164,9 @@ BatteryStatus PartitionManager::initBatteryStatus(const std::string &childName)
     childStatus.max_capacity_mAh           = max_capacity * capacity_proportion; 
     childStatus.max_charging_current_mA    = max_charge * charge_proportion; 
     childStatus.max_discharging_current_mA = max_discharge * charge_proportion;
-    childStatus.time = convertToMilliseconds(getTimeNow());
+    childStatus.max_temperature_dK         = this->status.max_temperature_dK;
+    childStatus.protection_flags           = this->status.protection_flags;
+    childStatus.time = convertToMilliseconds(this->clock->now());
 
     return childStatus;
 }
@@ -0,0 +1,206 @@
+#include <cmath>
+#include <algorithm>
+#include "PartitionPolicy.hpp"
+
+void PartitionShares::resize(size_t numChildren) {
+    this->capacity_mAh.resize(numChildren, 0);
+    this->max_capacity_mAh.resize(numChildren, 0);
+    this->max_charging_current_mA.resize(numChildren, 0);
+    this->max_discharging_current_mA.resize(numChildren, 0);
+}
+
+/***********
+Constructor
+************/
+
+PartitionPolicy::PartitionPolicy(const PolicyType &policyType, const std::vector<Scale> &proportions) {
+    this->policyType  = policyType;
+    this->numChildren = proportions.size();
+
+    for (const Scale &proportion : proportions) {
+        this->chargeProportion.push_back(proportion.charge_proportion);
+        this->capacityProportion.push_back(proportion.capacity_proportion);
+    }
+
+    this->reserved.resize(this->numChildren);
+    this->shares.resize(this->numChildren);
+    this->room.resize(this->numChildren, 0);
+    this->before.resize(this->numChildren, 0);
+}
+
+/**************************
+Private Helper Functions
+***************************/
+
+/**
+ * Four running sums instead of one, so the additions do not all wait on
+ * each other (the compiler may not reorder them itself without -ffast-math).
+ */
+double PartitionPolicy::sum(const std::vector<double> &values) const {
+    size_t n = this->numChildren;
+    const double* value = values.data();
+
+    double partial[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        partial[0] += value[i];
+        partial[1] += value[i + 1];
+        partial[2] += value[i + 2];
+        partial[3] += value[i + 3];
+    }
+    for (; i < n; i++)
+        partial[0] += value[i];
+    return (partial[0] + partial[1]) + (partial[2] + partial[3]);
+}
+
+void PartitionPolicy::waterfill(double amount, const std::vector<double> &room, std::vector<double> &values, bool fromBack) {
+    size_t n = this->numChildren;
+    const double* space = room.data();
+    double* ahead = this->before.data();
+    double* value = values.data();
+
+    // the running sum is the only loop that carries a dependency
+    double total = 0;
+    if (fromBack) {
+        for (size_t i = n; i-- > 0;) {
+            ahead[i] = total;
+            total += space[i];
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            ahead[i] = total;
+            total += space[i];
+        }
+    }
+
+    double sign      = (amount < 0) ? -1 : 1;
+    double magnitude = std::fabs(amount);
+    for (size_t i = 0; i < n; i++)
+        value[i] += sign * std::min(std::max(magnitude - ahead[i], 0.0), space[i]);
+}
+
+void PartitionPolicy::distribute(double difference, std::vector<double> &values, size_t beneficiary) {
+    if (difference >= 0) {
+        values[beneficiary] += difference;
+        return;
+    }
+
+    for (size_t i = 0; i < this->numChildren; i++)
+        this->room[i] = std::max(values[i], 0.0);
+    this->waterfill(difference, this->room, values, true);
+}
+
+/**
+ * If the children have no capacity left between them, the capacity of the
+ * source is split by the capacity proportions instead.
+ */
+void PartitionPolicy::refreshProportional(const BatteryStatus &source) {
+    size_t n = this->numChildren;
+    const double* chargeProportion   = this->chargeProportion.data();
+    const double* capacityProportion = this->capacityProportion.data();
+    double* capacity       = this->shares.capacity_mAh.data();
+    double* maxCapacity    = this->shares.max_capacity_mAh.data();
+    double* maxCharging    = this->shares.max_charging_current_mA.data();
+    double* maxDischarging = this->shares.max_discharging_current_mA.data();
+
+    double total  = this->sum(this->shares.capacity_mAh);
+    bool reset    = std::fabs(total) < 1e-6;
+    double scale  = reset ? 0 : source.capacity_mAh / total;
+    double spread = reset ? source.capacity_mAh : 0;
+
+    // copies of the source fields, so the stores below cannot alias them, and two loops
+    // instead of one, so the compiler can check the arrays do not overlap and vectorize them
+    double sourceMaxCapacity    = source.max_capacity_mAh;
+    double sourceMaxCharging    = source.max_charging_current_mA;
+    double sourceMaxDischarging = source.max_discharging_current_mA;
+
+    for (size_t i = 0; i < n; i++) {
+        maxCapacity[i] = sourceMaxCapacity * capacityProportion[i];
+        capacity[i]    = std::min(std::max(capacity[i] * scale + spread * capacityProportion[i], 0.0), maxCapacity[i]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        maxCharging[i]    = sourceMaxCharging * chargeProportion[i];
+        maxDischarging[i] = sourceMaxDischarging * chargeProportion[i];
+    }
+}
+
+void PartitionPolicy::refreshReservations(const BatteryStatus &source) {
+    size_t n = this->numChildren;
+    bool reservedPolicy = this->policyType == PolicyType::RESERVED;
+    size_t beneficiary  = reservedPolicy ? n - 1 : 0;
+
+    this->shares.max_capacity_mAh           = this->reserved.max_capacity_mAh;
+    this->shares.max_charging_current_mA    = this->reserved.max_charging_current_mA;
+    this->shares.max_discharging_current_mA = this->reserved.max_discharging_current_mA;
+
+    this->distribute(source.max_capacity_mAh - this->reservedTotal.max_capacity_mAh, this->shares.max_capacity_mAh, beneficiary);
+    this->distribute(source.max_charging_current_mA - this->reservedTotal.max_charging_current_mA,
+                     this->shares.max_charging_current_mA, beneficiary);
+    this->distribute(source.max_discharging_current_mA - this->reservedTotal.max_discharging_current_mA,
+                     this->shares.max_discharging_current_mA, beneficiary);
+
+    double* capacity          = this->shares.capacity_mAh.data();
+    const double* maxCapacity = this->shares.max_capacity_mAh.data();
+    for (size_t i = 0; i < n; i++)
+        capacity[i] = std::min(std::max(capacity[i], 0.0), maxCapacity[i]);
+
+    // a surplus fills the children up in the order of the policy, a shortfall empties the last children first
+    double difference = source.capacity_mAh - this->sum(this->shares.capacity_mAh);
+    double* space     = this->room.data();
+    if (difference >= 0) {
+        for (size_t i = 0; i < n; i++)
+            space[i] = maxCapacity[i] - capacity[i];
+        this->waterfill(difference, this->room, this->shares.capacity_mAh, reservedPolicy);
+    } else {
+        for (size_t i = 0; i < n; i++)
+            space[i] = capacity[i];
+        this->waterfill(difference, this->room, this->shares.capacity_mAh, true);
+    }
+}
+
+/***************
+Public Functions
+****************/
+
+size_t PartitionPolicy::size() const {
+    return this->numChildren;
+}
+
+void PartitionPolicy::reserve(const BatteryStatus &source) {
+    for (size_t i = 0; i < this->numChildren; i++) {
+        this->reserved.capacity_mAh[i]               = source.capacity_mAh * this->capacityProportion[i];
+        this->reserved.max_capacity_mAh[i]           = source.max_capacity_mAh * this->capacityProportion[i];
+        this->reserved.max_charging_current_mA[i]    = source.max_charging_current_mA * this->chargeProportion[i];
+        this->reserved.max_discharging_current_mA[i] = source.max_discharging_current_mA * this->chargeProportion[i];
+    }
+
+    this->reservedTotal.capacity_mAh               = this->sum(this->reserved.capacity_mAh);
+    this->reservedTotal.max_capacity_mAh           = this->sum(this->reserved.max_capacity_mAh);
+    this->reservedTotal.max_charging_current_mA    = this->sum(this->reserved.max_charging_current_mA);
+    this->reservedTotal.max_discharging_current_mA = this->sum(this->reserved.max_discharging_current_mA);
+
+    this->shares = this->reserved;
+}
+
+void PartitionPolicy::setCapacity(size_t index, double capacity_mAh) {
+    this->shares.capacity_mAh[index] = capacity_mAh;
+}
+
+void PartitionPolicy::setCapacities(const std::vector<double> &capacities) {
+    std::copy(capacities.begin(), capacities.begin() + std::min(capacities.size(), this->numChildren), this->shares.capacity_mAh.begin());
+}
+
+const PartitionShares& PartitionPolicy::refresh(const BatteryStatus &source) {
+    if (this->numChildren == 0)
+        return this->shares;
+
+    if (this->policyType == PolicyType::PROPORTIONAL)
+        this->refreshProportional(source);
+    else
+        this->refreshReservations(source);
+    return this->shares;
+}
+
+const PartitionShares& PartitionPolicy::getShares() const {
+    return this->shares;
+}
@@ -31,6 +31,9 @@ paramsDynamic parseDynamicBattery(const bosproto::Dynamic_Battery& battery) {
     p.constructor = battery.constructor_func();
     p.setCurrentFunc = battery.set_current_func();
 
+    if (battery.has_telemetry_func())
+        p.telemetryFunc = battery.telemetry_func();
+
     if (battery.has_max_staleness())
         p.staleness = std::chrono::milliseconds(battery.max_staleness());
     else
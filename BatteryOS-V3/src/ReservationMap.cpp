@@ -0,0 +1,510 @@
+#include <cmath>
+#include <iterator>
+#include <algorithm>
+#include "ReservationMap.hpp"
+
+/* changes smaller than this are treated as zero */
+static const double EPSILON_mA = 1e-9;
+
+/************
+ProfileTree
+*************/
+
+ProfileTree::ProfileTree() : count(0), generator(std::random_device{}()) {}
+
+double ProfileTree::sumOf(const std::unique_ptr<Node> &node) {
+    return node ? node->sum : 0;
+}
+
+void ProfileTree::update(std::unique_ptr<Node> &node) {
+    if (node)
+        node->sum = node->value + sumOf(node->left) + sumOf(node->right);
+}
+
+std::unique_ptr<ProfileTree::Node> ProfileTree::merge(std::unique_ptr<Node> left, std::unique_ptr<Node> right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    if (left->priority > right->priority) {
+        left->right = merge(std::move(left->right), std::move(right));
+        update(left);
+        return left;
+    }
+    right->left = merge(std::move(left), std::move(right->left));
+    update(right);
+    return right;
+}
+
+/* left receives every key <= key, right every key > key */
+void ProfileTree::split(std::unique_ptr<Node> node, int64_t key, std::unique_ptr<Node> &left, std::unique_ptr<Node> &right) {
+    if (!node) {
+        left.reset();
+        right.reset();
+        return;
+    }
+
+    if (node->key <= key) {
+        split(std::move(node->right), key, node->right, right);
+        update(node);
+        left = std::move(node);
+    } else {
+        split(std::move(node->left), key, left, node->left);
+        update(node);
+        right = std::move(node);
+    }
+}
+
+bool ProfileTree::addExisting(std::unique_ptr<Node> &node, int64_t key, double value, bool &removed) {
+    if (!node)
+        return false;
+
+    bool found;
+    if (key < node->key) {
+        found = addExisting(node->left, key, value, removed);
+    } else if (key > node->key) {
+        found = addExisting(node->right, key, value, removed);
+    } else {
+        found = true;
+        node->value += value;
+        if (std::fabs(node->value) < EPSILON_mA) {
+            node = merge(std::move(node->left), std::move(node->right));
+            removed = true;
+        }
+    }
+
+    if (found)
+        update(node);
+    return found;
+}
+
+bool ProfileTree::empty() const {
+    return this->count == 0;
+}
+
+size_t ProfileTree::size() const {
+    return this->count;
+}
+
+int64_t ProfileTree::firstKey() const {
+    const Node* node = this->root.get();
+    while (node->left)
+        node = node->left.get();
+    return node->key;
+}
+
+double ProfileTree::prefix(int64_t key) const {
+    double sum = 0;
+    const Node* node = this->root.get();
+    while (node) {
+        if (node->key <= key) {
+            sum += node->value + sumOf(node->left);
+            node = node->right.get();
+        } else {
+            node = node->left.get();
+        }
+    }
+    return sum;
+}
+
+double ProfileTree::consume(int64_t key) {
+    std::unique_ptr<Node> left, right;
+    split(std::move(this->root), key, left, right);
+    this->root = std::move(right);
+
+    if (!left)
+        return 0;
+
+    // walk the detached subtree once to keep the node count exact
+    double sum = left->sum;
+    std::vector<std::unique_ptr<Node>> stack;
+    stack.push_back(std::move(left));
+    while (!stack.empty()) {
+        std::unique_ptr<Node> node = std::move(stack.back());
+        stack.pop_back();
+        this->count--;
+        if (node->left)
+            stack.push_back(std::move(node->left));
+        if (node->right)
+            stack.push_back(std::move(node->right));
+    }
+    return sum;
+}
+
+void ProfileTree::add(int64_t key, double value) {
+    if (std::fabs(value) < EPSILON_mA)
+        return;
+
+    bool removed = false;
+    if (addExisting(this->root, key, value, removed)) {
+        if (removed)
+            this->count--;
+        return;
+    }
+
+    std::unique_ptr<Node> left, right;
+    split(std::move(this->root), key, left, right);
+    std::unique_ptr<Node> node = std::make_unique<Node>(key, value, this->generator());
+    this->root = merge(merge(std::move(left), std::move(node)), std::move(right));
+    this->count++;
+}
+
+void ProfileTree::updateAll(std::unique_ptr<Node> &node) {
+    if (!node)
+        return;
+    updateAll(node->left);
+    updateAll(node->right);
+    update(node);
+}
+
+/**
+ * The tree and the changes are merged as two sorted lists, and the tree
+ * is built again from the result left to right, keeping the nodes on its
+ * right spine that the next node (the largest key so far) hangs under.
+ */
+void ProfileTree::addAll(std::vector<std::pair<int64_t, double>> &changes) {
+    if (changes.empty())
+        return;
+    std::sort(changes.begin(), changes.end(), [](const std::pair<int64_t, double> &a, const std::pair<int64_t, double> &b) {
+        return a.first < b.first;
+    });
+
+    std::vector<std::pair<int64_t, double>> existing;
+    existing.reserve(this->count);
+    std::vector<const Node*> stack;
+    const Node* node = this->root.get();
+    while (node || !stack.empty()) {
+        for (; node; node = node->left.get())
+            stack.push_back(node);
+        node = stack.back();
+        stack.pop_back();
+        existing.push_back({node->key, node->value});
+        node = node->right.get();
+    }
+    this->clear();
+
+    std::vector<std::pair<int64_t, double>> merged;
+    merged.reserve(existing.size() + changes.size());
+    std::merge(existing.begin(), existing.end(), changes.begin(), changes.end(), std::back_inserter(merged),
+               [](const std::pair<int64_t, double> &a, const std::pair<int64_t, double> &b) { return a.first < b.first; });
+
+    std::vector<Node*> spine;
+    for (size_t i = 0; i < merged.size(); ) {
+        int64_t key  = merged[i].first;
+        double value = 0;
+        for (; i < merged.size() && merged[i].first == key; i++)
+            value += merged[i].second;
+        if (std::fabs(value) < EPSILON_mA)
+            continue;
+
+        std::unique_ptr<Node> inserted = std::make_unique<Node>(key, value, this->generator());
+        Node* raw = inserted.get();
+        bool popped = false;
+        while (!spine.empty() && spine.back()->priority < raw->priority) {
+            spine.pop_back();
+            popped = true;
+        }
+
+        std::unique_ptr<Node> &parent = spine.empty() ? this->root : spine.back()->right;
+        if (popped)
+            inserted->left = std::move(parent);
+        parent = std::move(inserted);
+        spine.push_back(raw);
+        this->count++;
+    }
+    updateAll(this->root);
+}
+
+void ProfileTree::clear() {
+    this->consume(INT64_MAX);
+}
+
+/***************
+ReservationMap
+****************/
+
+ReservationMap::ReservationMap() : projected(false), restoring(false), applied_mA(0), consumedUntil(timepoint_t::min()) {}
+
+void ReservationMap::addChange(timepoint_t time, double current_mA) {
+    if (this->restoring)
+        this->restored.push_back({time.time_since_epoch().count(), current_mA});
+    else
+        this->profile.add(time.time_since_epoch().count(), current_mA);
+}
+
+void ReservationMap::settle() const {
+    if (this->restored.empty())
+        return;
+    this->profile.addAll(this->restored);
+    this->restored.clear();
+}
+
+void ReservationMap::addSegment(battery_id_t requester, Timeline &timeline, timepoint_t startTime, const Segment &segment) {
+    timeline.insert({startTime, segment});
+    this->addChange(startTime, segment.current_mA);
+    this->addChange(segment.endTime, -segment.current_mA);
+    if (this->projected)
+        this->projection.add(segment.current_mA, startTime, segment.endTime);
+
+    Reservation &reservation = this->reservations[segment.sequenceNumber];
+    reservation.requester  = requester;
+    reservation.current_mA = segment.current_mA;
+    reservation.startTimes.insert(startTime);
+}
+
+/**
+ * Changes that were already consumed are undone by adding the opposite
+ * change at their (past) time, which the next consume() applies right away.
+ * Segments that ended before consumedUntil are dropped without touching
+ * the profile since both of their changes were already applied. The
+ * projection only removes the part of a segment after consumedUntil.
+ */
+ReservationMap::Timeline::iterator ReservationMap::removeSegment(Timeline &timeline, Timeline::iterator iter) {
+    const Segment &segment = iter->second;
+    if (segment.endTime > this->consumedUntil) {
+        this->addChange(iter->first, -segment.current_mA);
+        this->addChange(segment.endTime, segment.current_mA);
+        if (this->projected)
+            this->projection.add(-segment.current_mA, iter->first, segment.endTime);
+    }
+
+    auto reservation = this->reservations.find(segment.sequenceNumber);
+    if (reservation != this->reservations.end()) {
+        reservation->second.startTimes.erase(iter->first);
+        if (reservation->second.startTimes.empty())
+            this->reservations.erase(reservation);
+    }
+    return timeline.erase(iter);
+}
+
+void ReservationMap::prune(Timeline &timeline) {
+    // segments of a timeline do not overlap, so they also end in order
+    auto iter = timeline.begin();
+    while (iter != timeline.end() && iter->second.endTime <= this->consumedUntil)
+        iter = this->removeSegment(timeline, iter);
+}
+
+void ReservationMap::project() {
+    this->projection.consume(this->consumedUntil);
+    for (const auto &timeline : this->timelines) {
+        for (const auto &segment : timeline.second) {
+            if (segment.second.endTime > this->consumedUntil)
+                this->projection.add(segment.second.current_mA, segment.first, segment.second.endTime);
+        }
+    }
+    for (const auto &held : this->holds) {
+        for (const Hold &hold : held.second) {
+            if (hold.endTime > this->consumedUntil)
+                this->projection.add(hold.current_mA, hold.startTime, hold.endTime);
+        }
+    }
+    this->projected = true;
+}
+
+void ReservationMap::unproject(const Hold &hold) {
+    if (this->projected && hold.endTime > this->consumedUntil)
+        this->projection.add(-hold.current_mA, hold.startTime, hold.endTime);
+}
+
+/**
+ * Mirrors insert(): a reservation with the same sequence number is replaced
+ * by one with the summed current, and the requester's overlapping segments
+ * are removed where the new reservation covers them.
+ */
+std::vector<ChargeProjection::Change> ReservationMap::plan(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime) const {
+    std::vector<ChargeProjection::Change> changes;
+
+    auto existing = this->reservations.find(sequenceNumber);
+    if (existing != this->reservations.end()) {
+        current_mA += existing->second.current_mA;
+        const Timeline &timeline = this->timelines.at(existing->second.requester);
+        for (const timepoint_t &segmentStart : existing->second.startTimes) {
+            auto iter = timeline.find(segmentStart);
+            if (iter != timeline.end() && iter->second.endTime > this->consumedUntil)
+                changes.push_back({-iter->second.current_mA, iter->first, iter->second.endTime});
+        }
+    }
+
+    auto timeline = this->timelines.find(requester);
+    if (timeline != this->timelines.end()) {
+        auto iter = timeline->second.lower_bound(startTime);
+        if (iter != timeline->second.begin() && std::prev(iter)->second.endTime > startTime)
+            --iter;
+
+        for (; iter != timeline->second.end() && iter->first < endTime; ++iter) {
+            const Segment &segment = iter->second;
+            if (segment.sequenceNumber == sequenceNumber || segment.endTime <= this->consumedUntil)
+                continue;
+            changes.push_back({-segment.current_mA, std::max(iter->first, startTime), std::min(segment.endTime, endTime)});
+        }
+    }
+
+    changes.push_back({current_mA, startTime, endTime});
+    return changes;
+}
+
+bool ReservationMap::insert(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    if (endTime <= startTime)
+        return false;
+
+    // the same request reaching a battery through several paths adds up
+    auto existing = this->reservations.find(sequenceNumber);
+    if (existing != this->reservations.end()) {
+        current_mA += existing->second.current_mA;
+        this->cancel(sequenceNumber);
+    }
+
+    Timeline &timeline = this->timelines[requester];
+    this->prune(timeline);
+
+    // override the overlapping parts of the requester's earlier reservations
+    auto iter = timeline.lower_bound(startTime);
+    if (iter != timeline.begin() && std::prev(iter)->second.endTime > startTime)
+        --iter;
+
+    std::vector<std::pair<timepoint_t, Segment>> remainders;
+    while (iter != timeline.end() && iter->first < endTime) {
+        Segment segment = iter->second;
+        if (iter->first < startTime)
+            remainders.push_back({iter->first, Segment{startTime, segment.current_mA, segment.sequenceNumber}});
+        if (segment.endTime > endTime)
+            remainders.push_back({endTime, segment});
+        iter = this->removeSegment(timeline, iter);
+    }
+
+    for (const auto &remainder : remainders)
+        this->addSegment(requester, timeline, remainder.first, remainder.second);
+    this->addSegment(requester, timeline, startTime, Segment{endTime, current_mA, sequenceNumber});
+    return true;
+}
+
+/**
+ * A reservation that is restored was admitted before it was journaled, so
+ * the projection (only needed to admit new ones) is dropped instead of
+ * being updated for every restored reservation.
+ */
+bool ReservationMap::restore(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    if (this->projected) {
+        this->projection = ChargeProjection();
+        this->projected  = false;
+    }
+
+    this->restoring = true;
+    bool inserted = this->insert(requester, sequenceNumber, current_mA, startTime, endTime);
+    this->restoring = false;
+    return inserted;
+}
+
+/**
+ * Holds add to the projection on top of the active reservations (they do
+ * not override the requester's earlier reservations until they are
+ * committed), which only makes admits() more conservative meanwhile.
+ */
+bool ReservationMap::hold(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    if (endTime <= startTime)
+        return false;
+
+    this->holds[sequenceNumber].push_back(Hold{requester, current_mA, startTime, endTime});
+    if (this->projected)
+        this->projection.add(current_mA, startTime, endTime);
+    return true;
+}
+
+/**
+ * Every hold of the sequence number is inserted, so the shares of a
+ * request that reached this battery through several paths add up like
+ * they would have with insert().
+ */
+bool ReservationMap::commit(uint64_t sequenceNumber) {
+    auto held = this->holds.find(sequenceNumber);
+    if (held == this->holds.end())
+        return this->contains(sequenceNumber);
+
+    std::vector<Hold> pending = std::move(held->second);
+    this->holds.erase(held);
+    for (const Hold &hold : pending) {
+        this->unproject(hold);
+        this->insert(hold.requester, sequenceNumber, hold.current_mA, hold.startTime, hold.endTime);
+    }
+    return this->contains(sequenceNumber);
+}
+
+bool ReservationMap::release(uint64_t sequenceNumber) {
+    auto held = this->holds.find(sequenceNumber);
+    if (held == this->holds.end())
+        return false;
+
+    for (const Hold &hold : held->second)
+        this->unproject(hold);
+    this->holds.erase(held);
+    return true;
+}
+
+bool ReservationMap::cancel(uint64_t sequenceNumber) {
+    auto reservation = this->reservations.find(sequenceNumber);
+    if (reservation == this->reservations.end())
+        return false;
+
+    auto timeline = this->timelines.find(reservation->second.requester);
+    std::set<timepoint_t> startTimes = reservation->second.startTimes;
+
+    for (const timepoint_t &startTime : startTimes) {
+        auto iter = timeline->second.find(startTime);
+        if (iter != timeline->second.end())
+            this->removeSegment(timeline->second, iter);
+    }
+
+    if (timeline->second.empty())
+        this->timelines.erase(timeline);
+    return true;
+}
+
+bool ReservationMap::contains(uint64_t sequenceNumber) const {
+    return this->reservations.count(sequenceNumber) == 1;
+}
+
+double ReservationMap::currentAt(timepoint_t time) const {
+    this->settle();
+    return this->applied_mA + this->profile.prefix(time.time_since_epoch().count());
+}
+
+double ReservationMap::consume(timepoint_t time) {
+    this->settle();
+    double delta_mA = this->profile.consume(time.time_since_epoch().count());
+    this->applied_mA += delta_mA;
+    if (this->projected)
+        this->projection.consume(time);
+    if (time > this->consumedUntil)
+        this->consumedUntil = time;
+    return delta_mA;
+}
+
+timepoint_t ReservationMap::nextEventTime() const {
+    this->settle();
+    return timepoint_t(std::chrono::milliseconds(this->profile.firstKey()));
+}
+
+bool ReservationMap::hasEvents() const {
+    this->settle();
+    return !this->profile.empty();
+}
+
+size_t ReservationMap::size() const {
+    return this->reservations.size();
+}
+
+double ReservationMap::chargeBetween(timepoint_t startTime, timepoint_t endTime) {
+    if (!this->projected)
+        this->project();
+    return this->projection.chargeAt(endTime) - this->projection.chargeAt(startTime);
+}
+
+bool ReservationMap::admits(battery_id_t requester, uint64_t sequenceNumber, double current_mA, timepoint_t startTime, timepoint_t endTime,
+                            timepoint_t from, double capacity_mAh, double maxCapacity_mAh) {
+    if (endTime <= startTime)
+        return true;
+    if (!this->projected)
+        this->project();
+    return this->projection.admits(this->plan(requester, sequenceNumber, current_mA, startTime, endTime), from, capacity_mAh, maxCapacity_mAh);
+}
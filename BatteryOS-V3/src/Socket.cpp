@@ -76,6 +76,7 @@ std::unique_ptr<Socket> Socket::connect(int fd, in_addr_t addr, int port) {
         ERROR() << "could not connect to server! " << std::strerror(errno) << std::endl;
         exit(1);
     }
+    util::set_nodelay(socket->fd);
 
     return socket;
 }
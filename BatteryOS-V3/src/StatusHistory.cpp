@@ -0,0 +1,123 @@
+#include "StatusHistory.hpp"
+
+#include <limits>
+#include <algorithm>
+
+static int32_t quantize(double value) {
+    if (std::isnan(value))
+        return 0;
+    double clamped = std::min<double>(std::max<double>(std::round(value), std::numeric_limits<int32_t>::min()),
+                                      std::numeric_limits<int32_t>::max());
+    return (int32_t) clamped;
+}
+
+static BatteryStatus toStatus(const StatusSample &sample, uint64_t time) {
+    BatteryStatus status;
+    status.voltage_mV         = sample.voltage_mV;
+    status.current_mA         = sample.current_mA;
+    status.capacity_mAh       = sample.capacity_mAh;
+    status.max_capacity_mAh   = sample.max_capacity_mAh;
+    status.max_temperature_dK = sample.max_temperature_dK;
+    status.protection_flags   = sample.protection_flags;
+    status.time               = time;
+    return status;
+}
+
+StatusHistory::StatusHistory(size_t capacity) {
+    this->capacity = std::max<size_t>(capacity, 1);
+    this->next     = 0;
+    this->count    = 0;
+    this->lastTime = 0;
+}
+
+bool StatusHistory::record(const BatteryStatus &status) {
+    // never captured (e.g. a battery that has not been refreshed yet)
+    if (status.time == 0)
+        return false;
+
+    uint64_t time = (this->count == 0) ? status.time : std::max(status.time, this->lastTime);
+    if (time - this->lastTime > std::numeric_limits<uint32_t>::max())
+        this->clear();
+
+    StatusSample sample;
+    sample.delta_ms           = (this->count == 0) ? 0 : time - this->lastTime;
+    sample.voltage_mV         = quantize(status.voltage_mV);
+    sample.current_mA         = quantize(status.current_mA);
+    sample.capacity_mAh       = quantize(status.capacity_mAh);
+    sample.max_capacity_mAh   = quantize(status.max_capacity_mAh);
+    sample.max_temperature_dK = status.max_temperature_dK;
+    sample.protection_flags   = status.protection_flags;
+
+    if (this->count != 0 && sample.delta_ms == 0) {
+        const StatusSample &newest = this->samples[(this->next + this->capacity - 1) % this->capacity];
+        if (newest.voltage_mV == sample.voltage_mV && newest.current_mA == sample.current_mA &&
+            newest.capacity_mAh == sample.capacity_mAh && newest.max_capacity_mAh == sample.max_capacity_mAh &&
+            newest.max_temperature_dK == sample.max_temperature_dK && newest.protection_flags == sample.protection_flags)
+            return false;
+    }
+
+    if (this->samples.empty())
+        this->samples.resize(this->capacity);
+
+    this->samples[this->next] = sample;
+    this->next     = (this->next + 1) % this->capacity;
+    this->count    = std::min(this->count + 1, this->capacity);
+    this->lastTime = time;
+    return true;
+}
+
+std::vector<BatteryStatus> StatusHistory::query(uint64_t startTime, uint64_t endTime, uint64_t downsample_ms) const {
+    std::vector<BatteryStatus> statuses;
+    if (startTime > endTime)
+        return statuses;
+
+    // newest to oldest
+    uint64_t time = this->lastTime;
+    size_t index  = this->next;
+    for (size_t i = 0; i < this->count; i++) {
+        index = (index + this->capacity - 1) % this->capacity;
+        const StatusSample &sample = this->samples[index];
+
+        if (time < startTime)
+            break;
+        if (time <= endTime)
+            statuses.push_back(toStatus(sample, time));
+        time -= sample.delta_ms;
+    }
+    std::reverse(statuses.begin(), statuses.end());
+
+    if (downsample_ms == 0 || statuses.empty())
+        return statuses;
+
+    std::vector<BatteryStatus> buckets;
+    size_t numSamples = 0;
+    for (const BatteryStatus &status : statuses) {
+        uint64_t bucketTime = status.time - status.time % downsample_ms;
+        if (buckets.empty() || buckets.back().time != bucketTime) {
+            buckets.push_back(status);
+            buckets.back().time = bucketTime;
+            numSamples = 1;
+            continue;
+        }
+
+        BatteryStatus &bucket = buckets.back();
+        numSamples++;
+        bucket.voltage_mV         += (status.voltage_mV - bucket.voltage_mV) / numSamples;
+        bucket.current_mA         += (status.current_mA - bucket.current_mA) / numSamples;
+        bucket.capacity_mAh       += (status.capacity_mAh - bucket.capacity_mAh) / numSamples;
+        bucket.max_capacity_mAh    = status.max_capacity_mAh;
+        bucket.max_temperature_dK  = std::max(bucket.max_temperature_dK, status.max_temperature_dK);
+        bucket.protection_flags   |= status.protection_flags;
+    }
+    return buckets;
+}
+
+size_t StatusHistory::size() const {
+    return this->count;
+}
+
+void StatusHistory::clear() {
+    this->next     = 0;
+    this->count    = 0;
+    this->lastTime = 0;
+}
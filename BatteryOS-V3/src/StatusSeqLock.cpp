@@ -0,0 +1,63 @@
+#include "StatusSeqLock.hpp"
+
+#include <cstring>
+
+static uint64_t toBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double fromBits(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+StatusSeqLock::StatusSeqLock() : sequence(0) {
+    // all zero bits is a status of zeros
+    for (std::atomic<uint64_t> &field : this->fields)
+        field.store(0, std::memory_order_relaxed);
+}
+
+void StatusSeqLock::store(const BatteryStatus &status) {
+    uint64_t seq = this->sequence.load(std::memory_order_relaxed);
+    this->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    this->fields[0].store(toBits(status.voltage_mV), std::memory_order_relaxed);
+    this->fields[1].store(toBits(status.current_mA), std::memory_order_relaxed);
+    this->fields[2].store(toBits(status.capacity_mAh), std::memory_order_relaxed);
+    this->fields[3].store(toBits(status.max_capacity_mAh), std::memory_order_relaxed);
+    this->fields[4].store(toBits(status.max_charging_current_mA), std::memory_order_relaxed);
+    this->fields[5].store(toBits(status.max_discharging_current_mA), std::memory_order_relaxed);
+    this->fields[6].store(status.time, std::memory_order_relaxed);
+    this->fields[7].store(status.max_temperature_dK | ((uint64_t) status.protection_flags << 16), std::memory_order_relaxed);
+
+    this->sequence.store(seq + 2, std::memory_order_release);
+}
+
+BatteryStatus StatusSeqLock::load() const {
+    BatteryStatus status;
+    while (true) {
+        uint64_t before = this->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        status.voltage_mV                 = fromBits(this->fields[0].load(std::memory_order_relaxed));
+        status.current_mA                 = fromBits(this->fields[1].load(std::memory_order_relaxed));
+        status.capacity_mAh               = fromBits(this->fields[2].load(std::memory_order_relaxed));
+        status.max_capacity_mAh           = fromBits(this->fields[3].load(std::memory_order_relaxed));
+        status.max_charging_current_mA    = fromBits(this->fields[4].load(std::memory_order_relaxed));
+        status.max_discharging_current_mA = fromBits(this->fields[5].load(std::memory_order_relaxed));
+        status.time                       = this->fields[6].load(std::memory_order_relaxed);
+
+        uint64_t packed                   = this->fields[7].load(std::memory_order_relaxed);
+        status.max_temperature_dK         = packed & 0xffff;
+        status.protection_flags           = (packed >> 16) & 0xffff;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->sequence.load(std::memory_order_relaxed) == before)
+            return status;
+    }
+}
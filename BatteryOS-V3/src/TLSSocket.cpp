@@ -1,7 +1,24 @@
 
 #include "TLSSocket.hpp"
 
-SSL_CTX* TLSSocket::context = nullptr;
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+SSL_CTX* TLSSocket::serverContext = nullptr;
+SSL_CTX* TLSSocket::clientContext = nullptr;
+bool TLSSocket::sessionResumption = true;
+
+/* protects the contexts and the session cache */
+static std::mutex contextLock;
+
+/* last session ticket received from each server (keyed by address:port) */
+static std::map<std::string, SSL_SESSION*> sessions;
+
+/* id that ties sessions to this server's client-certificate settings (required to resume with SSL_VERIFY_PEER) */
+static const unsigned char SESSION_ID_CONTEXT[] = "BatteryOS";
 
 SSL_CTX* server_init() {
     SSL_library_init();
@@ -42,41 +59,111 @@ void load_certificates(SSL_CTX* ctx, const char* certFile, const char* keyFile)
     abort();
 }
 
+std::string peer_key(int fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr*)&addr, &len) == -1)
+        return "";
+
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+    return std::string(host) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// called by OpenSSL whenever a client receives a session ticket
+// (TLS 1.3 sends them after the handshake, so this runs inside SSL_read)
+int cache_session(SSL* ssl, SSL_SESSION* session) {
+    std::string key = peer_key(SSL_get_fd(ssl));
+    if (key.empty())
+        return 0;
+
+    std::lock_guard<std::mutex> guard(contextLock);
+    SSL_SESSION*& cached = sessions[key];
+    if (cached)
+        SSL_SESSION_free(cached);
+    cached = session;
+    return 1; // keeps the reference to session
+}
+
+void set_blocking(int fd, bool blocking) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
 void TLSSocket::InitializeServer(const std::string& ca_path, const std::string& cert_path, const std::string& key_path) {
-    TLSSocket::context = server_init();
+    std::lock_guard<std::mutex> guard(contextLock);
+    if (TLSSocket::serverContext)
+        return;
+
+    SSL_CTX* context = server_init();
 
     // TODO: client init...
-    if (SSL_CTX_load_verify_locations(TLSSocket::context, ca_path.c_str(), NULL) != 1) {
+    if (SSL_CTX_load_verify_locations(context, ca_path.c_str(), NULL) != 1) {
         ERR_print_errors_fp(stderr);
         abort();
     }
-    load_certificates(TLSSocket::context, cert_path.c_str(), key_path.c_str()); /* load certs */
-    SSL_CTX_set_verify(TLSSocket::context, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL); 
+    load_certificates(context, cert_path.c_str(), key_path.c_str()); /* load certs */
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL); 
+
+    // stateless TLS 1.3 tickets let clients resume without a full handshake
+    SSL_CTX_set_session_id_context(context, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT));
+    SSL_CTX_set_num_tickets(context, 1);
+
+    // clients close their sockets without a close_notify
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    TLSSocket::serverContext = context;
 }
 
 void TLSSocket::InitializeClient(const std::string& ca_path, const std::string& cert_path, const std::string& key_path) {
-    TLSSocket::context = client_init();
+    std::lock_guard<std::mutex> guard(contextLock);
+    if (TLSSocket::clientContext)
+        return;
+
+    SSL_CTX* context = client_init();
 
     // TODO: client init...
-    if (SSL_CTX_load_verify_locations(TLSSocket::context, ca_path.c_str(), NULL) != 1) {
+    if (SSL_CTX_load_verify_locations(context, ca_path.c_str(), NULL) != 1) {
         ERR_print_errors_fp(stderr);
         abort();
     }
-    load_certificates(TLSSocket::context, cert_path.c_str(), key_path.c_str()); /* load certs */
-    SSL_CTX_set_verify(TLSSocket::context, SSL_VERIFY_PEER, NULL); 
+    load_certificates(context, cert_path.c_str(), key_path.c_str()); /* load certs */
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, NULL); 
+
+    // sessions are stored by cache_session instead of OpenSSL's internal cache
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(context, cache_session);
+
+    TLSSocket::clientContext = context;
 }
 
+void TLSSocket::SetSessionResumption(bool enable) {
+    std::lock_guard<std::mutex> guard(contextLock);
+    TLSSocket::sessionResumption = enable;
+}
 
-TLSSocket::TLSSocket(int fd) : Socket(fd) {
-    this->ssl = SSL_new(TLSSocket::context);
+TLSSocket::TLSSocket(int fd, SSL_CTX* context) : Socket(fd) {
+    this->ssl = SSL_new(context);
     SSL_set_fd(this->ssl, fd);
 }
 
-TLSSocket::TLSSocket(int fd, std::function<void()> readHandler) : TLSSocket(fd) {
+TLSSocket::TLSSocket(int fd, SSL_CTX* context, std::function<void()> readHandler) : TLSSocket(fd, context) {
     this->readHandler = readHandler; 
 } 
 
-TLSSocket::~TLSSocket() {}
+TLSSocket::~TLSSocket() {
+    if (this->ssl) {
+        // without a shutdown OpenSSL treats the session as broken and
+        // stops it from being resumed (no close_notify is sent since
+        // the peer may already be gone)
+        SSL_set_shutdown(this->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        SSL_free(this->ssl);
+    }
+    if (this->fd > 0)
+        close(this->fd);
+}
 
 TLSSocket::TLSSocket(TLSSocket&& other) noexcept : Socket(std::move(other)) {
     this->ssl = std::exchange(other.ssl, nullptr);
@@ -121,8 +208,17 @@ std::unique_ptr<TLSSocket> TLSSocket::connect(int fd, in_addr_t addr, int port)
         ERROR() << "could not connect to server!" << std::endl;
         exit(1);
     }
+    util::set_nodelay(fd);
+
+    std::unique_ptr<TLSSocket> socket = std::make_unique<TLSSocket>(fd, TLSSocket::clientContext);
+
+    {
+        std::lock_guard<std::mutex> guard(contextLock);
+        auto iter = sessions.find(peer_key(fd));
+        if (TLSSocket::sessionResumption && iter != sessions.end())
+            SSL_set_session(socket->ssl, iter->second);
+    }
 
-    std::unique_ptr<TLSSocket> socket = std::make_unique<TLSSocket>(fd);
     int err = SSL_connect(socket->ssl);
 
     /*Check for error in connect.*/
@@ -136,24 +232,33 @@ std::unique_ptr<TLSSocket> TLSSocket::connect(int fd, in_addr_t addr, int port)
 }
 
 TLSSocket* TLSSocket::accept(int fd) {
-    TLSSocket* socket = new TLSSocket(fd);
+    TLSSocket* socket = new TLSSocket(fd, TLSSocket::serverContext);
+
+    // the handshake is driven by continueAccept() as data arrives
+    set_blocking(fd, false);
+    return socket; 
+}
+
+int TLSSocket::continueAccept() {
+    int err = SSL_accept(this->ssl);
 
-    /*Do the SSL Handshake*/
-    int err=SSL_accept(socket->ssl);
+    if (err < 1) {
+        int code = SSL_get_error(this->ssl, err);
+        if (code == SSL_ERROR_WANT_READ || code == SSL_ERROR_WANT_WRITE)
+            return 0;
 
-    /* Check for error in handshake*/
-    if (err<1) {
-      err=SSL_get_error(socket->ssl,err);
-      printf("SSL error #%d in SSL_accept,program terminated\n",err);
-      std::cout << "SSL Error: " << ERR_error_string(err, NULL) << std::endl;
-      exit(0);
+        unsigned long error = ERR_get_error();
+        WARNING() << "SSL handshake failed: " << (error ? ERR_error_string(error, NULL) : "connection closed by client") << std::endl;
+        return -1;
     }
 
     /* Check for Client authentication error */
-    if (SSL_get_verify_result(socket->ssl) != X509_V_OK) {
-        printf("SSL Client Authentication error\n");
-        exit(0);
+    if (SSL_get_verify_result(this->ssl) != X509_V_OK) {
+        WARNING() << "SSL client authentication error" << std::endl;
+        return -1;
     }
 
-    return socket; 
+    // reads and writes after the handshake expect a blocking socket
+    set_blocking(this->fd, true);
+    return 1;
 }
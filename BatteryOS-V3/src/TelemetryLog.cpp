@@ -0,0 +1,646 @@
+#include "TelemetryLog.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const size_t MAGIC_SIZE  = sizeof(TELEMETRY_LOG_MAGIC) - 1;
+static const size_t HEADER_SIZE = sizeof(TelemetrySegmentHeader);
+static const size_t CRC_START   = offsetof(TelemetrySegmentHeader, crc) + sizeof(uint32_t);
+static const size_t ENTRY_SIZE  = sizeof(uint64_t) + HEADER_SIZE;
+
+static std::mutex telemetryLogLock;
+static std::shared_ptr<TelemetryLog> processTelemetryLog;
+
+static const char* COLUMN_NAMES[TELEMETRY_NUM_COLUMNS] = {
+    "time_ms",
+    "voltage_mV",
+    "current_mA",
+    "capacity_mAh",
+    "max_capacity_mAh",
+    "max_charging_current_mA",
+    "max_discharging_current_mA",
+    "max_temperature_dK",
+    "protection_flags",
+};
+
+const char* getTelemetryColumnName(int column) {
+    return (column < 0 || column >= TELEMETRY_NUM_COLUMNS) ? "" : COLUMN_NAMES[column];
+}
+
+std::shared_ptr<TelemetryLog> getTelemetryLog(void) {
+    std::lock_guard<std::mutex> guard(telemetryLogLock);
+    return processTelemetryLog;
+}
+
+void setTelemetryLog(std::shared_ptr<TelemetryLog> log) {
+    std::lock_guard<std::mutex> guard(telemetryLogLock);
+    processTelemetryLog = log;
+}
+
+static int64_t quantize(double value) {
+    if (!std::isfinite(value))
+        return 0;
+    return std::llround(std::min(std::max(value, -1e15), 1e15));
+}
+
+static void toValues(const BatteryStatus &status, int64_t* values) {
+    values[TELEMETRY_TIME]                    = status.time;
+    values[TELEMETRY_VOLTAGE]                 = quantize(status.voltage_mV);
+    values[TELEMETRY_CURRENT]                 = quantize(status.current_mA);
+    values[TELEMETRY_CAPACITY]                = quantize(status.capacity_mAh);
+    values[TELEMETRY_MAX_CAPACITY]            = quantize(status.max_capacity_mAh);
+    values[TELEMETRY_MAX_CHARGING_CURRENT]    = quantize(status.max_charging_current_mA);
+    values[TELEMETRY_MAX_DISCHARGING_CURRENT] = quantize(status.max_discharging_current_mA);
+    values[TELEMETRY_TEMPERATURE]             = status.max_temperature_dK;
+    values[TELEMETRY_PROTECTION_FLAGS]        = status.protection_flags;
+}
+
+static void putVarint(std::string &buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char) value);
+}
+
+/*
+ * decodes numSamples zigzag varint differences into values (false if they do not end at end)
+ */
+static bool decodeColumn(const uint8_t* data, const uint8_t* end, size_t numSamples, int64_t* values) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < numSamples; i++) {
+        uint64_t delta = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (data == end || shift > 63)
+                return false;
+            uint8_t byte = *data++;
+            delta |= (uint64_t) (byte & 0x7F) << shift;
+            if (byte < 0x80)
+                break;
+        }
+        value += (delta >> 1) ^ (0 - (delta & 1));
+        values[i] = (int64_t) value;
+    }
+    return data == end;
+}
+
+static uint32_t segmentCRC(const TelemetrySegmentHeader &header, const char* payload) {
+    uint32_t crc = util::crc32((const char*) &header + CRC_START, HEADER_SIZE - CRC_START);
+    return util::crc32(payload, header.size, crc);
+}
+
+/*
+ * reads the header of the segment at offset (false if the segment is torn or is not a segment)
+ */
+static bool readHeader(const char* data, size_t length, size_t offset, TelemetrySegmentHeader &header) {
+    if (length - offset < HEADER_SIZE)
+        return false;
+    memcpy(&header, data + offset, HEADER_SIZE);
+    if (header.magic != TELEMETRY_SEGMENT_MAGIC || header.size > length - offset - HEADER_SIZE || header.nameLength > header.size)
+        return false;
+
+    uint32_t columnStart = 0;
+    for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++) {
+        if (header.columnEnd[column] < columnStart)
+            return false;
+        columnStart = header.columnEnd[column];
+    }
+    return columnStart == header.size - header.nameLength;
+}
+
+static void appendIndexEntry(std::string &index, uint64_t offset, const TelemetrySegmentHeader &header, const char* batteryName) {
+    index.append((const char*) &offset, sizeof(offset));
+    index.append((const char*) &header, HEADER_SIZE);
+    index.append(batteryName, header.nameLength);
+}
+
+static bool readAll(int fd, std::string &buffer) {
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+        return false;
+
+    buffer.resize(info.st_size);
+    size_t numRead = 0;
+    while (numRead < buffer.size()) {
+        ssize_t numBytes = pread(fd, &buffer[numRead], buffer.size() - numRead, numRead);
+        if (numBytes == -1 && errno == EINTR)
+            continue;
+        if (numBytes <= 0)
+            break;
+        numRead += numBytes;
+    }
+    buffer.resize(numRead);
+    return true;
+}
+
+/*
+ * finds the segments of the log in data: from the index while its entries follow each other through
+ * the log, then from the segment headers in the log. add is called with the offset, header and battery
+ * name of each segment and the end of its entry in the index (0 if it was found in the log). Returns
+ * the end of the last segment.
+ */
+static size_t findSegments(const char* data, size_t length, const std::string &index,
+                           const std::function<void(size_t, const TelemetrySegmentHeader&, const char*, size_t)> &add) {
+    size_t offset = MAGIC_SIZE;
+    TelemetrySegmentHeader header;
+
+    if (index.compare(0, MAGIC_SIZE, TELEMETRY_INDEX_MAGIC) == 0) {
+        size_t position = MAGIC_SIZE;
+        while (index.size() - position >= ENTRY_SIZE) {
+            uint64_t entryOffset;
+            memcpy(&entryOffset, &index[position], sizeof(entryOffset));
+            memcpy(&header, &index[position + sizeof(entryOffset)], HEADER_SIZE);
+            if (entryOffset != offset || length - offset < HEADER_SIZE || header.magic != TELEMETRY_SEGMENT_MAGIC ||
+                header.size > length - offset - HEADER_SIZE || header.nameLength > index.size() - position - ENTRY_SIZE)
+                break;
+
+            position += ENTRY_SIZE + header.nameLength;
+            add(offset, header, &index[position - header.nameLength], position);
+            offset += HEADER_SIZE + header.size;
+        }
+    }
+
+    while (readHeader(data, length, offset, header)) {
+        add(offset, header, data + offset + HEADER_SIZE, 0);
+        offset += HEADER_SIZE + header.size;
+    }
+    return offset;
+}
+
+BatteryStatus TelemetryColumns::getStatus(size_t index) const {
+    auto value = [&](int column) -> int64_t {
+        return this->values[column].empty() ? 0 : this->values[column][index];
+    };
+
+    BatteryStatus status;
+    status.time                       = value(TELEMETRY_TIME);
+    status.voltage_mV                 = value(TELEMETRY_VOLTAGE);
+    status.current_mA                 = value(TELEMETRY_CURRENT);
+    status.capacity_mAh               = value(TELEMETRY_CAPACITY);
+    status.max_capacity_mAh           = value(TELEMETRY_MAX_CAPACITY);
+    status.max_charging_current_mA    = value(TELEMETRY_MAX_CHARGING_CURRENT);
+    status.max_discharging_current_mA = value(TELEMETRY_MAX_DISCHARGING_CURRENT);
+    status.max_temperature_dK         = value(TELEMETRY_TEMPERATURE);
+    status.protection_flags           = value(TELEMETRY_PROTECTION_FLAGS);
+    return status;
+}
+
+/************************
+TelemetryLog Constructor
+*************************/
+
+TelemetryLog::~TelemetryLog() {
+    if (this->writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->quit = true;
+        }
+        this->flushSignal.notify_one();
+        this->writer.join();
+    }
+    if (this->fd != -1)
+        close(this->fd);
+    if (this->indexFd != -1)
+        close(this->indexFd);
+}
+
+TelemetryLog::TelemetryLog(const std::string &path, size_t segmentSize, std::chrono::milliseconds flushInterval) {
+    this->path          = path;
+    this->indexFd       = -1;
+    this->logLength     = 0;
+    this->segmentSize   = std::min<size_t>(std::max<size_t>(segmentSize, 1), 1 << 20);
+    this->flushInterval = flushInterval;
+    this->quit          = false;
+    this->flushRequests = 0;
+    this->flushesDone   = 0;
+    this->numSamples    = 0;
+    this->numSegments   = 0;
+    this->numDropped    = 0;
+
+    if (this->open())
+        this->writer = std::thread(&TelemetryLog::run, this);
+}
+
+/*****************************
+TelemetryLog Private Functions
+******************************/
+
+bool TelemetryLog::open() {
+    this->fd = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->fd == -1) {
+        WARNING() << "could not open telemetry log " << this->path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::string indexPath = this->path + ".index";
+    this->indexFd = ::open(indexPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat info;
+    if (this->indexFd == -1 || fstat(this->fd, &info) == -1) {
+        WARNING() << "could not open telemetry log " << this->path << ": " << strerror(errno) << std::endl;
+        close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    size_t length = info.st_size;
+    std::string magic = TELEMETRY_LOG_MAGIC;
+    if (length == 0 && util::write_exact(this->fd, &magic[0], MAGIC_SIZE) == MAGIC_SIZE)
+        length = MAGIC_SIZE;
+
+    void* mapping = (length < MAGIC_SIZE) ? MAP_FAILED : mmap(NULL, length, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (mapping == MAP_FAILED || memcmp(mapping, TELEMETRY_LOG_MAGIC, MAGIC_SIZE) != 0) {
+        WARNING() << this->path << " is not a telemetry log" << std::endl;
+        if (mapping != MAP_FAILED)
+            munmap(mapping, length);
+        close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    std::string index;
+    readAll(this->indexFd, index);
+    bool validIndex = index.compare(0, MAGIC_SIZE, TELEMETRY_INDEX_MAGIC) == 0;
+
+    // segments the index is missing are added to it, except a last segment torn by a crash
+    const char* data = (const char*) mapping;
+    std::string missing;
+    size_t lastOffset = 0, indexEnd = MAGIC_SIZE, lastIndexEnd = MAGIC_SIZE, lastMissing = 0;
+    size_t end = findSegments(data, length, index, [&](size_t offset, const TelemetrySegmentHeader &header, const char* batteryName, size_t entryEnd) {
+        lastOffset   = offset;
+        lastIndexEnd = indexEnd;
+        lastMissing  = missing.size();
+        if (entryEnd != 0)
+            indexEnd = entryEnd;
+        else
+            appendIndexEntry(missing, offset, header, batteryName);
+    });
+
+    TelemetrySegmentHeader header;
+    if (lastOffset != 0 && (!readHeader(data, length, lastOffset, header) ||
+                            segmentCRC(header, data + lastOffset + HEADER_SIZE) != header.crc)) {
+        end = lastOffset;
+        indexEnd = lastIndexEnd;
+        missing.resize(lastMissing);
+    }
+    munmap(mapping, length);
+
+    if (end != length) {
+        WARNING() << "cutting a torn segment (" << length - end << " bytes) off " << this->path << std::endl;
+        if (ftruncate(this->fd, end) == -1)
+            WARNING() << "could not truncate " << this->path << ": " << strerror(errno) << std::endl;
+    }
+    this->logLength = end;
+
+    if (!validIndex)
+        missing.insert(0, TELEMETRY_INDEX_MAGIC);
+    if ((size_t) index.size() != (validIndex ? indexEnd : 0) && ftruncate(this->indexFd, validIndex ? indexEnd : 0) == -1)
+        WARNING() << "could not truncate " << indexPath << ": " << strerror(errno) << std::endl;
+    if (!missing.empty() && util::write_exact(this->indexFd, &missing[0], missing.size()) != missing.size())
+        WARNING() << "could not update " << indexPath << std::endl;
+    return true;
+}
+
+void TelemetryLog::run() {
+    std::vector<PendingStatus> batch;
+    std::chrono::milliseconds wait = std::min(this->flushInterval, std::chrono::milliseconds(1000));
+
+    while (true) {
+        bool stop, all;
+        uint64_t requests;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->flushSignal.wait_for(guard, wait, [this]() {
+                return this->quit || this->flushRequests != this->flushesDone || this->pending.size() >= this->segmentSize;
+            });
+            batch.swap(this->pending);
+            stop     = this->quit;
+            requests = this->flushRequests;
+            all      = stop || requests != this->flushesDone;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (const PendingStatus &entry : batch) {
+            Buffer &buffer = this->buffers[entry.batteryID];
+            if (buffer.batteryName.empty())
+                buffer.batteryName = getBatteryNameOf(entry.batteryID);
+            if (buffer.statuses.empty())
+                buffer.firstTime = now;
+            buffer.statuses.push_back(entry.status);
+        }
+        batch.clear();
+        this->writeBuffers(all);
+
+        if (all) {
+            {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->flushesDone = requests;
+            }
+            this->flushedSignal.notify_all();
+        }
+        if (stop)
+            return;
+    }
+}
+
+void TelemetryLog::encode(const std::string &batteryName, const BatteryStatus* statuses, size_t numStatuses, std::string &buffer, std::string &index) {
+    TelemetrySegmentHeader header;
+    memset(&header, 0, HEADER_SIZE);
+    header.magic      = TELEMETRY_SEGMENT_MAGIC;
+    header.numSamples = numStatuses;
+    header.nameLength = batteryName.size();
+
+    std::vector<int64_t> values(TELEMETRY_NUM_COLUMNS * numStatuses);
+    for (size_t i = 0; i < numStatuses; i++)
+        toValues(statuses[i], &values[i * TELEMETRY_NUM_COLUMNS]);
+
+    size_t headerOffset = buffer.size();
+    buffer.append(HEADER_SIZE, '\0');
+    buffer.append(batteryName);
+
+    size_t columnsOffset = buffer.size();
+    for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++) {
+        int64_t previous = 0;
+        header.minValue[column] = values[column];
+        header.maxValue[column] = values[column];
+        for (size_t i = 0; i < numStatuses; i++) {
+            int64_t value = values[i * TELEMETRY_NUM_COLUMNS + column];
+            uint64_t delta = (uint64_t) value - (uint64_t) previous;
+            putVarint(buffer, (delta << 1) ^ (0 - (delta >> 63)));
+            header.minValue[column] = std::min(header.minValue[column], value);
+            header.maxValue[column] = std::max(header.maxValue[column], value);
+            previous = value;
+        }
+        header.columnEnd[column] = buffer.size() - columnsOffset;
+    }
+
+    header.size = buffer.size() - headerOffset - HEADER_SIZE;
+    header.crc  = segmentCRC(header, &buffer[headerOffset + HEADER_SIZE]);
+    memcpy(&buffer[headerOffset], &header, HEADER_SIZE);
+    appendIndexEntry(index, this->logLength + headerOffset, header, batteryName.data());
+}
+
+void TelemetryLog::writeBuffers(bool all) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::string output, index;
+    uint64_t numSamples = 0, numSegments = 0;
+
+    for (auto &entry : this->buffers) {
+        Buffer &buffer = entry.second;
+        size_t numWritten = 0;
+        while (buffer.statuses.size() - numWritten >= this->segmentSize) {
+            this->encode(buffer.batteryName, &buffer.statuses[numWritten], this->segmentSize, output, index);
+            numWritten += this->segmentSize;
+            numSegments++;
+        }
+
+        bool expired = now - buffer.firstTime >= this->flushInterval;
+        if (numWritten < buffer.statuses.size() && (all || expired)) {
+            this->encode(buffer.batteryName, &buffer.statuses[numWritten], buffer.statuses.size() - numWritten, output, index);
+            numWritten = buffer.statuses.size();
+            numSegments++;
+        }
+
+        if (numWritten == 0)
+            continue;
+        numSamples += numWritten;
+        buffer.statuses.erase(buffer.statuses.begin(), buffer.statuses.begin() + numWritten);
+        buffer.firstTime = now;
+    }
+
+    if (output.empty())
+        return;
+    if (util::write_exact(this->fd, &output[0], output.size()) != output.size()) {
+        WARNING() << "could not append " << numSamples << " samples to telemetry log " << this->path << std::endl;
+        off_t length = lseek(this->fd, 0, SEEK_END);
+        this->logLength = (length == -1) ? this->logLength : length;
+        return;
+    }
+    this->logLength += output.size();
+    if (util::write_exact(this->indexFd, &index[0], index.size()) != index.size())
+        WARNING() << "could not index " << numSegments << " segments of telemetry log " << this->path << std::endl;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->numSamples  += numSamples;
+    this->numSegments += numSegments;
+}
+
+/****************************
+TelemetryLog Public Functions
+*****************************/
+
+bool TelemetryLog::isOpen() const {
+    return this->fd != -1;
+}
+
+void TelemetryLog::record(battery_id_t batteryID, const BatteryStatus &status) {
+    if (this->fd == -1)
+        return;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->pending.size() >= TELEMETRY_MAX_PENDING) {
+        this->numDropped++;
+        return;
+    }
+    this->pending.push_back({batteryID, status});
+    if (this->pending.size() == this->segmentSize)
+        this->flushSignal.notify_one();
+}
+
+void TelemetryLog::flush() {
+    if (this->fd == -1)
+        return;
+
+    std::unique_lock<std::mutex> guard(this->lock);
+    uint64_t request = ++this->flushRequests;
+    this->flushSignal.notify_one();
+    this->flushedSignal.wait(guard, [this, request]() { return this->flushesDone >= request; });
+}
+
+uint64_t TelemetryLog::getNumSamples() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numSamples;
+}
+
+uint64_t TelemetryLog::getNumSegments() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numSegments;
+}
+
+uint64_t TelemetryLog::getNumDropped() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numDropped;
+}
+
+/******************************
+TelemetryLogReader Constructor
+*******************************/
+
+TelemetryLogReader::~TelemetryLogReader() {
+    if (this->data != nullptr)
+        munmap((void*) this->data, this->length);
+    if (this->fd != -1)
+        close(this->fd);
+}
+
+TelemetryLogReader::TelemetryLogReader(const std::string &path) {
+    this->path   = path;
+    this->data   = nullptr;
+    this->length = 0;
+
+    this->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->fd == -1) {
+        WARNING() << "could not open telemetry log " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    struct stat info;
+    if (fstat(this->fd, &info) == -1 || (size_t) info.st_size < MAGIC_SIZE) {
+        WARNING() << path << " is not a telemetry log" << std::endl;
+        return;
+    }
+
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (mapping == MAP_FAILED) {
+        WARNING() << "could not map telemetry log " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    this->data   = (const char*) mapping;
+    this->length = info.st_size;
+
+    if (memcmp(this->data, TELEMETRY_LOG_MAGIC, MAGIC_SIZE) != 0) {
+        WARNING() << path << " is not a telemetry log" << std::endl;
+        munmap(mapping, this->length);
+        this->data = nullptr;
+        return;
+    }
+
+    std::string index;
+    int indexFd = ::open((path + ".index").c_str(), O_RDONLY | O_CLOEXEC);
+    if (indexFd != -1) {
+        readAll(indexFd, index);
+        close(indexFd);
+    }
+
+    // stops at a segment that is torn or still being written
+    findSegments(this->data, this->length, index, [this](size_t offset, const TelemetrySegmentHeader &header, const char* batteryName, size_t) {
+        this->segments[std::string(batteryName, header.nameLength)].push_back({offset, header});
+    });
+}
+
+/***********************************
+TelemetryLogReader Private Functions
+************************************/
+
+bool TelemetryLogReader::decode(const Segment &segment, uint32_t columns, TelemetryColumns &samples) const {
+    TelemetrySegmentHeader header;
+    if (!readHeader(this->data, this->length, segment.offset, header) || header.crc != segment.header.crc)
+        return false;
+
+    const char* payload = this->data + segment.offset + HEADER_SIZE;
+    if (segmentCRC(header, payload) != header.crc)
+        return false;
+
+    const uint8_t* start = (const uint8_t*) payload + header.nameLength;
+    samples.numSamples = header.numSamples;
+    for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++) {
+        if (!(columns & (1 << column))) {
+            samples.values[column].clear();
+            continue;
+        }
+
+        uint32_t columnStart = (column == 0) ? 0 : header.columnEnd[column - 1];
+        samples.values[column].resize(header.numSamples);
+        if (!decodeColumn(start + columnStart, start + header.columnEnd[column], header.numSamples, samples.values[column].data()))
+            return false;
+    }
+    return true;
+}
+
+/**********************************
+TelemetryLogReader Public Functions
+***********************************/
+
+bool TelemetryLogReader::isOpen() const {
+    return this->data != nullptr;
+}
+
+std::vector<std::string> TelemetryLogReader::getBatteryNames() const {
+    std::vector<std::string> names;
+    for (const auto &entry : this->segments)
+        names.push_back(entry.first);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::vector<TelemetrySegmentHeader> TelemetryLogReader::getSegments(const std::string &batteryName) const {
+    std::vector<TelemetrySegmentHeader> headers;
+    auto it = this->segments.find(batteryName);
+    if (it == this->segments.end())
+        return headers;
+
+    for (const Segment &segment : it->second)
+        headers.push_back(segment.header);
+    return headers;
+}
+
+size_t TelemetryLogReader::scan(const std::string &batteryName, uint64_t startTime, uint64_t endTime,
+                                const std::function<void(const TelemetryColumns&)> &visit, uint32_t columns) const {
+    auto it = this->segments.find(batteryName);
+    if (it == this->segments.end() || startTime > endTime)
+        return 0;
+
+    columns |= 1 << TELEMETRY_TIME;
+    TelemetryColumns samples;
+    size_t numVisited = 0;
+
+    for (const Segment &segment : it->second) {
+        uint64_t minTime = segment.header.minValue[TELEMETRY_TIME];
+        uint64_t maxTime = segment.header.maxValue[TELEMETRY_TIME];
+        if (maxTime < startTime || minTime > endTime)
+            continue;
+
+        if (!this->decode(segment, columns, samples)) {
+            WARNING() << "skipping corrupt segment at " << segment.offset << " of " << this->path << std::endl;
+            continue;
+        }
+
+        // keep only the samples in range of a segment that straddles it
+        if (minTime < startTime || maxTime > endTime) {
+            std::vector<int64_t> &time = samples.values[TELEMETRY_TIME];
+            size_t numKept = 0;
+            for (size_t i = 0; i < samples.numSamples; i++) {
+                if ((uint64_t) time[i] < startTime || (uint64_t) time[i] > endTime)
+                    continue;
+                for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++)
+                    if (!samples.values[column].empty())
+                        samples.values[column][numKept] = samples.values[column][i];
+                numKept++;
+            }
+            for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++)
+                if (!samples.values[column].empty())
+                    samples.values[column].resize(numKept);
+            samples.numSamples = numKept;
+        }
+
+        if (samples.numSamples == 0)
+            continue;
+        visit(samples);
+        numVisited += samples.numSamples;
+    }
+    return numVisited;
+}
+
+std::vector<BatteryStatus> TelemetryLogReader::read(const std::string &batteryName, uint64_t startTime, uint64_t endTime) const {
+    std::vector<BatteryStatus> statuses;
+    this->scan(batteryName, startTime, endTime, [&statuses](const TelemetryColumns &samples) {
+        for (size_t i = 0; i < samples.numSamples; i++)
+            statuses.push_back(samples.getStatus(i));
+    });
+    return statuses;
+}
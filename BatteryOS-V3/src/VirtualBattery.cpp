@@ -23,6 +23,21 @@ void VirtualBattery::setMaxDischargingCurrent(double current_mA) {
     this->status.max_discharging_current_mA = current_mA ;
 }
 
+void VirtualBattery::setShare(double capacity_mAh, double max_capacity_mAh, double max_charging_current_mA, double max_discharging_current_mA,
+                              uint16_t max_temperature_dK, uint16_t protection_flags) {
+    std::unique_lock<lock_t> mutexLock(this->lock);
+    this->status.capacity_mAh               = capacity_mAh;
+    this->status.max_capacity_mAh           = max_capacity_mAh;
+    this->status.max_charging_current_mA    = max_charging_current_mA;
+    this->status.max_discharging_current_mA = max_discharging_current_mA;
+    this->status.max_temperature_dK         = max_temperature_dK;
+    this->status.protection_flags           = protection_flags;
+    this->publishStatus();
+    mutexLock.unlock();
+
+    this->notifySubscribers();
+}
+
 BatteryStatus VirtualBattery::refresh() {
     PRINT() << "VIRTUAL BATTERY REFRESH!!!!" << std::endl;
 
@@ -33,10 +48,14 @@ BatteryStatus VirtualBattery::refresh() {
     status.max_capacity_mAh = 0;
     status.max_charging_current_mA = 0;
     status.max_discharging_current_mA = 0;
-    status.time = convertToMilliseconds(getTimeNow());
+    status.time = convertToMilliseconds(this->clock->now());
     return status; 
 }
 
 bool VirtualBattery::set_current(double current_mA) {
     return true;
 } 
+
+bool VirtualBattery::restore_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime) {
+    return schedule_set_current(current_mA, startTime, endTime);
+}
@@ -0,0 +1,25 @@
+#include "DriverABI.hpp"
+
+/**
+ * Drivers in libbatterydrivers (add an entry for every new driver)
+ */
+
+static const DriverEntry drivers[] = {
+    {"Driver", DRIVER_CHARGE | DRIVER_DISCHARGE,
+     "CreateDriverBattery", "DestroyDriverBattery", "DriverRefresh", "DriverSetCurrent", nullptr},
+    {"JBDBMS", DRIVER_TELEMETRY,
+     "CreateJBDBMS", "DestroyJBDBMS", "JBDBMSRefresh", "JBDBMSSetCurrent", "JBDBMSTelemetry"},
+    {"RD6006", DRIVER_CHARGE,
+     "CreateRD6006", "DestroyRD6006", "RD6006Refresh", "RD6006SetCurrent", nullptr},
+};
+
+static const DriverTable table = {
+    BOS_DRIVER_ABI_VERSION,
+    sizeof(BatteryStatus),
+    sizeof(drivers) / sizeof(drivers[0]),
+    drivers,
+};
+
+extern "C" const DriverTable* BOSDriverTable() {
+    return &table;
+}
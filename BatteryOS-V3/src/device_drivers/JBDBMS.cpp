@@ -1,15 +1,104 @@
 #include "JBDBMS.hpp"
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*******
+JBD Port
+********/
+
+JBDPort::JBDPort(int fd, std::function<void(const JBDFrame&)> frameHandler) {
+    this->fd           = fd;
+    this->frameHandler = frameHandler;
+}
+
+void JBDPort::parse() {
+    size_t start = 0;
+
+    while (true) {
+        while (start < this->buffer.size() && this->buffer[start] != BMS_STARTBYTE)
+            start++;
+        if (this->buffer.size() - start < 4)
+            break;
+
+        size_t length = this->buffer[start + 3];
+        size_t size   = length + BMS_FRAME_OVERHEAD;
+        if (this->buffer.size() - start < size)
+            break;
+
+        const uint8_t* frame = this->buffer.data() + start;
+        uint16_t checkSum    = ((uint16_t) frame[size - 3] << 8) | frame[size - 2];
+
+        if (frame[size - 1] != BMS_STOPBYTE || checkSum != checksum(frame + 2, length + 2)) {
+            start++; // resynchronize on the next start byte
+            continue;
+        }
+
+        JBDFrame response{frame[1], frame[2], {frame + 4, frame + 4 + length}};
+        start += size;
+        this->frameHandler(response);
+    }
+
+    this->buffer.erase(this->buffer.begin(), this->buffer.begin() + start);
+}
+
+struct pollfd JBDPort::pollInfo() {
+    return {this->fd, POLLIN, 0};
+}
+
+void JBDPort::pollHandler() {
+    uint8_t bytes[256];
+    ssize_t numBytes;
+
+    while ((numBytes = ::read(this->fd, bytes, sizeof(bytes))) > 0)
+        this->buffer.insert(this->buffer.end(), bytes, bytes + numBytes);
+
+    if (numBytes == -1 && errno != EAGAIN && errno != EINTR)
+        WARNING() << "could not read from BMS: " << strerror(errno) << std::endl;
+
+    this->parse();
+}
+
+bool JBDPort::write(const std::vector<uint8_t> &data) {
+    size_t written = 0;
+
+    while (written < data.size()) {
+        ssize_t numBytes = ::write(this->fd, data.data() + written, data.size() - written);
+        if (numBytes > 0)
+            written += numBytes;
+        else if (numBytes == -1 && errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+uint16_t JBDPort::checksum(const uint8_t* payload, size_t size) {
+    uint16_t c = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        c += (uint16_t) payload[i];
+    }
+
+    return ~c + 1;
+}
+
 /**********************
 Constructor/Destructor
 ***********************/
 
 JBDBMS::~JBDBMS() {
+    this->quit = true;
+    this->service.wakeup();
+    this->pollThread.join();
     serialClose(this->fd);
 }
 
 JBDBMS::JBDBMS(const std::string& device_path, int baud,
-               double max_charge, double max_discharge) {
+               double max_charge, double max_discharge,
+               std::chrono::milliseconds timeout,
+               std::chrono::milliseconds telemetryInterval) {
     this->fd = serialOpen(device_path.c_str(), baud);   
     
     if (this->fd == -2)
@@ -17,99 +106,154 @@ JBDBMS::JBDBMS(const std::string& device_path, int baud,
     else if (this->fd == -1)
         ERROR() << "could not open device path" << std::endl;
 
+    fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) | O_NONBLOCK);
+    serialFlush(this->fd);
+
+    this->quit                       = false;
+    this->timeout                    = timeout;
+    this->telemetryInterval          = telemetryInterval;
     this->max_charging_current_mA    = max_charge;
     this->max_discharging_current_mA = max_discharge;
+
+    this->requests[0] = {BMS_REFRESH, false, {}, 0};
+    this->requests[1] = {BMS_CELL_VOLTAGES, false, {}, 0};
+
+    this->port = std::make_shared<JBDPort>(this->fd, [this](const JBDFrame &frame) {
+        this->handleFrame(frame);
+    });
+    this->service.add(this->port);
+    this->pollThread = std::thread(&JBDBMS::runPoll, this);
 }
 
 /****************
 Private Functions
 *****************/
 
-bool JBDBMS::validateData(uint8_t startByte, uint8_t errorByte, std::vector<uint8_t>& payload, uint16_t checkSum, uint8_t stopByte) {
-    if (startByte != BMS_STARTBYTE)
-        return false;
-    else if (errorByte == 0x80)
-        return false;
-    else if (checkSum != this->checksum(payload))
-        return false;
-    else if (stopByte != BMS_STOPBYTE)
-        return false;
-    return true;
-}
-
-uint16_t JBDBMS::checksum(const std::vector<uint8_t>& payload) {
-    uint16_t c = 0;
+void JBDBMS::sendRequests(bool readCellVoltages) {
+    std::vector<uint8_t> data;
+    auto currentTime = std::chrono::steady_clock::now();
 
-    for (const uint8_t p : payload) {
-        c += (uint16_t) p;
+    // requests are pipelined: the BMS answers them in the order they were sent
+    for (Request &request : this->requests) {
+        if (&request == &this->requests[1] && !readCellVoltages)
+            continue;
+        if (request.inFlight && currentTime - request.sentTime < this->timeout)
+            continue;
+        data.insert(data.end(), request.frame, request.frame + sizeof(BMS_REFRESH));
+        request.inFlight = true;
+        request.sentTime = currentTime;
     }
 
-    return ~c + 1;
+    if (!data.empty() && !this->port->write(data))
+        WARNING() << "could not write to BMS: " << strerror(errno) << std::endl;
 }
 
-/***************
-Public Functions
-****************/
-
-BatteryStatus JBDBMS::refresh() {
-    PRINT() << "JBDBMS REFRESH!!!" << std::endl;
-    using namespace std::chrono_literals;
-
-    BatteryStatus status{};
-    std::vector<uint8_t> data;
-
+void JBDBMS::handleFrame(const JBDFrame &frame) {
     auto U16 = [] (const uint8_t x, const uint8_t y) -> uint16_t {
         return ((uint16_t) x << 8) | ((uint16_t) y);
     };
-    
-    auto S16 = [] (const int8_t x, const int8_t y) -> int16_t {
-        return ((int16_t) x << 8) | ((int16_t) y);
-    };
 
-    while (true) {
-        serialFlush(this->fd);
-        
-        for (const uint8_t c: BMS_REFRESH)
-            serialPutchar(this->fd, (unsigned char)c);
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+
+    Request* request;
+    if (frame.reg == BMS_REG_BASIC_SYSTEM_INFO)
+        request = &this->requests[0];
+    else if (frame.reg == BMS_REG_CELL_VOLTAGES)
+        request = &this->requests[1];
+    else
+        return;
+
+    request->inFlight = false;
+    request->responses++;
 
-        std::this_thread::sleep_for(1s); // wait for response from BMS
+    const std::vector<uint8_t> &data = frame.data;
+    uint64_t currentTime = convertToMilliseconds(getTimeNow());
 
-        if (serialDataAvail(this->fd) > 0)
-            break; 
+    if (frame.reg == BMS_REG_CELL_VOLTAGES)
+        this->cellVoltagesRead = std::chrono::steady_clock::now();
+
+    if (frame.status == BMS_ERRORBYTE) {
+        WARNING() << "BMS could not read register " << (int) frame.reg << std::endl;
+    } else if (frame.reg == BMS_REG_BASIC_SYSTEM_INFO && data.size() >= 8) {
+        this->status.voltage_mV                 = U16(data[0], data[1]) * 10;
+        this->status.current_mA                 = (int16_t) U16(data[2], data[3]) * 10;
+        this->status.capacity_mAh               = U16(data[4], data[5]) * 10;
+        this->status.max_capacity_mAh           = U16(data[6], data[7]) * 10; 
+        this->status.max_charging_current_mA    = this->max_charging_current_mA;
+        this->status.max_discharging_current_mA = this->max_discharging_current_mA;
+        this->status.time = currentTime;
+
+        // offsets 0x8 to 0x17 + 2 * NTC count (see doc/JBD_REGISTER_MAP.md, which lists the
+        // fields after the 16 bit protection flags one byte early: the BMS sends the version at
+        // 0x12, the state of charge at 0x13, FETs at 0x14, cells at 0x15 and NTCs at 0x16)
+        size_t numSensors = data.size() > 0x16 ? data[0x16] : 0;
+        if (data.size() >= 0x17 + 2 * numSensors) {
+            this->telemetry.cycles          = U16(data[0x8], data[0x9]);
+            this->telemetry.balanceFlags    = U16(data[0xC], data[0xD]) | ((uint32_t) U16(data[0xE], data[0xF]) << 16);
+            this->telemetry.protectionFlags = U16(data[0x10], data[0x11]);
+            this->telemetry.stateOfCharge   = data[0x13];
+            this->telemetry.fetStatus       = data[0x14];
+
+            this->telemetry.temperatures.clear();
+            for (size_t i = 0; i < numSensors; i++)
+                this->telemetry.temperatures.push_back(U16(data[0x17 + 2 * i], data[0x18 + 2 * i]));
+            this->telemetry.time = currentTime;
+        }
+
+        this->status.max_temperature_dK = this->telemetry.maxTemperature();
+        this->status.protection_flags   = this->telemetry.protectionFlags;
+    } else if (frame.reg == BMS_REG_CELL_VOLTAGES) {
+        this->telemetry.cellVoltages.clear();
+        for (size_t i = 0; i + 1 < data.size(); i += 2)
+            this->telemetry.cellVoltages.push_back(U16(data[i], data[i + 1]));
+        this->telemetry.cellVoltagesTime = currentTime;
+        this->telemetry.time             = currentTime;
     }
 
-    if (serialDataAvail(this->fd) != BMS_RX_BASIC_INFO_SIZE)
-        return status; 
+    this->responseReady.notify_all();
+}
+
+void JBDBMS::runPoll() {
+    while (!this->quit)
+        this->service.poll();
+}
+
+/***************
+Public Functions
+****************/
 
-    for (int i = 0; i < BMS_RX_BASIC_INFO_SIZE; i++)
-        data.push_back((uint8_t) serialGetchar(this->fd));
+BatteryStatus JBDBMS::refresh() {
+    PRINT() << "JBDBMS REFRESH!!!" << std::endl;
 
-    uint8_t startByte = data[0];
-    uint8_t errorByte = data[2];
-    uint8_t stopByte  = data[33];
-    uint16_t checkSum = U16(data[31], data[32]);
-    std::vector<uint8_t> payload = {data.begin() + 2, data.end() - 3}; 
+    std::unique_lock<std::mutex> uniqueLock(this->lock);
+    uint64_t basicInfo    = this->requests[0].responses;
+    uint64_t cellVoltages = this->requests[1].responses;
 
-    if (!validateData(startByte, errorByte, payload, checkSum, stopByte))
-        return status;
+    // the cell voltages change slowly, so they are read at the (slower) telemetry cadence
+    bool readCellVoltages = this->requests[1].responses == 0 ||
+                            std::chrono::steady_clock::now() - this->cellVoltagesRead >= this->telemetryInterval;
+    this->sendRequests(readCellVoltages);
 
-    status.voltage_mV                 = U16(data[4], data[5])   * 10;
-    status.current_mA                 = S16(data[6], data[7])   * 10;
-    status.capacity_mAh               = U16(data[8], data[9])   * 10;
-    status.max_capacity_mAh           = U16(data[10], data[11]) * 10; 
-    status.max_charging_current_mA    = this->max_charging_current_mA;
-    status.max_discharging_current_mA = this->max_discharging_current_mA;
-    status.time = convertToMilliseconds(getTimeNow());
+    bool answered = this->responseReady.wait_for(uniqueLock, this->timeout, [&] {
+        return this->requests[0].responses > basicInfo && (!readCellVoltages || this->requests[1].responses > cellVoltages);
+    });
+    if (!answered)
+        WARNING() << "BMS did not respond within " << this->timeout.count() << "ms" << std::endl;
     
-    PRINT() << status << std::endl;
+    PRINT() << this->status << std::endl;
 
-    return status;
+    return this->status;
 }
 
 bool JBDBMS::set_current(double current_mA) {
     return true;
 }
 
+BatteryTelemetry JBDBMS::getTelemetry() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    return this->telemetry;
+}
+
 /**********
 C Functions
 ***********/
@@ -139,3 +283,11 @@ bool JBDBMSSetCurrent(void* battery, double current_mA) {
     JBDBMS* bat = (JBDBMS*) battery;
     return bat->set_current(current_mA);
 }
+
+size_t JBDBMSTelemetry(void* battery, uint8_t* buffer, size_t size) {
+    JBDBMS* bat = (JBDBMS*) battery;
+    std::string bytes = bat->getTelemetry().encode();
+    if (bytes.size() <= size)
+        memcpy(buffer, bytes.data(), bytes.size());
+    return bytes.size();
+}
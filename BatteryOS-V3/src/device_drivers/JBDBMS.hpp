@@ -1,18 +1,26 @@
 #ifndef JBDBMS_HPP
 #define JBDBMS_HPP
 
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <thread>
+#include <functional>
+#include <condition_variable>
 #include <stdlib.h>
 #include "util.hpp"
 #include "wiringSerial.h"
+#include "NetService.hpp"
 #include "BatteryStatus.hpp"
+#include "BatteryTelemetry.hpp"
 
 // Constants
 #define BMS_STARTBYTE 0xDD
 #define BMS_STOPBYTE  0x77
 #define BMS_READBYTE  0xA5
 #define BMS_WRITEBYTE 0x5A
+#define BMS_ERRORBYTE 0x80
 
 // Command codes (registers)
 #define BMS_REG_BASIC_SYSTEM_INFO 0x03
@@ -20,9 +28,13 @@
 #define BMS_REG_NAME              0x05
 
 // number of bytes sent from bms
-// regarding basic info  
+// regarding basic info
 #define BMS_RX_BASIC_INFO_SIZE 34
 
+// bytes of a response frame around its data
+// (start, register, status, length, checksum, stop)
+#define BMS_FRAME_OVERHEAD 7
+
 constexpr uint8_t BMS_REFRESH[] {BMS_STARTBYTE,
                                  BMS_READBYTE,
                                  BMS_REG_BASIC_SYSTEM_INFO,
@@ -31,29 +43,141 @@ constexpr uint8_t BMS_REFRESH[] {BMS_STARTBYTE,
                                  0xfd,
                                  0x77};
 
+constexpr uint8_t BMS_CELL_VOLTAGES[] {BMS_STARTBYTE,
+                                       BMS_READBYTE,
+                                       BMS_REG_CELL_VOLTAGES,
+                                       0x00,
+                                       0xff,
+                                       0xfc,
+                                       0x77};
+
+/**
+ * Response frame of the BMS
+ *
+ * @param reg:    register the frame answers
+ * @param status: 0x00 on success, BMS_ERRORBYTE if the BMS rejected the request
+ * @param data:   contents of the register
+ */
+struct JBDFrame {
+    uint8_t reg;
+    uint8_t status;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * JBD Port
+ *
+ * Serial port of a JBD BMS read without blocking by a NetService.
+ * Responses are framed as their bytes arrive: start byte, register,
+ * status, length, data, checksum, stop byte. Bytes in front of a start
+ * byte are dropped and a frame with a bad checksum or stop byte is
+ * skipped by looking for the next start byte after it.
+ *
+ * @param fd:           non-blocking fd of the serial port
+ * @param buffer:       bytes received that are not part of a complete frame yet
+ * @param frameHandler: called with every valid frame (on the polling thread)
+ *
+ * @func checksum: checksum of the status, length and data bytes of a frame
+ */
+class JBDPort : public Pollable {
+    private:
+        int fd;
+        std::vector<uint8_t> buffer;
+        std::function<void(const JBDFrame&)> frameHandler;
+
+    public:
+        JBDPort(int fd, std::function<void(const JBDFrame&)> frameHandler);
+
+    private:
+        void parse();
+
+    public:
+        struct pollfd pollInfo() override;
+        void pollHandler() override;
+        bool write(const std::vector<uint8_t> &data);
+        static uint16_t checksum(const uint8_t* payload, size_t size);
+};
+
+/**
+ * JBD BMS driver
+ *
+ * refresh() sends the basic info request, and the cell voltage request
+ * right behind it once every telemetryInterval, and waits until the
+ * responses were framed by the polling thread (or timeout passed), so a
+ * refresh takes as long as the bytes take on the line. A request that is
+ * still in flight is not sent again until it times out. If the BMS does
+ * not answer in time the last status is returned.
+ *
+ * Besides the status, the basic info response carries the temperatures,
+ * protection flags, cycles, balancing and FET state, which are kept with
+ * the cell voltages in telemetry. The status carries the highest
+ * temperature and the protection flags.
+ *
+ * @param fd:                fd of the serial port
+ * @param quit:              signals the polling thread to exit
+ * @param timeout:           longest time refresh() waits for the responses
+ * @param telemetryInterval: time between two reads of the cell voltages
+ * @param requests:          state of the basic info and cell voltage requests
+ * @param status:            last status decoded from a basic info response
+ * @param telemetry:         last extended telemetry decoded from the responses
+ * @param cellVoltagesRead:  time the last cell voltage response arrived
+ * @param service:           polls the port on pollThread
+ * @param port:              frames the responses of the BMS
+ */
 class JBDBMS {
     private:
+        struct Request {
+            const uint8_t* frame;
+            bool inFlight;
+            std::chrono::steady_clock::time_point sentTime;
+            uint64_t responses;
+        };
+
         int fd;
+        std::atomic<bool> quit;
         double max_charging_current_mA;
         double max_discharging_current_mA;
+        std::chrono::milliseconds timeout;
+        std::chrono::milliseconds telemetryInterval;
+        std::mutex lock;
+        std::condition_variable responseReady;
+        Request requests[2];
+        BatteryStatus status{};
+        BatteryTelemetry telemetry;
+        std::chrono::steady_clock::time_point cellVoltagesRead;
+        NetService service;
+        std::shared_ptr<JBDPort> port;
+        std::thread pollThread;
 
     public:
         ~JBDBMS();
         JBDBMS(const std::string& device_path, int baud = 9600,
-               double max_charge = 200000, double max_discharge = 200000);
+               double max_charge = 200000, double max_discharge = 200000,
+               std::chrono::milliseconds timeout = std::chrono::milliseconds(500),
+               std::chrono::milliseconds telemetryInterval = std::chrono::seconds(10));
 
+    /**
+     * Private Functions
+     *
+     * @func sendRequests: sends the requests that are not in flight in a single write (lock must be held)
+     * @func handleFrame:  decodes a response and wakes up refresh() (called on the polling thread)
+     * @func runPoll:      services the port until quit
+     */
     private:
-        uint16_t checksum(const std::vector<uint8_t>& payload);
-        bool validateData(uint8_t startByte, uint8_t errorByte, std::vector<uint8_t>& payload, uint16_t checkSum, uint8_t stopByte);
+        void sendRequests(bool readCellVoltages);
+        void handleFrame(const JBDFrame &frame);
+        void runPoll();
 
     public:
         BatteryStatus refresh();
         bool set_current(double current_mA);
+        BatteryTelemetry getTelemetry();
 };
 
 extern "C" void* CreateJBDBMS(void* args);
 extern "C" void DestroyJBDBMS(void* battery);
 extern "C" BatteryStatus JBDBMSRefresh(void* battery);
 extern "C" bool JBDBMSSetCurrent(void* battery, double current_mA);
+extern "C" size_t JBDBMSTelemetry(void* battery, uint8_t* buffer, size_t size);
 
 #endif
@@ -0,0 +1,205 @@
+#include "ModbusRTU.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+/**********************
+Constructor/Destructor
+***********************/
+
+ModbusRTU::~ModbusRTU() {
+    if (this->fd >= 0)
+        serialClose(this->fd);
+}
+
+ModbusRTU::ModbusRTU(const std::string &device_path, int baud, uint8_t slave,
+                     std::chrono::milliseconds timeout, int retries) {
+    this->fd = serialOpen(device_path.c_str(), baud);
+
+    if (this->fd == -2)
+        ERROR() << "Invalid baud rate" << std::endl;
+    else if (this->fd == -1)
+        ERROR() << "could not open device path" << std::endl;
+
+    fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) | O_NONBLOCK);
+
+    this->slave        = slave;
+    this->timeout      = timeout;
+    this->retries      = retries;
+    this->transactions = 0;
+}
+
+/****************
+Private Functions
+*****************/
+
+bool ModbusRTU::readFrame(uint8_t function, size_t responseSize, std::vector<uint8_t> &response) {
+    auto deadline = std::chrono::steady_clock::now() + this->timeout;
+    response.clear();
+
+    while (true) {
+        // an exception frame is slave, function | MODBUS_EXCEPTION, exception code and CRC
+        size_t size = (response.size() >= 2 && response[1] == (function | MODBUS_EXCEPTION)) ? 5 : responseSize;
+        if (response.size() >= size) {
+            response.resize(size);
+            break;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            return false;
+
+        struct pollfd pollInfo = {this->fd, POLLIN, 0};
+        if (::poll(&pollInfo, 1, remaining.count() + 1) <= 0)
+            continue;
+
+        uint8_t bytes[256];
+        ssize_t numBytes = ::read(this->fd, bytes, sizeof(bytes));
+        if (numBytes > 0)
+            response.insert(response.end(), bytes, bytes + numBytes);
+        else if (numBytes == -1 && errno != EAGAIN && errno != EINTR) {
+            WARNING() << "could not read from modbus slave: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    uint16_t crc = response[response.size() - 2] | ((uint16_t) response[response.size() - 1] << 8);
+    return response[0] == this->slave && crc == crc16(response.data(), response.size() - 2);
+}
+
+bool ModbusRTU::transact(std::vector<uint8_t> request, size_t responseSize, std::vector<uint8_t> &response) {
+    uint8_t function = request[0];
+    request.insert(request.begin(), this->slave);
+
+    uint16_t crc = crc16(request.data(), request.size());
+    request.push_back(crc & 0xff);
+    request.push_back(crc >> 8);
+
+    for (int attempt = 0; attempt <= this->retries; attempt++) {
+        // drop whatever is left of an answer that arrived after its timeout
+        serialFlush(this->fd);
+
+        this->transactions++;
+        size_t written = 0;
+        while (written < request.size()) {
+            ssize_t numBytes = ::write(this->fd, request.data() + written, request.size() - written);
+            if (numBytes > 0)
+                written += numBytes;
+            else if (numBytes == -1 && errno != EINTR && errno != EAGAIN) {
+                WARNING() << "could not write to modbus slave: " << strerror(errno) << std::endl;
+                return false;
+            }
+        }
+
+        if (!this->readFrame(function, responseSize, response))
+            continue;
+
+        if (response[1] == (function | MODBUS_EXCEPTION)) {
+            WARNING() << "modbus slave " << (int) this->slave << " rejected function " << (int) function
+                      << " with exception " << (int) response[2] << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    WARNING() << "modbus slave " << (int) this->slave << " did not answer function " << (int) function << std::endl;
+    return false;
+}
+
+/***************
+Public Functions
+****************/
+
+bool ModbusRTU::readRegisters(uint16_t start, uint16_t count, std::vector<uint16_t> &values) {
+    if (count == 0 || count > MODBUS_MAX_READ_REGISTERS)
+        return false;
+
+    std::vector<uint8_t> request = {MODBUS_READ_HOLDING_REGISTERS,
+                                    (uint8_t) (start >> 8), (uint8_t) (start & 0xff),
+                                    (uint8_t) (count >> 8), (uint8_t) (count & 0xff)};
+    std::vector<uint8_t> response;
+
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    // slave, function, byte count, 2 bytes per register, CRC
+    if (!this->transact(request, 5 + 2 * count, response) || response[2] != 2 * count)
+        return false;
+
+    values.resize(count);
+    for (uint16_t i = 0; i < count; i++)
+        values[i] = ((uint16_t) response[3 + 2 * i] << 8) | response[4 + 2 * i];
+    return true;
+}
+
+bool ModbusRTU::readRegisters(std::vector<uint16_t> addresses, std::map<uint16_t, uint16_t> &values) {
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    size_t first = 0;
+    while (first < addresses.size()) {
+        size_t last = first;
+        while (last + 1 < addresses.size() && addresses[last + 1] - addresses[first] < MODBUS_MAX_READ_REGISTERS)
+            last++;
+
+        std::vector<uint16_t> span;
+        uint16_t start = addresses[first];
+        if (!this->readRegisters(start, addresses[last] - start + 1, span))
+            return false;
+
+        for (size_t i = first; i <= last; i++)
+            values[addresses[i]] = span[addresses[i] - start];
+        first = last + 1;
+    }
+    return true;
+}
+
+bool ModbusRTU::writeRegister(uint16_t address, uint16_t value) {
+    std::vector<uint8_t> request = {MODBUS_WRITE_SINGLE_REGISTER,
+                                    (uint8_t) (address >> 8), (uint8_t) (address & 0xff),
+                                    (uint8_t) (value >> 8), (uint8_t) (value & 0xff)};
+    std::vector<uint8_t> response;
+
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    // the slave echoes the request
+    return this->transact(request, 8, response) && std::equal(request.begin(), request.end(), response.begin() + 1);
+}
+
+bool ModbusRTU::writeRegisters(uint16_t start, const std::vector<uint16_t> &values) {
+    if (values.empty() || values.size() > MODBUS_MAX_WRITE_REGISTERS)
+        return false;
+
+    uint16_t count = values.size();
+    std::vector<uint8_t> request = {MODBUS_WRITE_MULTIPLE_REGISTERS,
+                                    (uint8_t) (start >> 8), (uint8_t) (start & 0xff),
+                                    (uint8_t) (count >> 8), (uint8_t) (count & 0xff),
+                                    (uint8_t) (2 * count)};
+    for (uint16_t value : values) {
+        request.push_back(value >> 8);
+        request.push_back(value & 0xff);
+    }
+    std::vector<uint8_t> response;
+
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    // the slave answers with the start address and count
+    return this->transact(request, 8, response) && std::equal(request.begin(), request.begin() + 5, response.begin() + 1);
+}
+
+uint64_t ModbusRTU::getTransactions() {
+    std::lock_guard<std::mutex> mutexLock(this->lock);
+    return this->transactions;
+}
+
+uint16_t ModbusRTU::crc16(const uint8_t* data, size_t size) {
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    }
+
+    return crc;
+}
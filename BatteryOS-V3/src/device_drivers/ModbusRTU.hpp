@@ -0,0 +1,79 @@
+#ifndef MODBUS_RTU_HPP
+#define MODBUS_RTU_HPP
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include "util.hpp"
+#include "wiringSerial.h"
+
+// Function codes
+#define MODBUS_READ_HOLDING_REGISTERS   0x03
+#define MODBUS_WRITE_SINGLE_REGISTER    0x06
+#define MODBUS_WRITE_MULTIPLE_REGISTERS 0x10
+#define MODBUS_EXCEPTION                0x80
+
+// most registers a single read (or write) may carry
+#define MODBUS_MAX_READ_REGISTERS  125
+#define MODBUS_MAX_WRITE_REGISTERS 123
+
+/**
+ * Modbus RTU client
+ *
+ * Talks to a single slave on a serial line. Every request is a frame of
+ * slave address, function code, data and a CRC16 (low byte first), and
+ * the slave answers with a frame of the same shape or with an exception
+ * frame (function code | MODBUS_EXCEPTION). A request that is not answered
+ * with a valid frame within timeout is sent again up to retries times.
+ * Transactions are serialized on lock, so a refresh and a set_current()
+ * from different threads never interleave on the line.
+ *
+ * readRegisters() with a list of addresses batches them: the addresses
+ * are sorted and covered by as few reads of consecutive registers as
+ * possible, so registers that are close together cost a few more bytes
+ * on the line instead of a transaction each.
+ *
+ * @param fd:           fd of the serial port
+ * @param slave:        address of the slave
+ * @param timeout:      longest time to wait for the answer to a request
+ * @param retries:      times a request is sent again after a timeout or a corrupted answer
+ * @param transactions: number of requests sent (including retries)
+ *
+ * @func crc16: Modbus CRC16 of size bytes
+ */
+class ModbusRTU {
+    private:
+        int fd;
+        uint8_t slave;
+        std::chrono::milliseconds timeout;
+        int retries;
+        uint64_t transactions;
+        std::mutex lock;
+
+    public:
+        ~ModbusRTU();
+        ModbusRTU(const std::string &device_path, int baud, uint8_t slave = 1,
+                  std::chrono::milliseconds timeout = std::chrono::milliseconds(200), int retries = 2);
+
+    /**
+     * Private Functions
+     *
+     * @func transact:  sends request and reads an answer of responseSize bytes (lock must be held)
+     * @func readFrame: reads an answer until it is complete or timeout passed
+     */
+    private:
+        bool transact(std::vector<uint8_t> request, size_t responseSize, std::vector<uint8_t> &response);
+        bool readFrame(uint8_t function, size_t responseSize, std::vector<uint8_t> &response);
+
+    public:
+        bool readRegisters(uint16_t start, uint16_t count, std::vector<uint16_t> &values);
+        bool readRegisters(std::vector<uint16_t> addresses, std::map<uint16_t, uint16_t> &values);
+        bool writeRegister(uint16_t address, uint16_t value);
+        bool writeRegisters(uint16_t start, const std::vector<uint16_t> &values);
+        uint64_t getTransactions();
+        static uint16_t crc16(const uint8_t* data, size_t size);
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "RD6006.hpp"
+
+#include <cmath>
+
+/**********************
+Constructor/Destructor
+***********************/
+
+RD6006::~RD6006() {
+    if (this->enabled)
+        this->bus.writeRegister(RD6006_REG_ENABLE, 0);
+}
+
+RD6006::RD6006(const std::string &device_path, int baud, uint8_t address,
+               double max_charge, double start_capacity, double max_capacity) : bus(device_path, baud, address) {
+    this->model                   = 0;
+    this->voltageResolution       = 100;
+    this->currentResolution       = 1000;
+    this->max_charging_current_mA = max_charge;
+    this->start_capacity_mAh      = start_capacity;
+    this->max_capacity_mAh        = max_capacity;
+    this->chargeCounter_mAh       = 0;
+    this->chargeOffset_mAh        = 0;
+    this->enabled                 = false;
+
+    std::vector<uint16_t> info;
+    if (!this->bus.readRegisters(RD6006_REG_MODEL, 4, info)) {
+        WARNING() << "could not identify power supply on " << device_path << std::endl;
+    } else {
+        this->model = info[RD6006_REG_MODEL] / 10;
+        // the RD6012 and RD6018 report the current in 10mA steps, the RD6006 in 1mA steps
+        if (this->model == 6012 || this->model == 6018)
+            this->currentResolution = 100;
+        LOG() << "RD" << this->model << " SN " << (((uint32_t) info[RD6006_REG_SERIAL_HIGH] << 16) | info[RD6006_REG_SERIAL_LOW])
+              << " firmware " << info[RD6006_REG_FIRMWARE] / 100.0 << std::endl;
+    }
+
+    // the supply starts out not charging
+    this->bus.writeRegister(RD6006_REG_ENABLE, 0);
+    this->refresh();
+}
+
+/***************
+Public Functions
+****************/
+
+BatteryStatus RD6006::refresh() {
+    PRINT() << "RD6006 REFRESH!!!" << std::endl;
+
+    std::map<uint16_t, uint16_t> registers;
+    if (!this->bus.readRegisters({RD6006_REG_VOLTAGE_OUT, RD6006_REG_CURRENT_OUT, RD6006_REG_ENABLE,
+                                  RD6006_REG_BATTERY_AH_HIGH, RD6006_REG_BATTERY_AH_LOW}, registers)) {
+        WARNING() << "could not read power supply, returning last status" << std::endl;
+        return this->status;
+    }
+
+    uint32_t counter = ((uint32_t) registers[RD6006_REG_BATTERY_AH_HIGH] << 16) | registers[RD6006_REG_BATTERY_AH_LOW];
+    if (counter < this->chargeCounter_mAh)
+        this->chargeOffset_mAh += this->chargeCounter_mAh; // the supply restarted its counter
+    this->chargeCounter_mAh = counter;
+    this->enabled           = registers[RD6006_REG_ENABLE] != 0;
+
+    double current_mA = registers[RD6006_REG_CURRENT_OUT] * 1000 / this->currentResolution;
+    double capacity   = this->start_capacity_mAh + this->chargeOffset_mAh + this->chargeCounter_mAh;
+
+    this->status.voltage_mV                 = registers[RD6006_REG_VOLTAGE_OUT] * 1000 / this->voltageResolution;
+    this->status.current_mA                 = this->enabled ? -current_mA : 0;
+    this->status.capacity_mAh               = std::min(capacity, this->max_capacity_mAh);
+    this->status.max_capacity_mAh           = this->max_capacity_mAh;
+    this->status.max_charging_current_mA    = this->max_charging_current_mA;
+    this->status.max_discharging_current_mA = 0;
+    this->status.time = convertToMilliseconds(getTimeNow());
+
+    return this->status;
+}
+
+bool RD6006::set_current(double current_mA) {
+    PRINT() << "RD6006 SET CURRENT: " << current_mA << "mA" << std::endl;
+
+    if (current_mA > 0 || -current_mA > this->max_charging_current_mA) {
+        WARNING() << "power supply can only charge at up to " << this->max_charging_current_mA << "mA" << std::endl;
+        return false;
+    }
+
+    bool enable = current_mA != 0;
+    if (enable && !this->bus.writeRegister(RD6006_REG_CURRENT_SET, std::lround(-current_mA * this->currentResolution / 1000)))
+        return false;
+
+    if (enable != this->enabled) {
+        if (!this->bus.writeRegister(RD6006_REG_ENABLE, enable))
+            return false;
+        this->enabled = enable;
+    }
+    return true;
+}
+
+uint16_t RD6006::getModel() const {
+    return this->model;
+}
+
+uint64_t RD6006::getTransactions() {
+    return this->bus.getTransactions();
+}
+
+/**********
+C Functions
+***********/
+
+void* CreateRD6006(void* args) {
+    const char** initArgs = (const char**)args;
+
+    std::string device_path = initArgs[0];
+    int baud                = atoi(initArgs[1]);
+    int address             = atoi(initArgs[2]);
+    double max_charge       = atof(initArgs[3]);
+    double start_capacity   = atof(initArgs[4]);
+    double max_capacity     = atof(initArgs[5]);
+
+    return (void *) new RD6006(device_path, baud, address, max_charge, start_capacity, max_capacity);
+}
+
+void DestroyRD6006(void* battery) {
+    RD6006* bat = (RD6006*) battery;
+    delete bat;
+}
+
+BatteryStatus RD6006Refresh(void* battery) {
+    RD6006* bat = (RD6006*) battery;
+    return bat->refresh();
+}
+
+bool RD6006SetCurrent(void* battery, double current_mA) {
+    RD6006* bat = (RD6006*) battery;
+    return bat->set_current(current_mA);
+}
@@ -0,0 +1,82 @@
+#ifndef RD6006_HPP
+#define RD6006_HPP
+
+#include "ModbusRTU.hpp"
+#include "BatteryStatus.hpp"
+
+// Registers
+#define RD6006_REG_MODEL           0
+#define RD6006_REG_SERIAL_HIGH     1
+#define RD6006_REG_SERIAL_LOW      2
+#define RD6006_REG_FIRMWARE        3
+#define RD6006_REG_VOLTAGE_SET     8
+#define RD6006_REG_CURRENT_SET     9
+#define RD6006_REG_VOLTAGE_OUT     10
+#define RD6006_REG_CURRENT_OUT     11
+#define RD6006_REG_POWER_OUT       13
+#define RD6006_REG_VOLTAGE_IN      14
+#define RD6006_REG_PROTECTION      16
+#define RD6006_REG_CVCC            17
+#define RD6006_REG_ENABLE          18
+#define RD6006_REG_BATTERY_MODE    32
+#define RD6006_REG_BATTERY_AH_HIGH 38
+#define RD6006_REG_BATTERY_AH_LOW  39
+
+/**
+ * RD6006 power supply driver
+ *
+ * The supply charges a battery, so it is a battery that can only be
+ * charged (a negative current in BOS). The driver talks Modbus RTU to
+ * the supply directly: refresh() reads the output voltage, output
+ * current, output state and the charge counter in a single transaction
+ * and set_current() writes the current setpoint, and the output state
+ * only when it changes.
+ *
+ * The charge counter of the supply counts the charge delivered since the
+ * output was turned on, so the capacity is the capacity of the battery
+ * when the driver was created plus the charge delivered since then.
+ *
+ * @param bus:                     Modbus RTU client of the supply
+ * @param model:                   model number of the supply (6006 for an RD6006)
+ * @param voltageResolution:       register counts per volt
+ * @param currentResolution:       register counts per amp
+ * @param max_charging_current_mA: highest current the supply is set to
+ * @param start_capacity_mAh:      capacity of the battery when the driver was created
+ * @param max_capacity_mAh:        capacity of the full battery
+ * @param chargeCounter_mAh:       charge counter the last time it was read
+ * @param chargeOffset_mAh:        charge delivered before the counter last restarted
+ * @param enabled:                 whether the output of the supply is on
+ * @param status:                  last status read from the supply
+ */
+class RD6006 {
+    private:
+        ModbusRTU bus;
+        uint16_t model;
+        double voltageResolution;
+        double currentResolution;
+        double max_charging_current_mA;
+        double start_capacity_mAh;
+        double max_capacity_mAh;
+        uint32_t chargeCounter_mAh;
+        double chargeOffset_mAh;
+        bool enabled;
+        BatteryStatus status{};
+
+    public:
+        ~RD6006();
+        RD6006(const std::string &device_path, int baud = 115200, uint8_t address = 1,
+               double max_charge = 6000, double start_capacity = 0, double max_capacity = 10000);
+
+    public:
+        BatteryStatus refresh();
+        bool set_current(double current_mA);
+        uint16_t getModel() const;
+        uint64_t getTransactions();
+};
+
+extern "C" void* CreateRD6006(void* args);
+extern "C" void DestroyRD6006(void* battery);
+extern "C" BatteryStatus RD6006Refresh(void* battery);
+extern "C" bool RD6006SetCurrent(void* battery, double current_mA);
+
+#endif
@@ -1,30 +1,113 @@
+#include <cmath>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "iec61850.hpp"
 
-IEC61850::IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, std::string ZBAT_Name, 
+// members of the status dataset (and of the array the reads fill)
+enum StatusField { VOLTAGE = 0, CURRENT = 1, MAX_CAPACITY = 2, MAX_DISCHARGING_CURRENT = 3 };
+
+std::mutex IEC61850Connection::poolLock;
+std::map<std::string, std::weak_ptr<IEC61850Connection>> IEC61850Connection::pool;
+
+IEC61850ReportCache::IEC61850ReportCache(std::shared_ptr<BatteryClock> clock) : clock(clock), reports(0) {
+    this->values.fill(0);
+    this->fields.fill(false);
+}
+
+IEC61850Connection::IEC61850Connection(IedConnection con, TLSConfiguration config) : con(con), config(config), outstandingRequests(0) {}
+
+IEC61850Connection::Request::Request(IEC61850Connection &connection) : connection(connection) {
+    std::unique_lock<std::mutex> mutexLock(connection.requestLock);
+    connection.requestFinished.wait(mutexLock, [&connection] { return connection.outstandingRequests < MAX_OUTSTANDING_REQUESTS; });
+    connection.outstandingRequests++;
+}
+
+IEC61850Connection::Request::~Request() {
+    std::lock_guard<std::mutex> mutexLock(connection.requestLock);
+    connection.outstandingRequests--;
+    connection.requestFinished.notify_one();
+}
+
+IEC61850Connection::~IEC61850Connection() {
+    IedConnection_close(con);
+    IedConnection_destroy(con);
+    TLSConfiguration_destroy(config);
+}
+
+std::shared_ptr<IEC61850Connection> IEC61850Connection::acquire(const std::string &hostname, int tcpPort) {
+    std::string endpoint = hostname + ":" + std::to_string(tcpPort);
+    std::lock_guard<std::mutex> mutexLock(poolLock);
+
+    std::shared_ptr<IEC61850Connection> connection = pool[endpoint].lock();
+    if (connection != nullptr && IedConnection_getState(connection->con) == IED_STATE_CONNECTED)
+        return connection;
+
+    // no connection yet, or the server closed it: batteries still holding a closed one keep it until they go away
+    TLSConfiguration config = TLSConfiguration_create();
+    TLSConfiguration_setClientMode(config);
+    TLSConfiguration_setOwnCertificateFromFile(config, "../certs/client.pem");
+    TLSConfiguration_setOwnKeyFromFile(config, "../certs/client.key", nullptr);
+    TLSConfiguration_addCACertificateFromFile(config, "../certs/ca_cert.pem");
+
+    // reports are received on the connection thread
+    IedConnection con = IedConnection_createEx(config, true);
+    IedClientError error;
+    IedConnection_connect(con, &error, hostname.c_str(), tcpPort);
+
+    if (error != IED_ERROR_OK) {
+        IedConnection_close(con);
+        IedConnection_destroy(con);
+        TLSConfiguration_destroy(config);
+        return nullptr;
+    }
+
+    connection = std::shared_ptr<IEC61850Connection>(new IEC61850Connection(con, config));
+    pool[endpoint] = connection;
+    return connection;
+}
+
+size_t IEC61850Connection::getConnectionCount() {
+    std::lock_guard<std::mutex> mutexLock(poolLock);
+    return std::count_if(pool.begin(), pool.end(), [](const auto &entry) { return !entry.second.expired(); });
+}
+
+void IEC61850Connection::retain(const std::string &reportReference, std::shared_ptr<IEC61850ReportCache> cache) {
+    std::lock_guard<std::mutex> mutexLock(cacheLock);
+    reportCaches[reportReference] = cache;
+}
+
+IEC61850::IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, std::string ZBAT_Name,
 std::string ZBTC_Name, std::string ZINV_Name)
+: IEC61850(name, staleness, LogicalDevice_Name, ZBAT_Name, ZBTC_Name, ZINV_Name, "localhost", 102) {}
+
+IEC61850::IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, std::string ZBAT_Name,
+std::string ZBTC_Name, std::string ZINV_Name, std::string hostname, int tcpPort, std::string dataSetName, std::string reportName)
 : PhysicalBattery(name, staleness) {
     this -> ZBAT_Name = ZBAT_Name;
     this -> ZBTC_Name = ZBTC_Name;
     this -> ZINV_Name = ZINV_Name;
     this -> LogicalDevice_Name = LogicalDevice_Name;
-    create_iec61850_client("localhost", 102); // quit gracefully if this returns false
-}
 
-IEC61850::IEC61850(const std::string &name, std::chrono::milliseconds staleness, std::string LogicalDevice_Name, std::string ZBAT_Name, 
-std::string ZBTC_Name, std::string ZINV_Name, std::string hostname, int tcpPort) : PhysicalBattery(name, staleness) {
-    this -> ZBAT_Name = ZBAT_Name;
-    this -> ZBTC_Name = ZBTC_Name;
-    this -> ZINV_Name = ZINV_Name;
-    this -> LogicalDevice_Name = LogicalDevice_Name;
-    create_iec61850_client(hostname, tcpPort); // quit gracefully if this returns false
+    if (!dataSetName.empty())
+        this -> dataSetReference = LogicalDevice_Name + '/' + dataSetName;
+    if (!reportName.empty())
+        this -> reportReference = LogicalDevice_Name + '/' + reportName;
+
+    this -> connected = create_iec61850_client(hostname, tcpPort); // quit gracefully if this returns false
+    if (!this -> connected)
+        WARNING() << "could not connect to IEC61850 server " << hostname << ":" << tcpPort << std::endl;
+    else if (!this -> reportReference.empty() && !enable_reporting())
+        WARNING() << "could not enable report control block " << LogicalDevice_Name << '/' << reportName << ", polling instead" << std::endl;
 }
 
 IEC61850::~IEC61850() {
-    IedConnection_close(con);
-	IedConnection_destroy(con);
+    if (!this -> connected)
+        return;
+
+    if (!this -> reportReference.empty())
+        disable_reporting();
+    // the connection closes with the last battery using it
 }
 
 std::string IEC61850::getBatteryString() const {
@@ -32,94 +115,282 @@ std::string IEC61850::getBatteryString() const {
 }
 
 BatteryStatus IEC61850::refresh() {
-    MmsValue* value;
-    std::string voltage = LogicalDevice_Name + '/' + ZBAT_Name + ".Vol.mag.f";
-    std::string current = LogicalDevice_Name + '/' + ZBAT_Name + ".Amp.mag.f";
-    std::string max_capacity = LogicalDevice_Name + '/' + ZBAT_Name + ".AhrRtg.setMag.f";
-    std::string discharging_current = LogicalDevice_Name + '/' + ZBAT_Name + ".MaxBatA.setMag.f";
-
-    // Should I typecast the float to int64_t??
-    value = IedConnection_readObject(con, &error, voltage.c_str(), IEC61850_FC_MX);
-    if (check_MmsValue(value))
-        status.voltage_mV = (int64_t) MmsValue_toFloat(value);
-    
-    value = IedConnection_readObject(con, &error, current.c_str(), IEC61850_FC_MX);
-    if (check_MmsValue(value)) // Amp 
-        status.current_mA = (int64_t) MmsValue_toFloat(value);
+    std::array<float, 4> values = {(float) status.voltage_mV, (float) status.current_mA,
+                                   (float) status.max_capacity_mAh, (float) status.max_discharging_current_mA};
+    bool fresh = false;
 
-    value = IedConnection_readObject(con, &error, max_capacity.c_str(), IEC61850_FC_SP);
-    if (check_MmsValue(value)) // AhrRtg // value should be non-volatile so should represent the max_capacity instead of current capcacity
-        status.max_capacity_mAh =  (int64_t) MmsValue_toFloat(value);
-
-    value = IedConnection_readObject(con, &error, discharging_current.c_str(), IEC61850_FC_SP);
-    if (check_MmsValue(value)) // MaxBatA
-        status.max_discharging_current_mA = (int64_t) MmsValue_toFloat(value);
+    if (!reportReference.empty()) {
+        std::lock_guard<std::mutex> mutexLock(reportCache -> lock);
+        bool complete = std::all_of(reportCache -> fields.begin(), reportCache -> fields.end(), [](bool field) { return field; });
+        if (complete && this -> clock -> monotonicNow() - reportCache -> time <= getMaxStaleness()) {
+            values = reportCache -> values;
+            fresh  = true;
+        }
+    }
 
-    status.time = convertToMilliseconds(getTimeNow());
+    // no recent report: poll the server instead
+    if (!fresh && this -> connected) {
+        if (!dataSetReference.empty())
+            fresh = read_dataset(values);
+        if (!fresh)
+            fresh = read_attributes(values);
+    }
 
-    status.max_charging_current_mA = 10;
-    // status.capacity_mAh
+    set_status(values);
     return status;
 }
 
 bool IEC61850::set_current(double current_mA) {
     // do I need to check staleness and refresh???
-    // MmsValue* value;
-    std::string charge_mode = LogicalDevice_Name + '/' + ZBTC_Name + ".BatChaMod.setVal";
-    std::string current_limit = LogicalDevice_Name + '/' + ZINV_Name + ".InALim.setMag.i";
-    std::string recharge_rate = LogicalDevice_Name + '/' + ZBTC_Name + ".ReChaRte.setMag.i";
+    std::string charge_mode = ZBTC_Name + "$SP$BatChaMod$setVal";
+    std::string current_limit = ZINV_Name + "$SP$InALim$setMag$i";
+    std::string recharge_rate = ZBTC_Name + "$SP$ReChaRte$setMag$i";
+    std::vector<std::pair<std::string, MmsValue*>> writes;
 
-    if ((current_mA < 0) && (-current_mA) < this->status.max_charging_current_mA) {
-        int current = (-current_mA);
+    if (!this -> connected)
+        return false;
 
-        IedConnection_writeObject(con, &error, recharge_rate.c_str(), IEC61850_FC_SP, MmsValue_newIntegerFromInt64(current));
-        if (error != IED_ERROR_OK)
-            LOG() << "Failed to write recharge rate: " + recharge_rate + " to server";;
+    if ((current_mA < 0) && (-current_mA) < this->status.max_charging_current_mA) {
+        int64_t current = std::llround(-current_mA);
 
-        // switches battery to Operatinal Mode (turns it on??)
-        IedConnection_writeObject(con, &error, charge_mode.c_str(), IEC61850_FC_SP, MmsValue_newIntegerFromInt64(2)); // Operational Mode page 84 of ZBAT file 
-        if (error != IED_ERROR_OK)
-            LOG() << "Failed to write charge mode to server";
-        
-        return 0;
+        // recharge rate, then switch battery to Operatinal Mode (turns it on??)
+        writes.push_back({recharge_rate, MmsValue_newIntegerFromInt64(current)});
+        writes.push_back({charge_mode, MmsValue_newIntegerFromInt64(2)}); // Operational Mode page 84 of ZBAT file
     } else if (current_mA > 0 && current_mA < this->status.max_discharging_current_mA) {
-        // Turn Battery Charger Off 
-        IedConnection_writeObject(con, &error, charge_mode.c_str(), IEC61850_FC_SP, MmsValue_newIntegerFromInt64(1));
-        if (error != IED_ERROR_OK) // How do you turn the inverter on/off?
-            LOG() << "Failed to write charge mode to server";
-        
-        // Sets current limit for inverter
-        IedConnection_writeObject(con, &error, current_limit.c_str(), IEC61850_FC_SP, MmsValue_newIntegerFromInt64(current_mA));
-        if (error != IED_ERROR_OK)
-            LOG() << "Failed to write current limit: " + current_limit + " to server"; 
+        // Turn Battery Charger Off and set current limit for inverter
+        writes.push_back({charge_mode, MmsValue_newIntegerFromInt64(1)}); // How do you turn the inverter on/off?
+        writes.push_back({current_limit, MmsValue_newIntegerFromInt64(std::llround(current_mA))});
+    } else {
+        return false;
+    }
 
-        return 0;
+    if (!write_values(std::move(writes))) {
+        LOG() << "Failed to write " << (current_mA < 0 ? recharge_rate : current_limit) << " and " << charge_mode << " to server" << std::endl;
+        return false;
     }
-    return 1;
+    return true;
+}
+
+uint64_t IEC61850::getReportCount() {
+    if (this -> reportCache == nullptr)
+        return 0;
+    std::lock_guard<std::mutex> mutexLock(this -> reportCache -> lock);
+    return this -> reportCache -> reports;
 }
 
 bool IEC61850::check_MmsValue(MmsValue* value) {
     if (value == NULL)
         return false;
+    if (MmsValue_getType(value) == MMS_DATA_ACCESS_ERROR) {
+        MmsValue_delete(value);
+        return false;
+    }
     return true;
 }
 
 bool IEC61850::create_iec61850_client(std::string hostname, int tcpPort) {
-    this->config = TLSConfiguration_create();
-    TLSConfiguration_setClientMode(config);
-    TLSConfiguration_setOwnCertificateFromFile(config, "../certs/client.pem"); 
-    TLSConfiguration_setOwnKeyFromFile(config, "../certs/client.key", nullptr);
-    TLSConfiguration_addCACertificateFromFile(config, "../certs/ca_cert.pem");
+    this->connection = IEC61850Connection::acquire(hostname, tcpPort);
+    if (this->connection == nullptr)
+        return false;
+    this->con = this->connection->con;
+    return true;
+}
 
-    this->con = IedConnection_createEx(config, false); 
+/*
+ * Installs the report handler and enables the report control block with a
+ * general interrogation, so the first report carries the whole dataset.
+ * If the report control block cannot be enabled the handler is removed and
+ * refresh() polls. If only the general interrogation fails reporting stays
+ * on, and refresh() polls until a report has carried every member.
+ */
+bool IEC61850::enable_reporting() {
+    IEC61850Connection::Request request(*connection);
+    IedClientError error;
+    ClientReportControlBlock rcb = IedConnection_getRCBValues(con, &error, reportReference.c_str(), NULL);
+    if (error != IED_ERROR_OK || rcb == NULL) {
+        reportReference.clear();
+        return false;
+    }
 
-    IedConnection_connect(con, &error, hostname.c_str(), tcpPort);
+    // the connection keeps the cache for as long as its thread may call the handler: installing
+    // a handler replaces the old handler of the report control block, so its cache is released after
+    this->reportCache = std::make_shared<IEC61850ReportCache>(this->clock);
+    IedConnection_installReportHandler(con, reportReference.c_str(), ClientReportControlBlock_getRptId(rcb),
+                                       &IEC61850::report_handler, this->reportCache.get());
+    this->connection->retain(reportReference, this->reportCache);
+
+    // an integrity report at least twice per maxStaleness keeps the cache fresh when nothing changes
+    ClientReportControlBlock_setTrgOps(rcb, TRG_OPT_DATA_CHANGED | TRG_OPT_DATA_UPDATE | TRG_OPT_INTEGRITY | TRG_OPT_GI);
+    ClientReportControlBlock_setIntgPd(rcb, std::max<int64_t>(getMaxStaleness().count() / 2, 1));
+    ClientReportControlBlock_setRptEna(rcb, true);
+    IedConnection_setRCBValues(con, &error, rcb, RCB_ELEMENT_TRG_OPS | RCB_ELEMENT_INTG_PD | RCB_ELEMENT_RPT_ENA, true);
 
     if (error != IED_ERROR_OK) {
-        IedConnection_close(con);
-        IedConnection_destroy(con);
-        TLSConfiguration_destroy(config);
+        ClientReportControlBlock_destroy(rcb);
+        IedConnection_uninstallReportHandler(con, reportReference.c_str());
+        reportReference.clear();
+        return false;
+    }
+
+    ClientReportControlBlock_setGI(rcb, true);
+    IedConnection_setRCBValues(con, &error, rcb, RCB_ELEMENT_GI, true);
+    if (error != IED_ERROR_OK)
+        WARNING() << "could not start a general interrogation of " << reportReference << ", polling until a report carries the whole dataset" << std::endl;
+    ClientReportControlBlock_destroy(rcb);
+    return true;
+}
+
+/*
+ * Disables the report control block (so the server stops sending reports
+ * on the shared connection) and removes the report handler.
+ */
+void IEC61850::disable_reporting() {
+    IEC61850Connection::Request request(*connection);
+    IedClientError error;
+    ClientReportControlBlock rcb = ClientReportControlBlock_create(reportReference.c_str());
+    ClientReportControlBlock_setRptEna(rcb, false);
+    IedConnection_setRCBValues(con, &error, rcb, RCB_ELEMENT_RPT_ENA, true);
+    ClientReportControlBlock_destroy(rcb);
+
+    IedConnection_uninstallReportHandler(con, reportReference.c_str());
+}
+
+/*
+ * Reads Vol, Amp, AhrRtg and MaxBatA with a request each (values keeps the
+ * old value of an attribute that could not be read).
+ */
+bool IEC61850::read_attributes(std::array<float, 4> &values) {
+    const std::array<std::pair<std::string, FunctionalConstraint>, 4> attributes = {{
+        {".Vol.mag.f", IEC61850_FC_MX},
+        {".Amp.mag.f", IEC61850_FC_MX},
+        {".AhrRtg.setMag.f", IEC61850_FC_SP}, // value should be non-volatile so should represent the max_capacity instead of current capcacity
+        {".MaxBatA.setMag.f", IEC61850_FC_SP},
+    }};
+    IEC61850Connection::Request request(*connection);
+    IedClientError error;
+    bool read = false;
+
+    for (size_t i = 0; i < attributes.size(); i++) {
+        std::string reference = LogicalDevice_Name + '/' + ZBAT_Name + attributes[i].first;
+        MmsValue* value = IedConnection_readObject(con, &error, reference.c_str(), attributes[i].second);
+        if (!check_MmsValue(value))
+            continue;
+        read |= to_float(value, values[i]);
+        MmsValue_delete(value);
+    }
+    return read;
+}
+
+/*
+ * Reads the status dataset in a single request (values keeps the old value
+ * of a member the server could not read). Every read gets a new
+ * ClientDataSet: reusing one updates its members in place, which silently
+ * keeps the old value of a member whose type changed (a member the server
+ * could not read comes back as a data access error), so a failed member
+ * would pass for a fresh one.
+ */
+bool IEC61850::read_dataset(std::array<float, 4> &values) {
+    IEC61850Connection::Request request(*connection);
+    IedClientError error;
+    ClientDataSet dataSet = IedConnection_readDataSetValues(con, &error, dataSetReference.c_str(), NULL);
+    if (dataSet == NULL)
         return false;
+
+    // owned by dataSet
+    MmsValue* members = ClientDataSet_getValues(dataSet);
+    bool read = false;
+    if (error == IED_ERROR_OK && members != NULL && MmsValue_getArraySize(members) >= (int) values.size()) {
+        for (size_t i = 0; i < values.size(); i++)
+            read |= to_float(MmsValue_getElement(members, i), values[i]);
+    }
+    ClientDataSet_destroy(dataSet);
+    return read;
+}
+
+/*
+ * Writes the values to the MMS variables (names relative to the logical
+ * device, e.g. "ZBTC1$SP$BatChaMod$setVal") with a single write request
+ * and deletes them. Returns true if the server wrote every variable.
+ * writes owns the names the item list points to until the request is done.
+ * The item and value lists are only read by the request, and the list of
+ * access results is allocated by it for the caller to delete.
+ */
+bool IEC61850::write_values(std::vector<std::pair<std::string, MmsValue*>> writes) {
+    LinkedList items = LinkedList_create();
+    LinkedList values = LinkedList_create();
+    for (const std::pair<std::string, MmsValue*> &write : writes) {
+        LinkedList_add(items, (void*) write.first.c_str());
+        LinkedList_add(values, write.second);
     }
+
+    MmsError mmsError = MMS_ERROR_NONE;
+    LinkedList results = NULL;
+    IEC61850Connection::Request request(*connection);
+    MmsConnection_writeMultipleVariables(IedConnection_getMmsConnection(con), &mmsError, LogicalDevice_Name.c_str(),
+                                         items, values, &results);
+
+    // a result per variable, DATA_ACCESS_ERROR_SUCCESS if it was written
+    bool written = mmsError == MMS_ERROR_NONE && results != NULL && LinkedList_size(results) == (int) writes.size();
+    if (results != NULL) {
+        for (LinkedList result = LinkedList_getNext(results); result != NULL; result = LinkedList_getNext(result))
+            written &= MmsValue_getDataAccessError((MmsValue*) LinkedList_getData(result)) == DATA_ACCESS_ERROR_SUCCESS;
+        LinkedList_destroyDeep(results, (LinkedListValueDeleteFunction) MmsValue_delete);
+    }
+
+    LinkedList_destroyStatic(items);
+    LinkedList_destroyDeep(values, (LinkedListValueDeleteFunction) MmsValue_delete);
+    return written;
+}
+
+void IEC61850::set_status(const std::array<float, 4> &values) {
+    // Should I typecast the float to int64_t??
+    status.voltage_mV = (int64_t) values[VOLTAGE];
+    status.current_mA = (int64_t) values[CURRENT];
+    status.max_capacity_mAh = (int64_t) values[MAX_CAPACITY];
+    status.max_discharging_current_mA = (int64_t) values[MAX_DISCHARGING_CURRENT];
+
+    status.time = convertToMilliseconds(this->clock->now());
+
+    status.max_charging_current_mA = 10;
+    // status.capacity_mAh
+}
+
+/*
+ * Value of a float leaf, or of the first leaf of a structure (a dataset
+ * member that is a whole data object, e.g. Vol [MX] is {mag {f}, q, t}).
+ */
+bool IEC61850::to_float(const MmsValue* value, float &result) {
+    while (value != NULL && MmsValue_getType(value) == MMS_STRUCTURE && MmsValue_getArraySize(value) > 0)
+        value = MmsValue_getElement(value, 0);
+
+    if (value == NULL)
+        return false;
+    if (MmsValue_getType(value) == MMS_FLOAT)
+        result = MmsValue_toFloat(value);
+    else if (MmsValue_getType(value) == MMS_INTEGER)
+        result = MmsValue_toInt32(value);
+    else
+        return false;
     return true;
 }
+
+/*
+ * Called on the connection thread with every report of the status dataset.
+ */
+void IEC61850::report_handler(void* parameter, ClientReport report) {
+    IEC61850ReportCache* cache = (IEC61850ReportCache*) parameter;
+    MmsValue* members = ClientReport_getDataSetValues(report);
+    if (members == NULL)
+        return;
+
+    std::lock_guard<std::mutex> mutexLock(cache->lock);
+    int size = std::min<int>(MmsValue_getArraySize(members), cache->values.size());
+    for (int i = 0; i < size; i++) {
+        if (ClientReport_getReasonForInclusion(report, i) == IEC61850_REASON_NOT_INCLUDED)
+            continue;
+        if (to_float(MmsValue_getElement(members, i), cache->values[i]))
+            cache->fields[i] = true;
+    }
+    cache->time = cache->clock->monotonicNow();
+    cache->reports++;
+}
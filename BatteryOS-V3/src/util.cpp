@@ -1,8 +1,12 @@
 
 #include "util.hpp"
 #include <errno.h>
+#include <vector>
 #include <cstring>
 #include <openssl/err.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
 
 size_t util::read_exact(int fd, char* buffer, size_t num_bytes) {
@@ -46,11 +50,14 @@ size_t util::SSL_read_exact(SSL* fd, char* buffer, size_t num_bytes) {
     size_t bytes_read = 0;
     while (bytes_read < num_bytes) {
         ssize_t res = SSL_read(fd, (char*)buffer + bytes_read, num_bytes - bytes_read);
-        if (res < 0) {
+        if (res <= 0) {
             int err = SSL_get_error(fd, res);
-            std::cout << "SSL Error: " << ERR_error_string(err, NULL) << std::endl;
-            abort();
-            continue;
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                continue;
+            // the peer closed the connection or the connection is broken
+            if (err != SSL_ERROR_ZERO_RETURN)
+                std::cout << "SSL Error: " << ERR_error_string(ERR_get_error(), NULL) << std::endl;
+            return -1;
         }
 
         bytes_read += res;
@@ -63,11 +70,12 @@ size_t util::SSL_write_exact(SSL* fd, char* buffer, size_t num_bytes) {
     size_t bytes_written = 0;
     while (bytes_written < num_bytes) {
         ssize_t res = SSL_write(fd, (char*)buffer+ bytes_written, num_bytes - bytes_written);
-        if (res == -1) {
+        if (res <= 0) {
             int err =  SSL_get_error(fd, res);
-            std::cout << "SSL Error: " << ERR_error_string(err, NULL) << std::endl;
-            abort();
-            continue;
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                continue;
+            std::cout << "SSL Error: " << ERR_error_string(ERR_get_error(), NULL) << std::endl;
+            return -1;
         }
 
         bytes_written += res;
@@ -75,3 +83,38 @@ size_t util::SSL_write_exact(SSL* fd, char* buffer, size_t num_bytes) {
 
     return bytes_written;
 }
+
+void util::set_nodelay(int fd) {
+    int flag = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) == -1)
+        WARNING() << "could not set TCP_NODELAY: " << std::strerror(errno) << std::endl;
+}
+
+uint32_t util::crc32(const char* data, size_t length, uint32_t crc) {
+    // slicing-by-8: table[k][i] is the CRC of byte i followed by k zero bytes
+    static const std::vector<std::vector<uint32_t>> table = []() {
+        std::vector<std::vector<uint32_t>> table(8, std::vector<uint32_t>(256));
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+            table[0][i] = value;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+            for (int k = 1; k < 8; k++)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        return table;
+    }();
+
+    const uint8_t* bytes = (const uint8_t*) data;
+    crc ^= 0xFFFFFFFF;
+    for (; length >= 8; length -= 8, bytes += 8) {
+        uint32_t low  = crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24);
+        uint32_t high = bytes[4] | bytes[5] << 8 | bytes[6] << 16 | (uint32_t) bytes[7] << 24;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+    for (; length > 0; length--, bytes++)
+        crc = table[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
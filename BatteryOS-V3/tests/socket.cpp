@@ -1,9 +1,15 @@
 #include "BOS.hpp"
 
-int main() {
+int main(int argc, char** argv) {
     using namespace std::chrono_literals;
     
     BOS bos;
+    if (argc > 1)
+        bos.setDispatchThreads(atoi(argv[1]));
+    if (argc > 2)
+        bos.setJournal(argv[2]);
+    if (argc > 3)
+        bos.setTelemetryLog(argv[3]);
     bos.startSockets(65432, 65431);
 
     LOG() << "SHUTTING DOWN!" << std::endl;
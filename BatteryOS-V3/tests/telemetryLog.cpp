@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <algorithm>
+#include "TelemetryLog.hpp"
+
+/**
+ * Telemetry log tool
+ *
+ * Reads a telemetry log written by BOS without going through BOS. With
+ * only the log it prints every battery in the log with its number of
+ * segments and samples and the range of every column (read from the
+ * segment indexes, nothing is decoded). With a battery it prints the
+ * samples of the battery between two times (ms since epoch, the whole
+ * log by default) as CSV with a header line, optionally only the listed
+ * columns (the time is always printed first), e.g. in python
+ *
+ *     output = subprocess.run(["./telemetry_log", "bos.tlog", "bat0"], capture_output=True, text=True).stdout
+ *     samples = np.loadtxt(output.splitlines(), delimiter=",", skiprows=1)
+ *
+ * usage: ./telemetry_log <log> [battery [startTime endTime [column,column,...]]]
+ */
+
+int summary(const TelemetryLogReader &reader) {
+    for (const std::string &batteryName : reader.getBatteryNames()) {
+        std::vector<TelemetrySegmentHeader> segments = reader.getSegments(batteryName);
+        uint64_t numSamples = 0;
+        int64_t minValue[TELEMETRY_NUM_COLUMNS], maxValue[TELEMETRY_NUM_COLUMNS];
+        std::copy(segments[0].minValue, segments[0].minValue + TELEMETRY_NUM_COLUMNS, minValue);
+        std::copy(segments[0].maxValue, segments[0].maxValue + TELEMETRY_NUM_COLUMNS, maxValue);
+
+        for (const TelemetrySegmentHeader &segment : segments) {
+            numSamples += segment.numSamples;
+            for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++) {
+                minValue[column] = std::min(minValue[column], segment.minValue[column]);
+                maxValue[column] = std::max(maxValue[column], segment.maxValue[column]);
+            }
+        }
+
+        PRINT() << batteryName << ": " << numSamples << " samples in " << segments.size() << " segments" << std::endl;
+        for (int column = 0; column < TELEMETRY_NUM_COLUMNS; column++)
+            PRINT() << "    " << getTelemetryColumnName(column) << ": [" << minValue[column] << ", " << maxValue[column] << "]" << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        PRINT() << "usage: " << argv[0] << " <log> [battery [startTime endTime [column,column,...]]]" << std::endl;
+        return 1;
+    }
+
+    TelemetryLogReader reader(argv[1]);
+    if (!reader.isOpen())
+        return 1;
+    if (argc < 3)
+        return summary(reader);
+
+    std::string batteryName = argv[2];
+    uint64_t startTime = (argc > 4) ? strtoull(argv[3], NULL, 10) : 0;
+    uint64_t endTime   = (argc > 4) ? strtoull(argv[4], NULL, 10) : UINT64_MAX;
+
+    std::vector<int> columns = {TELEMETRY_TIME};
+    uint32_t mask = 1 << TELEMETRY_TIME;
+    std::string names = (argc > 5) ? argv[5] : "";
+    for (int column = 1; column < TELEMETRY_NUM_COLUMNS; column++) {
+        std::string name = getTelemetryColumnName(column);
+        if (argc > 5 && ("," + names + ",").find("," + name + ",") == std::string::npos)
+            continue;
+        columns.push_back(column);
+        mask |= 1 << column;
+    }
+
+    std::string output;
+    for (size_t i = 0; i < columns.size(); i++)
+        output += std::string(i == 0 ? "" : ",") + getTelemetryColumnName(columns[i]);
+    output += "\n";
+
+    reader.scan(batteryName, startTime, endTime, [&](const TelemetryColumns &samples) {
+        for (size_t i = 0; i < samples.numSamples; i++) {
+            for (size_t j = 0; j < columns.size(); j++) {
+                if (j != 0)
+                    output += ',';
+                output += std::to_string(samples.values[columns[j]][i]);
+            }
+            output += '\n';
+        }
+        fwrite(output.data(), 1, output.size(), stdout);
+        output.clear();
+    }, mask);
+
+    fwrite(output.data(), 1, output.size(), stdout);
+    return 0;
+}
@@ -0,0 +1,247 @@
+#include <random>
+#include "PseudoBattery.hpp"
+#include "PhysicalBattery.hpp"
+
+/**
+ * Admission control test
+ *
+ * Schedules set_current requests on physical batteries and checks that a
+ * request is only accepted if the projected capacity of the battery stays
+ * between empty and full with it:
+ *  - requests that fit are accepted and move the projected capacity, while
+ *    requests that would run the battery empty or past full are rejected
+ *  - a charge scheduled earlier makes room for a later discharge
+ *  - a request whose window is empty is rejected instead of reported as
+ *    scheduled
+ *  - a request that ends with charge left but runs the battery empty in
+ *    the middle of its window is rejected
+ *  - a request that overrides an earlier one of the same requester only
+ *    needs the capacity the earlier one did not already take, and
+ *    cancelling a request gives its capacity back
+ *  - once the schedule is already overcommitted (the battery lost charge)
+ *    charging is still accepted but discharging is not
+ *  - a pseudo battery, whose ChargeModel stops it at empty instead, accepts
+ *    a request a physical battery rejects and runs empty
+ * Random requests are then checked against a brute force evaluation of
+ * the projected capacity at every current change while time moves on
+ * (checking a request must leave the projection exactly as it was),
+ * and numRequests requests (100,000 by default) from 100 requesters are
+ * admitted into one reservation map to print the cost of an admission
+ * check.
+ *
+ * usage: ./admission [numRequests]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+struct Request {
+    double current_mA;
+    timepoint_t startTime;
+    timepoint_t endTime;
+};
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool near(double value, double expected) {
+    return std::fabs(value - expected) < 1e-6;
+}
+
+template <typename BatteryType = PhysicalBattery>
+std::shared_ptr<Battery> makeBattery(const std::string &name, double capacity_mAh, double maxCapacity_mAh) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = capacity_mAh;
+    status.max_capacity_mAh = maxCapacity_mAh;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+    status.time = convertToMilliseconds(getTimeNow());
+
+    std::shared_ptr<Battery> battery = std::make_shared<BatteryType>(name, 100s);
+    battery->setBatteryStatus(status);
+    return battery;
+}
+
+/* lowest and highest capacity at from and at every start and end time after it */
+std::pair<double, double> bruteForce(const std::vector<Request> &requests, timepoint_t from, double capacity_mAh) {
+    std::vector<timepoint_t> times = {from};
+    for (const Request &request : requests) {
+        times.push_back(request.startTime);
+        times.push_back(request.endTime);
+    }
+
+    std::pair<double, double> range = {capacity_mAh, capacity_mAh};
+    for (const timepoint_t &time : times) {
+        if (time < from)
+            continue;
+        double capacity = capacity_mAh;
+        for (const Request &request : requests) {
+            timepoint_t start = std::max(request.startTime, from);
+            timepoint_t end   = std::min(request.endTime, time);
+            if (end > start)
+                capacity -= request.current_mA * (end - start).count() / 3600000.0;
+        }
+        range.first  = std::min(range.first, capacity);
+        range.second = std::max(range.second, capacity);
+    }
+    return range;
+}
+
+int main(int argc, char** argv) {
+    int numRequests = argc > 1 ? atoi(argv[1]) : 100000;
+    bool passed = true;
+    timepoint_t t0 = std::chrono::time_point_cast<std::chrono::milliseconds>(getTimeNow()) + 1h;
+
+    {
+        std::shared_ptr<Battery> battery = makeBattery("adm0", 5000, 10000);
+        bool fits = battery->schedule_set_current(3600, t0, t0 + 1h);
+        passed &= check("fits", fits && near(battery->getProjectedCapacity(t0 + 1h), 1400) && near(battery->getProjectedCapacity(t0 + 30min), 3200));
+        passed &= check("empty", !battery->schedule_set_current(3600, t0 + 2h, t0 + 3h) && near(battery->getProjectedCapacity(t0 + 3h), 1400));
+
+        bool charged = battery->schedule_set_current(-3600, t0 + 1h, t0 + 2h) && battery->schedule_set_current(3600, t0 + 2h, t0 + 3h);
+        passed &= check("charge first", charged && near(battery->getProjectedCapacity(t0 + 3h), 1400));
+        passed &= check("full", !battery->schedule_set_current(-3600, t0 + 4h, t0 + 7h) && battery->schedule_set_current(-3600, t0 + 4h, t0 + 6h) &&
+                                near(battery->getProjectedCapacity(t0 + 10h), 8600));
+        passed &= check("empty window", !battery->schedule_set_current(100, t0 + 11h, t0 + 11h) &&
+                                        !battery->schedule_set_current(100, t0 + 12h, t0 + 11h));
+    }
+
+    {
+        std::shared_ptr<Battery> battery = makeBattery("adm1", 1000, 10000);
+        // from another requester, so the requests below do not override it
+        battery->schedule_set_current(-3600, t0 + 30min, t0 + 1h, internBatteryName("adm1_charger"), getSequenceNumber());
+        passed &= check("dip", !battery->schedule_set_current(2400, t0, t0 + 1h) && battery->schedule_set_current(1800, t0, t0 + 1h) &&
+                               near(battery->getProjectedCapacity(t0 + 30min), 100) && near(battery->getProjectedCapacity(t0 + 1h), 1000));
+
+        battery_id_t child = internBatteryName("adm1_child");
+        uint64_t first  = getSequenceNumber();
+        uint64_t second = getSequenceNumber();
+        bool overrides = !battery->schedule_set_current(1800, t0 + 2h, t0 + 3h, child, first) &&
+                         battery->schedule_set_current(900, t0 + 2h, t0 + 3h, child, first) &&
+                         battery->schedule_set_current(1000, t0 + 2h, t0 + 3h, child, second);
+        passed &= check("override", overrides && near(battery->getProjectedCapacity(t0 + 3h), 0));
+
+        bool cancels = battery->cancel_set_current(second) && near(battery->getProjectedCapacity(t0 + 3h), 1000) &&
+                       battery->schedule_set_current(1000, t0 + 3h, t0 + 4h, child, getSequenceNumber());
+        passed &= check("cancel", cancels && near(battery->getProjectedCapacity(t0 + 4h), 0));
+    }
+
+    {
+        std::shared_ptr<Battery> battery = makeBattery("adm2", 2000, 10000);
+        battery->schedule_set_current(1800, t0, t0 + 1h);
+
+        BatteryStatus status = battery->getStatus();
+        status.capacity_mAh = 1000;
+        battery->setBatteryStatus(status);
+        passed &= check("overcommitted", !battery->schedule_set_current(100, t0 + 2h, t0 + 3h) &&
+                                         battery->schedule_set_current(-500, t0 + 2h, t0 + 3h));
+    }
+
+    {
+        timepoint_t start = std::chrono::time_point_cast<std::chrono::milliseconds>(getTimeNow()) + 100ms;
+        std::shared_ptr<Battery> physical = makeBattery("adm3", 100, 10000);
+        std::shared_ptr<Battery> pseudo   = makeBattery<PseudoBattery>("adm4", 100, 10000);
+        bool admitted = !physical->schedule_set_current(3600, start, start + 1h) && pseudo->schedule_set_current(3600, start, start + 1h);
+
+        // the first step of the ChargeModel (180mAh at 3600mA) empties the pseudo battery and stops its current
+        std::this_thread::sleep_for(500ms);
+        BatteryStatus status = pseudo->getStatus();
+        passed &= check("pseudo", admitted && status.capacity_mAh == 0 && status.current_mA == 0);
+        pseudo->quit();
+    }
+
+    // random requests of distinct requesters (nothing is overridden) against the brute force capacity
+    {
+        std::mt19937 generator(7);
+        std::uniform_int_distribution<int> offset(0, 48 * 60);
+        std::uniform_int_distribution<int> duration(1, 6 * 60);
+        std::uniform_real_distribution<double> current(-1000, 1000);
+
+        ReservationMap reservations;
+        std::vector<Request> accepted;
+        timepoint_t from = t0;
+        int mismatches = 0, numAccepted = 0, residues = 0;
+        for (int i = 0; i < 2000; i++) {
+            timepoint_t start = t0 + std::chrono::minutes(offset(generator));
+            Request request = {std::round(current(generator)), start, start + std::chrono::minutes(duration(generator))};
+
+            // the capacity at from is 5000 whatever was drawn before, so the schedule may already be out of range
+            std::pair<double, double> before = bruteForce(accepted, from, 5000);
+            accepted.push_back(request);
+            std::pair<double, double> after = bruteForce(accepted, from, 5000);
+            accepted.pop_back();
+            bool feasible = !(after.first < -1e-6 && after.first < before.first - 1e-6) &&
+                            !(after.second > 10000 + 1e-6 && after.second > before.second + 1e-6);
+
+            uint64_t sequenceNumber = getSequenceNumber();
+            double drawn  = reservations.chargeBetween(from, t0 + 72h);
+            bool admitted = reservations.admits(internBatteryName("random" + std::to_string(i)), sequenceNumber, request.current_mA,
+                                                request.startTime, request.endTime, from, 5000, 10000);
+            if (admitted != feasible)
+                mismatches++;
+            if (reservations.chargeBetween(from, t0 + 72h) != drawn)
+                residues++;
+            if (admitted) {
+                reservations.insert(internBatteryName("random" + std::to_string(i)), sequenceNumber, request.current_mA, request.startTime, request.endTime);
+                accepted.push_back(request);
+                numAccepted++;
+            }
+
+            // time moves on every 100 requests
+            if (i % 100 == 99) {
+                from += 1h;
+                reservations.consume(from);
+            }
+        }
+        PRINT() << numAccepted << " of 2000 random requests accepted" << std::endl;
+        passed &= check("brute force", mismatches == 0 && numAccepted > 0 && numAccepted < 2000);
+        passed &= check("no residue", residues == 0);
+    }
+
+    // a week of requests from 100 requesters on a battery large enough to admit them all
+    {
+        std::mt19937 generator(11);
+        std::uniform_int_distribution<int> requester(0, 99);
+        std::uniform_int_distribution<int> offset(0, 7 * 24 * 60);
+        std::uniform_int_distribution<int> duration(1, 120);
+
+        std::vector<battery_id_t> requesters;
+        for (int i = 0; i < 100; i++)
+            requesters.push_back(internBatteryName("requester" + std::to_string(i)));
+
+        ReservationMap reservations;
+        int numAdmitted = 0;
+        Clock::time_point begin = Clock::now();
+        for (int i = 0; i < numRequests; i++) {
+            timepoint_t start = t0 + std::chrono::minutes(offset(generator));
+            timepoint_t end   = start + std::chrono::minutes(duration(generator));
+            battery_id_t id   = requesters[requester(generator)];
+            uint64_t sequenceNumber = getSequenceNumber();
+            if (reservations.admits(id, sequenceNumber, 100, start, end, t0, 1e9, 2e9)) {
+                reservations.insert(id, sequenceNumber, 100, start, end);
+                numAdmitted++;
+            }
+        }
+        double admitTime = std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / numRequests;
+
+        const int rejections = 1000;
+        int numRejected = 0;
+        begin = Clock::now();
+        for (int i = 0; i < rejections; i++) {
+            timepoint_t start = t0 + std::chrono::minutes(offset(generator));
+            if (!reservations.admits(requesters[0], getSequenceNumber(), 1e9, start, start + 1h, t0, 1e9, 2e9))
+                numRejected++;
+        }
+        double rejectTime = std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / rejections;
+
+        passed &= check("scale", numAdmitted == numRequests && numRejected == rejections);
+        PRINT() << numRequests << " requests (" << reservations.size() << " pending): " << admitTime << "us per admitted request (check and insert), "
+                << rejectTime << "us per rejected request" << std::endl;
+    }
+
+    return passed ? 0 : 1;
+}
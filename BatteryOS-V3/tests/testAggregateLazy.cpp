@@ -0,0 +1,103 @@
+#include <cmath>
+#include <thread>
+#include "PseudoBattery.hpp"
+#include "AggregateBattery.hpp"
+
+/**
+ * Lazy aggregate test
+ *
+ * Checks aggregate batteries whose parents are LAZY (the default refresh
+ * mode), so the parents only push their status when they are read:
+ *  - an aggregate over a discharging pseudo battery follows its capacity
+ *    without the pseudo battery being read directly (the aggregate reads
+ *    the parents whose last push is stale)
+ *  - an aggregate of aggregates does the same through the middle level
+ *  - an aggregate without parents reports an empty status
+ *  - a parent status with a NaN charging limit (so a NaN c rate) does not
+ *    break the running totals once the parent pushes a valid status again
+ *
+ * usage: ./aggregate_lazy
+ */
+
+using namespace std::chrono_literals;
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool closeEnough(double lhs, double rhs) {
+    return std::fabs(lhs - rhs) <= 1e-6 * std::max(1.0, std::max(std::fabs(lhs), std::fabs(rhs)));
+}
+
+BatteryStatus makeStatus(double capacity_mAh) {
+    BatteryStatus status;
+    status.voltage_mV = 5000;
+    status.current_mA = 0;
+    status.capacity_mAh = capacity_mAh;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 1000;
+    status.max_discharging_current_mA = 1000;
+    status.time = convertToMilliseconds(getTimeNow());
+    return status;
+}
+
+int main() {
+    bool passed = true;
+
+    {
+        std::shared_ptr<Battery> pseudo = std::make_shared<PseudoBattery>("lazy_pseudo");
+        pseudo->setBatteryStatus(makeStatus(5000));
+        std::shared_ptr<Battery> aggregate = std::make_shared<AggregateBattery>("lazy_aggregate", std::vector<std::shared_ptr<Battery>>{pseudo});
+        std::shared_ptr<Battery> root = std::make_shared<AggregateBattery>("lazy_root", std::vector<std::shared_ptr<Battery>>{aggregate});
+
+        timepoint_t start = std::chrono::time_point_cast<std::chrono::milliseconds>(getTimeNow()) + 100ms;
+        bool scheduled = pseudo->schedule_set_current(500, start, start + 1h);
+
+        // 25mAh per CHARGE_INTERVAL at 500mA, read through the aggregates only
+        std::this_thread::sleep_for(4500ms);
+        BatteryStatus aggregateStatus = aggregate->getStatus();
+        passed &= check("lazy parent", scheduled && aggregateStatus.capacity_mAh <= 4925 &&
+                                       aggregateStatus.capacity_mAh == pseudo->getStatus().capacity_mAh);
+
+        std::this_thread::sleep_for(2500ms);
+        BatteryStatus rootStatus = root->getStatus();
+        passed &= check("lazy aggregate parent", rootStatus.capacity_mAh < aggregateStatus.capacity_mAh &&
+                                                 rootStatus.capacity_mAh == pseudo->getStatus().capacity_mAh);
+
+        root->quit();
+        aggregate->quit();
+        pseudo->quit();
+    }
+
+    {
+        AggregateBattery empty("lazy_empty", {});
+        BatteryStatus status = empty.getStatus();
+        passed &= check("no parents", status.capacity_mAh == 0 && status.max_capacity_mAh == 0 && status.max_charging_current_mA == 0 &&
+                                      std::isfinite(status.voltage_mV));
+        empty.quit();
+    }
+
+    {
+        std::shared_ptr<Battery> physical = std::make_shared<PhysicalBattery>("lazy_physical", 100s);
+        physical->setBatteryStatus(makeStatus(4000));
+        std::shared_ptr<Battery> other = std::make_shared<PhysicalBattery>("lazy_other", 100s);
+        other->setBatteryStatus(makeStatus(6000));
+        std::shared_ptr<AggregateBattery> aggregate = std::make_shared<AggregateBattery>("lazy_nan", std::vector<std::shared_ptr<Battery>>{physical, other}, 100s);
+
+        BatteryStatus invalid = makeStatus(3500);
+        invalid.max_charging_current_mA = NAN;
+        physical->setBatteryStatus(invalid);
+        physical->setBatteryStatus(makeStatus(3000));
+        BatteryStatus status = aggregate->getStatus();
+        BatteryStatus rescan = aggregate->recomputeStatus();
+        passed &= check("NaN c rate", closeEnough(status.capacity_mAh, 9000) && closeEnough(status.max_charging_current_mA, rescan.max_charging_current_mA) &&
+                                      closeEnough(status.max_discharging_current_mA, rescan.max_discharging_current_mA));
+
+        aggregate->quit();
+        physical->quit();
+        other->quit();
+    }
+
+    return passed ? 0 : 1;
+}
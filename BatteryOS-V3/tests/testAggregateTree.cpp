@@ -0,0 +1,141 @@
+#include <random>
+#include <algorithm>
+#include "PhysicalBattery.hpp"
+#include "AggregateBattery.hpp"
+#include "BatteryDirectory.hpp"
+
+/**
+ * Aggregate tree benchmark
+ *
+ * Builds a tree of aggregate batteries depth levels deep where every
+ * aggregate has fanout parents (fanout^depth physical batteries at the
+ * bottom), then measures:
+ *  - how long a physical battery status change takes to reach the root
+ *  - the latency of reading the root aggregate's status
+ *  - how long a full rescan of every aggregate takes (what refreshing
+ *    the root cost before aggregates kept running totals)
+ * and checks that the running totals of every aggregate match a full
+ * rescan of its parents.
+ *
+ * usage: ./aggregate_tree [fanout] [depth] [updates]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static bool closeEnough(double lhs, double rhs) {
+    return std::fabs(lhs - rhs) <= 1e-6 * std::max(1.0, std::max(std::fabs(lhs), std::fabs(rhs)));
+}
+
+static bool closeEnough(const BatteryStatus &lhs, const BatteryStatus &rhs) {
+    return closeEnough(lhs.voltage_mV, rhs.voltage_mV) &&
+           closeEnough(lhs.current_mA, rhs.current_mA) &&
+           closeEnough(lhs.capacity_mAh, rhs.capacity_mAh) &&
+           closeEnough(lhs.max_capacity_mAh, rhs.max_capacity_mAh) &&
+           closeEnough(lhs.max_charging_current_mA, rhs.max_charging_current_mA) &&
+           closeEnough(lhs.max_discharging_current_mA, rhs.max_discharging_current_mA);
+}
+
+static BatteryStatus randomStatus(std::mt19937 &generator) {
+    std::uniform_real_distribution<double> maxCapacity(5000, 10000);
+    std::uniform_real_distribution<double> fraction(0.05, 0.95);
+    std::uniform_real_distribution<double> voltage(4500, 5500);
+
+    BatteryStatus status;
+    status.voltage_mV = voltage(generator);
+    status.current_mA = 0;
+    status.max_capacity_mAh = maxCapacity(generator);
+    status.capacity_mAh = status.max_capacity_mAh * fraction(generator);
+    status.max_charging_current_mA = status.max_capacity_mAh * fraction(generator);
+    status.max_discharging_current_mA = status.max_capacity_mAh * fraction(generator);
+    status.time = convertToMilliseconds(getTimeNow());
+    return status;
+}
+
+int main(int argc, char** argv) {
+    int fanout  = argc > 1 ? atoi(argv[1]) : 10;
+    int depth   = argc > 2 ? atoi(argv[2]) : 4;
+    int updates = argc > 3 ? atoi(argv[3]) : 10000;
+
+    std::mt19937 generator(42);
+    BatteryDirectory d;
+    {
+        std::vector<std::shared_ptr<Battery>> leaves;
+        std::vector<std::vector<std::shared_ptr<AggregateBattery>>> levels;
+
+        int numLeaves = 1;
+        for (int i = 0; i < depth; i++)
+            numLeaves *= fanout;
+
+        std::vector<std::shared_ptr<Battery>> level;
+        for (int i = 0; i < numLeaves; i++) {
+            std::shared_ptr<Battery> battery = std::make_shared<PhysicalBattery>("leaf" + std::to_string(i), std::chrono::seconds(100));
+            battery->setBatteryStatus(randomStatus(generator));
+            d.addBattery(battery);
+            leaves.push_back(battery);
+            level.push_back(battery);
+        }
+
+        for (int l = 1; l <= depth; l++) {
+            std::vector<std::shared_ptr<Battery>> nextLevel;
+            levels.push_back({});
+            for (size_t i = 0; i < level.size(); i += fanout) {
+                std::vector<std::shared_ptr<Battery>> parents(level.begin() + i, level.begin() + i + fanout);
+                std::string name = "agg" + std::to_string(l) + "_" + std::to_string(i / fanout);
+                std::shared_ptr<AggregateBattery> battery = std::make_shared<AggregateBattery>(name, parents, std::chrono::seconds(100));
+                d.addBattery(battery);
+                for (std::shared_ptr<Battery> &parent : parents)
+                    d.addEdge(parent->getBatteryName(), name);
+                levels.back().push_back(battery);
+                nextLevel.push_back(battery);
+            }
+            level = nextLevel;
+        }
+
+        std::shared_ptr<Battery> root = level[0];
+        LOG() << "built " << numLeaves << " physical batteries under " << depth << " levels of aggregates (fanout " << fanout << ")" << std::endl;
+
+        std::uniform_int_distribution<int> leaf(0, numLeaves - 1);
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < updates; i++)
+            leaves[leaf(generator)]->setBatteryStatus(randomStatus(generator));
+        double updateTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        std::vector<int64_t> reads;
+        for (int i = 0; i < updates; i++) {
+            Clock::time_point begin = Clock::now();
+            root->getStatus();
+            reads.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+        }
+        std::sort(reads.begin(), reads.end());
+
+        BatteryStatus incremental = root->getStatus();
+
+        // rescan bottom up so every level rescans the level below it
+        int mismatches = 0;
+        start = Clock::now();
+        for (auto &aggregates : levels) {
+            for (std::shared_ptr<AggregateBattery> &battery : aggregates) {
+                BatteryStatus before = battery->getStatus();
+                if (!closeEnough(before, battery->recomputeStatus()))
+                    mismatches++;
+            }
+        }
+        double rescanTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        PRINT() << "root status" << std::endl << incremental << std::endl;
+        PRINT() << "status change pushed to the root: " << updateTime / updates << "us per change" << std::endl;
+        PRINT() << "root getStatus (ns): p50 = " << reads[reads.size() / 2]
+                << ", p99 = " << reads[reads.size() * 99 / 100]
+                << ", max = " << reads.back() << std::endl;
+        PRINT() << "full rescan of every aggregate: " << rescanTime << "us" << std::endl;
+
+        if (mismatches == 0)
+            PRINT() << "PASS: running totals match a full rescan" << std::endl;
+        else
+            PRINT() << "FAIL: " << mismatches << " aggregates differ from a full rescan" << std::endl;
+
+        d.destroyDirectory();
+    }
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <map>
+#include <random>
+#include "PhysicalBattery.hpp"
+#include "BatteryDirectory.hpp"
+
+/**
+ * Battery ID benchmark
+ *
+ * Builds a directory of numBatteries physical batteries and measures:
+ *  - status lookups through the directory by battery ID, by name, and
+ *    through the std::map<std::string, ...> the directory used before
+ *  - inserting events into an EventSet with event_t (which carries the
+ *    battery ID) and with a copy of the old event that carried the name
+ *  - scheduling reservations on batteries found by ID and by name
+ *
+ * usage: ./battery_ids [numBatteries] [operations]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * copy of event_t before battery IDs (the name is copied with every event)
+ */
+struct NamedEvent {
+    EventID eventID;
+    double current_mA;
+    timepoint_t eventTime;
+    std::string batteryName;
+    uint64_t sequenceNumber;
+
+    NamedEvent(const std::string &batteryName, EventID event, int64_t current_mA, timepoint_t time, uint64_t sequenceNumber)
+        : eventID(event), current_mA(current_mA), eventTime(time), batteryName(batteryName), sequenceNumber(sequenceNumber) {}
+
+    friend bool operator<(const NamedEvent &lhs, const NamedEvent &rhs) {
+        if (lhs.eventTime != rhs.eventTime)
+            return lhs.eventTime < rhs.eventTime;
+        else if (lhs.eventID != rhs.eventID)
+            return lhs.eventID > rhs.eventID;
+        return lhs.sequenceNumber < rhs.sequenceNumber;
+    }
+};
+
+double elapsed(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void report(const std::string &label, int operations, double time_ms) {
+    PRINT() << label << ": " << time_ms << "ms (" << operations / time_ms / 1000 << "M ops/s)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int numBatteries = argc > 1 ? atoi(argv[1]) : 10000;
+    int operations   = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 5000;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 3000;
+    status.max_discharging_current_mA = 3000;
+    status.time = convertToMilliseconds(getTimeNow());
+
+    BatteryDirectory d;
+    {
+        std::vector<std::string> names;
+        std::vector<battery_id_t> ids;
+        std::map<std::string, std::shared_ptr<Battery>> legacyDirectory;
+
+        for (int i = 0; i < numBatteries; i++) {
+            std::shared_ptr<Battery> battery = std::make_shared<PhysicalBattery>("battery" + std::to_string(i), 100s);
+            battery->setBatteryStatus(status);
+            d.addBattery(battery);
+            legacyDirectory.insert({battery->getBatteryName(), battery});
+            names.push_back(battery->getBatteryName());
+            ids.push_back(battery->getBatteryID());
+        }
+
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> battery(0, numBatteries - 1);
+        std::vector<int> order;
+        for (int i = 0; i < operations; i++)
+            order.push_back(battery(generator));
+
+        volatile double sink = 0;
+        PRINT() << numBatteries << " batteries, " << operations << " operations each" << std::endl;
+
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < operations; i++)
+            sink = sink + d.getBattery(ids[order[i]])->getStatus().capacity_mAh;
+        report("status lookup by ID              ", operations, elapsed(start));
+
+        start = Clock::now();
+        for (int i = 0; i < operations; i++)
+            sink = sink + d.getBattery(names[order[i]])->getStatus().capacity_mAh;
+        report("status lookup by name            ", operations, elapsed(start));
+
+        start = Clock::now();
+        for (int i = 0; i < operations; i++)
+            sink = sink + legacyDirectory.at(names[order[i]])->getStatus().capacity_mAh;
+        report("status lookup by name (std::map) ", operations, elapsed(start));
+
+        timepoint_t t0 = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now());
+        {
+            EventSet events;
+            start = Clock::now();
+            for (int i = 0; i < operations; i++)
+                events.insert(event_t(ids[order[i]], EventID::SET_CURRENT_BEGIN, 100, t0 + std::chrono::seconds(i % 3600), i + 1));
+            report("event insert with ID             ", operations, elapsed(start));
+        }
+        {
+            std::set<NamedEvent> events;
+            start = Clock::now();
+            for (int i = 0; i < operations; i++)
+                events.insert(NamedEvent(names[order[i]], EventID::SET_CURRENT_BEGIN, 100, t0 + std::chrono::seconds(i % 3600), i + 1));
+            report("event insert with name           ", operations, elapsed(start));
+        }
+
+        // schedule far enough ahead that no reservation starts during the run
+        int reservations = std::min(operations, 10 * numBatteries);
+        timepoint_t base = getTimeNow() + 1h;
+
+        start = Clock::now();
+        for (int i = 0; i < reservations; i++)
+            d.getBattery(ids[order[i]])->schedule_set_current(100, base + std::chrono::seconds(i), base + std::chrono::seconds(i + 60));
+        report("schedule_set_current by ID       ", reservations, elapsed(start));
+
+        start = Clock::now();
+        for (int i = 0; i < reservations; i++)
+            d.getBattery(names[order[i]])->schedule_set_current(100, base + std::chrono::seconds(i), base + std::chrono::seconds(i + 60));
+        report("schedule_set_current by name     ", reservations, elapsed(start));
+
+        d.destroyDirectory();
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "PseudoBattery.hpp"
+
+/**
+ * Clock test
+ *
+ * Steps the wall clock of the batteries back and forward by an hour (the
+ * way NTP or an operator would) and checks that:
+ *  - an ACTIVE battery keeps refreshing every maxStaleness instead of
+ *    stalling for an hour (backward step) or bursting through an hour of
+ *    refreshes (forward step)
+ *  - a LAZY battery whose status was stamped before a backward step is
+ *    refreshed on the next read
+ *  - a reservation given in wall clock time after a step still starts on time
+ * Then runs an ACTIVE battery for a day on a ManualClock with the
+ * SimulationScheduler to show the same battery runs at CPU speed.
+ *
+ * usage: ./clock
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * system clock whose wall clock time can be stepped by offset
+ */
+class OffsetClock : public BatteryClock {
+    private:
+        std::atomic<int64_t> offset_ms{0};
+
+    public:
+        timestamp_t now() const override {
+            timestamp_t time = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now());
+            return time + std::chrono::milliseconds(this->offset_ms.load());
+        }
+
+        monotonic_t monotonicNow() const override {
+            return std::chrono::steady_clock::now();
+        }
+
+        void step(std::chrono::milliseconds offset) {
+            this->offset_ms += offset.count();
+        }
+};
+
+class CountingBattery : public PseudoBattery {
+    public:
+        std::atomic<int> refreshes{0};
+
+    public:
+        CountingBattery(const std::string &batteryName, std::chrono::milliseconds maxStaleness, RefreshMode refreshMode)
+            : PseudoBattery(batteryName, maxStaleness, refreshMode) {}
+
+    protected:
+        BatteryStatus refresh() override {
+            this->refreshes++;
+            return PseudoBattery::refresh();
+        }
+};
+
+BatteryStatus initialStatus(timestamp_t time) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 5000;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 1000;
+    status.max_discharging_current_mA = 1000;
+    status.time = convertToMilliseconds(time);
+    return status;
+}
+
+/**
+ * number of refreshes of battery during the next second
+ */
+int refreshesPerSecond(CountingBattery &battery) {
+    int before = battery.refreshes;
+    std::this_thread::sleep_for(1s);
+    return battery.refreshes - before;
+}
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool runWallClockSteps() {
+    std::shared_ptr<OffsetClock> clock = std::make_shared<OffsetClock>();
+    setClock(clock);
+    setEventScheduler(std::make_shared<TimerWheelScheduler>(2, clock));
+
+    bool passed = true;
+
+    // 100ms cadence, so about 10 refreshes a second
+    std::shared_ptr<CountingBattery> active = std::make_shared<CountingBattery>("active", 100ms, RefreshMode::LAZY);
+    active->setBatteryStatus(initialStatus(clock->now()));
+    active->setRefreshMode(RefreshMode::ACTIVE);
+
+    std::shared_ptr<CountingBattery> lazy = std::make_shared<CountingBattery>("lazy", 500ms, RefreshMode::LAZY);
+    lazy->setBatteryStatus(initialStatus(clock->now()));
+
+    int steady = refreshesPerSecond(*active);
+    clock->step(-1h);
+    int backward = refreshesPerSecond(*active);
+    clock->step(1h);
+    int forward = refreshesPerSecond(*active);
+
+    PRINT() << "ACTIVE refreshes per second: " << steady << " before, " << backward << " after stepping back an hour, "
+            << forward << " after stepping forward an hour" << std::endl;
+    passed &= check("ACTIVE cadence", std::abs(backward - steady) <= 2 && std::abs(forward - steady) <= 2);
+
+    lazy->getFreshStatus();
+    int before = lazy->refreshes;
+    clock->step(-1h);
+    lazy->getFreshStatus();
+    passed &= check("LAZY refresh after stepping back", lazy->refreshes == before + 1);
+
+    timestamp_t start = clock->now() + 200ms;
+    lazy->schedule_set_current(500, start, start + 300ms);
+    std::this_thread::sleep_for(350ms);
+    passed &= check("reservation after stepping back", lazy->getScheduledCurrent(clock->now()) == 500 && lazy->getCurrent() == 500);
+
+    active->quit();
+    lazy->quit();
+    return passed;
+}
+
+bool runManualClock() {
+    timestamp_t start = getTimeNow();
+    std::shared_ptr<ManualClock> clock = std::make_shared<ManualClock>(start);
+    std::shared_ptr<SimulationScheduler> scheduler = std::make_shared<SimulationScheduler>(clock);
+    setClock(clock);
+    setEventScheduler(scheduler);
+
+    std::shared_ptr<CountingBattery> active = std::make_shared<CountingBattery>("manual", 1s, RefreshMode::LAZY);
+    active->setBatteryStatus(initialStatus(clock->now()));
+    active->setRefreshMode(RefreshMode::ACTIVE);
+    int before = active->refreshes;
+
+    Clock::time_point begin = Clock::now();
+    scheduler->runUntil(start + 24h);
+    double runTime = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    int refreshes = active->refreshes - before;
+    PRINT() << "ManualClock: " << refreshes << " refreshes over 24 hours in " << runTime << "s" << std::endl;
+    active->quit();
+    return check("ManualClock cadence", refreshes == 24 * 3600);
+}
+
+int main() {
+    bool passed = runWallClockSteps();
+    passed &= runManualClock();
+
+    setClock(std::make_shared<SystemClock>());
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+#include <map>
+#include <list>
+#include "BatteryGraph.hpp"
+#include "PhysicalBattery.hpp"
+#include "AggregateBattery.hpp"
+#include "BatteryDirectory.hpp"
+
+/**
+ * Directory graph benchmark
+ *
+ * Builds the topology of numBatteries physical batteries under levels of
+ * aggregates with fanout parents each (the same shape as aggregate_tree)
+ * with the BatteryGraph and with the std::map<std::string, std::list>
+ * graphs that BatteryDirectory used before, then compares building the
+ * topology, walking the children and parents of every battery, and
+ * removing it again one aggregate subtree at a time. Afterwards a small
+ * directory of real batteries is built with addBatteries and its
+ * topological order, children, parents, and subtree removal are checked.
+ *
+ * usage: ./directory_graph [numBatteries] [fanout] [rounds]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * copy of the original BatteryDirectory graphs and removeBattery kept for comparison
+ */
+class LegacyGraph {
+    public:
+        std::map<std::string, bool> nodes;
+        std::map<std::string, std::list<std::string>> childGraph;
+        std::map<std::string, std::list<std::string>> parentGraph;
+
+    public:
+        void addEdge(const std::string &parentName, const std::string &childName) {
+            childGraph[childName].push_back(parentName);
+            parentGraph[parentName].push_back(childName);
+        }
+
+        bool removeBattery(const std::string &batteryName) {
+            if (nodes.count(batteryName) == 0) {
+                return false;
+            } else if (parentGraph.count(batteryName) == 1) {
+                std::list<std::string> childNames = parentGraph[batteryName];
+                for (std::string &child : childNames) {
+                    if (!this->removeBattery(child))
+                        return false;
+                }
+                parentGraph.erase(batteryName);
+            }
+            if (childGraph.count(batteryName) == 1) {
+                std::list<std::string> parentNames = childGraph[batteryName];
+                for (std::string &parent : parentNames) {
+                    parentGraph[parent].remove(batteryName);
+                    if (parentGraph[parent].empty())
+                        parentGraph.erase(parent);
+                }
+                childGraph.erase(batteryName);
+            }
+            nodes.erase(batteryName);
+            return true;
+        }
+};
+
+struct Topology {
+    std::vector<std::string> names;
+    std::vector<battery_id_t> ids;
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> aggregates;
+};
+
+Topology makeTopology(int numBatteries, int fanout) {
+    Topology topology;
+    std::vector<int> level;
+    for (int i = 0; i < numBatteries; i++) {
+        level.push_back(topology.names.size());
+        topology.names.push_back("graph_leaf" + std::to_string(i));
+    }
+
+    for (int l = 1; level.size() > 1; l++) {
+        std::vector<int> nextLevel;
+        for (size_t i = 0; i < level.size(); i += fanout) {
+            int node = topology.names.size();
+            topology.names.push_back("graph_agg" + std::to_string(l) + "_" + std::to_string(i / fanout));
+            for (size_t j = i; j < std::min(level.size(), i + fanout); j++)
+                topology.edges.push_back({level[j], node});
+            topology.aggregates.push_back(node);
+            nextLevel.push_back(node);
+        }
+        level = nextLevel;
+    }
+
+    for (const std::string &name : topology.names)
+        topology.ids.push_back(internBatteryName(name));
+    return topology;
+}
+
+double elapsed(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool checkDirectory() {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 5000;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 3000;
+    status.max_discharging_current_mA = 3000;
+    status.time = convertToMilliseconds(getTimeNow());
+
+    bool passed = true;
+    BatteryDirectory d;
+    {
+        std::vector<std::shared_ptr<Battery>> physical;
+        for (int i = 0; i < 4; i++) {
+            std::shared_ptr<Battery> battery = std::make_shared<PhysicalBattery>("phys" + std::to_string(i), std::chrono::seconds(100));
+            battery->setBatteryStatus(status);
+            physical.push_back(battery);
+        }
+
+        // top is added before its sources to check that the order does not depend on insertion order
+        std::shared_ptr<Battery> left  = std::make_shared<AggregateBattery>("left", std::vector<std::shared_ptr<Battery>>{physical[0], physical[1]});
+        std::shared_ptr<Battery> right = std::make_shared<AggregateBattery>("right", std::vector<std::shared_ptr<Battery>>{physical[2], physical[3]});
+        std::shared_ptr<Battery> top   = std::make_shared<AggregateBattery>("top", std::vector<std::shared_ptr<Battery>>{left, right});
+
+        std::vector<std::shared_ptr<Battery>> batteries = {top, left, right};
+        batteries.insert(batteries.end(), physical.begin(), physical.end());
+        passed &= d.addBatteries(batteries, {{"phys0", "left"}, {"phys1", "left"}, {"phys2", "right"}, {"phys3", "right"},
+                                             {"left", "top"}, {"right", "top"}});
+
+        // nothing is added when an edge names a missing battery
+        std::shared_ptr<Battery> extra = std::make_shared<PhysicalBattery>("extra", std::chrono::seconds(100));
+        passed &= !d.addBatteries({extra}, {{"missing", "extra"}});
+        passed &= !d.nameExists("extra");
+
+        std::vector<std::shared_ptr<Battery>> order = d.getTopologicalOrder();
+        std::map<std::string, size_t> position;
+        for (size_t i = 0; i < order.size(); i++)
+            position[order[i]->getBatteryName()] = i;
+        passed &= order.size() == 7;
+        passed &= position["phys0"] < position["left"] && position["phys3"] < position["right"];
+        passed &= position["left"] < position["top"] && position["right"] < position["top"];
+
+        passed &= d.getChildren("phys0").size() == 1 && d.getChildren("phys0")[0] == left;
+        passed &= d.getParents("top").size() == 2;
+        passed &= !d.canBeSource("left") && d.canBeSource("top");
+
+        // removing a physical battery takes every battery built on it
+        passed &= d.removeBattery("phys0");
+        passed &= !d.nameExists("phys0") && !d.nameExists("left") && !d.nameExists("top");
+        passed &= d.nameExists("phys1") && d.nameExists("right");
+        passed &= d.canBeSource("phys1") && d.getChildren("right").empty();
+        passed &= d.getTopologicalOrder().size() == 4;
+
+        d.destroyDirectory();
+    }
+
+    PRINT() << "directory checks: " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    int numBatteries = argc > 1 ? atoi(argv[1]) : 10000;
+    int fanout       = argc > 2 ? atoi(argv[2]) : 10;
+    int rounds       = argc > 3 ? atoi(argv[3]) : 10;
+
+    Topology topology = makeTopology(numBatteries, fanout);
+    double legacyTime[3] = {0, 0, 0};
+    double graphTime[3]  = {0, 0, 0};
+    volatile size_t sink = 0;
+    bool passed = true;
+
+    for (int r = 0; r < rounds; r++) {
+        LegacyGraph legacy;
+        Clock::time_point start = Clock::now();
+        for (const std::string &name : topology.names)
+            legacy.nodes[name] = true;
+        for (const auto &edge : topology.edges)
+            legacy.addEdge(topology.names[edge.first], topology.names[edge.second]);
+        legacyTime[0] += elapsed(start);
+
+        start = Clock::now();
+        for (const std::string &name : topology.names) {
+            auto children = legacy.parentGraph.find(name);
+            if (children != legacy.parentGraph.end())
+                sink = sink + children->second.size();
+            auto parents = legacy.childGraph.find(name);
+            if (parents != legacy.childGraph.end())
+                sink = sink + parents->second.size();
+        }
+        legacyTime[1] += elapsed(start);
+
+        start = Clock::now();
+        for (int node : topology.aggregates)
+            legacy.removeBattery(topology.names[node]);
+        legacyTime[2] += elapsed(start);
+
+        BatteryGraph graph;
+        start = Clock::now();
+        for (battery_id_t id : topology.ids)
+            graph.addNode(id);
+        std::vector<std::pair<battery_id_t, battery_id_t>> edges;
+        edges.reserve(topology.edges.size());
+        for (const auto &edge : topology.edges)
+            edges.push_back({topology.ids[edge.first], topology.ids[edge.second]});
+        graph.addEdges(edges);
+        graph.children(topology.ids[0]);
+        graphTime[0] += elapsed(start);
+
+        start = Clock::now();
+        for (battery_id_t id : topology.ids) {
+            for (battery_id_t child : graph.children(id))
+                sink = sink + child;
+            for (battery_id_t parent : graph.parents(id))
+                sink = sink + parent;
+        }
+        graphTime[1] += elapsed(start);
+
+        if (r == 0)
+            passed &= graph.topologicalOrder().size() == topology.ids.size();
+
+        start = Clock::now();
+        for (int node : topology.aggregates)
+            graph.removeNodes(graph.subtree(topology.ids[node]));
+        graphTime[2] += elapsed(start);
+
+        if (r == 0) {
+            passed &= legacy.nodes.size() == (size_t) numBatteries;
+            passed &= graph.topologicalOrder().size() == (size_t) numBatteries;
+        }
+    }
+
+    PRINT() << topology.names.size() << " batteries, " << topology.edges.size() << " edges, " << rounds << " rounds" << std::endl;
+    PRINT() << "build (ms):                 legacy = " << legacyTime[0] / rounds << ", graph = " << graphTime[0] / rounds << std::endl;
+    PRINT() << "walk every battery (ms):    legacy = " << legacyTime[1] / rounds << ", graph = " << graphTime[1] / rounds << std::endl;
+    PRINT() << "remove aggregates (ms):     legacy = " << legacyTime[2] / rounds << ", graph = " << graphTime[2] / rounds << std::endl;
+    PRINT() << "graph checks: " << (passed ? "passed" : "FAILED") << std::endl;
+
+    return checkDirectory() && passed ? 0 : 1;
+}
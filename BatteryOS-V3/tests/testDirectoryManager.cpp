@@ -106,6 +106,11 @@ int main() {
 
     std::this_thread::sleep_for(20s);
 
+    std::vector<std::string> missing;
+    LOG() << "status snapshot of the directory" << std::endl;
+    for (const auto &iter : manager->getStatusSnapshot({}, missing))
+        PRINT() << iter.first << ": " << iter.second << std::endl;
+
     manager->removeBattery("bat3");
 
     return 0;
@@ -0,0 +1,79 @@
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "Admin.hpp"
+#include "ClientBattery.hpp"
+
+/**
+ * Head-of-line blocking benchmark
+ *
+ * Creates a "slow" battery whose status is never set (scheduling a
+ * current on it takes a second) and a "fast" battery with a status.
+ * One thread keeps scheduling currents on the slow battery while the
+ * main thread measures Get_Status latency on the fast battery. With
+ * battery commands run on the polling thread every status request
+ * waits behind the slow command; with dispatch threads (./socket 4)
+ * they do not. The admin socket is expected on port 65432 and the
+ * battery socket on port 65431.
+ *
+ * usage: ./dispatch [numRequests]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    int numRequests = argc > 1 ? atoi(argv[1]) : 200;
+
+    Admin admin(65432);
+
+    if (!admin.createPhysicalBattery("slow", std::chrono::seconds(100)))
+        ERROR() << "could not create slow battery!" << std::endl;
+    if (!admin.createPhysicalBattery("fast", std::chrono::seconds(100)))
+        ERROR() << "could not create fast battery!" << std::endl;
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 7500;
+    status.max_capacity_mAh = 7500;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+
+    ClientBattery fast(65431, "fast");
+    if (!fast.setBatteryStatus(status))
+        ERROR() << "could not set fast battery status" << std::endl;
+
+    std::atomic<bool> done(false);
+    std::thread slowThread([&done] {
+        ClientBattery slow(65431, "slow");
+        while (!done) {
+            timestamp_t start = getTimeNow() + 10s;
+            slow.schedule_set_current(100, start, start + 1s);
+        }
+    });
+
+    // let the first slow command reach BOS
+    std::this_thread::sleep_for(100ms);
+
+    std::vector<int64_t> samples;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < numRequests; i++) {
+        Clock::time_point begin = Clock::now();
+        fast.getStatus();
+        samples.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count());
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    done = true;
+    slowThread.join();
+
+    std::sort(samples.begin(), samples.end());
+    PRINT() << samples.size() << " Get_Status requests on fast battery in " << elapsed << "s" << std::endl;
+    PRINT() << "latency (us): p50 = " << samples[samples.size() / 2]
+            << ", p99 = " << samples[samples.size() * 99 / 100]
+            << ", max = " << samples.back() << std::endl;
+
+    admin.shutdown();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <fstream>
+#include <unistd.h>
+#include "DriverRegistry.hpp"
+
+/**
+ * Driver registry test
+ *
+ * Loads libbatterydrivers (build it first with make linux) from a driver
+ * directory through the driver registry and checks that:
+ *  - driver tables with the wrong ABI version, BatteryStatus size or an
+ *    inconsistent entry are rejected
+ *  - the drivers of the library are found by the name of their
+ *    constructor and functions of different drivers are not mixed
+ *  - files that are not driver libraries are skipped
+ *  - a new build of the library replaces the drivers for new batteries,
+ *    while a battery created from the previous build keeps running on it
+ *    until it is destroyed (which unloads the previous build)
+ *  - a broken build leaves the previous one in place
+ *  - the drivers of a removed library are dropped
+ * The lookup time of a driver is compared to resolving its functions with
+ * dlsym.
+ *
+ * usage: ./driver_registry [library]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static const char* CONSTRUCTOR = "CreateDriverBattery";
+static const char* DESTRUCTOR  = "DestroyDriverBattery";
+static const char* REFRESH     = "DriverRefresh";
+static const char* SET_CURRENT = "DriverSetCurrent";
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+/**
+ * writes a new file at path (a new inode, like a build or a deployment does)
+ */
+bool install(const std::string &source, const std::string &path) {
+    std::string temporary = path + ".new";
+    {
+        std::ifstream input(source, std::ios::binary);
+        std::ofstream output(temporary, std::ios::binary);
+        output << input.rdbuf();
+        if (!input || !output)
+            return false;
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool installText(const std::string &text, const std::string &path) {
+    std::ofstream output(path);
+    output << text;
+    return output.good();
+}
+
+std::unique_ptr<DynamicBattery> createBattery(const std::shared_ptr<const LoadedDriver> &driver, const std::string &name) {
+    static const char* initArgs[] = {"1"};
+    return std::make_unique<DynamicBattery>((void*) initArgs, (void*) driver->destructor, (void*) driver->constructor,
+                                            (void*) driver->refreshFunc, (void*) driver->setCurrentFunc, name,
+                                            std::chrono::milliseconds(1000), RefreshMode::LAZY,
+                                            (void*) driver->telemetryFunc, driver->library);
+}
+
+int main(int argc, char** argv) {
+    std::string source = argc > 1 ? argv[1] : "libbatterydrivers" DYLIB_EXT;
+    bool passed = true;
+    std::string error;
+
+    DriverEntry entries[] = {{"A", DRIVER_CHARGE, "CreateA", "DestroyA", "ARefresh", "ASetCurrent", nullptr},
+                             {"B", DRIVER_TELEMETRY, "CreateB", "DestroyB", "BRefresh", "BSetCurrent", "BTelemetry"}};
+    DriverTable table = {BOS_DRIVER_ABI_VERSION, sizeof(BatteryStatus), 2, entries};
+    passed &= check("valid table", DriverRegistry::validate(&table, error));
+
+    table.abiVersion++;
+    passed &= check("ABI version", !DriverRegistry::validate(&table, error));
+    PRINT() << "  " << error << std::endl;
+    table.abiVersion--;
+
+    table.statusSize--;
+    passed &= check("status size", !DriverRegistry::validate(&table, error));
+    PRINT() << "  " << error << std::endl;
+    table.statusSize++;
+
+    entries[0].telemetry = "ATelemetry";
+    bool telemetry = !DriverRegistry::validate(&table, error);
+    entries[0].telemetry = nullptr;
+    entries[1].name = "A";
+    bool duplicate = !DriverRegistry::validate(&table, error);
+    entries[1].name = "B";
+    entries[1].refresh = nullptr;
+    bool missing = !DriverRegistry::validate(&table, error);
+    entries[1].refresh = "BRefresh";
+    table.numDrivers = 0;
+    bool empty = !DriverRegistry::validate(&table, error);
+    passed &= check("inconsistent tables", telemetry && duplicate && missing && empty);
+
+    char directoryTemplate[] = "driversXXXXXX";
+    if (mkdtemp(directoryTemplate) == NULL)
+        ERROR() << "could not create driver directory" << std::endl;
+    std::string directory = directoryTemplate;
+    std::string library   = directory + "/libbatterydrivers" DYLIB_EXT;
+
+    if (!install(source, library))
+        ERROR() << "could not copy " << source << " (build it with make linux)" << std::endl;
+    installText("not a library", directory + "/broken" DYLIB_EXT);
+    installText("not a library either", directory + "/notes.txt");
+
+    DriverRegistry registry(directory);
+    size_t numLoaded = registry.scan();
+    std::vector<std::string> drivers = registry.getDrivers();
+    passed &= check("scan", numLoaded == 1 && drivers == std::vector<std::string>({"Driver", "JBDBMS", "RD6006"}));
+    passed &= check("rescan", registry.scan() == 0);
+
+    std::shared_ptr<const LoadedDriver> driver = registry.resolve(CONSTRUCTOR, DESTRUCTOR, REFRESH, SET_CURRENT, "", error);
+    bool mixed   = registry.resolve(CONSTRUCTOR, DESTRUCTOR, "RD6006Refresh", SET_CURRENT, "", error) == nullptr;
+    bool unknown = registry.resolve("CreateNothing", DESTRUCTOR, REFRESH, SET_CURRENT, "", error) == nullptr;
+    bool noTelemetry = registry.resolve(CONSTRUCTOR, DESTRUCTOR, REFRESH, SET_CURRENT, "JBDBMSTelemetry", error) == nullptr;
+    std::shared_ptr<const LoadedDriver> jbd = registry.find("CreateJBDBMS");
+    passed &= check("resolve", driver != nullptr && driver->library->generation == 0 && mixed && unknown && noTelemetry &&
+                               jbd != nullptr && (jbd->capabilities & DRIVER_TELEMETRY) && jbd->telemetryFunc != nullptr);
+    jbd.reset();
+
+    // lookup by name against dlsym of every function (what creating a battery did before)
+    const int lookups = 100000;
+    Clock::time_point begin = Clock::now();
+    for (int i = 0; i < lookups; i++)
+        registry.find(CONSTRUCTOR);
+    double findTime = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / lookups;
+    begin = Clock::now();
+    for (int i = 0; i < lookups; i++) {
+        dlsym(driver->library->handle, CONSTRUCTOR);
+        dlsym(driver->library->handle, DESTRUCTOR);
+        dlsym(driver->library->handle, REFRESH);
+        dlsym(driver->library->handle, SET_CURRENT);
+    }
+    double dlsymTime = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / lookups;
+    PRINT() << "driver lookup: " << findTime << "ns (dlsym of its functions: " << dlsymTime << "ns)" << std::endl;
+
+    std::unique_ptr<DynamicBattery> oldBattery = createBattery(driver, "old");
+    std::weak_ptr<DriverLibrary> oldLibrary = driver->library;
+    construct_t oldConstructor = driver->constructor;
+    driver.reset();
+    passed &= check("battery", oldBattery->getFreshStatus().voltage_mV == 5);
+
+    // deploy a new build while the battery runs
+    install(source, library);
+    numLoaded = registry.scan();
+    driver = registry.find(CONSTRUCTOR);
+    passed &= check("reload", numLoaded == 1 && driver != nullptr && driver->library->generation == 1 &&
+                              driver->constructor != oldConstructor && !oldLibrary.expired());
+
+    std::unique_ptr<DynamicBattery> newBattery = createBattery(driver, "new");
+    passed &= check("old build keeps running", oldBattery->getFreshStatus().voltage_mV == 5 &&
+                                               newBattery->getFreshStatus().voltage_mV == 5);
+    oldBattery.reset();
+    passed &= check("old build unloaded", oldLibrary.expired());
+
+    // a broken build is not loaded over a working one
+    installText("broken build", library);
+    numLoaded = registry.scan();
+    passed &= check("broken build", numLoaded == 0 && registry.find(CONSTRUCTOR) == driver);
+
+    unlink(library.c_str());
+    registry.scan();
+    passed &= check("removed library", registry.find(CONSTRUCTOR) == nullptr && registry.getDrivers().empty() &&
+                                       newBattery->getFreshStatus().voltage_mV == 5);
+
+    newBattery.reset();
+    driver.reset();
+    unlink((directory + "/broken" DYLIB_EXT).c_str());
+    unlink((directory + "/notes.txt").c_str());
+    rmdir(directory.c_str());
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+#include <random>
+#include "PseudoBattery.hpp"
+#include "AggregateBattery.hpp"
+#include "BatteryDirectory.hpp"
+
+/**
+ * Aggregate fan-out test
+ *
+ * An aggregate battery is built over pseudo batteries that take
+ * latency milliseconds to accept a set_current request and reject it
+ * at random. Requests are sent to the aggregate and after each one the
+ * parents are checked: either every parent has its share of the
+ * request scheduled or none of them has anything scheduled. The
+ * average request latency is reported next to the sum of the parent
+ * latencies (what sending the requests one parent at a time took).
+ *
+ * Then the two phases of a request are checked on their own:
+ *  - a prepared request is held by the parents but not scheduled until it
+ *    is committed, and aborting it leaves nothing behind
+ *  - in a diamond (two aggregates sharing a parent under one root) the
+ *    shares of both paths add up on the shared parent, and a request that
+ *    fails on one path leaves the shared parent's earlier reservation alone
+ *
+ * usage: ./fanout [numParents] [requests] [rejectProbability] [latency]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+class FlakyBattery : public PseudoBattery {
+    private:
+        lock_t rngLock;
+        std::mt19937 generator;
+        double rejectProbability;
+        std::chrono::milliseconds latency;
+
+    public:
+        FlakyBattery(const std::string &batteryName, unsigned int seed, double rejectProbability, std::chrono::milliseconds latency)
+            : PseudoBattery(batteryName, std::chrono::seconds(100)), generator(seed), rejectProbability(rejectProbability), latency(latency) {}
+
+        bool prepare_set_current(double current_mA, timepoint_t startTime, timepoint_t endTime, battery_id_t requester, uint64_t sequenceNumber) override {
+            std::this_thread::sleep_for(this->latency);
+
+            bool reject;
+            {
+                lockguard_t mutexLock(this->rngLock);
+                reject = std::uniform_real_distribution<double>(0, 1)(this->generator) < this->rejectProbability;
+            }
+            if (reject)
+                return false;
+            return PseudoBattery::prepare_set_current(current_mA, startTime, endTime, requester, sequenceNumber);
+        }
+};
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool closeEnough(double lhs, double rhs) {
+    return std::fabs(lhs - rhs) <= 1e-6;
+}
+
+bool runPhaseChecks(const BatteryStatus &status) {
+    bool passed = true;
+
+    auto makeParent = [&](const std::string &name, double rejectProbability) {
+        std::shared_ptr<Battery> battery = std::make_shared<FlakyBattery>(name, 1, rejectProbability, 0ms);
+        battery->setBatteryStatus(status);
+        return battery;
+    };
+
+    std::shared_ptr<Battery> shared   = makeParent("shared", 0);
+    std::shared_ptr<Battery> left     = makeParent("left", 0);
+    std::shared_ptr<Battery> right    = makeParent("right", 0);
+    std::shared_ptr<Battery> rejecter = makeParent("rejecter", 1);
+
+    std::shared_ptr<Battery> leftPath  = std::make_shared<AggregateBattery>("left_path", std::vector<std::shared_ptr<Battery>>{shared, left});
+    std::shared_ptr<Battery> rightPath = std::make_shared<AggregateBattery>("right_path", std::vector<std::shared_ptr<Battery>>{shared, right});
+    std::shared_ptr<Battery> failPath  = std::make_shared<AggregateBattery>("fail_path", std::vector<std::shared_ptr<Battery>>{shared, rejecter});
+    std::shared_ptr<Battery> root      = std::make_shared<AggregateBattery>("diamond", std::vector<std::shared_ptr<Battery>>{leftPath, rightPath});
+    std::shared_ptr<Battery> failRoot  = std::make_shared<AggregateBattery>("diamond_fail", std::vector<std::shared_ptr<Battery>>{leftPath, failPath});
+
+    timepoint_t start = getTimeNow() + 10min;
+
+    // every parent has the same status, so each path gets half of the
+    // request and each of its parents half of that
+    uint64_t sequenceNumber = getSequenceNumber();
+    bool prepared = leftPath->prepare_set_current(1000, start, start + 30s, leftPath->getBatteryID(), sequenceNumber);
+    bool held = shared->getScheduledCurrent(start + 15s) == 0 && left->getScheduledCurrent(start + 15s) == 0;
+    bool aborted = leftPath->abort_set_current(sequenceNumber);
+    bool committed = leftPath->commit_set_current(sequenceNumber);
+    passed &= check("prepare and abort", prepared && held && aborted && !committed &&
+                                         shared->getScheduledCurrent(start + 15s) == 0 && left->getScheduledCurrent(start + 15s) == 0);
+
+    sequenceNumber = getSequenceNumber();
+    prepared = leftPath->prepare_set_current(1000, start, start + 30s, leftPath->getBatteryID(), sequenceNumber);
+    held = shared->getScheduledCurrent(start + 15s) == 0;
+    committed = leftPath->commit_set_current(sequenceNumber);
+    passed &= check("prepare and commit", prepared && held && committed && closeEnough(shared->getScheduledCurrent(start + 15s), 500) &&
+                                          closeEnough(left->getScheduledCurrent(start + 15s), 500));
+
+    timepoint_t diamondStart = start + 1min;
+    bool scheduled = root->schedule_set_current(1000, diamondStart, diamondStart + 30s);
+    passed &= check("diamond", scheduled && closeEnough(shared->getScheduledCurrent(diamondStart + 15s), 500) &&
+                               closeEnough(left->getScheduledCurrent(diamondStart + 15s), 250) &&
+                               closeEnough(right->getScheduledCurrent(diamondStart + 15s), 250));
+
+    // the failed request overlaps the diamond request on the shared parent
+    scheduled = failRoot->schedule_set_current(1000, diamondStart, diamondStart + 30s);
+    passed &= check("diamond rollback", !scheduled && closeEnough(shared->getScheduledCurrent(diamondStart + 15s), 500) &&
+                                        closeEnough(left->getScheduledCurrent(diamondStart + 15s), 250) &&
+                                        rejecter->getScheduledCurrent(diamondStart + 15s) == 0);
+
+    for (std::shared_ptr<Battery> battery : {failRoot, root, failPath, rightPath, leftPath, rejecter, right, left, shared})
+        battery->quit();
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    int numParents           = argc > 1 ? atoi(argv[1]) : 8;
+    int requests             = argc > 2 ? atoi(argv[2]) : 40;
+    double rejectProbability = argc > 3 ? atof(argv[3]) : 0.1;
+    std::chrono::milliseconds latency(argc > 4 ? atoi(argv[4]) : 50);
+
+    bool passed;
+    BatteryDirectory d;
+    {
+        BatteryStatus status;
+        status.voltage_mV = 5;
+        status.current_mA = 0;
+        status.capacity_mAh = 5000;
+        status.max_capacity_mAh = 10000;
+        status.max_charging_current_mA = 3000;
+        status.max_discharging_current_mA = 3000;
+        status.time = convertToMilliseconds(getTimeNow());
+
+        std::vector<std::shared_ptr<Battery>> parents;
+        for (int i = 0; i < numParents; i++) {
+            std::shared_ptr<Battery> battery = std::make_shared<FlakyBattery>("flaky" + std::to_string(i), i + 1, rejectProbability, latency);
+            battery->setBatteryStatus(status);
+            d.addBattery(battery);
+            parents.push_back(battery);
+        }
+
+        std::shared_ptr<Battery> aggregate = std::make_shared<AggregateBattery>("fanout", parents);
+        d.addBattery(aggregate);
+        for (std::shared_ptr<Battery> &parent : parents)
+            d.addEdge(parent->getBatteryName(), "fanout");
+
+        int accepted = 0;
+        int partial  = 0;
+        double totalTime = 0;
+        timepoint_t base = getTimeNow() + 10min;
+
+        for (int r = 0; r < requests; r++) {
+            timepoint_t startTime = base + r * 1min;
+            timepoint_t endTime   = startTime + 30s;
+
+            Clock::time_point begin = Clock::now();
+            bool success = aggregate->schedule_set_current(1000, startTime, endTime);
+            totalTime += std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+            int scheduled = 0;
+            double scheduled_mA = 0;
+            for (std::shared_ptr<Battery> &parent : parents) {
+                double current_mA = parent->getScheduledCurrent(startTime + 15s);
+                if (current_mA != 0)
+                    scheduled++;
+                scheduled_mA += current_mA;
+            }
+
+            if (success) {
+                accepted++;
+                if (scheduled != numParents || std::fabs(scheduled_mA - 1000) > 1e-6)
+                    partial++;
+            } else if (scheduled != 0) {
+                partial++;
+            }
+        }
+
+        PRINT() << accepted << " of " << requests << " requests accepted, " << requests - accepted << " rolled back" << std::endl;
+        PRINT() << "average request latency: " << totalTime / requests << "ms (one parent at a time: "
+                << (numParents * latency).count() << "ms)" << std::endl;
+
+        if (partial == 0)
+            PRINT() << "PASS: every request was scheduled on all of the parents or none of them" << std::endl;
+        else
+            PRINT() << "FAIL: " << partial << " requests were left partially scheduled" << std::endl;
+        passed = partial == 0;
+
+        d.destroyDirectory();
+        passed &= runPhaseChecks(status);
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "BatteryConnection.hpp"
+#include "protobuf/battery.pb.h"
+#include "util.hpp"
+
+/**
+ * Framing benchmark
+ *
+ * Sends numMessages Get_Status commands and BatteryStatus messages
+ * through a pair of BatteryConnections over a socketpair and counts
+ * the heap allocations made while doing so (every operator new in
+ * the process is counted). After the connection buffers have grown to
+ * fit the messages no allocations should be made. The original framing
+ * (two writes and a new[] per message) is run for comparison.
+ *
+ * usage: ./framing [numMessages]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<uint64_t> numAllocations(0);
+
+void* operator new(size_t size) {
+    numAllocations++;
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    ::operator delete(pointer);
+}
+
+/**
+ * copy of the original BatteryConnection::write/read kept for comparison
+ */
+void legacyWrite(Stream& stream, const google::protobuf::MessageLite& message) {
+    uint32_t message_len = htonl(message.ByteSizeLong());
+    stream.write_exact((char*)&message_len, 4);
+
+    uint32_t num_bytes = message.ByteSizeLong();
+    char* buffer = new char[num_bytes];
+    message.SerializeToArray(buffer, num_bytes);
+    stream.write_exact(buffer, num_bytes);
+    delete[] buffer;
+}
+
+int legacyRead(Stream& stream, google::protobuf::MessageLite& message) {
+    char message_len_buf[4] = {0};
+    while (stream.read_exact(message_len_buf, 4) == (size_t)-1) {}
+    uint32_t message_len = ntohl(*(uint32_t*)message_len_buf);
+
+    char* buffer = new char[message_len];
+    stream.read_exact(buffer, message_len);
+    int r = message.ParseFromArray(buffer, message_len);
+    delete[] buffer;
+    return r;
+}
+
+struct Result {
+    uint64_t allocations;
+    double elapsed_us;
+};
+
+template <typename Send, typename Receive>
+Result roundTrips(int numMessages, Send send, Receive receive) {
+    bosproto::BatteryCommand command;
+    command.set_command(bosproto::Command::Get_Status);
+
+    bosproto::BatteryStatus status;
+    status.set_voltage_mv(5000);
+    status.set_current_ma(-1200);
+    status.set_capacity_mah(7500);
+    status.set_max_capacity_mah(7500);
+    status.set_max_charging_current_ma(3600);
+    status.set_max_discharging_current_ma(3600);
+
+    bosproto::BatteryCommand receivedCommand;
+    bosproto::BatteryStatus receivedStatus;
+
+    // warm up with the largest message so the connection buffers reach
+    // their steady state size
+    status.set_timestamp(numMessages);
+    send(command);
+    receive(receivedCommand);
+    send(status);
+    receive(receivedStatus);
+
+    uint64_t before = numAllocations;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < numMessages; i++) {
+        status.set_timestamp(i);
+        send(command);
+        if (!receive(receivedCommand) || receivedCommand.command() != bosproto::Command::Get_Status)
+            ERROR() << "command " << i << " was not received" << std::endl;
+        send(status);
+        if (!receive(receivedStatus) || receivedStatus.timestamp() != (uint64_t)i)
+            ERROR() << "status " << i << " was not received" << std::endl;
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    return {numAllocations - before, elapsed};
+}
+
+int main(int argc, char** argv) {
+    int numMessages = argc > 1 ? atoi(argv[1]) : 100000;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        ERROR() << "could not create socketpair" << std::endl;
+
+    BatteryConnection sender(std::make_unique<Socket>(fds[0]));
+    BatteryConnection receiver(std::make_unique<Socket>(fds[1]));
+
+    Result current = roundTrips(numMessages,
+        [&](const google::protobuf::MessageLite& message) { sender.write(message); },
+        [&](google::protobuf::MessageLite& message) { return receiver.read(message); });
+
+    Result legacy = roundTrips(numMessages,
+        [&](const google::protobuf::MessageLite& message) { legacyWrite(*sender.stream, message); },
+        [&](google::protobuf::MessageLite& message) { return legacyRead(*receiver.stream, message); });
+
+    close(fds[0]);
+    close(fds[1]);
+
+    int numSent = 2 * numMessages;
+    std::cout << "BatteryConnection: " << current.allocations << " allocations for " << numSent << " messages, "
+              << current.elapsed_us / numSent << " us per message" << std::endl;
+    std::cout << "original framing:  " << legacy.allocations << " allocations for " << numSent << " messages, "
+              << legacy.elapsed_us / numSent << " us per message" << std::endl;
+
+    if (current.allocations != 0) {
+        std::cout << "FAILED: BatteryConnection allocated in steady state" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
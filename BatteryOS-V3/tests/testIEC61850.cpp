@@ -0,0 +1,289 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "iec61850.hpp"
+#include "iec61850_server.h"
+#include "iec61850_dynamic_model.h"
+#include "iec61850_cdc.h"
+
+/**
+ * IEC61850 driver test
+ *
+ * Starts a local IEC61850 server (over TLS, with the certificates in
+ * ../certs) whose logical device holds ZBAT, ZBTC and ZINV logical nodes,
+ * a status dataset with ZBAT Vol, Amp, AhrRtg and MaxBatA and an
+ * unbuffered report control block sending the dataset. Then checks that
+ * an IEC61850 battery reading attributes one by one, one reading the
+ * dataset and one subscribed to the reports all return the status of the
+ * server, that a change on the server reaches the subscribed battery
+ * without a refresh asking for it, and that set_current() writes ZBTC and
+ * ZINV. The refresh latency of the three batteries is compared. A battery
+ * given a report control block the server does not have polls the dataset
+ * instead, and batteries subscribed to a second report control block are
+ * created and destroyed while the server keeps sending reports (each one
+ * has to get reports, so the last one disabled the report control block
+ * when it went away).
+ *
+ * The server then holds more logical devices (each with its own ZBAT, ZBTC
+ * and ZINV), and the test checks that the batteries of all of them share a
+ * single connection, that setting the current of every battery at once
+ * (each with a single write request) succeeds for every battery, more of
+ * them than the connection may have requests outstanding, and that its
+ * latency stays close to that of a single battery.
+ *
+ * Run from the tests directory (for ../certs).
+ *
+ * usage: ./iec61850 [refreshes] [port] [logical devices]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+static const char* IED_NAME = "battery";
+
+/**
+ * name of logical device i (IED name + logical device instance)
+ */
+std::string ldName(int i) {
+    return std::string(IED_NAME) + "LD" + std::to_string(i);
+}
+
+/**
+ * IEC61850 server holding the model of a battery in each logical device
+ */
+class BatteryServer {
+    public:
+        IedModel* model;
+        IedServer server;
+        TLSConfiguration config;
+
+    public:
+        BatteryServer(int port, int devices) {
+            this->model = IedModel_create(IED_NAME);
+            for (int i = 0; i < devices; i++)
+                createDevice(("LD" + std::to_string(i)).c_str());
+
+            this->config = TLSConfiguration_create();
+            TLSConfiguration_setChainValidation(this->config, false);
+            TLSConfiguration_setAllowOnlyKnownCertificates(this->config, false);
+            TLSConfiguration_setOwnCertificateFromFile(this->config, "../certs/server.pem");
+            TLSConfiguration_setOwnKeyFromFile(this->config, "../certs/server.key", NULL);
+            TLSConfiguration_addCACertificateFromFile(this->config, "../certs/ca_cert.pem");
+
+            this->server = IedServer_createWithTlsSupport(this->model, this->config);
+            IedServer_setWriteAccessPolicy(this->server, IEC61850_FC_SP, ACCESS_POLICY_ALLOW);
+
+            for (int i = 0; i < devices; i++) {
+                this->set(ldName(i), "ZBAT1.Vol.mag.f", 13200);
+                this->set(ldName(i), "ZBAT1.Amp.mag.f", 0);
+                this->set(ldName(i), "ZBAT1.AhrRtg.setMag.f", 10000);
+                this->set(ldName(i), "ZBAT1.MaxBatA.setMag.f", 5000);
+            }
+
+            IedServer_start(this->server, port);
+            if (!IedServer_isRunning(this->server))
+                ERROR() << "could not start IEC61850 server on port " << port << std::endl;
+        }
+
+        ~BatteryServer() {
+            IedServer_stop(this->server);
+            IedServer_destroy(this->server);
+            IedModel_destroy(this->model);
+            TLSConfiguration_destroy(this->config);
+        }
+
+        DataAttribute* attribute(const std::string &device, const std::string &name) {
+            std::string reference = device + "/" + name;
+            return (DataAttribute*) IedModel_getModelNodeByObjectReference(this->model, reference.c_str());
+        }
+
+        void set(const std::string &device, const std::string &name, float value) {
+            IedServer_lockDataModel(this->server);
+            IedServer_updateFloatAttributeValue(this->server, this->attribute(device, name), value);
+            IedServer_unlockDataModel(this->server);
+        }
+
+        int32_t getInt(const std::string &device, const std::string &name) {
+            IedServer_lockDataModel(this->server);
+            int32_t value = MmsValue_toInt32(IedServer_getAttributeValue(this->server, this->attribute(device, name)));
+            IedServer_unlockDataModel(this->server);
+            return value;
+        }
+
+    private:
+        /**
+         * logical device with ZBAT, ZBTC and ZINV, the status dataset and its report control block
+         */
+        void createDevice(const char* name) {
+            LogicalDevice* device = LogicalDevice_create(name, this->model);
+
+            LogicalNode* lln0 = LogicalNode_create("LLN0", device);
+            LogicalNode* zbat = LogicalNode_create("ZBAT1", device);
+            LogicalNode* zbtc = LogicalNode_create("ZBTC1", device);
+            LogicalNode* zinv = LogicalNode_create("ZINV1", device);
+
+            CDC_MV_create("Vol", (ModelNode*) zbat, 0, false);
+            CDC_MV_create("Amp", (ModelNode*) zbat, 0, false);
+            CDC_ASG_create("AhrRtg", (ModelNode*) zbat, 0, false);
+            CDC_ASG_create("MaxBatA", (ModelNode*) zbat, 0, false);
+            CDC_ING_create("BatChaMod", (ModelNode*) zbtc, 0);
+            CDC_ASG_create("ReChaRte", (ModelNode*) zbtc, 0, true);
+            CDC_ASG_create("InALim", (ModelNode*) zinv, 0, true);
+
+            DataSet* dataSet = DataSet_create("BatteryStatus", lln0);
+            DataSetEntry_create(dataSet, "ZBAT1$MX$Vol$mag$f", -1, NULL);
+            DataSetEntry_create(dataSet, "ZBAT1$MX$Amp$mag$f", -1, NULL);
+            DataSetEntry_create(dataSet, "ZBAT1$SP$AhrRtg$setMag$f", -1, NULL);
+            DataSetEntry_create(dataSet, "ZBAT1$SP$MaxBatA$setMag$f", -1, NULL);
+
+            ReportControlBlock_create("StatusRCB01", lln0, "StatusRCB01", false, "BatteryStatus", 1,
+                                      TRG_OPT_DATA_CHANGED | TRG_OPT_INTEGRITY | TRG_OPT_GI,
+                                      RPT_OPT_SEQ_NUM | RPT_OPT_DATA_SET | RPT_OPT_REASON_FOR_INCLUSION, 0, 0);
+            ReportControlBlock_create("StatusRCB02", lln0, "StatusRCB02", false, "BatteryStatus", 1,
+                                      TRG_OPT_DATA_CHANGED | TRG_OPT_INTEGRITY | TRG_OPT_GI,
+                                      RPT_OPT_SEQ_NUM | RPT_OPT_DATA_SET | RPT_OPT_REASON_FOR_INCLUSION, 0, 0);
+        }
+};
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool matches(const BatteryStatus &status, double voltage_mV) {
+    return status.voltage_mV == voltage_mV && status.current_mA == 0 &&
+           status.max_capacity_mAh == 10000 && status.max_discharging_current_mA == 5000;
+}
+
+/**
+ * waits up to a second for the battery to get a report after the given count
+ */
+bool waitForReport(IEC61850 &battery, uint64_t count = 0) {
+    for (int i = 0; i < 100 && battery.getReportCount() == count; i++)
+        std::this_thread::sleep_for(10ms);
+    return battery.getReportCount() > count;
+}
+
+/**
+ * mean latency of refresh() in microseconds
+ */
+double refreshLatency(IEC61850 &battery, int refreshes) {
+    Clock::time_point begin = Clock::now();
+    for (int i = 0; i < refreshes; i++)
+        battery.refresh();
+    return std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / refreshes;
+}
+
+/**
+ * mean latency in microseconds of setting the current of all batteries at
+ * once (one thread per battery), counting the commands that failed
+ */
+double setCurrentLatency(const std::vector<IEC61850*> &batteries, int commands, std::atomic<int> &failed) {
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (IEC61850* battery : batteries) {
+        threads.emplace_back([battery, commands, &failed] {
+            for (int i = 0; i < commands; i++) {
+                if (!battery->set_current(i % 2 ? 1000 : -5))
+                    failed++;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    return std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / commands;
+}
+
+int main(int argc, char** argv) {
+    int refreshes = argc > 1 ? atoi(argv[1]) : 200;
+    int port      = argc > 2 ? atoi(argv[2]) : 10102;
+    int devices   = std::max(argc > 3 ? atoi(argv[3]) : 8, 1);
+    bool passed   = true;
+
+    BatteryServer server(port, devices);
+    std::string ld0 = ldName(0);
+
+    IEC61850 attributes("attributes", 1s, ld0, "ZBAT1", "ZBTC1", "ZINV1", "localhost", port);
+    IEC61850 dataset("dataset", 1s, ld0, "ZBAT1", "ZBTC1", "ZINV1", "localhost", port, "LLN0.BatteryStatus");
+    IEC61850 reports("reports", 1s, ld0, "ZBAT1", "ZBTC1", "ZINV1", "localhost", port, "LLN0.BatteryStatus", "LLN0.RP.StatusRCB01");
+
+    passed &= check("attribute reads", matches(attributes.refresh(), 13200));
+    passed &= check("dataset read", matches(dataset.refresh(), 13200));
+
+    // the general interrogation fills the cache
+    passed &= check("report", waitForReport(reports) && matches(reports.refresh(), 13200));
+
+    double attributeTime = refreshLatency(attributes, refreshes);
+    double dataSetTime   = refreshLatency(dataset, refreshes);
+    double reportTime    = refreshLatency(reports, refreshes);
+    PRINT() << "refresh latency: " << attributeTime << "us reading attributes, " << dataSetTime << "us reading the dataset, "
+            << reportTime << "us from reports" << std::endl;
+    passed &= check("dataset faster than attributes", dataSetTime < attributeTime);
+
+    uint64_t before = reports.getReportCount();
+    server.set(ld0, "ZBAT1.Vol.mag.f", 13100);
+    waitForReport(reports, before);
+    passed &= check("pushed change", matches(reports.refresh(), 13100) && matches(dataset.refresh(), 13100));
+
+    bool set = reports.set_current(-5);
+    passed &= check("charge", set && server.getInt(ld0, "ZBTC1.ReChaRte.setMag.i") == 5 && server.getInt(ld0, "ZBTC1.BatChaMod.setVal") == 2);
+    set = reports.set_current(1000);
+    passed &= check("discharge", set && server.getInt(ld0, "ZINV1.InALim.setMag.i") == 1000 && server.getInt(ld0, "ZBTC1.BatChaMod.setVal") == 1);
+    passed &= check("reject current", !reports.set_current(-50) && !reports.set_current(0));
+
+    IEC61850 missing("missing", 1s, ld0, "ZBAT1", "ZBTC1", "ZINV1", "localhost", port, "LLN0.BatteryStatus", "LLN0.RP.MissingRCB01");
+    passed &= check("missing report control block", matches(missing.refresh(), 13100) && missing.getReportCount() == 0);
+    missing.quit();
+
+    // the server sends a report on every change while subscribers come and go
+    std::atomic<bool> changing(true);
+    std::thread changer([&server, &ld0, &changing] {
+        for (int i = 0; changing; i++) {
+            server.set(ld0, "ZBAT1.Amp.mag.f", i % 2);
+            std::this_thread::sleep_for(1ms);
+        }
+    });
+    bool subscribed = true;
+    for (int i = 0; i < 20; i++) {
+        IEC61850 subscriber("subscriber", 1s, ld0, "ZBAT1", "ZBTC1", "ZINV1", "localhost", port, "LLN0.BatteryStatus", "LLN0.RP.StatusRCB02");
+        subscribed &= waitForReport(subscriber);
+        subscriber.quit();
+    }
+    changing = false;
+    changer.join();
+    server.set(ld0, "ZBAT1.Amp.mag.f", 0);
+    passed &= check("unsubscribe", subscribed);
+
+    // a battery per logical device, all on the connection of the first three
+    std::vector<std::unique_ptr<IEC61850>> batteries;
+    std::vector<IEC61850*> all;
+    for (int i = 0; i < devices; i++) {
+        batteries.push_back(std::make_unique<IEC61850>("battery" + std::to_string(i), 1s, ldName(i), "ZBAT1", "ZBTC1", "ZINV1",
+                                                       "localhost", port, "LLN0.BatteryStatus"));
+        batteries.back()->refresh();
+        all.push_back(batteries.back().get());
+    }
+    passed &= check("shared connection", IEC61850Connection::getConnectionCount() == 1);
+
+    int commands      = std::max(refreshes / 10, 1);
+    std::atomic<int> failed(0);
+    double singleTime = setCurrentLatency({all.front()}, commands, failed);
+    double allTime    = setCurrentLatency(all, commands, failed);
+
+    bool written = true;
+    for (int i = 0; i < devices; i++) {
+        written &= batteries[i]->set_current(-(i % 9 + 1)) && server.getInt(ldName(i), "ZBTC1.ReChaRte.setMag.i") == i % 9 + 1 &&
+                   server.getInt(ldName(i), "ZBTC1.BatChaMod.setVal") == 2;
+    }
+    PRINT() << "set_current latency: " << singleTime << "us for one battery, " << allTime << "us for " << devices
+            << " batteries at once" << std::endl;
+    passed &= check("logical devices", written);
+    passed &= check("commands at once", failed == 0);
+    passed &= check("flat command latency", devices == 1 || allTime < singleTime * devices / 2);
+
+    batteries.clear();
+    attributes.quit();
+    dataset.quit();
+    reports.quit();
+    return passed ? 0 : 1;
+}
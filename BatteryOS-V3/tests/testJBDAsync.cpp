@@ -0,0 +1,318 @@
+#include <poll.h>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+#include "src/device_drivers/JBDBMS.hpp"
+
+/**
+ * JBD driver test
+ *
+ * Runs the JBD BMS driver against a simulated BMS on a pseudo-terminal.
+ * The simulator answers basic info and cell voltage requests one byte
+ * at a time at the line rate of 9600 baud, so responses arrive split
+ * across many reads. The test measures the refresh latency of the driver
+ * against a copy of the old refresh loop (write, sleep a second, read),
+ * and checks that the driver:
+ *  - returns a fresh status (and cell voltages) on every refresh
+ *  - decodes the temperatures, protection flags and the rest of the extended
+ *    telemetry, and reads the cell voltages once every telemetry interval
+ *  - skips line noise and corrupted frames without returning a wrong status
+ *  - returns the last status when the BMS rejects a request or stays silent
+ *
+ * usage: ./jbd_async [refreshes]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+static const uint16_t VOLTAGE_10mV     = 1320;
+static const int16_t  CURRENT_10mA     = 200;
+static const uint16_t MAX_CAPACITY_10mAh = 10000;
+static const std::vector<uint16_t> CELL_VOLTAGES = {3300, 3301, 3302, 3303};
+static const std::vector<uint16_t> TEMPERATURES  = {2981, 3031}; // about 25 and 30 degrees C
+static const uint16_t CYCLES        = 42;
+static const uint16_t BALANCE_FLAGS = 0x0005;
+static const uint8_t  SOC_PERCENT   = 50;
+static const uint8_t  FET_STATUS    = 0x03;
+
+/**
+ * JBD BMS on the master side of a pseudo-terminal; the driver opens the slave (path)
+ */
+class JBDSimulator {
+    public:
+        int master;
+        int slave;
+        std::string path;
+        std::chrono::microseconds byteTime;
+        std::atomic<bool> quit{false};
+        std::atomic<bool> noise{false};
+        std::atomic<bool> silent{false};
+        std::atomic<bool> reject{false};
+        std::atomic<int> corruptEvery{0};
+        std::atomic<int> responses{0};
+        std::atomic<int> capacity_10mAh{5000};
+        std::atomic<int> cellRequests{0};
+        std::atomic<uint16_t> protectionFlags{0};
+        std::thread thread;
+
+    public:
+        JBDSimulator(std::chrono::microseconds byteTime) : byteTime(byteTime) {
+            this->master = posix_openpt(O_RDWR | O_NOCTTY);
+            if (this->master == -1 || grantpt(this->master) == -1 || unlockpt(this->master) == -1)
+                ERROR() << "could not open pseudo-terminal" << std::endl;
+            this->path = ptsname(this->master);
+
+            // held open so the master does not hang up while the driver has the slave closed
+            this->slave  = open(this->path.c_str(), O_RDWR | O_NOCTTY);
+            this->thread = std::thread(&JBDSimulator::run, this);
+        }
+
+        ~JBDSimulator() {
+            this->quit = true;
+            this->thread.join();
+            close(this->slave);
+            close(this->master);
+        }
+
+    private:
+        static void put16(std::vector<uint8_t> &data, uint16_t value) {
+            data.push_back(value >> 8);
+            data.push_back(value & 0xff);
+        }
+
+        std::vector<uint8_t> response(uint8_t reg) {
+            std::vector<uint8_t> data;
+            if (reg == BMS_REG_BASIC_SYSTEM_INFO) {
+                put16(data, VOLTAGE_10mV);
+                put16(data, (uint16_t) CURRENT_10mA);
+                put16(data, --this->capacity_10mAh);
+                put16(data, MAX_CAPACITY_10mAh);
+                put16(data, CYCLES);
+                put16(data, 0x2a21);         // production date
+                put16(data, BALANCE_FLAGS);
+                put16(data, 0);
+                put16(data, this->protectionFlags);
+                data.push_back(0x10);        // software version
+                data.push_back(SOC_PERCENT);
+                data.push_back(FET_STATUS);
+                data.push_back(CELL_VOLTAGES.size());
+                data.push_back(TEMPERATURES.size());
+                for (uint16_t temperature : TEMPERATURES)
+                    put16(data, temperature);
+            } else {
+                for (uint16_t voltage : CELL_VOLTAGES)
+                    put16(data, voltage);
+            }
+
+            uint8_t status = this->reject ? BMS_ERRORBYTE : 0x00;
+            if (status == BMS_ERRORBYTE)
+                data.clear();
+
+            std::vector<uint8_t> frame = {BMS_STARTBYTE, reg, status, (uint8_t) data.size()};
+            frame.insert(frame.end(), data.begin(), data.end());
+            put16(frame, JBDPort::checksum(frame.data() + 2, data.size() + 2));
+            frame.push_back(BMS_STOPBYTE);
+            return frame;
+        }
+
+        void send(std::vector<uint8_t> frame, std::mt19937 &generator) {
+            int count = ++this->responses;
+            if (this->corruptEvery > 0 && count % this->corruptEvery == 0)
+                frame[frame.size() / 2] ^= 0x5a;
+
+            std::vector<uint8_t> bytes;
+            if (this->noise) {
+                // anything but a start byte, so a frame is never hidden behind a fake length
+                std::uniform_int_distribution<int> value(0, 0xdc);
+                for (int i = 0; i < 5; i++)
+                    bytes.push_back(value(generator));
+            }
+            bytes.insert(bytes.end(), frame.begin(), frame.end());
+
+            for (uint8_t byte : bytes) {
+                std::this_thread::sleep_for(this->byteTime);
+                if (::write(this->master, &byte, 1) != 1)
+                    return;
+            }
+        }
+
+        void run() {
+            std::mt19937 generator(7);
+            std::vector<uint8_t> buffer;
+
+            while (!this->quit) {
+                struct pollfd fd = {this->master, POLLIN, 0};
+                if (::poll(&fd, 1, 20) <= 0)
+                    continue;
+
+                uint8_t bytes[64];
+                ssize_t numBytes = ::read(this->master, bytes, sizeof(bytes));
+                if (numBytes <= 0)
+                    continue;
+                buffer.insert(buffer.end(), bytes, bytes + numBytes);
+
+                // requests are 7 bytes: start, read, register, 0, checksum, stop
+                while (buffer.size() >= sizeof(BMS_REFRESH)) {
+                    if (buffer[0] != BMS_STARTBYTE || buffer[1] != BMS_READBYTE) {
+                        buffer.erase(buffer.begin());
+                        continue;
+                    }
+                    uint8_t reg = buffer[2];
+                    buffer.erase(buffer.begin(), buffer.begin() + sizeof(BMS_REFRESH));
+                    if (reg == BMS_REG_CELL_VOLTAGES)
+                        this->cellRequests++;
+                    if (!this->silent)
+                        this->send(this->response(reg), generator);
+                }
+            }
+        }
+};
+
+/**
+ * copy of the old JBDBMS::refresh loop (returns the remaining capacity, -1 on failure)
+ */
+int legacyRefresh(int fd) {
+    while (true) {
+        serialFlush(fd);
+        for (const uint8_t c: BMS_REFRESH)
+            serialPutchar(fd, (unsigned char)c);
+
+        std::this_thread::sleep_for(1s);
+
+        if (serialDataAvail(fd) > 0)
+            break;
+    }
+    if (serialDataAvail(fd) != BMS_RX_BASIC_INFO_SIZE)
+        return -1;
+
+    std::vector<uint8_t> data;
+    for (int i = 0; i < BMS_RX_BASIC_INFO_SIZE; i++)
+        data.push_back((uint8_t) serialGetchar(fd));
+    return ((data[8] << 8) | data[9]) * 10;
+}
+
+bool isValid(const BatteryStatus &status) {
+    return status.voltage_mV == VOLTAGE_10mV * 10 && status.current_mA == CURRENT_10mA * 10 &&
+           status.max_capacity_mAh == MAX_CAPACITY_10mAh * 10;
+}
+
+bool isValid(const BatteryTelemetry &telemetry) {
+    return telemetry.cycles == CYCLES && telemetry.balanceFlags == BALANCE_FLAGS &&
+           telemetry.stateOfCharge == SOC_PERCENT && telemetry.fetStatus == FET_STATUS &&
+           telemetry.temperatures == TEMPERATURES && telemetry.cellVoltages == CELL_VOLTAGES;
+}
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+double milliseconds(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+int main(int argc, char** argv) {
+    int refreshes = argc > 1 ? atoi(argv[1]) : 20;
+    std::chrono::microseconds byteTime(1042); // 10 bits per byte at 9600 baud
+    bool passed = true;
+
+    double legacyTime = 0;
+    {
+        JBDSimulator simulator(byteTime);
+        int fd = serialOpen(simulator.path.c_str(), 9600);
+        bool fresh = true;
+        for (int i = 0; i < 3; i++) {
+            Clock::time_point begin = Clock::now();
+            fresh &= legacyRefresh(fd) == simulator.capacity_10mAh * 10;
+            legacyTime += milliseconds(Clock::now() - begin) / 3;
+        }
+        serialClose(fd);
+        passed &= check("old refresh loop", fresh);
+    }
+
+    JBDSimulator simulator(byteTime);
+    JBDBMS bms(simulator.path, 9600, 200000, 200000, 300ms, 0ms);
+
+    double refreshTime = 0;
+    bool fresh = true;
+    double lastCapacity = 1e9;
+    for (int i = 0; i < refreshes; i++) {
+        Clock::time_point begin = Clock::now();
+        BatteryStatus status = bms.refresh();
+        refreshTime += milliseconds(Clock::now() - begin) / refreshes;
+
+        fresh &= isValid(status) && status.capacity_mAh == simulator.capacity_10mAh * 10 && status.capacity_mAh < lastCapacity;
+        fresh &= bms.getTelemetry().cellVoltages == CELL_VOLTAGES;
+        lastCapacity = status.capacity_mAh;
+    }
+    PRINT() << "refresh latency: " << refreshTime << "ms (old refresh loop: " << legacyTime << "ms)" << std::endl;
+    passed &= check("fresh status", fresh);
+
+    simulator.protectionFlags = PROTECTION_CHARGE_OVERTEMP | PROTECTION_CELL_OVERVOLTAGE;
+    BatteryStatus hot = bms.refresh();
+    BatteryTelemetry telemetry = bms.getTelemetry();
+    BatteryTelemetry decoded;
+    simulator.protectionFlags = 0;
+
+    uint8_t small[8];
+    std::vector<uint8_t> buffer(JBDBMSTelemetry(&bms, small, sizeof(small)));
+    bool exported = JBDBMSTelemetry(&bms, buffer.data(), buffer.size()) == buffer.size() &&
+                    BatteryTelemetry::decode(std::string(buffer.begin(), buffer.end()), decoded) && decoded == telemetry;
+
+    PRINT() << "telemetry: " << telemetry.cellVoltages.size() << " cells, " << telemetry.temperatures.size()
+            << " sensors, " << buffer.size() << " bytes encoded" << std::endl;
+    passed &= check("telemetry", isValid(telemetry) && telemetry.protectionFlags == hot.protection_flags && exported);
+    passed &= check("status summary", hot.max_temperature_dK == 3031 &&
+                                      hot.protection_flags == (PROTECTION_CHARGE_OVERTEMP | PROTECTION_CELL_OVERVOLTAGE));
+
+    simulator.noise        = true;
+    simulator.corruptEvery = 3;
+    int numFresh = 0;
+    bool valid   = true;
+    for (int i = 0; i < refreshes; i++) {
+        BatteryStatus status = bms.refresh();
+        valid &= isValid(status) && status.capacity_mAh <= lastCapacity;
+        if (status.capacity_mAh < lastCapacity)
+            numFresh++;
+        lastCapacity = status.capacity_mAh;
+    }
+    simulator.noise        = false;
+    simulator.corruptEvery = 0;
+    PRINT() << "noisy line: " << numFresh << " of " << refreshes << " refreshes fresh" << std::endl;
+    passed &= check("noisy line", valid && numFresh >= refreshes / 2);
+
+    // let a late response to a corrupted request drain before the next checks
+    std::this_thread::sleep_for(400ms);
+    bms.refresh();
+
+    simulator.reject = true;
+    Clock::time_point begin = Clock::now();
+    BatteryStatus rejected = bms.refresh();
+    double rejectTime = milliseconds(Clock::now() - begin);
+    simulator.reject = false;
+    passed &= check("rejected request", isValid(rejected) && rejectTime < 300);
+
+    simulator.silent = true;
+    begin = Clock::now();
+    BatteryStatus silent = bms.refresh();
+    double silentTime = milliseconds(Clock::now() - begin);
+    simulator.silent = false;
+    passed &= check("silent BMS", isValid(silent) && silentTime >= 300 && silentTime < 400);
+
+    // a second BMS whose cell voltages are read once a second
+    JBDSimulator slowSimulator(byteTime);
+    JBDBMS slowBms(slowSimulator.path, 9600, 200000, 200000, 300ms, 1s);
+    for (int i = 0; i < 5; i++)
+        slowBms.refresh();
+    int withinInterval = slowSimulator.cellRequests;
+    std::this_thread::sleep_for(1s);
+    slowBms.refresh();
+    int afterInterval = slowSimulator.cellRequests;
+
+    PRINT() << "cell voltage requests: " << withinInterval << " in 5 refreshes, " << afterInterval
+            << " after the telemetry interval" << std::endl;
+    passed &= check("telemetry interval", withinInterval == 1 && afterInterval == 2 &&
+                                          isValid(slowBms.getTelemetry()));
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+#include <fstream>
+#include <unistd.h>
+#include "BOS.hpp"
+
+/**
+ * Journal test
+ *
+ * Journals a topology (two physical batteries, an aggregate of them and
+ * two partitions of the aggregate), their statuses and a large number of
+ * reservations the way BOS journals its commands, and checks that:
+ *  - BOS recovers every battery and every reservation that has not ended
+ *    from the journal (a reservation that started before the restart
+ *    keeps what is left of it, one that ended is dropped), and that it
+ *    does so in well under a second (250ms)
+ *  - a torn record at the end of the journal and a record that fails its
+ *    checksum are dropped and cut off the journal
+ *  - a snapshot drops the reservations that ended and the statuses that
+ *    were replaced, empties the journal, and records that a crash left in
+ *    the journal after the snapshot are not replayed twice
+ *  - BOS recovers the same reservations from the snapshot
+ *  - recovery judges reservations by the clock of the batteries (a
+ *    reservation that has ended by that clock is dropped)
+ *  - a reservation is replayed after the status its battery had when it
+ *    was journaled, before and after a snapshot (a new status only
+ *    replaces the last one if no reservation came in between)
+ *  - a snapshot that failed is retried snapshotEvery records later
+ *
+ * usage: ./journal [reservations]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+timepoint_t at(uint64_t time_ms) {
+    return timepoint_t(std::chrono::milliseconds(time_ms));
+}
+
+off_t fileSize(const std::string &path) {
+    struct stat info;
+    return (stat(path.c_str(), &info) == -1) ? -1 : info.st_size;
+}
+
+bosproto::Admin_Command physical(const std::string &name) {
+    bosproto::Admin_Command command;
+    command.set_command_options(bosproto::Command_Options::Create_Physical);
+    command.mutable_physical_battery()->set_batteryname(name);
+    command.mutable_physical_battery()->set_max_staleness(100000);
+    return command;
+}
+
+bosproto::Admin_Command aggregate(const std::string &name, const std::vector<std::string> &parents) {
+    bosproto::Admin_Command command;
+    command.set_command_options(bosproto::Command_Options::Create_Aggregate);
+    command.mutable_aggregate_battery()->set_batteryname(name);
+    for (const std::string &parent : parents)
+        command.mutable_aggregate_battery()->add_parentnames(parent);
+    return command;
+}
+
+bosproto::Admin_Command partition(const std::string &source, const std::vector<std::string> &names) {
+    bosproto::Admin_Command command;
+    command.set_command_options(bosproto::Command_Options::Create_Partition);
+    bosproto::Partition_Battery* params = command.mutable_partition_battery();
+    params->set_sourcename(source);
+    params->set_policy(bosproto::Policy::PROPORTIONAL);
+    for (const std::string &name : names) {
+        params->add_names(name);
+        bosproto::Scale* scale = params->add_scales();
+        scale->set_charge_proportion(1.0 / names.size());
+        scale->set_capacity_proportion(1.0 / names.size());
+    }
+    return command;
+}
+
+bosproto::BatteryCommand status(double capacity_mAh) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = capacity_mAh;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+    status.time = now_ms();
+
+    bosproto::BatteryCommand command;
+    command.set_command(bosproto::Command::Set_Status);
+    status.toProto(*command.mutable_status());
+    return command;
+}
+
+bosproto::BatteryCommand reservation(double current_mA, uint64_t startTime, uint64_t endTime) {
+    bosproto::BatteryCommand command;
+    command.set_command(bosproto::Command::Schedule_Set_Current);
+    command.mutable_schedule_set_current()->set_current_ma(current_mA);
+    command.mutable_schedule_set_current()->set_starttime(startTime);
+    command.mutable_schedule_set_current()->set_endtime(endTime);
+    return command;
+}
+
+/**
+ * times a recovery of BOS from the journal at path and checks the batteries and reservations it recovered
+ */
+bool recover(const std::string &path, size_t numExpected, int numReservations, uint64_t base, uint64_t partitionStart, uint64_t ongoingEnd) {
+    BOS bos;
+    Clock::time_point begin = Clock::now();
+    bos.setJournal(path, 0);
+    size_t numRecovered = bos.recover();
+    double time_ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    PRINT() << "  recovered " << numRecovered << " commands in " << time_ms << "ms" << std::endl;
+
+    bool passed = check("  recovery time", numRecovered == numExpected && time_ms < 250);
+
+    std::shared_ptr<Battery> a = bos.getBattery("A");
+    std::shared_ptr<Battery> b = bos.getBattery("B");
+    std::shared_ptr<Battery> p1 = bos.getBattery("P1");
+    passed &= check("  topology", a && b && bos.getBattery("AB") && p1 && bos.getBattery("P2"));
+    if (!a || !b || !p1)
+        return false;
+
+    bool reservations = true;
+    for (int i = 0; i < numReservations; i += 997)
+        reservations &= a->getScheduledCurrent(at(base + 10 * i + 1)) == 1 + i % 100;
+    reservations &= a->getScheduledCurrent(at(base + 10 * (numReservations - 1) + 6)) == 0;
+    passed &= check("  reservations", reservations);
+
+    // the partition forwards its reservation to the aggregate, which splits it between A and B
+    uint64_t time = partitionStart + 1;
+    passed &= check("  forwarded reservation", p1->getScheduledCurrent(at(time)) == 500 &&
+                                                 std::abs(a->getScheduledCurrent(at(time)) + b->getScheduledCurrent(at(time)) - 500) < 1e-6);
+    passed &= check("  ongoing reservation", b->getScheduledCurrent(at(now_ms() + 100)) == 200 &&
+                                               b->getScheduledCurrent(at(ongoingEnd + 1)) == 0);
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    int numReservations = argc > 1 ? atoi(argv[1]) : 100000;
+    bool passed = true;
+
+    char directoryTemplate[] = "journalXXXXXX";
+    if (mkdtemp(directoryTemplate) == NULL)
+        ERROR() << "could not create journal directory" << std::endl;
+    std::string directory = directoryTemplate;
+    std::string path = directory + "/bos.journal";
+
+    uint64_t now            = now_ms();
+    uint64_t base           = now + 3600000;
+    uint64_t partitionStart = now + 1800000;
+    uint64_t ongoingEnd     = now + 600000;
+    size_t numRecords       = 0;
+
+    {
+        Journal journal(path, 0);
+        Clock::time_point begin = Clock::now();
+
+        journal.appendAdminCommand(physical("A"));
+        journal.appendAdminCommand(physical("B"));
+        journal.appendBatteryCommand("A", status(1000));
+        journal.appendBatteryCommand("B", status(1000));
+        journal.appendBatteryCommand("A", status(5000)); // replaces the first status of A
+        journal.appendAdminCommand(aggregate("AB", {"A", "B"}));
+        journal.appendAdminCommand(partition("AB", {"P1", "P2"}));
+        journal.appendBatteryCommand("B", reservation(300, now - 2000, now - 1000));   // ended before the restart
+        journal.appendBatteryCommand("B", reservation(200, now - 1000, ongoingEnd));   // started before the restart
+        journal.appendBatteryCommand("P1", reservation(500, partitionStart, partitionStart + 60000));
+        for (int i = 0; i < numReservations; i++)
+            journal.appendBatteryCommand("A", reservation(1 + i % 100, base + 10 * i, base + 10 * i + 5));
+
+        double time_ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+        numRecords = journal.getNumLiveRecords();
+        PRINT() << "journaled " << journal.getNumRecords() << " commands in " << time_ms << "ms (" << fileSize(path) << " bytes)" << std::endl;
+        passed &= check("journal", journal.getNumRecords() == 10 + (size_t) numReservations && numRecords == journal.getNumRecords() - 1);
+    }
+
+    // everything but the reservation that ended
+    PRINT() << "recovery from the journal" << std::endl;
+    passed &= recover(path, numRecords - 1, numReservations, base, partitionStart, ongoingEnd);
+
+    // a torn record at the end of the journal
+    off_t size = fileSize(path);
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::app);
+        output.write("\x40\x00\x00\x00\x12\x34", 6);
+    }
+    {
+        Journal journal(path, 0);
+        passed &= check("torn record", journal.getNumLiveRecords() == numRecords && fileSize(path) == size);
+        journal.appendBatteryCommand("A", reservation(50, base - 100, base - 50));
+    }
+
+    // a record that fails its checksum
+    off_t lastSize = fileSize(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(lastSize - 1);
+        file.put('\xff');
+    }
+    {
+        Journal journal(path, 0);
+        passed &= check("corrupt record", journal.getNumLiveRecords() == numRecords && fileSize(path) == size);
+    }
+
+    // snapshot, then a crash before the journal was emptied
+    std::string contents;
+    {
+        std::ifstream input(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    {
+        Journal journal(path, 0);
+        Clock::time_point begin = Clock::now();
+        bool success = journal.snapshot();
+        double time_ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+        PRINT() << "snapshot in " << time_ms << "ms (" << fileSize(path + ".snapshot") << " bytes)" << std::endl;
+        passed &= check("snapshot", success && fileSize(path) == 0 && journal.getNumLiveRecords() == numRecords - 1);
+    }
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output << contents;
+    }
+    {
+        Journal journal(path, 0);
+        passed &= check("records in snapshot", journal.getNumLiveRecords() == numRecords - 1);
+        journal.appendBatteryCommand("B", status(4000)); // comes after the ongoing reservation of B, so both statuses are kept
+        passed &= check("status after snapshot", journal.getNumLiveRecords() == numRecords && journal.snapshot());
+    }
+
+    PRINT() << "recovery from the snapshot" << std::endl;
+    passed &= recover(path, numRecords, numReservations, base, partitionStart, ongoingEnd);
+
+    // reservations are replayed against the clock of the batteries: ten minutes after the ongoing reservation of B ended
+    setClock(std::make_shared<ManualClock>(at(ongoingEnd + 600000)));
+    {
+        BOS bos;
+        bos.setJournal(path, 0);
+        bos.recover();
+        std::shared_ptr<Battery> b  = bos.getBattery("B");
+        std::shared_ptr<Battery> p1 = bos.getBattery("P1");
+        passed &= check("recovery clock", b && p1 && b->getScheduledCurrent(at(ongoingEnd - 1)) == 0 &&
+                                          p1->getScheduledCurrent(at(partitionStart + 1)) == 500);
+    }
+    setClock(std::make_shared<SystemClock>());
+
+    // capacity of each status and -1 for each reservation, in replay order
+    std::string statusPath = directory + "/status.journal";
+    auto replayed = [](Journal &journal) {
+        std::vector<double> order;
+        journal.replay([&](const bosproto::Journal_Record &record) {
+            bool isStatus = record.battery_command().command() == bosproto::Command::Set_Status;
+            order.push_back(isStatus ? record.battery_command().status().capacity_mah() : -1);
+            return true;
+        });
+        return order;
+    };
+    {
+        Journal journal(statusPath, 0);
+        journal.appendBatteryCommand("C", status(1000));
+        journal.appendBatteryCommand("C", status(9000)); // replaces the status before it
+        journal.appendBatteryCommand("C", reservation(-3000, base, base + 3600000));
+        journal.appendBatteryCommand("C", status(2000));
+        journal.appendBatteryCommand("C", status(1500)); // replaces the status before it
+        passed &= check("status of a reservation", replayed(journal) == std::vector<double>{9000, -1, 1500});
+
+        journal.appendBatteryCommand("C", reservation(500, now - 2000, now - 1000)); // ended, so status 1500 is replaced after the snapshot
+        journal.snapshot();
+        journal.appendBatteryCommand("C", status(500));
+    }
+    {
+        Journal journal(statusPath, 0);
+        passed &= check("status of a reservation after a snapshot", replayed(journal) == std::vector<double>{9000, -1, 500});
+    }
+
+    unlink(statusPath.c_str());
+    unlink((statusPath + ".snapshot").c_str());
+
+    // a directory in place of the temporary snapshot fails the first snapshot
+    std::string failPath = directory + "/fail.journal";
+    mkdir((failPath + ".snapshot.tmp").c_str(), 0755);
+    {
+        Journal journal(failPath, 4);
+        std::vector<size_t> numRecordsAfter;
+        for (int i = 0; i < 8; i++) {
+            journal.appendBatteryCommand("C", status(1000 + i));
+            numRecordsAfter.push_back(journal.getNumRecords());
+            if (i == 3)
+                rmdir((failPath + ".snapshot.tmp").c_str());
+        }
+        passed &= check("failed snapshot", numRecordsAfter == std::vector<size_t>{1, 2, 3, 4, 5, 6, 7, 0});
+    }
+    unlink(failPath.c_str());
+    unlink((failPath + ".snapshot").c_str());
+
+    unlink(path.c_str());
+    unlink((path + ".snapshot").c_str());
+    rmdir(directory.c_str());
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <thread>
+#include <algorithm>
+#include "Admin.hpp"
+#include "ClientBattery.hpp"
+
+/**
+ * Load generator
+ *
+ * Opens numConnections ClientBattery connections to a running BOS
+ * (see socket.cpp) spread across numBatteries physical batteries and
+ * measures Get_Status latency while numThreads threads keep every
+ * connection busy. The admin socket is expected on port 65432 and the
+ * battery socket on port 65431.
+ *
+ * usage: ./load [numConnections] [numThreads] [requestsPerConnection] [numBatteries]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    int numConnections        = argc > 1 ? atoi(argv[1]) : 1000;
+    int numThreads            = argc > 2 ? atoi(argv[2]) : 8;
+    int requestsPerConnection = argc > 3 ? atoi(argv[3]) : 20;
+    int numBatteries          = argc > 4 ? atoi(argv[4]) : 10;
+
+    Admin admin(65432);
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 7500;
+    status.max_capacity_mAh = 7500;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+
+    for (int i = 0; i < numBatteries; i++) {
+        std::string name = "load" + std::to_string(i);
+        if (!admin.createPhysicalBattery(name, std::chrono::seconds(100)))
+            ERROR() << "could not create " << name << " battery!" << std::endl;
+
+        ClientBattery battery(65431, name);
+        if (!battery.setBatteryStatus(status))
+            ERROR() << "could not set " << name << " battery status" << std::endl;
+    }
+
+    std::vector<std::unique_ptr<ClientBattery>> clients;
+    for (int i = 0; i < numConnections; i++)
+        clients.push_back(std::make_unique<ClientBattery>(65431, "load" + std::to_string(i % numBatteries)));
+
+    LOG() << "opened " << numConnections << " connections" << std::endl;
+
+    std::vector<std::vector<int64_t>> latencies(numThreads);
+    std::vector<std::thread> threads;
+
+    Clock::time_point start = Clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t] {
+            for (int k = 0; k < requestsPerConnection; k++) {
+                for (int i = t; i < numConnections; i += numThreads) {
+                    Clock::time_point begin = Clock::now();
+                    clients[i]->getStatus();
+                    latencies[t].push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count());
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<int64_t> samples;
+    for (const auto &latency : latencies)
+        samples.insert(samples.end(), latency.begin(), latency.end());
+    std::sort(samples.begin(), samples.end());
+
+    PRINT() << samples.size() << " Get_Status requests over " << numConnections << " connections in " << elapsed << "s ("
+            << samples.size() / elapsed << " req/s)" << std::endl;
+    PRINT() << "latency (us): p50 = " << samples[samples.size() / 2]
+            << ", p99 = " << samples[samples.size() * 99 / 100]
+            << ", max = " << samples.back() << std::endl;
+
+    admin.shutdown();
+    return 0;
+}
@@ -0,0 +1,336 @@
+#include <random>
+#include "PhysicalBattery.hpp"
+#include "PartitionBattery.hpp"
+#include "PartitionManager.hpp"
+
+/**
+ * Partition policy test
+ *
+ * Checks the shares the partition policies give the children of a
+ * partition:
+ *  - proportional: the limits and max capacity of a child follow the
+ *    source, the capacity of the source is split by the capacity the
+ *    children have left (and by the proportions once they have none)
+ *  - tranched: the first child gets what the source has on top of the
+ *    children and surplus capacity fills the children from the first on
+ *  - reserved: the same for the last child and from the last child on
+ *  - in both, a shortfall is taken from the last children first
+ *  - a partition manager hands the shares to its partitions
+ * Random partitions of 300 children are then checked against a child by
+ * child evaluation of the policies, and the cost of a refresh of a
+ * partition of numChildren children (500 by default) is printed for the
+ * engine and for the child by child evaluation (best of 10 rounds).
+ *
+ * usage: ./partition_policy [numChildren]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool near(double value, double expected) {
+    return std::fabs(value - expected) < 1e-6;
+}
+
+bool near(const std::vector<double> &values, const std::vector<double> &expected) {
+    if (values.size() != expected.size())
+        return false;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (std::fabs(values[i] - expected[i]) > 1e-6 * std::max(1.0, std::fabs(expected[i])))
+            return false;
+    }
+    return true;
+}
+
+BatteryStatus makeStatus(double capacity_mAh, double max_capacity_mAh, double max_current_mA) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = capacity_mAh;
+    status.max_capacity_mAh = max_capacity_mAh;
+    status.max_charging_current_mA = max_current_mA;
+    status.max_discharging_current_mA = max_current_mA;
+    return status;
+}
+
+/**
+ * child by child evaluation of the policies (one status per child, in the style of the BALSplitter of BOS v2),
+ * into children so a caller can reuse them across evaluations
+ */
+void evaluate(PolicyType policyType, const std::vector<Scale> &proportions, const BatteryStatus &initial,
+              const BatteryStatus &source, const std::vector<double> &capacities, std::vector<BatteryStatus> &children)
+{
+    size_t n = proportions.size();
+    children.resize(n);
+
+    if (policyType == PolicyType::PROPORTIONAL) {
+        double total = 0;
+        for (double capacity : capacities)
+            total += capacity;
+        for (size_t i = 0; i < n; i++) {
+            children[i].max_capacity_mAh = source.max_capacity_mAh * proportions[i].capacity_proportion;
+            children[i].max_charging_current_mA = source.max_charging_current_mA * proportions[i].charge_proportion;
+            children[i].max_discharging_current_mA = source.max_discharging_current_mA * proportions[i].charge_proportion;
+            if (std::fabs(total) < 1e-6)
+                children[i].capacity_mAh = source.capacity_mAh * proportions[i].capacity_proportion;
+            else
+                children[i].capacity_mAh = capacities[i] / total * source.capacity_mAh;
+            children[i].capacity_mAh = std::min(std::max(children[i].capacity_mAh, 0.0), children[i].max_capacity_mAh);
+        }
+        return;
+    }
+
+    size_t beneficiary = (policyType == PolicyType::RESERVED) ? n - 1 : 0;
+    BatteryStatus remaining = source;
+    for (size_t i = 0; i < n; i++) {
+        children[i].max_capacity_mAh = initial.max_capacity_mAh * proportions[i].capacity_proportion;
+        children[i].max_charging_current_mA = initial.max_charging_current_mA * proportions[i].charge_proportion;
+        children[i].max_discharging_current_mA = initial.max_discharging_current_mA * proportions[i].charge_proportion;
+        remaining.max_capacity_mAh -= children[i].max_capacity_mAh;
+        remaining.max_charging_current_mA -= children[i].max_charging_current_mA;
+        remaining.max_discharging_current_mA -= children[i].max_discharging_current_mA;
+    }
+
+    for (double BatteryStatus::*field : {&BatteryStatus::max_capacity_mAh, &BatteryStatus::max_charging_current_mA,
+                                         &BatteryStatus::max_discharging_current_mA}) {
+        if (remaining.*field >= 0) {
+            children[beneficiary].*field += remaining.*field;
+            continue;
+        }
+        for (size_t i = n; i-- > 0 && remaining.*field < 0;) {
+            double taken = std::min(-(remaining.*field), std::max(children[i].*field, 0.0));
+            children[i].*field -= taken;
+            remaining.*field += taken;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        children[i].capacity_mAh = std::min(std::max(capacities[i], 0.0), children[i].max_capacity_mAh);
+        remaining.capacity_mAh -= children[i].capacity_mAh;
+    }
+
+    if (remaining.capacity_mAh >= 0) {
+        for (size_t j = 0; j < n && remaining.capacity_mAh > 0; j++) {
+            size_t i = (policyType == PolicyType::RESERVED) ? n - 1 - j : j;
+            double added = std::min(remaining.capacity_mAh, children[i].max_capacity_mAh - children[i].capacity_mAh);
+            children[i].capacity_mAh += added;
+            remaining.capacity_mAh -= added;
+        }
+    } else {
+        for (size_t i = n; i-- > 0 && remaining.capacity_mAh < 0;) {
+            double taken = std::min(-remaining.capacity_mAh, children[i].capacity_mAh);
+            children[i].capacity_mAh -= taken;
+            remaining.capacity_mAh += taken;
+        }
+    }
+}
+
+std::vector<BatteryStatus> evaluate(PolicyType policyType, const std::vector<Scale> &proportions, const BatteryStatus &initial,
+                                    const BatteryStatus &source, const std::vector<double> &capacities)
+{
+    std::vector<BatteryStatus> children;
+    evaluate(policyType, proportions, initial, source, capacities, children);
+    return children;
+}
+
+bool matches(const PartitionShares &shares, const std::vector<BatteryStatus> &children) {
+    for (size_t i = 0; i < children.size(); i++) {
+        if (!near(std::vector<double>({shares.capacity_mAh[i], shares.max_capacity_mAh[i], shares.max_charging_current_mA[i],
+                                       shares.max_discharging_current_mA[i]}),
+                  std::vector<double>({children[i].capacity_mAh, children[i].max_capacity_mAh, children[i].max_charging_current_mA,
+                                       children[i].max_discharging_current_mA})))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * random proportions that add up to 1
+ */
+std::vector<Scale> makeProportions(size_t numChildren, std::mt19937 &generator) {
+    std::uniform_real_distribution<double> weight(0.1, 1);
+    std::vector<double> charge(numChildren), capacity(numChildren);
+    double chargeTotal = 0, capacityTotal = 0;
+    for (size_t i = 0; i < numChildren; i++) {
+        chargeTotal   += (charge[i] = weight(generator));
+        capacityTotal += (capacity[i] = weight(generator));
+    }
+
+    std::vector<Scale> proportions;
+    for (size_t i = 0; i < numChildren; i++)
+        proportions.push_back(Scale(capacity[i] / capacityTotal, charge[i] / chargeTotal));
+    return proportions;
+}
+
+bool runManager() {
+    std::shared_ptr<Battery> source = std::make_shared<PhysicalBattery>("source", 100s);
+    source->setBatteryStatus(makeStatus(6000, 10000, 3000));
+
+    std::vector<std::shared_ptr<PartitionBattery>> partitions;
+    std::vector<std::weak_ptr<VirtualBattery>> children;
+    for (int i = 0; i < 3; i++) {
+        partitions.push_back(std::make_shared<PartitionBattery>("tranche" + std::to_string(i), 100s));
+        children.push_back(partitions.back());
+    }
+    std::vector<Scale> proportions = {Scale(0.5, 0.5), Scale(0.3, 0.3), Scale(0.2, 0.2)};
+
+    std::shared_ptr<PartitionManager> manager = std::make_shared<PartitionManager>("manager", proportions, PolicyType::TRANCHED,
+                                                                                   source, children);
+    for (std::shared_ptr<PartitionBattery> &partition : partitions)
+        partition->setSourceBattery(manager);
+
+    // the source loses charge and max capacity, then the manager refreshes on the next read instead of once a minute
+    source->setBatteryStatus(makeStatus(4000, 9000, 3000));
+    manager->setMaxStaleness(10ms);
+    manager->setRefreshMode(RefreshMode::LAZY);
+    std::this_thread::sleep_for(20ms);
+    manager->getFreshStatus();
+
+    std::vector<double> capacities, maxCapacities;
+    for (std::shared_ptr<PartitionBattery> &partition : partitions) {
+        BatteryStatus status = partition->getFreshStatus();
+        capacities.push_back(status.capacity_mAh);
+        maxCapacities.push_back(status.max_capacity_mAh);
+    }
+    bool passed = check("manager", near(capacities, {3000, 1000, 0}) && near(maxCapacities, {5000, 3000, 1000}) &&
+                                   near(partitions[2]->getMaxDischargingCurrent(), 600));
+
+    for (std::shared_ptr<PartitionBattery> &partition : partitions)
+        partition->quit();
+    manager->quit();
+    source->quit();
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    size_t numChildren = argc > 1 ? atoi(argv[1]) : 500;
+    bool passed = true;
+
+    std::vector<Scale> proportions = {Scale(0.5, 0.5), Scale(0.3, 0.3), Scale(0.2, 0.2)};
+    BatteryStatus initial = makeStatus(5000, 10000, 3600);
+
+    {
+        PartitionPolicy policy(PolicyType::PROPORTIONAL, proportions);
+        policy.reserve(initial);
+        passed &= check("proportional reserve", near(policy.getShares().capacity_mAh, {2500, 1500, 1000}) &&
+                                                near(policy.getShares().max_charging_current_mA, {1800, 1080, 720}));
+
+        policy.setCapacity(0, 1000);
+        policy.setCapacity(1, 1000);
+        policy.setCapacity(2, 0);
+        const PartitionShares &shares = policy.refresh(makeStatus(4000, 8000, 1000));
+        passed &= check("proportional", near(shares.capacity_mAh, {2000, 2000, 0}) && near(shares.max_capacity_mAh, {4000, 2400, 1600}) &&
+                                        near(shares.max_discharging_current_mA, {500, 300, 200}));
+
+        for (size_t i = 0; i < 3; i++)
+            policy.setCapacity(i, 0);
+        passed &= check("proportional reset", near(policy.refresh(makeStatus(1000, 8000, 1000)).capacity_mAh, {500, 300, 200}));
+    }
+
+    {
+        PartitionPolicy policy(PolicyType::TRANCHED, proportions);
+        policy.reserve(initial);
+        const PartitionShares &shares = policy.refresh(makeStatus(5000, 9000, 3000));
+        passed &= check("tranched shortfall", near(shares.max_capacity_mAh, {5000, 3000, 1000}) &&
+                                              near(shares.max_charging_current_mA, {1800, 1080, 120}) &&
+                                              near(shares.capacity_mAh, {2500, 1500, 1000}));
+
+        policy.refresh(makeStatus(5500, 11000, 4000));
+        passed &= check("tranched surplus", near(shares.max_capacity_mAh, {6000, 3000, 2000}) &&
+                                            near(shares.max_discharging_current_mA, {2200, 1080, 720}) &&
+                                            near(shares.capacity_mAh, {3000, 1500, 1000}));
+
+        policy.setCapacity(0, 6000);
+        policy.refresh(makeStatus(9000, 11000, 4000));
+        passed &= check("tranched fill", near(shares.capacity_mAh, {6000, 2000, 1000}));
+
+        policy.refresh(makeStatus(2000, 11000, 4000));
+        passed &= check("tranched drain", near(shares.capacity_mAh, {2000, 0, 0}));
+    }
+
+    {
+        PartitionPolicy policy(PolicyType::RESERVED, proportions);
+        policy.reserve(initial);
+        const PartitionShares &shares = policy.refresh(makeStatus(6000, 12000, 3600));
+        passed &= check("reserved surplus", near(shares.max_capacity_mAh, {5000, 3000, 4000}) && near(shares.capacity_mAh, {2500, 1500, 2000}));
+
+        policy.refresh(makeStatus(3000, 9000, 3600));
+        passed &= check("reserved shortfall", near(shares.max_capacity_mAh, {5000, 3000, 1000}) && near(shares.capacity_mAh, {2500, 500, 0}));
+    }
+
+    passed &= runManager();
+
+    // random partitions against the child by child evaluation
+    {
+        std::mt19937 generator(5);
+        std::uniform_real_distribution<double> fraction(0, 1.2);
+        int mismatches = 0;
+        for (int round = 0; round < 300; round++) {
+            PolicyType policyType = (PolicyType) (round % 3);
+            std::vector<Scale> scales = makeProportions(300, generator);
+            BatteryStatus initialStatus = makeStatus(50000 * fraction(generator), 100000, 20000);
+
+            PartitionPolicy policy(policyType, scales);
+            policy.reserve(initialStatus);
+            for (int step = 0; step < 5; step++) {
+                BatteryStatus source = makeStatus(100000 * fraction(generator), 100000 * fraction(generator), 20000 * fraction(generator));
+                std::vector<double> capacities = policy.getShares().capacity_mAh;
+                for (double &capacity : capacities)
+                    capacity *= fraction(generator);
+                for (size_t i = 0; i < capacities.size(); i++)
+                    policy.setCapacity(i, capacities[i]);
+
+                if (!matches(policy.refresh(source), evaluate(policyType, scales, initialStatus, source, capacities)))
+                    mismatches++;
+            }
+        }
+        passed &= check("random", mismatches == 0);
+    }
+
+    // cost of a refresh of a large partition: both sides get the capacities of the
+    // children and write the shares into storage they keep, and the best of a few
+    // rounds is kept so a descheduled round does not count
+    {
+        const int rounds    = 10;
+        const int refreshes = 2000;
+        std::mt19937 generator(3);
+        std::vector<Scale> scales = makeProportions(numChildren, generator);
+        BatteryStatus source = makeStatus(40000, 90000, 20000);
+
+        for (PolicyType policyType : {PolicyType::PROPORTIONAL, PolicyType::TRANCHED, PolicyType::RESERVED}) {
+            PartitionPolicy policy(policyType, scales);
+            policy.reserve(initial);
+            std::vector<double> capacities = policy.getShares().capacity_mAh;
+            std::vector<BatteryStatus> children;
+
+            double engineTime = 1e300, childTime = 1e300;
+            double engineChecksum = 0, childChecksum = 0;
+            for (int round = 0; round < rounds; round++) {
+                Clock::time_point begin = Clock::now();
+                for (int i = 0; i < refreshes; i++) {
+                    policy.setCapacities(capacities);
+                    source.capacity_mAh = 40000 + i % 100;
+                    engineChecksum += policy.refresh(source).capacity_mAh.back();
+                }
+                engineTime = std::min(engineTime, std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / refreshes);
+
+                begin = Clock::now();
+                for (int i = 0; i < refreshes; i++) {
+                    source.capacity_mAh = 40000 + i % 100;
+                    evaluate(policyType, scales, initial, source, capacities, children);
+                    childChecksum += children.back().capacity_mAh;
+                }
+                childTime = std::min(childTime, std::chrono::duration<double, std::micro>(Clock::now() - begin).count() / refreshes);
+            }
+
+            PRINT() << "policy " << (int) policyType << ", " << numChildren << " children: " << engineTime << "us per refresh ("
+                    << childTime << "us child by child, checksums " << engineChecksum << " / " << childChecksum << ")" << std::endl;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
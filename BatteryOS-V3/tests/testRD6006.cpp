@@ -0,0 +1,277 @@
+#include <poll.h>
+#include <fcntl.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "src/device_drivers/RD6006.hpp"
+
+/**
+ * RD6006 driver test
+ *
+ * Runs the native Modbus RTU driver of the RD6006 power supply against an
+ * emulated supply on a pseudo-terminal. The emulator keeps the register
+ * map of an RD6006, answers read, write and write multiple requests at
+ * 115200 baud and checks the CRC of every request. The test checks:
+ *  - the CRC16 of the Modbus check string
+ *  - the driver identifies the supply and reads its status in a single
+ *    transaction
+ *  - set_current() writes the current setpoint and turns the output on
+ *    and off, without writing the output state when it does not change
+ *  - the charge counter of the supply shows up in the capacity
+ *  - a corrupted answer is retried and an exception is reported
+ *  - refreshes of several supplies run in parallel (the Python driver
+ *    serialized every call on the interpreter lock)
+ *
+ * usage: ./rd6006 [refreshes]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * RD6006 on the master side of a pseudo-terminal; the driver opens the slave (path)
+ */
+class RD6006Emulator {
+    public:
+        int master;
+        int slave;
+        std::string path;
+        uint8_t address;
+        std::chrono::microseconds byteTime;
+        std::mutex lock;
+        uint16_t registers[84] = {};
+        std::atomic<bool> quit{false};
+        std::atomic<int> requests{0};
+        std::atomic<int> badRequests{0};
+        std::atomic<int> corruptNext{0};
+        std::thread thread;
+
+    public:
+        RD6006Emulator(uint8_t address, std::chrono::microseconds byteTime) : address(address), byteTime(byteTime) {
+            this->master = posix_openpt(O_RDWR | O_NOCTTY);
+            if (this->master == -1 || grantpt(this->master) == -1 || unlockpt(this->master) == -1)
+                ERROR() << "could not open pseudo-terminal" << std::endl;
+            this->path = ptsname(this->master);
+
+            this->registers[RD6006_REG_MODEL]       = 60062;
+            this->registers[RD6006_REG_SERIAL_HIGH] = 0;
+            this->registers[RD6006_REG_SERIAL_LOW]  = 12345;
+            this->registers[RD6006_REG_FIRMWARE]    = 128;
+            this->registers[RD6006_REG_VOLTAGE_SET] = 1460; // 14.6V charging voltage
+            this->registers[RD6006_REG_VOLTAGE_IN]  = 2400;
+            this->registers[RD6006_REG_VOLTAGE_OUT] = 1320;
+
+            // held open so the master does not hang up while the driver has the slave closed
+            this->slave  = open(this->path.c_str(), O_RDWR | O_NOCTTY);
+            this->thread = std::thread(&RD6006Emulator::run, this);
+        }
+
+        ~RD6006Emulator() {
+            this->quit = true;
+            this->thread.join();
+            close(this->slave);
+            close(this->master);
+        }
+
+        uint16_t get(uint16_t reg) {
+            std::lock_guard<std::mutex> mutexLock(this->lock);
+            return this->registers[reg];
+        }
+
+        void set(uint16_t reg, uint16_t value) {
+            std::lock_guard<std::mutex> mutexLock(this->lock);
+            this->registers[reg] = value;
+        }
+
+    private:
+        /**
+         * output follows the setpoint while the output is on
+         */
+        void update() {
+            bool on = this->registers[RD6006_REG_ENABLE] != 0;
+            this->registers[RD6006_REG_CURRENT_OUT] = on ? this->registers[RD6006_REG_CURRENT_SET] : 0;
+            this->registers[RD6006_REG_POWER_OUT]   = on ? this->registers[RD6006_REG_CURRENT_OUT] * this->registers[RD6006_REG_VOLTAGE_OUT] / 1000 : 0;
+            this->registers[RD6006_REG_CVCC]        = on;
+        }
+
+        std::vector<uint8_t> answer(const std::vector<uint8_t> &request) {
+            std::lock_guard<std::mutex> mutexLock(this->lock);
+            uint8_t function = request[1];
+            uint16_t start   = (request[2] << 8) | request[3];
+            uint16_t value   = (request[4] << 8) | request[5];
+            std::vector<uint8_t> response = {this->address, function};
+
+            if (function == MODBUS_READ_HOLDING_REGISTERS && start + value <= 84) {
+                response.push_back(2 * value);
+                for (uint16_t i = start; i < start + value; i++) {
+                    response.push_back(this->registers[i] >> 8);
+                    response.push_back(this->registers[i] & 0xff);
+                }
+            } else if (function == MODBUS_WRITE_SINGLE_REGISTER && start < 84) {
+                this->registers[start] = value;
+                response.insert(response.end(), request.begin() + 2, request.begin() + 6);
+            } else if (function == MODBUS_WRITE_MULTIPLE_REGISTERS && start + value <= 84) {
+                for (uint16_t i = 0; i < value; i++)
+                    this->registers[start + i] = (request[7 + 2 * i] << 8) | request[8 + 2 * i];
+                response.insert(response.end(), request.begin() + 2, request.begin() + 6);
+            } else {
+                response = {this->address, (uint8_t) (function | MODBUS_EXCEPTION), 0x02}; // illegal data address
+            }
+            this->update();
+
+            uint16_t crc = ModbusRTU::crc16(response.data(), response.size());
+            response.push_back(crc & 0xff);
+            response.push_back(crc >> 8);
+            return response;
+        }
+
+        /**
+         * size of the request at the front of buffer, 0 if it is not complete yet
+         */
+        static size_t requestSize(const std::vector<uint8_t> &buffer) {
+            if (buffer.size() < 2)
+                return 0;
+            size_t size = 8;
+            if (buffer[1] == MODBUS_WRITE_MULTIPLE_REGISTERS)
+                size = buffer.size() >= 7 ? 9 + buffer[6] : 0;
+            return (size != 0 && buffer.size() >= size) ? size : 0;
+        }
+
+        void run() {
+            std::vector<uint8_t> buffer;
+
+            while (!this->quit) {
+                struct pollfd fd = {this->master, POLLIN, 0};
+                if (::poll(&fd, 1, 20) <= 0)
+                    continue;
+
+                uint8_t bytes[256];
+                ssize_t numBytes = ::read(this->master, bytes, sizeof(bytes));
+                if (numBytes <= 0)
+                    continue;
+                buffer.insert(buffer.end(), bytes, bytes + numBytes);
+
+                size_t size;
+                while ((size = requestSize(buffer)) > 0) {
+                    std::vector<uint8_t> request(buffer.begin(), buffer.begin() + size);
+                    buffer.erase(buffer.begin(), buffer.begin() + size);
+                    this->requests++;
+
+                    uint16_t crc = request[size - 2] | (request[size - 1] << 8);
+                    if (request[0] != this->address || crc != ModbusRTU::crc16(request.data(), size - 2)) {
+                        this->badRequests++;
+                        buffer.clear();
+                        continue;
+                    }
+
+                    std::vector<uint8_t> response = this->answer(request);
+                    if (this->corruptNext > 0) {
+                        this->corruptNext--;
+                        response[response.size() / 2] ^= 0x5a;
+                    }
+
+                    std::this_thread::sleep_for(this->byteTime * (request.size() + response.size()));
+                    if (::write(this->master, response.data(), response.size()) != (ssize_t) response.size())
+                        return;
+                }
+            }
+        }
+};
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+double milliseconds(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+int main(int argc, char** argv) {
+    int refreshes = argc > 1 ? atoi(argv[1]) : 20;
+    std::chrono::microseconds byteTime(87); // 10 bits per byte at 115200 baud
+    bool passed = true;
+
+    const uint8_t message[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    passed &= check("crc16", ModbusRTU::crc16(message, sizeof(message)) == 0x4b37);
+
+    RD6006Emulator emulator(1, byteTime);
+    RD6006 supply(emulator.path, 115200, 1, 6000, 2000, 10000);
+    passed &= check("identify", supply.getModel() == 6006 && emulator.get(RD6006_REG_ENABLE) == 0);
+
+    uint64_t before = supply.getTransactions();
+    double refreshTime = 0;
+    BatteryStatus status;
+    for (int i = 0; i < refreshes; i++) {
+        Clock::time_point begin = Clock::now();
+        status = supply.refresh();
+        refreshTime += milliseconds(Clock::now() - begin) / refreshes;
+    }
+    uint64_t perRefresh = (supply.getTransactions() - before) / refreshes;
+    PRINT() << "refresh latency: " << refreshTime << "ms, " << perRefresh << " transaction per refresh" << std::endl;
+    passed &= check("refresh", perRefresh == 1 && status.voltage_mV == 13200 && status.current_mA == 0 &&
+                               status.capacity_mAh == 2000 && status.max_discharging_current_mA == 0);
+
+    before = supply.getTransactions();
+    bool set = supply.set_current(-1500);
+    uint64_t enableTransactions = supply.getTransactions() - before;
+    status = supply.refresh();
+    passed &= check("start charging", set && enableTransactions == 2 && emulator.get(RD6006_REG_CURRENT_SET) == 1500 &&
+                                      emulator.get(RD6006_REG_ENABLE) == 1 && status.current_mA == -1500);
+
+    before = supply.getTransactions();
+    set = supply.set_current(-750);
+    uint64_t changeTransactions = supply.getTransactions() - before;
+    status = supply.refresh();
+    passed &= check("change current", set && changeTransactions == 1 && status.current_mA == -750);
+
+    passed &= check("reject discharge", !supply.set_current(500) && !supply.set_current(-7000) &&
+                                        emulator.get(RD6006_REG_CURRENT_SET) == 750);
+
+    emulator.set(RD6006_REG_BATTERY_AH_LOW, 250);
+    status = supply.refresh();
+    passed &= check("charge counter", status.capacity_mAh == 2250);
+
+    set = supply.set_current(0);
+    status = supply.refresh();
+    passed &= check("stop charging", set && emulator.get(RD6006_REG_ENABLE) == 0 && status.current_mA == 0);
+
+    emulator.corruptNext = 1;
+    before = supply.getTransactions();
+    status = supply.refresh();
+    passed &= check("corrupted answer", supply.getTransactions() - before == 2 && status.voltage_mV == 13200);
+
+    ModbusRTU bus(emulator.path, 115200, 1);
+    std::vector<uint16_t> values;
+    passed &= check("exception", !bus.readRegisters(80, 10, values) && bus.getTransactions() == 1 &&
+                                 bus.writeRegisters(RD6006_REG_VOLTAGE_SET, {1450, 900}) &&
+                                 emulator.get(RD6006_REG_VOLTAGE_SET) == 1450 && emulator.get(RD6006_REG_CURRENT_SET) == 900);
+    passed &= check("no bad requests", emulator.badRequests == 0);
+
+    // four supplies refreshed from four threads at once
+    const int numSupplies = 4;
+    std::vector<std::unique_ptr<RD6006Emulator>> emulators;
+    std::vector<std::unique_ptr<RD6006>> supplies;
+    for (int i = 0; i < numSupplies; i++) {
+        emulators.push_back(std::make_unique<RD6006Emulator>(1, byteTime));
+        supplies.push_back(std::make_unique<RD6006>(emulators.back()->path, 115200, 1, 6000, 2000, 10000));
+    }
+
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numSupplies; i++) {
+        threads.emplace_back([&, i] {
+            for (int j = 0; j < refreshes; j++)
+                supplies[i]->refresh();
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    double parallelTime = milliseconds(Clock::now() - begin) / refreshes;
+
+    PRINT() << numSupplies << " supplies: " << parallelTime << "ms per round of refreshes (one supply: " << refreshTime << "ms)" << std::endl;
+    passed &= check("parallel supplies", parallelTime < refreshTime * numSupplies);
+
+    return passed ? 0 : 1;
+}
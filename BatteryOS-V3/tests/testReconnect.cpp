@@ -0,0 +1,103 @@
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include "Admin.hpp"
+#include "ClientBattery.hpp"
+#include "TLSSocket.hpp"
+
+/**
+ * Reconnect storm benchmark
+ *
+ * Connects numClients ClientBatteries to a running BOS (see socket.cpp)
+ * at the same moment and measures the time from connecting to receiving
+ * the first status, once with full TLS handshakes and once resuming the
+ * session of an earlier connection. A client that opens a TCP connection
+ * and never starts its handshake stays connected during both storms; it
+ * must not hold up the other clients. The admin socket is expected on
+ * port 65432 and the battery socket on port 65431.
+ *
+ * usage: ./reconnect [numClients]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+void storm(int numClients, bool resume) {
+    TLSSocket::SetSessionResumption(resume);
+
+    // receives the session ticket that the storm resumes
+    {
+        ClientBattery battery(65431, "reconnect");
+        battery.getStatus();
+    }
+
+    std::mutex lock;
+    std::condition_variable condition;
+    bool started = false;
+
+    std::vector<int64_t> latencies(numClients);
+    std::vector<std::unique_ptr<ClientBattery>> clients(numClients);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < numClients; i++) {
+        threads.push_back(std::thread([&, i] {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                condition.wait(guard, [&] { return started; });
+            }
+            Clock::time_point begin = Clock::now();
+            clients[i] = std::make_unique<ClientBattery>(65431, "reconnect");
+            clients[i]->getStatus();
+            latencies[i] = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+        }));
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        started = true;
+    }
+    condition.notify_all();
+
+    for (std::thread &thread : threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    PRINT() << (resume ? "resumed handshakes: " : "full handshakes:    ") << numClients << " clients in " << elapsed << " ms, "
+            << "time to first status (us): p50 = " << latencies[numClients / 2]
+            << ", p99 = " << latencies[numClients * 99 / 100]
+            << ", max = " << latencies.back() << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int numClients = argc > 1 ? atoi(argv[1]) : 500;
+
+    Admin admin(65432);
+    if (!admin.createPhysicalBattery("reconnect", std::chrono::seconds(100)))
+        ERROR() << "could not create reconnect battery!" << std::endl;
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 7500;
+    status.max_capacity_mAh = 7500;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+
+    {
+        ClientBattery battery(65431, "reconnect");
+        if (!battery.setBatteryStatus(status))
+            ERROR() << "could not set reconnect battery status" << std::endl;
+    }
+
+    // connects without ever sending a ClientHello
+    int silent = socket(AF_INET, SOCK_STREAM, 0);
+    std::unique_ptr<Socket> silentSocket = Socket::connect(silent, INADDR_ANY, 65431);
+
+    storm(numClients, false);
+    storm(numClients, true);
+
+    close(silent);
+    admin.shutdown();
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <random>
+#include <chrono>
+#include <iostream>
+#include "ReservationMap.hpp"
+
+/**
+ * Reservation benchmark
+ *
+ * Replays the merge cases of testMerge against the ReservationMap (checking
+ * the net current at every second) and then compares inserting, querying
+ * and cancelling numEvents reservations with the ReservationMap and with
+ * the EventSet/EventMap merge that Battery used before.
+ *
+ * usage: ./reservation [numEvents] [numRequesters]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * copy of the original Battery::checkMergeAndInsertEvents (linear scan of
+ * eventMap on every insert) kept for comparison
+ */
+class LegacyEventQueue {
+    public:
+        EventSet eventSet;
+        EventMap eventMap;
+
+    public:
+        void insert(battery_id_t batteryID, double current_mA, timepoint_t startTime, timepoint_t endTime, uint64_t sequenceNumber) {
+            double target_current_mA = current_mA;
+
+            if (eventMap.count(sequenceNumber) == 1) {
+                EventPair pair = eventMap.at(sequenceNumber);
+                eventSet.erase(pair.first);
+                eventSet.erase(pair.second);
+                eventMap.erase(sequenceNumber);
+                target_current_mA += pair.first.current_mA;
+            } else {
+                for (const auto &iter : eventMap) {
+                    EventPair currPair = iter.second;
+                    event_t startEvent = currPair.first;
+                    event_t endEvent   = currPair.second;
+
+                    if (batteryID != startEvent.batteryID) {
+                        continue;
+                    } else if (startTime <= startEvent.eventTime && endTime >= endEvent.eventTime) {
+                        eventSet.insert(event_t(batteryID, EventID::CANCEL_SET_CURRENT_EVENT, 0, startTime, startEvent.sequenceNumber));
+                    } else if (startTime >= startEvent.eventTime && endTime < endEvent.eventTime) {
+                        target_current_mA -= startEvent.current_mA;
+                    } else if (startTime >= startEvent.eventTime && endTime >= endEvent.eventTime) {
+                        eventSet.erase(endEvent);
+                        event_t newEvent = event_t(batteryID, EventID::SET_CURRENT_END, endEvent.current_mA, startTime, endEvent.sequenceNumber);
+                        eventSet.insert(newEvent);
+                        eventMap.at(endEvent.sequenceNumber).second = newEvent;
+                    } else if (startTime <= startEvent.eventTime && endTime <= endEvent.eventTime) {
+                        eventSet.erase(startEvent);
+                        event_t newEvent = event_t(batteryID, EventID::SET_CURRENT_BEGIN, startEvent.current_mA, endTime, startEvent.sequenceNumber);
+                        eventSet.insert(newEvent);
+                        eventMap.at(startEvent.sequenceNumber).first = newEvent;
+                    }
+                }
+            }
+
+            event_t beginEvent = event_t(batteryID, EventID::SET_CURRENT_BEGIN, target_current_mA, startTime, sequenceNumber);
+            event_t endEvent   = event_t(batteryID, EventID::SET_CURRENT_END, target_current_mA, endTime, sequenceNumber);
+            eventSet.insert(beginEvent);
+            eventSet.insert(endEvent);
+            eventMap.insert({sequenceNumber, std::make_pair(beginEvent, endEvent)});
+        }
+
+        double currentAt(timepoint_t time) const {
+            double current_mA = 0;
+            for (const event_t &event : eventSet) {
+                if (event.eventTime > time)
+                    break;
+                if (event.eventID == EventID::SET_CURRENT_BEGIN)
+                    current_mA += event.current_mA;
+                else if (event.eventID == EventID::SET_CURRENT_END)
+                    current_mA -= event.current_mA;
+            }
+            return current_mA;
+        }
+
+        void cancel(uint64_t sequenceNumber) {
+            auto iter = eventMap.find(sequenceNumber);
+            if (iter == eventMap.end())
+                return;
+            eventSet.erase(iter->second.first);
+            eventSet.erase(iter->second.second);
+            eventMap.erase(iter);
+        }
+};
+
+bool checkCase(const std::string &name, const ReservationMap &reservations, timepoint_t start, const std::vector<double> &expected) {
+    bool passed = true;
+    for (unsigned int second = 0; second < expected.size(); second++) {
+        double current_mA = reservations.currentAt(start + std::chrono::seconds(second) + 500ms);
+        if (current_mA != expected[second])
+            passed = false;
+    }
+    std::cout << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool runMergeCases() {
+    bool passed = true;
+    timepoint_t t0 = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now());
+
+    battery_id_t bat  = internBatteryName("bat");
+    battery_id_t bat2 = internBatteryName("bat2");
+
+    ReservationMap case1;
+    case1.insert(bat, 1, 200, t0 + 1s, t0 + 3s);
+    case1.insert(bat, 2, 300, t0 + 2s, t0 + 4s);
+    passed &= checkCase("Case 1", case1, t0, {0, 200, 300, 300, 0});
+
+    ReservationMap case2;
+    case2.insert(bat, 1, 200, t0 + 1s, t0 + 4s);
+    case2.insert(bat, 2, 300, t0 + 2s, t0 + 3s);
+    passed &= checkCase("Case 2", case2, t0, {0, 200, 300, 200, 0});
+
+    ReservationMap case3;
+    case3.insert(bat, 1, 200, t0 + 2s, t0 + 4s);
+    case3.insert(bat, 2, 300, t0 + 1s, t0 + 3s);
+    passed &= checkCase("Case 3", case3, t0, {0, 300, 300, 200, 0});
+
+    ReservationMap case4;
+    case4.insert(bat, 1, 200, t0 + 1s, t0 + 2s);
+    case4.insert(bat, 2, 300, t0 + 2s, t0 + 3s);
+    passed &= checkCase("Case 4", case4, t0, {0, 200, 300, 0, 0});
+
+    // different requesters add up, cancelling removes what is left of a request
+    ReservationMap case5;
+    case5.insert(bat,  1, 100, t0, t0 + 5s);
+    case5.insert(bat2, 2, 200, t0 + 2s, t0 + 4s);
+    case5.consume(t0 + 2s);
+    case5.cancel(1);
+    passed &= checkCase("Case 5", case5, t0 + 2s, {200, 200, 0});
+
+    return passed;
+}
+
+double elapsed(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int numEvents     = argc > 1 ? atoi(argv[1]) : 20000;
+    int numRequesters = argc > 2 ? atoi(argv[2]) : 100;
+
+    if (!runMergeCases())
+        return 1;
+
+    struct Request {
+        battery_id_t requester;
+        double current_mA;
+        timepoint_t startTime;
+        timepoint_t endTime;
+    };
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> offset(0, 24 * 3600);
+    std::uniform_int_distribution<int> duration(60, 3600);
+    std::uniform_int_distribution<int> requester(0, numRequesters - 1);
+
+    timepoint_t t0 = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now());
+    std::vector<Request> requests;
+    for (int i = 0; i < numEvents; i++) {
+        timepoint_t start = t0 + std::chrono::seconds(offset(generator));
+        requests.push_back({internBatteryName("requester" + std::to_string(requester(generator))), 100, start, start + std::chrono::seconds(duration(generator))});
+    }
+
+    LegacyEventQueue legacy;
+    ReservationMap reservations;
+    double legacyTime[3], mapTime[3];
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < numEvents; i++)
+        legacy.insert(requests[i].requester, requests[i].current_mA, requests[i].startTime, requests[i].endTime, i + 1);
+    legacyTime[0] = elapsed(start);
+
+    start = Clock::now();
+    for (int i = 0; i < numEvents; i++)
+        reservations.insert(requests[i].requester, i + 1, requests[i].current_mA, requests[i].startTime, requests[i].endTime);
+    mapTime[0] = elapsed(start);
+
+    volatile double sink = 0;
+    int numQueries = 1000;
+
+    start = Clock::now();
+    for (int i = 0; i < numQueries; i++)
+        sink = sink + legacy.currentAt(t0 + std::chrono::seconds(offset(generator)));
+    legacyTime[1] = elapsed(start);
+
+    start = Clock::now();
+    for (int i = 0; i < numQueries; i++)
+        sink = sink + reservations.currentAt(t0 + std::chrono::seconds(offset(generator)));
+    mapTime[1] = elapsed(start);
+
+    start = Clock::now();
+    for (int i = 0; i < numEvents; i += 2)
+        legacy.cancel(i + 1);
+    legacyTime[2] = elapsed(start);
+
+    start = Clock::now();
+    for (int i = 0; i < numEvents; i += 2)
+        reservations.cancel(i + 1);
+    mapTime[2] = elapsed(start);
+
+    std::cout << numEvents << " reservations from " << numRequesters << " requesters (" << reservations.size() << " left after cancel)" << std::endl;
+    std::cout << "insert (ms):            legacy = " << legacyTime[0] << ", reservation map = " << mapTime[0] << std::endl;
+    std::cout << numQueries << " current queries (ms): legacy = " << legacyTime[1] << ", reservation map = " << mapTime[1] << std::endl;
+    std::cout << "cancel (ms):            legacy = " << legacyTime[2] << ", reservation map = " << mapTime[2] << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <random>
+#include <fstream>
+#include <algorithm>
+#include "PseudoBattery.hpp"
+
+/**
+ * Scheduler benchmark
+ *
+ * Schedules numEvents set_current events spread across numBatteries pseudo
+ * batteries and measures dispatch jitter (time between when an event was due
+ * and when set_current() was actually called) for either the timer wheel
+ * scheduler or the original thread-per-battery design.
+ *
+ * usage: ./scheduler [wheel|threaded] [numBatteries] [numEvents]
+ */
+
+using namespace std::chrono_literals;
+
+class TimedBattery : public PseudoBattery {
+    public:
+        std::vector<timepoint_t> transitions;
+        std::vector<std::chrono::microseconds> lateness;
+
+    public:
+        TimedBattery(const std::string &batteryName) : PseudoBattery(batteryName, std::chrono::seconds(100)) {}
+
+    protected:
+        bool set_current(double current_mA) override {
+            auto now = std::chrono::system_clock::now();
+            size_t index = this->lateness.size();
+            if (index < this->transitions.size())
+                this->lateness.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - this->transitions[index]));
+            this->status.current_mA = current_mA;
+            return true;
+        }
+};
+
+int countThreads() {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("Threads:", 0) == 0)
+            return std::stoi(line.substr(8));
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    std::string mode  = argc > 1 ? argv[1] : "wheel";
+    int numBatteries  = argc > 2 ? atoi(argv[2]) : 10000;
+    int numEvents     = argc > 3 ? atoi(argv[3]) : 100000;
+    int eventsPerBattery = std::max(1, numEvents / numBatteries);
+
+    if (mode == "threaded")
+        setEventScheduler(std::make_shared<ThreadedEventScheduler>());
+    else
+        setEventScheduler(std::make_shared<TimerWheelScheduler>(4));
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 7500;
+    status.max_capacity_mAh = 7500;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+    status.time = convertToMilliseconds(getTimeNow());
+
+    std::vector<std::shared_ptr<TimedBattery>> batteries;
+    for (int i = 0; i < numBatteries; i++) {
+        batteries.push_back(std::make_shared<TimedBattery>("bat" + std::to_string(i)));
+        batteries.back()->setBatteryStatus(status);
+    }
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> offset(0, 999);
+
+    auto period = 1000ms;
+    timepoint_t startTime = getTimeNow() + 2s;
+
+    // every event is submitted under its own requester name so that
+    // back-to-back events are not merged and each one toggles the current
+    for (auto &battery : batteries) {
+        timepoint_t begin = startTime + std::chrono::milliseconds(offset(generator));
+        for (int k = 0; k < eventsPerBattery; k++) {
+            timepoint_t start = begin + k * period;
+            timepoint_t end   = start + period / 2;
+            battery->transitions.push_back(start);
+            battery->transitions.push_back(end);
+            battery->schedule_set_current(100, start, end, internBatteryName(battery->getBatteryName() + "_" + std::to_string(k)), getSequenceNumber());
+        }
+    }
+
+    PRINT() << "scheduled " << numBatteries * eventsPerBattery << " events on " << numBatteries
+            << " batteries (" << mode << "), threads = " << countThreads() << std::endl;
+
+    std::this_thread::sleep_until(startTime + eventsPerBattery * period + 2s);
+
+    std::vector<int64_t> samples;
+    for (auto &battery : batteries) {
+        battery->quit();
+        for (auto &late : battery->lateness)
+            samples.push_back(late.count());
+    }
+
+    if (samples.empty()) {
+        WARNING() << "no events were dispatched" << std::endl;
+        return 1;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double mean = 0;
+    for (int64_t sample : samples)
+        mean += sample;
+    mean /= samples.size();
+
+    PRINT() << "dispatched " << samples.size() << "/" << 2 * numBatteries * eventsPerBattery << " transitions" << std::endl;
+    PRINT() << "jitter (us): mean = " << mean
+            << ", p50 = " << samples[samples.size() / 2]
+            << ", p99 = " << samples[samples.size() * 99 / 100]
+            << ", max = " << samples.back() << std::endl;
+
+    return 0;
+}
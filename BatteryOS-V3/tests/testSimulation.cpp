@@ -0,0 +1,213 @@
+#include <random>
+#include "PseudoBattery.hpp"
+
+/**
+ * Simulation test
+ *
+ * Replays a day of random charge/discharge schedules on numBatteries
+ * pseudo batteries with the SimulationScheduler on a ManualClock and
+ * reports how long it took. Every hour the status of a sample of the
+ * batteries is compared with a replay of the old charging thread (one
+ * capacity step per second with the same current changes). Beforehand
+ * a single pseudo battery is run in real time and compared with the
+ * same replay, to show the system clock and the manual clock produce
+ * the same trajectory.
+ *
+ * usage: ./simulation [numBatteries] [hours] [samples]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * copy of the PseudoBattery::runChargingThread loop, stepped one interval at a time
+ */
+class ChargingThreadReplay {
+    public:
+        BatteryStatus status;
+        timestamp_t nextStep;
+
+    public:
+        ChargingThreadReplay(const BatteryStatus &status) : status(status) {}
+
+        void stepUntil(timestamp_t time) {
+            while (this->status.current_mA != 0 && this->nextStep <= time) {
+                double capacity = this->status.capacity_mAh;
+                capacity += (-this->status.current_mA / 20);
+
+                if (this->status.current_mA < 0) {
+                    if (capacity >= this->status.max_capacity_mAh) {
+                        capacity = this->status.max_capacity_mAh;
+                        this->status.current_mA = 0;
+                    }
+                } else if (this->status.current_mA > 0) {
+                    if (capacity <= 0) {
+                        capacity = 0;
+                        this->status.current_mA = 0;
+                    }
+                }
+
+                this->status.capacity_mAh = capacity;
+                this->nextStep += PseudoBattery::CHARGE_INTERVAL;
+            }
+        }
+
+        void setCurrent(double current_mA, timestamp_t time) {
+            this->stepUntil(time);
+            bool idle = this->status.current_mA == 0;
+            this->status.current_mA = current_mA;
+            if (idle) {
+                this->nextStep = time;
+                this->stepUntil(time);
+            }
+        }
+};
+
+struct Request {
+    double current_mA;
+    timestamp_t startTime;
+    timestamp_t endTime;
+};
+
+/**
+ * state of the replay at time (requests must not overlap)
+ */
+BatteryStatus replay(const BatteryStatus &initial, const std::vector<Request> &requests, timestamp_t time) {
+    ChargingThreadReplay thread(initial);
+    for (const Request &request : requests) {
+        if (request.startTime > time)
+            break;
+        thread.setCurrent(request.current_mA, request.startTime);
+        if (request.endTime > time)
+            break;
+        thread.setCurrent(0, request.endTime);
+    }
+    thread.stepUntil(time);
+    return thread.status;
+}
+
+BatteryStatus randomStatus(std::mt19937 &generator, double maxCurrent_mA) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.max_capacity_mAh = 10000;
+    status.capacity_mAh = std::uniform_real_distribution<double>(1000, 9000)(generator);
+    status.max_charging_current_mA = maxCurrent_mA;
+    status.max_discharging_current_mA = maxCurrent_mA;
+    status.time = convertToMilliseconds(getTimeNow());
+    return status;
+}
+
+std::vector<Request> randomRequests(std::mt19937 &generator, timestamp_t start, timestamp_t end, double maxCurrent_mA) {
+    std::uniform_int_distribution<int> gap(60, 3600);
+    std::uniform_int_distribution<int> duration(600, 7200);
+    std::uniform_real_distribution<double> current(-maxCurrent_mA, maxCurrent_mA);
+
+    // gaps of at least a minute keep one request from ending at the same time the next one starts
+    std::vector<Request> requests;
+    timestamp_t time = start + std::chrono::seconds(gap(generator));
+    while (time + 2h < end) {
+        timestamp_t requestEnd = time + std::chrono::seconds(duration(generator));
+        requests.push_back({std::round(current(generator)), time, requestEnd});
+        time = requestEnd + std::chrono::seconds(gap(generator));
+    }
+    return requests;
+}
+
+bool matches(const BatteryStatus &status, const BatteryStatus &expected, double tolerance_mAh) {
+    return std::fabs(status.capacity_mAh - expected.capacity_mAh) <= tolerance_mAh;
+}
+
+bool runRealTime(std::mt19937 &generator) {
+    BatteryStatus initial = randomStatus(generator, 3000);
+    std::shared_ptr<Battery> battery = std::make_shared<PseudoBattery>("realtime", 0ms);
+    battery->setBatteryStatus(initial);
+
+    timestamp_t start = getTimeNow();
+    std::vector<Request> requests = {{2000, start + 300ms, start + 2300ms}, {-1000, start + 2600ms, start + 3600ms}};
+    for (const Request &request : requests)
+        battery->schedule_set_current(request.current_mA, request.startTime, request.endTime);
+
+    // the scheduler dispatches a few milliseconds late in real time, so a
+    // sample may be one step behind the replay
+    int mismatches = 0;
+    while (getTimeNow() < start + 4s) {
+        std::this_thread::sleep_for(200ms);
+        BatteryStatus status = battery->getFreshStatus();
+        if (!matches(status, replay(initial, requests, convertToTimestamp(status.time)), 2000.0 / 20 + 1e-6))
+            mismatches++;
+    }
+    battery->quit();
+
+    PRINT() << "real time: " << (mismatches == 0 ? "passed" : "FAILED") << std::endl;
+    return mismatches == 0;
+}
+
+int main(int argc, char** argv) {
+    int numBatteries = argc > 1 ? atoi(argv[1]) : 10000;
+    int hours        = argc > 2 ? atoi(argv[2]) : 24;
+    int samples      = argc > 3 ? atoi(argv[3]) : 100;
+
+    std::mt19937 generator(42);
+    bool passed = runRealTime(generator);
+
+    timestamp_t start = getTimeNow();
+    timestamp_t end   = start + std::chrono::hours(hours);
+
+    std::shared_ptr<ManualClock> clock = std::make_shared<ManualClock>(start);
+    std::shared_ptr<SimulationScheduler> scheduler = std::make_shared<SimulationScheduler>(clock);
+    setClock(clock);
+    setEventScheduler(scheduler);
+
+    {
+        std::vector<BatteryStatus> initial;
+        std::vector<std::vector<Request>> requests;
+        std::vector<std::shared_ptr<Battery>> batteries;
+
+        Clock::time_point begin = Clock::now();
+        size_t numRequests = 0;
+        for (int i = 0; i < numBatteries; i++) {
+            // maxStaleness of 0 so every read refreshes the state of charge
+            std::shared_ptr<Battery> battery = std::make_shared<PseudoBattery>("sim" + std::to_string(i), 0ms);
+            initial.push_back(randomStatus(generator, 200));
+            battery->setBatteryStatus(initial.back());
+
+            requests.push_back(randomRequests(generator, start, end, 200));
+            for (const Request &request : requests.back())
+                battery->schedule_set_current(request.current_mA, request.startTime, request.endTime);
+            numRequests += requests.back().size();
+            batteries.push_back(battery);
+        }
+        double setupTime = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        int mismatches = 0;
+        uint64_t dispatched = 0;
+        double runTime = 0;
+        int step = std::max(1, numBatteries / samples);
+
+        for (int hour = 1; hour <= hours; hour++) {
+            begin = Clock::now();
+            dispatched += scheduler->runUntil(start + std::chrono::hours(hour));
+            runTime += std::chrono::duration<double>(Clock::now() - begin).count();
+
+            for (int i = 0; i < numBatteries; i += step) {
+                BatteryStatus status = batteries[i]->getFreshStatus();
+                BatteryStatus expected = replay(initial[i], requests[i], convertToTimestamp(status.time));
+                if (!matches(status, expected, 1e-6) || status.current_mA != expected.current_mA)
+                    mismatches++;
+            }
+        }
+
+        PRINT() << numBatteries << " batteries, " << numRequests << " requests over " << hours << " simulated hours" << std::endl;
+        PRINT() << "setup: " << setupTime << "s, simulation: " << runTime << "s (" << dispatched << " dispatches)" << std::endl;
+        PRINT() << "simulated time: " << (mismatches == 0 ? "passed" : "FAILED") << " (" << mismatches << " of "
+                << hours * ((numBatteries + step - 1) / step) << " samples differ from the charging thread replay)" << std::endl;
+        passed &= mismatches == 0;
+
+        for (std::shared_ptr<Battery> &battery : batteries)
+            battery->quit();
+    }
+
+    setClock(std::make_shared<SystemClock>());
+    return passed ? 0 : 1;
+}
@@ -139,6 +139,17 @@ int main() {
     LOG() << "bat7 status" << std::endl;
     PRINT() << bat7.getStatus();
 
+    LOG() << "status of every battery (single batch request)" << std::endl;
+    for (const auto& iter : bat6.getStatusBatch())
+        PRINT() << iter.first << ": " << iter.second;
+
+    LOG() << "bat2 status history of the last minute" << std::endl;
+    std::vector<BatteryStatus> history = bat6.getStatusHistory(getTime() - 1min, getTime(), 0ms, "bat2");
+    if (history.empty())
+        ERROR() << "bat2 has no status history" << std::endl;
+    for (const BatteryStatus& status : history)
+        PRINT() << status;
+
     //std::this_thread::sleep_for(20s);
 
     admin.shutdown();
@@ -0,0 +1,123 @@
+#include "PhysicalBattery.hpp"
+#include "AggregateBattery.hpp"
+
+/**
+ * Status history test
+ *
+ * Publishes statuses to physical batteries and checks that:
+ *  - every published status lands in the history of the battery with its
+ *    time and its fields rounded to whole mV, mA and mAh
+ *  - a range query returns the samples between its times oldest first
+ *  - republishing the same status (a fresh read that did not refresh)
+ *    does not add a sample, and a status older than the newest sample is
+ *    stored at the time of the newest one
+ *  - the history keeps only the newest STATUS_HISTORY_SIZE samples
+ *  - downsampled queries average the fields over aligned buckets and keep
+ *    the highest temperature and every protection flag of a bucket
+ *  - an aggregate battery records the statuses pushed by its parents
+ * The cost of recording a status and of querying the last minute of the
+ * history are printed.
+ *
+ * usage: ./status_history
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+BatteryStatus makeStatus(uint64_t time, double current_mA) {
+    BatteryStatus status;
+    status.voltage_mV = 3700.4;
+    status.current_mA = current_mA;
+    status.capacity_mAh = 5000.6;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 1000;
+    status.max_discharging_current_mA = 1000;
+    status.max_temperature_dK = 2981;
+    status.time = time;
+    return status;
+}
+
+timepoint_t at(uint64_t time_ms) {
+    return convertToTimestamp(time_ms);
+}
+
+int main() {
+    bool passed = true;
+    uint64_t start = convertToMilliseconds(getTimeNow()) - 3600000;
+
+    PRINT() << "sample: " << sizeof(StatusSample) << " bytes (BatteryStatus: " << sizeof(BatteryStatus) << " bytes)" << std::endl;
+
+    std::shared_ptr<PhysicalBattery> battery = std::make_shared<PhysicalBattery>("bat0", 100s);
+    for (int i = 0; i < 100; i++)
+        battery->setBatteryStatus(makeStatus(start + 1000 * i, i));
+
+    std::vector<BatteryStatus> history = battery->getStatusHistory(at(start + 10000), at(start + 20000));
+    bool range = history.size() == 11;
+    for (size_t i = 0; range && i < history.size(); i++)
+        range = history[i].time == start + 10000 + 1000 * i && history[i].current_mA == 10 + i &&
+                history[i].voltage_mV == 3700 && history[i].capacity_mAh == 5001 && history[i].max_temperature_dK == 2981;
+    passed &= check("range", range);
+    passed &= check("empty range", battery->getStatusHistory(at(start - 10000), at(start - 1)).empty() &&
+                                   battery->getStatusHistory(at(start + 20000), at(start + 10000)).empty());
+
+    battery->getFreshStatus();
+    battery->setBatteryStatus(makeStatus(start + 99000, 99));
+    size_t size = battery->getStatusHistory(at(0), at(UINT64_MAX / 2)).size();
+    battery->setBatteryStatus(makeStatus(start + 50000, 7)); // older than the newest sample
+    history = battery->getStatusHistory(at(start + 99000), at(start + 99000));
+    passed &= check("duplicates", size == 100);
+    passed &= check("time going back", history.size() == 2 && history[1].current_mA == 7);
+
+    // every status of a full day at one per second
+    Clock::time_point begin = Clock::now();
+    int numStatuses = 86400;
+    for (int i = 0; i < numStatuses; i++)
+        battery->setBatteryStatus(makeStatus(start + 100000 + 1000 * i, i % 1000));
+    double recordTime = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / numStatuses;
+
+    uint64_t last = start + 100000 + 1000 * (numStatuses - 1);
+    history = battery->getStatusHistory(at(0), at(UINT64_MAX / 2));
+    passed &= check("ring buffer", history.size() == STATUS_HISTORY_SIZE && history.back().time == last &&
+                                   history.front().time == last - 1000 * (STATUS_HISTORY_SIZE - 1));
+
+    const int queries = 10000;
+    begin = Clock::now();
+    for (int i = 0; i < queries; i++)
+        history = battery->getStatusHistory(at(last - 59000), at(last));
+    double queryTime = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / queries;
+    passed &= check("last minute", history.size() == 60);
+    PRINT() << "record: " << recordTime << "ns per status, last minute query: " << queryTime << "ns" << std::endl;
+
+    // 10s buckets of one status per second, a hot sample and a protection flag in the second bucket
+    std::shared_ptr<PhysicalBattery> downsampled = std::make_shared<PhysicalBattery>("bat1", 100s);
+    uint64_t base = (start / 10000 + 1) * 10000;
+    for (int i = 0; i < 30; i++) {
+        BatteryStatus status = makeStatus(base + 1000 * i, i);
+        if (i == 15) {
+            status.max_temperature_dK = 3200;
+            status.protection_flags   = PROTECTION_CHARGE_OVERTEMP;
+        }
+        downsampled->setBatteryStatus(status);
+    }
+    history = downsampled->getStatusHistory(at(base), at(base + 29000), 10s);
+    passed &= check("downsample", history.size() == 3 && history[0].time == base && history[1].time == base + 10000 &&
+                                  history[0].current_mA == 4.5 && history[1].current_mA == 14.5 && history[2].current_mA == 24.5 &&
+                                  history[0].max_temperature_dK == 2981 && history[1].max_temperature_dK == 3200 &&
+                                  history[0].protection_flags == 0 && history[1].protection_flags == PROTECTION_CHARGE_OVERTEMP);
+
+    std::shared_ptr<Battery> aggregate = std::make_shared<AggregateBattery>("bat2", std::vector<std::shared_ptr<Battery>>({battery, downsampled}));
+    size = aggregate->getStatusHistory(at(0), at(UINT64_MAX / 2)).size();
+    for (int i = 0; i < 5; i++) {
+        std::this_thread::sleep_for(2ms);
+        downsampled->setBatteryStatus(makeStatus(convertToMilliseconds(getTimeNow()), 100 + i));
+    }
+    history = aggregate->getStatusHistory(at(0), at(UINT64_MAX / 2));
+    passed &= check("aggregate", history.size() >= size + 5 && history.back().current_mA == battery->getStatus().current_mA + 104);
+
+    return passed ? 0 : 1;
+}
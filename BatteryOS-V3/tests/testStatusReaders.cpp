@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "PhysicalBattery.hpp"
+
+/**
+ * Status reader contention benchmark
+ *
+ * A physical battery whose driver takes refreshTime milliseconds to
+ * refresh is read by numReaders threads (one read per millisecond
+ * each). Each run reports the status
+ * read latency through getFreshStatus() (which waits for the driver
+ * like getStatus() used to) and through getStatus() (which reads the
+ * last published status), first with the battery refreshing in the
+ * background (ACTIVE) and then with readers refreshing it (LAZY).
+ *
+ * usage: ./status_readers [numReaders] [seconds] [refreshTime]
+ */
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+class SlowBattery : public PhysicalBattery {
+    private:
+        std::chrono::milliseconds refreshTime;
+
+    public:
+        SlowBattery(const std::string &batteryName, std::chrono::milliseconds maxStaleness, std::chrono::milliseconds refreshTime)
+            : PhysicalBattery(batteryName, maxStaleness), refreshTime(refreshTime) {}
+
+    protected:
+        BatteryStatus refresh() override {
+            std::this_thread::sleep_for(this->refreshTime);
+            BatteryStatus status = this->status;
+            status.time = convertToMilliseconds(getTimeNow());
+            return status;
+        }
+};
+
+static void run(const std::string &label, int numReaders, std::chrono::milliseconds duration, std::function<BatteryStatus()> read) {
+    std::vector<std::vector<int64_t>> latencies(numReaders);
+    std::vector<std::thread> readers;
+
+    Clock::time_point end = Clock::now() + duration;
+    for (int i = 0; i < numReaders; i++) {
+        readers.push_back(std::thread([&, i] {
+            while (Clock::now() < end) {
+                Clock::time_point begin = Clock::now();
+                read();
+                latencies[i].push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count());
+                std::this_thread::sleep_for(1ms);
+            }
+        }));
+    }
+    for (std::thread &reader : readers)
+        reader.join();
+
+    std::vector<int64_t> samples;
+    for (const auto &latency : latencies)
+        samples.insert(samples.end(), latency.begin(), latency.end());
+    std::sort(samples.begin(), samples.end());
+
+    size_t blocked = samples.end() - std::upper_bound(samples.begin(), samples.end(), 10000);
+
+    PRINT() << label << ": " << samples.size() << " reads, " << blocked << " took over 10ms, latency (us): p50 = " << samples[samples.size() / 2]
+            << ", p99 = " << samples[samples.size() * 99 / 100]
+            << ", max = " << samples.back() << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int numReaders = argc > 1 ? atoi(argv[1]) : 16;
+    std::chrono::milliseconds duration(argc > 2 ? 1000 * atoi(argv[2]) : 2000);
+    std::chrono::milliseconds refreshTime(argc > 3 ? atoi(argv[3]) : 200);
+
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 7500;
+    status.max_capacity_mAh = 7500;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+    status.time = convertToMilliseconds(getTimeNow());
+
+    {
+        // refreshes every 250ms, so the driver holds the battery lock most of the time
+        std::shared_ptr<Battery> battery = std::make_shared<SlowBattery>("active", 250ms, refreshTime);
+        battery->setBatteryStatus(status);
+        battery->setRefreshMode(RefreshMode::ACTIVE);
+
+        run("ACTIVE getFreshStatus", numReaders, duration, [&] { return battery->getFreshStatus(); });
+        run("ACTIVE getStatus     ", numReaders, duration, [&] { return battery->getStatus(); });
+        battery->quit();
+    }
+
+    {
+        // every read after 100ms finds the status stale
+        std::shared_ptr<Battery> battery = std::make_shared<SlowBattery>("lazy", 100ms, refreshTime);
+        battery->setBatteryStatus(status);
+
+        run("LAZY getFreshStatus  ", numReaders, duration, [&] { return battery->getFreshStatus(); });
+        run("LAZY getStatus       ", numReaders, duration, [&] { return battery->getStatus(); });
+        battery->quit();
+    }
+
+    return 0;
+}
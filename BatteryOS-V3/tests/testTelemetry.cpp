@@ -0,0 +1,147 @@
+#include "PhysicalBattery.hpp"
+#include "AggregateBattery.hpp"
+#include "PartitionBattery.hpp"
+#include "PartitionManager.hpp"
+#include "protobuf/battery.pb.h"
+
+/**
+ * Telemetry test
+ *
+ * Checks that:
+ *  - an extended telemetry record survives encode() and decode() and that
+ *    truncated bytes are rejected
+ *  - the highest temperature and protection flags travel in the status
+ *    (and in its protobuf message) and the full record only when attached
+ *  - an aggregate battery reports the highest temperature of its parents
+ *    and every protection flag raised by one of them, also after a parent
+ *    cools down or clears its flags
+ *  - the partitions of a battery report the temperature and protection
+ *    flags of the battery they are carved from
+ *
+ * usage: ./telemetry
+ */
+
+using namespace std::chrono_literals;
+
+BatteryStatus makeStatus(uint16_t max_temperature_dK, uint16_t protection_flags) {
+    BatteryStatus status;
+    status.voltage_mV = 5;
+    status.current_mA = 0;
+    status.capacity_mAh = 5000;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 1000;
+    status.max_discharging_current_mA = 1000;
+    status.max_temperature_dK = max_temperature_dK;
+    status.protection_flags = protection_flags;
+    status.time = convertToMilliseconds(getTimeNow());
+    return status;
+}
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+bool runEncoding() {
+    BatteryTelemetry telemetry;
+    telemetry.time             = convertToMilliseconds(getTimeNow());
+    telemetry.cellVoltagesTime = telemetry.time - 8000;
+    telemetry.cycles           = 311;
+    telemetry.stateOfCharge    = 87;
+    telemetry.fetStatus        = 0x03;
+    telemetry.protectionFlags  = PROTECTION_DISCHARGE_OVERTEMP;
+    telemetry.balanceFlags     = 0x00010002;
+    telemetry.cellVoltages     = {3310, 3308, 3312, 3305, 3309, 3311, 3307, 3306};
+    telemetry.temperatures     = {2981, 3001, 3163};
+
+    std::string bytes = telemetry.encode();
+    BatteryTelemetry decoded;
+    bool passed = check("round trip", BatteryTelemetry::decode(bytes, decoded) && decoded == telemetry &&
+                                      decoded.maxTemperature() == 3163);
+    passed &= check("truncated record", !BatteryTelemetry::decode(bytes.substr(0, bytes.size() - 1), decoded) &&
+                                        !BatteryTelemetry::decode(bytes.substr(0, 10), decoded));
+
+    BatteryStatus status = makeStatus(telemetry.maxTemperature(), telemetry.protectionFlags);
+    bosproto::BatteryStatus message;
+    status.toProto(message);
+    size_t summarySize = message.ByteSizeLong();
+    message.set_telemetry(bytes);
+    size_t fullSize = message.ByteSizeLong();
+
+    PRINT() << "status message: " << summarySize << " bytes, " << fullSize << " bytes with "
+            << telemetry.cellVoltages.size() << " cells and " << telemetry.temperatures.size() << " sensors" << std::endl;
+    passed &= check("status message", BatteryStatus(message) == status);
+    return passed;
+}
+
+bool runAggregate() {
+    std::vector<std::shared_ptr<Battery>> parents;
+    for (int i = 0; i < 3; i++)
+        parents.push_back(std::make_shared<PhysicalBattery>("bat" + std::to_string(i), 100s));
+
+    parents[0]->setBatteryStatus(makeStatus(2981, 0));
+    parents[1]->setBatteryStatus(makeStatus(3131, PROTECTION_CHARGE_OVERTEMP));
+    parents[2]->setBatteryStatus(makeStatus(0, PROTECTION_CELL_UNDERVOLTAGE));
+
+    std::shared_ptr<AggregateBattery> aggregate = std::make_shared<AggregateBattery>("aggregate", parents, 100s);
+
+    BatteryStatus hot = aggregate->getStatus();
+    bool passed = check("aggregate maximum", hot.max_temperature_dK == 3131 &&
+                                             hot.protection_flags == (PROTECTION_CHARGE_OVERTEMP | PROTECTION_CELL_UNDERVOLTAGE));
+
+    parents[1]->setBatteryStatus(makeStatus(2991, 0));
+    BatteryStatus cooled = aggregate->getStatus();
+    passed &= check("aggregate after cooling down", cooled.max_temperature_dK == 2991 &&
+                                                    cooled.protection_flags == PROTECTION_CELL_UNDERVOLTAGE);
+
+    BatteryStatus rescan = aggregate->recomputeStatus();
+    passed &= check("aggregate rescan", rescan.max_temperature_dK == cooled.max_temperature_dK &&
+                                        rescan.protection_flags == cooled.protection_flags);
+
+    aggregate->quit();
+    for (std::shared_ptr<Battery> &parent : parents)
+        parent->quit();
+    return passed;
+}
+
+bool runPartition() {
+    std::shared_ptr<Battery> source = std::make_shared<PhysicalBattery>("source", 100s);
+    source->setBatteryStatus(makeStatus(3031, PROTECTION_CHARGE_UNDERTEMP));
+
+    std::shared_ptr<PartitionBattery> first  = std::make_shared<PartitionBattery>("first", 100s);
+    std::shared_ptr<PartitionBattery> second = std::make_shared<PartitionBattery>("second", 100s);
+    std::vector<std::weak_ptr<VirtualBattery>> children = {first, second};
+    std::vector<Scale> proportions = {Scale(0.5, 0.5), Scale(0.5, 0.5)};
+
+    std::shared_ptr<PartitionManager> manager = std::make_shared<PartitionManager>("manager", proportions, PolicyType::PROPORTIONAL,
+                                                                                   source, children);
+    first->setSourceBattery(manager);
+    second->setSourceBattery(manager);
+
+    BatteryStatus status = first->getStatus();
+    bool passed = check("new partition", status.max_temperature_dK == 3031 && status.protection_flags == PROTECTION_CHARGE_UNDERTEMP);
+
+    // make the manager refresh on the next read instead of once a minute
+    source->setBatteryStatus(makeStatus(3231, PROTECTION_SHORT_CIRCUIT));
+    manager->setMaxStaleness(10ms);
+    manager->setRefreshMode(RefreshMode::LAZY);
+    std::this_thread::sleep_for(20ms);
+    manager->getFreshStatus();
+
+    status = first->getFreshStatus();
+    passed &= check("partition after refresh", status.max_temperature_dK == 3231 && status.protection_flags == PROTECTION_SHORT_CIRCUIT &&
+                                               second->getFreshStatus().max_temperature_dK == 3231);
+
+    first->quit();
+    second->quit();
+    manager->quit();
+    source->quit();
+    return passed;
+}
+
+int main() {
+    bool passed = runEncoding();
+    passed &= runAggregate();
+    passed &= runPartition();
+    return passed ? 0 : 1;
+}
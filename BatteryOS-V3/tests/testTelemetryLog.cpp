@@ -0,0 +1,234 @@
+#include <fstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "PhysicalBattery.hpp"
+
+/**
+ * Telemetry log test
+ *
+ * Writes statuses to telemetry logs and reads them back to check that:
+ *  - every status comes back with its time and its fields rounded to
+ *    whole mV, mA, mAh in segments of the configured size
+ *  - a range scan returns only the samples between its times and decodes
+ *    only the columns it asks for
+ *  - a partial segment is written once its oldest status has waited the
+ *    flush interval
+ *  - batteries created after the process-wide log is set log every new
+ *    status they publish (and not a status they publish again)
+ *  - a torn segment at the end of the log is ignored by readers and cut
+ *    off when the log is opened again, and a segment that fails its
+ *    checksum is skipped
+ *  - a log without its index is read from the segment headers and its
+ *    index is rebuilt when it is opened again
+ * It then logs one sample per second of ten batteries (numSamples in
+ * total, 10 million by default) and prints the cost of recording a status,
+ * the size of a sample on disk, and the time to open the log and to scan
+ * one battery, whole and for one day.
+ *
+ * usage: ./telemetryLogTest [numSamples]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+bool check(const std::string &name, bool passed) {
+    PRINT() << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+off_t fileSize(const std::string &path) {
+    struct stat info;
+    return (stat(path.c_str(), &info) == -1) ? -1 : info.st_size;
+}
+
+BatteryStatus makeStatus(uint64_t time, int i) {
+    BatteryStatus status;
+    status.voltage_mV = 3700.4 + i % 7;
+    status.current_mA = (i % 2 == 0) ? -1000.6 + i : 1000 - i;
+    status.capacity_mAh = 5000 - i / 10.0;
+    status.max_capacity_mAh = 10000;
+    status.max_charging_current_mA = 3600;
+    status.max_discharging_current_mA = 3600;
+    status.max_temperature_dK = 2980 + i % 50;
+    status.protection_flags = (i % 100 == 0) ? PROTECTION_CHARGE_OVERTEMP : 0;
+    status.time = time;
+    return status;
+}
+
+bool sameSample(const BatteryStatus &sample, const BatteryStatus &status) {
+    return sample.time == status.time && sample.voltage_mV == std::round(status.voltage_mV) &&
+           sample.current_mA == std::round(status.current_mA) && sample.capacity_mAh == std::round(status.capacity_mAh) &&
+           sample.max_capacity_mAh == status.max_capacity_mAh && sample.max_charging_current_mA == status.max_charging_current_mA &&
+           sample.max_discharging_current_mA == status.max_discharging_current_mA &&
+           sample.max_temperature_dK == status.max_temperature_dK && sample.protection_flags == status.protection_flags;
+}
+
+int main(int argc, char** argv) {
+    uint64_t numSamples = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    bool passed = true;
+
+    char directoryTemplate[] = "telemetryXXXXXX";
+    if (mkdtemp(directoryTemplate) == NULL)
+        ERROR() << "could not create telemetry log directory" << std::endl;
+    std::string directory = directoryTemplate;
+    std::string path = directory + "/bos.tlog";
+    uint64_t start = convertToMilliseconds(getTimeNow()) - 365ULL * 86400000;
+
+    {
+        TelemetryLog log(path, 100, std::chrono::hours(1));
+        for (int i = 0; i < 1000; i++)
+            for (battery_id_t id = 0; id < 3; id++)
+                log.record(internBatteryName("log" + std::to_string(id)), makeStatus(start + 1000 * i, i + id));
+        log.flush();
+        passed &= check("segments", log.getNumSamples() == 3000 && log.getNumSegments() == 30 && log.getNumDropped() == 0);
+    }
+
+    {
+        TelemetryLogReader reader(path);
+        std::vector<BatteryStatus> statuses = reader.read("log1", 0, UINT64_MAX);
+        bool roundTrip = reader.getBatteryNames() == std::vector<std::string>({"log0", "log1", "log2"}) && statuses.size() == 1000;
+        for (size_t i = 0; roundTrip && i < statuses.size(); i++)
+            roundTrip = sameSample(statuses[i], makeStatus(start + 1000 * i, i + 1));
+        passed &= check("round trip", roundTrip);
+
+        std::vector<TelemetrySegmentHeader> segments = reader.getSegments("log2");
+        passed &= check("segment index", segments.size() == 10 && segments[3].numSamples == 100 &&
+                                         segments[3].minValue[TELEMETRY_TIME] == (int64_t) (start + 300000) &&
+                                         segments[3].maxValue[TELEMETRY_TIME] == (int64_t) (start + 399000) &&
+                                         segments[3].minValue[TELEMETRY_TEMPERATURE] == 2980);
+
+        statuses = reader.read("log0", start + 150000, start + 420000);
+        passed &= check("range", statuses.size() == 271 && statuses.front().time == start + 150000 && statuses.back().time == start + 420000);
+
+        bool columns = true;
+        size_t numVisited = reader.scan("log0", start, start + 999000, [&columns](const TelemetryColumns &samples) {
+            columns &= samples.values[TELEMETRY_TIME].size() == samples.numSamples && samples.values[TELEMETRY_CURRENT].size() == samples.numSamples &&
+                       samples.values[TELEMETRY_VOLTAGE].empty() && samples.values[TELEMETRY_CAPACITY].empty();
+        }, 1 << TELEMETRY_CURRENT);
+        passed &= check("columns", columns && numVisited == 1000);
+    }
+
+    // a partial segment is written after the flush interval without a flush
+    {
+        TelemetryLog log(path, 100, std::chrono::milliseconds(50));
+        for (int i = 0; i < 10; i++)
+            log.record(internBatteryName("log3"), makeStatus(start + 1000 * i, i));
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        passed &= check("flush interval", log.getNumSamples() == 10);
+    }
+
+    // batteries log the statuses they publish
+    {
+        std::shared_ptr<TelemetryLog> log = std::make_shared<TelemetryLog>(path);
+        setTelemetryLog(log);
+        std::shared_ptr<PhysicalBattery> battery = std::make_shared<PhysicalBattery>("bat0", std::chrono::seconds(100));
+        setTelemetryLog(nullptr);
+
+        for (int i = 0; i < 20; i++) {
+            battery->setBatteryStatus(makeStatus(start + 1000 * i, i));
+            battery->setBatteryStatus(makeStatus(start + 1000 * i, i));
+        }
+        log->flush();
+        TelemetryLogReader reader(path);
+        passed &= check("battery", reader.read("bat0", 0, UINT64_MAX).size() == 20);
+    }
+
+    // a torn segment at the end, then a segment that fails its checksum
+    off_t size = fileSize(path);
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::app);
+        output.write("\x54\x53\x45\x47\x12\x34\x56", 7);
+    }
+    {
+        TelemetryLogReader reader(path);
+        bool torn = reader.read("log1", 0, UINT64_MAX).size() == 1000;
+
+        TelemetryLog log(path, 100);
+        torn &= fileSize(path) == size;
+        log.record(internBatteryName("log4"), makeStatus(start, 0));
+        log.flush();
+        passed &= check("torn segment", torn && fileSize(path) > size);
+    }
+    std::string corruptName;
+    {
+        TelemetrySegmentHeader header;
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(8);
+        file.read((char*) &header, sizeof(header));
+        corruptName.resize(header.nameLength);
+        file.read(&corruptName[0], header.nameLength);
+        file.seekp(8 + sizeof(header) + header.size - 1);
+        file.put('\xff');
+    }
+    {
+        TelemetryLogReader reader(path);
+        passed &= check("corrupt segment", reader.read(corruptName, 0, UINT64_MAX).size() == 900 &&
+                                           reader.read("log4", 0, UINT64_MAX).size() == 1);
+    }
+
+    std::string indexPath = path + ".index";
+    off_t indexSize = fileSize(indexPath);
+    unlink(indexPath.c_str());
+    {
+        TelemetryLogReader reader(path);
+        bool index = reader.read("log0", 0, UINT64_MAX).size() + reader.read("log1", 0, UINT64_MAX).size() +
+                     reader.read("log2", 0, UINT64_MAX).size() == 2900 && reader.getSegments("log2").size() == 10;
+        TelemetryLog log(path, 100);
+        passed &= check("index", index && fileSize(indexPath) == indexSize);
+    }
+    unlink(path.c_str());
+    unlink(indexPath.c_str());
+
+    // one sample per second of ten batteries
+    const int numBatteries = 10;
+    uint64_t perBattery = numSamples / numBatteries;
+    double recordTime = 0;
+    {
+        TelemetryLog log(path);
+        std::vector<battery_id_t> ids;
+        for (int i = 0; i < numBatteries; i++)
+            ids.push_back(internBatteryName("scale" + std::to_string(i)));
+
+        Clock::time_point begin = Clock::now();
+        for (uint64_t i = 0; i < perBattery; i++) {
+            for (int j = 0; j < numBatteries; j++)
+                log.record(ids[j], makeStatus(start + 1000 * i, i + j));
+            // keep the writer from falling TELEMETRY_MAX_PENDING behind
+            if (i % 50000 == 49999) {
+                Clock::time_point flushBegin = Clock::now();
+                log.flush();
+                begin += Clock::now() - flushBegin;
+            }
+        }
+        recordTime = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / (perBattery * numBatteries);
+        log.flush();
+        passed &= check("scale", log.getNumSamples() == perBattery * numBatteries && log.getNumDropped() == 0);
+    }
+    PRINT() << "record: " << recordTime << "ns per status, " << (double) fileSize(path) / (perBattery * numBatteries)
+            << " bytes per sample on disk (index: " << fileSize(indexPath) << " bytes)" << std::endl;
+
+    Clock::time_point begin = Clock::now();
+    TelemetryLogReader reader(path);
+    double openTime = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    begin = Clock::now();
+    int64_t sum = 0;
+    size_t numScanned = reader.scan("scale3", 0, UINT64_MAX, [&sum](const TelemetryColumns &samples) {
+        for (size_t i = 0; i < samples.numSamples; i++)
+            sum += samples.values[TELEMETRY_CURRENT][i];
+    }, 1 << TELEMETRY_CURRENT);
+    double scanTime = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    begin = Clock::now();
+    uint64_t dayStart = start + 1000 * (perBattery / 2);
+    size_t numDay = reader.scan("scale3", dayStart, dayStart + 86399000, [](const TelemetryColumns &) {}, TELEMETRY_ALL_COLUMNS);
+    double dayTime = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    passed &= check("scan", numScanned == perBattery && numDay == std::min<uint64_t>(86400, perBattery - perBattery / 2));
+    PRINT() << "open: " << openTime << "ms, scan of " << numScanned << " samples of a battery: " << scanTime
+            << "ms (current sum " << sum << "), scan of a day: " << dayTime << "ms" << std::endl;
+
+    unlink(path.c_str());
+    unlink(indexPath.c_str());
+    rmdir(directory.c_str());
+    return passed ? 0 : 1;
+}